@@ -11,3 +11,8 @@
 # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 # See the License for the specific language governing permissions and
 # limitations under the License.
+
+# _py2tmp.compiler and _py2tmp.ir0_optimization import each other, and that only works when _py2tmp.compiler is
+# imported first. So we always import it here, also when a submodule is imported first (e.g. in the worker processes
+# used for parallel optimization, when they're started with the "spawn" method).
+import _py2tmp.compiler
@@ -13,4 +13,4 @@
 # limitations under the License.
 
 from ._compile import compile
-from ._link import link
+from ._link import link, link_to_files
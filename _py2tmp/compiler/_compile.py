@@ -12,14 +12,15 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 import itertools
-import pickle
-from typing import List, Iterable
+from typing import List, Iterable, Optional
 
 import ast
 
 from _py2tmp.compiler.stages import module_ast_to_ir2, module_to_ir1, module_to_ir0
-from _py2tmp.compiler.output_files import ObjectFileContent, ModuleInfo, merge_object_files
-from _py2tmp.ir0_optimization import optimize_header
+from _py2tmp.compiler.output_files import ObjectFileContent, ModuleInfo, load_object_files, \
+    compute_source_location_by_template_name, compute_source_location_by_toplevel_name
+from _py2tmp.ir0_optimization import optimize_header, ConfigurationKnobs, OptimizationCheckpoints, FrontendResult, \
+    RecordingIdentifierGenerator, LookaheadIdentifierGenerator
 from _py2tmp.ir2_optimization import optimize_module
 
 
@@ -31,16 +32,11 @@ def compile(file_name: str,
     with open(file_name) as file:
         tmppy_source_code = file.read()
 
-    object_file_contents = []
-    for context_module_file_name in context_object_files:
-        with open(context_module_file_name, 'rb') as file:
-            object_file_contents.append(pickle.loads(file.read()))
-
     return compile_source_code(module_name=module_name,
                                file_name=file_name,
                                source_code=tmppy_source_code,
                                include_intermediate_irs_for_debugging=include_intermediate_irs_for_debugging,
-                               context_object_file_content=merge_object_files(object_file_contents),
+                               context_object_file_content=load_object_files(tuple(context_object_files)),
                                coverage_collection_enabled=coverage_collection_enabled)
 
 def compile_source_code(module_name: str,
@@ -58,39 +54,69 @@ def compile_source_code(module_name: str,
         for i in itertools.count():
             yield unique_identifier_prefix + str(i)
 
-    identifier_generator = iter(identifier_generator_fun())
-    module_ir2 = module_ast_to_ir2(source_ast,
-                                   file_name,
-                                   source_code.splitlines(),
-                                   identifier_generator,
-                                   context_object_file_content)
-    if not coverage_collection_enabled:
-        module_ir2 = optimize_module(module_ir2, context_object_file_content)
-    module_ir1 = module_to_ir1(module_ir2, identifier_generator)
-    non_optimized_header = module_to_ir0(module_ir1, identifier_generator)
-    if coverage_collection_enabled:
-        optimized_header = non_optimized_header
+    identifier_generator = LookaheadIdentifierGenerator(identifier_generator_fun())
+
+    # The stages before the IR0 optimization don't depend on the ConfigurationKnobs, so when recompiling the same
+    # source their results can be reused.
+    checkpoints: Optional[OptimizationCheckpoints] = ConfigurationKnobs.optimization_checkpoints
+    frontend_result_key = (module_name,
+                           source_code,
+                           file_name,
+                           coverage_collection_enabled,
+                           tuple(context_object_file_content.modules_by_name.keys()))
+    frontend_result_context = tuple(context_object_file_content.modules_by_name.values())
+    frontend_result = (checkpoints.lookup_frontend_result(frontend_result_key, frontend_result_context)
+                       if checkpoints is not None
+                       else None)
+    if frontend_result is not None:
+        for generated_identifier in frontend_result.generated_identifiers:
+            assert next(identifier_generator) == generated_identifier
+        module_ir2, module_ir1, non_optimized_header = frontend_result.result
     else:
-        optimized_header = optimize_header(header=non_optimized_header,
-                                           identifier_generator=identifier_generator,
-                                           context_object_file_content=context_object_file_content,
-                                           linking_final_header=False)
+        recording_identifier_generator = RecordingIdentifierGenerator(identifier_generator)
+        module_ir2 = module_ast_to_ir2(source_ast,
+                                       file_name,
+                                       source_code.splitlines(),
+                                       recording_identifier_generator,
+                                       context_object_file_content)
+        # This changes the IR1 that's generated (e.g. calls to functions that can't throw don't check for errors), and
+        # with it the branches that are instrumented, so it's still skipped when collecting coverage.
+        if not coverage_collection_enabled:
+            module_ir2 = optimize_module(module_ir2, context_object_file_content)
+        module_ir1 = module_to_ir1(module_ir2, recording_identifier_generator)
+        non_optimized_header = module_to_ir0(module_ir1, recording_identifier_generator)
+        if checkpoints is not None:
+            checkpoints.record_frontend_result(frontend_result_key,
+                                               frontend_result_context,
+                                               FrontendResult(result=(module_ir2, module_ir1, non_optimized_header),
+                                                              generated_identifiers=tuple(recording_identifier_generator.generated_identifiers)))
+    # When collecting coverage, the optimizations preserve the coverage markers, so we get the same coverage as with the
+    # non-optimized code.
+    optimized_header = optimize_header(header=non_optimized_header,
+                                       identifier_generator=identifier_generator,
+                                       context_object_file_content=context_object_file_content,
+                                       linking_final_header=False,
+                                       coverage_collection_enabled=coverage_collection_enabled)
+
+    source_location_by_template_name = compute_source_location_by_template_name(
+        optimized_header,
+        compute_source_location_by_toplevel_name(source_ast, file_name))
+    source_location_by_template_name = tuple(sorted(source_location_by_template_name.items()))
 
     if include_intermediate_irs_for_debugging:
         module_info = ModuleInfo(ir0_header=optimized_header,
                                  ir0_header_before_optimization=non_optimized_header,
                                  ir1_module=module_ir1,
-                                 ir2_module=module_ir2)
+                                 ir2_module=module_ir2,
+                                 source_location_by_template_name=source_location_by_template_name)
     else:
         module_info = ModuleInfo(ir0_header=optimized_header,
-                                 ir2_module=module_ir2)
+                                 ir2_module=module_ir2,
+                                 source_location_by_template_name=source_location_by_template_name)
 
     modules_by_name = {module_name: (module_info
-                                     if module_info.ir2_module is None
-                                     else ModuleInfo(ir2_module=None,
-                                                     ir1_module=module_info.ir1_module,
-                                                     ir0_header_before_optimization=module_info.ir0_header_before_optimization,
-                                                     ir0_header=module_info.ir0_header))
+                                     if not module_info.has_ir2_module
+                                     else module_info.without_ir2_module())
                        for module_name, module_info in context_object_file_content.modules_by_name.items()}
     modules_by_name[module_name] = module_info
 
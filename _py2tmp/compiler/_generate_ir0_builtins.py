@@ -13,13 +13,12 @@
 # limitations under the License.
 import argparse
 import importlib.util as importlib_util
-import pickle
-from typing import List, Optional, Sequence, Tuple
+from typing import List, Optional, Sequence, Tuple, Callable
 
 from _py2tmp.ir0 import ir0
 from _py2tmp.compiler._compile import compile
-from _py2tmp.compiler.output_files import ModuleInfo, ObjectFileContent
-from _py2tmp.ir0 import GlobalLiterals
+from _py2tmp.compiler.output_files import ModuleInfo, ObjectFileContent, serialize_object_file_content
+from _py2tmp.ir0 import GlobalLiterals, select1st_literal
 
 
 def _type_arg_decl(name: str):
@@ -102,13 +101,6 @@ def _type_list_of(*args: ir0.Expr):
                                      args=args,
                                      instantiation_might_trigger_static_asserts=False)
 
-def _get_first_error(*args: ir0.Expr):
-    return _metafunction_call(template_expr=GlobalLiterals.GET_FIRST_ERROR,
-                              args=args,
-                              instantiation_might_trigger_static_asserts=False,
-                              member_name='type',
-                              member_type=ir0.TypeType())
-
 def _is_same(lhs: ir0.Expr, rhs: ir0.Expr):
     return _metafunction_call(template_expr=GlobalLiterals.STD_IS_SAME,
                               args=(lhs, rhs),
@@ -123,53 +115,23 @@ def _int64_list_sum(l: ir0.Expr):
                               member_name='value',
                               member_type=ir0.Int64Type())
 
-def _add_to_bool_set_helper(all_false_list_if_not_present: ir0.Expr, all_false_list: ir0.Expr, s: ir0.Expr, b: ir0.Expr):
-    return _metafunction_call(template_expr=GlobalLiterals.ADD_TO_BOOL_SET_HELPER,
-                              args=(all_false_list_if_not_present,
-                                    all_false_list,
-                                    s,
-                                    b),
-                              instantiation_might_trigger_static_asserts=False,
-                              member_name='type',
-                              member_type=ir0.TypeType())
-
-def _add_to_int64_set_helper(all_false_list_if_not_present: ir0.Expr, all_false_list: ir0.Expr, s: ir0.Expr, n: ir0.Expr):
-    return _metafunction_call(template_expr=GlobalLiterals.ADD_TO_INT64_SET_HELPER,
-                              args=(all_false_list_if_not_present,
-                                    all_false_list,
-                                    s,
-                                    n),
-                              instantiation_might_trigger_static_asserts=False,
-                              member_name='type',
-                              member_type=ir0.TypeType())
-
-def _add_to_type_set_helper(all_false_list_if_not_present: ir0.Expr, all_false_list: ir0.Expr, s: ir0.Expr, t: ir0.Expr):
-    return _metafunction_call(template_expr=GlobalLiterals.ADD_TO_TYPE_SET_HELPER,
-                              args=(all_false_list_if_not_present,
-                                    all_false_list,
-                                    s,
-                                    t),
-                              instantiation_might_trigger_static_asserts=False,
-                              member_name='type',
-                              member_type=ir0.TypeType())
-
-def _fold_bools_to_type(acc: ir0.Expr, f: ir0.Expr, bs: ir0.Expr):
+def _fold_bools_to_type(acc: ir0.Expr, f: ir0.Expr, l: ir0.Expr):
     return _metafunction_call(template_expr=GlobalLiterals.FOLD_BOOLS_TO_TYPE,
-                              args=(acc, f, bs),
+                              args=(acc, f, l),
                               instantiation_might_trigger_static_asserts=True,
                               member_name='type',
                               member_type=ir0.TypeType())
 
-def _fold_int64s_to_type(acc: ir0.Expr, f: ir0.Expr, ns: ir0.Expr):
+def _fold_int64s_to_type(acc: ir0.Expr, f: ir0.Expr, l: ir0.Expr):
     return _metafunction_call(template_expr=GlobalLiterals.FOLD_INT64S_TO_TYPE,
-                              args=(acc, f, ns),
+                              args=(acc, f, l),
                               instantiation_might_trigger_static_asserts=True,
                               member_name='type',
                               member_type=ir0.TypeType())
 
-def _fold_types_to_type(acc: ir0.Expr, f: ir0.Expr, ts: ir0.Expr):
+def _fold_types_to_type(acc: ir0.Expr, f: ir0.Expr, l: ir0.Expr):
     return _metafunction_call(template_expr=GlobalLiterals.FOLD_TYPES_TO_TYPE,
-                              args=(acc, f, ts),
+                              args=(acc, f, l),
                               instantiation_might_trigger_static_asserts=True,
                               member_name='type',
                               member_type=ir0.TypeType())
@@ -188,26 +150,20 @@ def _always_false_from_type(t: ir0.Expr):
                               member_name='value',
                               member_type=ir0.BoolType())
 
-def _is_in_bool_set(b: ir0.Expr, s: ir0.Expr):
-    return _metafunction_call(template_expr=GlobalLiterals.IS_IN_BOOL_LIST,
-                              args=(b, s),
+def _set_index_contains(index_elem_literal: ir0.AtomicTypeLiteral,
+                        index_literal: ir0.AtomicTypeLiteral,
+                        elem: ir0.Expr,
+                        set_elems: ir0.Expr):
+    return _metafunction_call(template_expr=GlobalLiterals.STD_IS_BASE_OF,
+                              args=(ir0.TemplateInstantiation(template_expr=index_elem_literal,
+                                                              args=(elem,),
+                                                              instantiation_might_trigger_static_asserts=False),
+                                    ir0.TemplateInstantiation(template_expr=index_literal,
+                                                              args=(set_elems,),
+                                                              instantiation_might_trigger_static_asserts=False)),
                               instantiation_might_trigger_static_asserts=False,
-                              member_type=ir0.BoolType(),
-                              member_name='value')
-
-def _is_in_int64_set(n: ir0.Expr, s: ir0.Expr):
-    return _metafunction_call(template_expr=GlobalLiterals.IS_IN_INT64_LIST,
-                              args=(n, s),
-                              instantiation_might_trigger_static_asserts=False,
-                              member_type=ir0.BoolType(),
-                              member_name='value')
-
-def _is_in_type_set(t: ir0.Expr, s: ir0.Expr):
-    return _metafunction_call(template_expr=GlobalLiterals.IS_IN_TYPE_LIST,
-                              args=(t, s),
-                              instantiation_might_trigger_static_asserts=False,
-                              member_type=ir0.BoolType(),
-                              member_name='value')
+                              member_name='value',
+                              member_type=ir0.BoolType())
 
 def _local_bool(cpp_type: str):
     return ir0.AtomicTypeLiteral.for_local(cpp_type, ir0.BoolType(), is_variadic=False)
@@ -327,6 +283,65 @@ def _define_template_with_single_specialization(name: str,
                          result_element_name='type',
                          has_error=(error_expr is not None))
 
+def _list_first_half(l: ir0.Expr):
+    return _metafunction_call(template_expr=GlobalLiterals.LIST_FIRST_HALF,
+                              args=(l,),
+                              instantiation_might_trigger_static_asserts=False,
+                              member_name='type',
+                              member_type=ir0.TypeType())
+
+def _list_second_half(l: ir0.Expr):
+    return _metafunction_call(template_expr=GlobalLiterals.LIST_SECOND_HALF,
+                              args=(l,),
+                              instantiation_might_trigger_static_asserts=False,
+                              member_name='type',
+                              member_type=ir0.TypeType())
+
+# The builtins that recurse on a list split it in halves (see ListFirstHalf in tmppy.h), so that the template
+# instantiation depth is O(log(n)) instead of O(n). These templates are defined with separate specializations for lists
+# with 1 element and with 2 or more elements, so that each recursive instantiation is on a shorter list.
+def _define_fold_template(name: str,
+                          elem_arg_type: ir0.TemplateArgType,
+                          elem_arg_decl: Callable[[str], ir0.TemplateArgDecl],
+                          variadic_elem_arg_decl: Callable[[str], ir0.TemplateArgDecl],
+                          local_elem: Callable[[str], ir0.Expr],
+                          local_variadic_elem: Callable[[str], ir0.Expr],
+                          list_of: Callable[..., ir0.Expr],
+                          fold: Callable[[ir0.Expr, ir0.Expr, ir0.Expr], ir0.Expr],
+                          elem_name: str):
+    functor_type = ir0.TemplateType((_type_arg_type(), elem_arg_type))
+    functor = ir0.AtomicTypeLiteral.for_local('F', functor_type, is_variadic=False)
+    acc = _local_type('Acc')
+    elem = local_elem(elem_name)
+    long_list = list_of(local_elem(elem_name + '0'),
+                        local_elem(elem_name + '1'),
+                        ir0.VariadicTypeExpansion(local_variadic_elem(elem_name + 's')))
+    _define_template(name=name,
+                     result_element_name='type',
+                     main_definition=_specialization(args=(_type_arg_decl('Acc'),
+                                                           _template_template_arg_decl('F', _type_arg_type(), elem_arg_type),
+                                                           _type_arg_decl('L')),
+                                                     type_expr=acc),
+                     specializations=(_specialization(args=(_type_arg_decl('Acc'),
+                                                            _template_template_arg_decl('F', _type_arg_type(), elem_arg_type),
+                                                            elem_arg_decl(elem_name)),
+                                                      patterns=(acc, functor, list_of(elem)),
+                                                      type_expr=_local_metafunction_call('F',
+                                                                                         arg_types=(_type_arg_type(), elem_arg_type),
+                                                                                         args=(acc, elem),
+                                                                                         instantiation_might_trigger_static_asserts=True,
+                                                                                         member_name='type',
+                                                                                         member_type=ir0.TypeType())),
+                                      _specialization(args=(_type_arg_decl('Acc'),
+                                                            _template_template_arg_decl('F', _type_arg_type(), elem_arg_type),
+                                                            elem_arg_decl(elem_name + '0'),
+                                                            elem_arg_decl(elem_name + '1'),
+                                                            variadic_elem_arg_decl(elem_name + 's')),
+                                                      patterns=(acc, functor, long_list),
+                                                      type_expr=fold(fold(acc, functor, _list_first_half(long_list)),
+                                                                     functor,
+                                                                     _list_second_half(long_list)))))
+
 # template <typename L1, typename L2>
 # struct TypeListConcat;
 #
@@ -383,84 +398,221 @@ _define_template_with_single_specialization(name='BoolListConcat',
 #   static constexpr int64_t value = 0;
 # };
 #
-# template <int64_t n, int64_t... ns>
-# struct Int64ListSum<Int64List<n, ns...>> {
-#   static constexpr int64_t value = n + Int64ListSum<Int64List<ns...>>::value;
+# template <int64_t n>
+# struct Int64ListSum<Int64List<n>> {
+#   static constexpr int64_t value = n;
+# };
+#
+# template <int64_t n0, int64_t n1, int64_t... ns>
+# struct Int64ListSum<Int64List<n0, n1, ns...>> {
+#   static constexpr int64_t value = Int64ListSum<typename ListFirstHalf<Int64List<n0, n1, ns...>>::type>::value
+#                                  + Int64ListSum<typename ListSecondHalf<Int64List<n0, n1, ns...>>::type>::value;
 # };
+_int64_long_list = _int_list_of(_local_int('n0'), _local_int('n1'), ir0.VariadicTypeExpansion(_local_variadic_int('ns')))
 _define_template(name='Int64ListSum',
                  result_element_name='value',
                  main_definition=_specialization(args=(_type_arg_decl('L'),),
                                                  value_expr=ir0.Literal(0)),
-                 specializations=(_specialization(args=(_int64_arg_decl('n'),
+                 specializations=(_specialization(args=(_int64_arg_decl('n'),),
+                                                  patterns=(_int_list_of(_local_int('n')),),
+                                                  value_expr=_local_int('n')),
+                                  _specialization(args=(_int64_arg_decl('n0'),
+                                                        _int64_arg_decl('n1'),
                                                         _variadic_int64_arg_decl('ns')),
-                                                  patterns=(_int_list_of(_local_int('n'), ir0.VariadicTypeExpansion(_local_variadic_int('ns'))),),
-                                                  value_expr=ir0.Int64BinaryOpExpr(lhs=_local_int('n'),
-                                                                                   rhs=_int64_list_sum(_int_list_of(ir0.VariadicTypeExpansion(_local_variadic_int('ns')))),
-                                                                                   op='+')),))
+                                                  patterns=(_int64_long_list,),
+                                                  value_expr=ir0.Int64BinaryOpExpr(lhs=_int64_list_sum(_list_first_half(_int64_long_list)),
+                                                                                   rhs=_int64_list_sum(_list_second_half(_int64_long_list)),
+                                                                                   op='+'))))
 
-
-# template <typename... Ts>
-# struct GetFirstError {
-#   using type = void;
+# template <typename T, typename S>
+# struct IsInTypeSet;
+#
+# template <typename T, typename... Ts>
+# struct IsInTypeSet<T, List<Ts...>> {
+#   static constexpr bool value = std::is_base_of<TypeSetIndexElem<T>, TypeSetIndex<Ts...>>::value;
 # };
 #
-# template <typename... Ts>
-# struct GetFirstError<void, Ts...> {
-#   using type = typename GetFirstError<Ts...>::type;
+# template <typename S1, typename S2>
+# struct TypeSetIsSubsetOf;
+#
+# template <typename... Ts, typename S2>
+# struct TypeSetIsSubsetOf<List<Ts...>, S2> {
+#   static constexpr bool value = std::is_same<BoolList<IsInTypeSet<Ts, S2>::value...>,
+#                                              BoolList<Select1stBoolType<true, Ts>::value...>>::value;
 # };
 #
-# template <typename T, typename... Ts>
-# struct GetFirstError<T, Ts...> {
-#   using type = T;
+# template <typename S1, typename S2>
+# struct TypeSetEquals {
+#   static constexpr bool value = TypeSetIsSubsetOf<S1, S2>::value && TypeSetIsSubsetOf<S2, S1>::value;
 # };
-_define_template(name='GetFirstError',
-                 result_element_name='type',
-                 main_definition=_specialization(args=(_variadic_type_arg_decl('Ts'),),
-                                                 type_expr=GlobalLiterals.VOID),
-                 specializations=(_specialization(args=(_variadic_type_arg_decl('Ts'),),
-                                                  patterns=(GlobalLiterals.VOID,
-                                                            ir0.VariadicTypeExpansion(_local_variadic_type('Ts'))),
-                                                  type_expr=_get_first_error(ir0.VariadicTypeExpansion(_local_variadic_type('Ts')))),
-                                  _specialization(args=(_type_arg_decl('T'),
-                                                        _variadic_type_arg_decl('Ts')),
-                                                  patterns=(_local_type('T'),
-                                                            ir0.VariadicTypeExpansion(_local_variadic_type('Ts'))),
-                                                  type_expr=_local_type('T'))))
-
-# template <typename Acc, template <typename Acc1, bool b1> class F, bool... bs>
+#
+# template <bool is_present, typename S, typename T>
+# struct AddToTypeSetHelper {
+#   using type = S;
+# };
+#
+# template <typename... Ts, typename T>
+# struct AddToTypeSetHelper<false, List<Ts...>, T> {
+#   using type = List<T, Ts...>;
+# };
+#
+# template <typename S, typename T>
+# struct AddToTypeSet {
+#   using type = typename AddToTypeSetHelper<IsInTypeSet<T, S>::value, S, T>::type;
+# };
+#
+# (and similarly for sets of bools and int64s)
+def _define_set_templates(elem_kind_name: str,
+                          elem_arg_type: ir0.TemplateArgType,
+                          elem_arg_decl: Callable[[str], ir0.TemplateArgDecl],
+                          variadic_elem_arg_decl: Callable[[str], ir0.TemplateArgDecl],
+                          local_elem: Callable[[str], ir0.Expr],
+                          local_variadic_elem: Callable[[str], ir0.Expr],
+                          list_of: Callable[..., ir0.Expr],
+                          index_elem_literal: ir0.AtomicTypeLiteral,
+                          index_literal: ir0.AtomicTypeLiteral,
+                          is_in_set_literal: ir0.AtomicTypeLiteral,
+                          is_subset_of_literal: ir0.AtomicTypeLiteral,
+                          add_to_set_helper_literal: ir0.AtomicTypeLiteral,
+                          elem_name: str):
+    elem = local_elem(elem_name)
+    variadic_elems = ir0.VariadicTypeExpansion(local_variadic_elem(elem_name + 's'))
+
+    def is_in_set(x: ir0.Expr, s: ir0.Expr):
+        return _metafunction_call(template_expr=is_in_set_literal,
+                                  args=(x, s),
+                                  instantiation_might_trigger_static_asserts=False,
+                                  member_name='value',
+                                  member_type=ir0.BoolType())
+
+    def is_subset_of(s1: ir0.Expr, s2: ir0.Expr):
+        return _metafunction_call(template_expr=is_subset_of_literal,
+                                  args=(s1, s2),
+                                  instantiation_might_trigger_static_asserts=False,
+                                  member_name='value',
+                                  member_type=ir0.BoolType())
+
+    _define_template_with_single_specialization(name='IsIn%sSet' % elem_kind_name,
+                                                main_definition_args=(elem_arg_decl(elem_name), _type_arg_decl('S')),
+                                                specialization_args=(elem_arg_decl(elem_name),
+                                                                     variadic_elem_arg_decl(elem_name + 's')),
+                                                patterns=(elem, list_of(variadic_elems)),
+                                                value_expr=_set_index_contains(index_elem_literal,
+                                                                               index_literal,
+                                                                               elem,
+                                                                               variadic_elems))
+
+    select1st = select1st_literal(ir0.BoolType(), elem_arg_type.expr_type)
+    all_true_list = _bool_list_of(ir0.VariadicTypeExpansion(_metafunction_call(template_expr=select1st,
+                                                                               args=(ir0.Literal(True),
+                                                                                     local_variadic_elem(elem_name + 's')),
+                                                                               instantiation_might_trigger_static_asserts=False,
+                                                                               member_name='value',
+                                                                               member_type=ir0.BoolType())))
+    _define_template_with_single_specialization(name='%sSetIsSubsetOf' % elem_kind_name,
+                                                main_definition_args=(_type_arg_decl('S1'), _type_arg_decl('S2')),
+                                                specialization_args=(variadic_elem_arg_decl(elem_name + 's'),
+                                                                     _type_arg_decl('S2')),
+                                                patterns=(list_of(variadic_elems), _local_type('S2')),
+                                                value_expr=_is_same(_bool_list_of(ir0.VariadicTypeExpansion(is_in_set(local_variadic_elem(elem_name + 's'),
+                                                                                                                       _local_type('S2')))),
+                                                                    all_true_list))
+
+    _define_template_with_no_specializations(name='%sSetEquals' % elem_kind_name,
+                                             args=(_type_arg_decl('S1'), _type_arg_decl('S2')),
+                                             value_expr=ir0.BoolBinaryOpExpr(lhs=is_subset_of(_local_type('S1'), _local_type('S2')),
+                                                                             rhs=is_subset_of(_local_type('S2'), _local_type('S1')),
+                                                                             op='&&'))
+
+    _define_template(name='AddTo%sSetHelper' % elem_kind_name,
+                     result_element_name='type',
+                     main_definition=_specialization(args=(_bool_arg_decl('is_present'),
+                                                           _type_arg_decl('S'),
+                                                           elem_arg_decl(elem_name)),
+                                                     type_expr=_local_type('S')),
+                     specializations=(_specialization(args=(variadic_elem_arg_decl(elem_name + 's'),
+                                                            elem_arg_decl(elem_name)),
+                                                      patterns=(ir0.Literal(False), list_of(variadic_elems), elem),
+                                                      type_expr=list_of(elem, variadic_elems)),))
+
+    _define_template_with_no_specializations(name='AddTo%sSet' % elem_kind_name,
+                                             args=(_type_arg_decl('S'), elem_arg_decl(elem_name)),
+                                             type_expr=_metafunction_call(template_expr=add_to_set_helper_literal,
+                                                                          args=(is_in_set(elem, _local_type('S')),
+                                                                                _local_type('S'),
+                                                                                elem),
+                                                                          instantiation_might_trigger_static_asserts=False,
+                                                                          member_name='type',
+                                                                          member_type=ir0.TypeType()))
+
+_define_set_templates(elem_kind_name='Bool',
+                      elem_arg_type=_bool_arg_type(),
+                      elem_arg_decl=_bool_arg_decl,
+                      variadic_elem_arg_decl=_variadic_bool_arg_decl,
+                      local_elem=_local_bool,
+                      local_variadic_elem=_local_variadic_bool,
+                      list_of=_bool_list_of,
+                      index_elem_literal=GlobalLiterals.BOOL_SET_INDEX_ELEM,
+                      index_literal=GlobalLiterals.BOOL_SET_INDEX,
+                      is_in_set_literal=GlobalLiterals.IS_IN_BOOL_SET,
+                      is_subset_of_literal=GlobalLiterals.BOOL_SET_IS_SUBSET_OF,
+                      add_to_set_helper_literal=GlobalLiterals.ADD_TO_BOOL_SET_HELPER,
+                      elem_name='b')
+
+_define_set_templates(elem_kind_name='Int64',
+                      elem_arg_type=_int64_arg_type(),
+                      elem_arg_decl=_int64_arg_decl,
+                      variadic_elem_arg_decl=_variadic_int64_arg_decl,
+                      local_elem=_local_int,
+                      local_variadic_elem=_local_variadic_int,
+                      list_of=_int_list_of,
+                      index_elem_literal=GlobalLiterals.INT64_SET_INDEX_ELEM,
+                      index_literal=GlobalLiterals.INT64_SET_INDEX,
+                      is_in_set_literal=GlobalLiterals.IS_IN_INT64_SET,
+                      is_subset_of_literal=GlobalLiterals.INT64_SET_IS_SUBSET_OF,
+                      add_to_set_helper_literal=GlobalLiterals.ADD_TO_INT64_SET_HELPER,
+                      elem_name='n')
+
+_define_set_templates(elem_kind_name='Type',
+                      elem_arg_type=_type_arg_type(),
+                      elem_arg_decl=_type_arg_decl,
+                      variadic_elem_arg_decl=_variadic_type_arg_decl,
+                      local_elem=_local_type,
+                      local_variadic_elem=_local_variadic_type,
+                      list_of=_type_list_of,
+                      index_elem_literal=GlobalLiterals.TYPE_SET_INDEX_ELEM,
+                      index_literal=GlobalLiterals.TYPE_SET_INDEX,
+                      is_in_set_literal=GlobalLiterals.IS_IN_TYPE_SET,
+                      is_subset_of_literal=GlobalLiterals.TYPE_SET_IS_SUBSET_OF,
+                      add_to_set_helper_literal=GlobalLiterals.ADD_TO_TYPE_SET_HELPER,
+                      elem_name='T')
+
+# template <typename Acc, template <typename Acc1, bool b1> class F, typename L>
 # struct FoldBoolsToType {
 #   using type = Acc;
 # };
 #
-# template <typename Acc, template <typename Acc1, bool b1> class F, bool b, bool... bs>
-# struct FoldBoolsToType<Acc, F, b, bs...> {
-#   using type = typename FoldBoolsToType<typename F<Acc, b>::type,
+# template <typename Acc, template <typename Acc1, bool b1> class F, bool b>
+# struct FoldBoolsToType<Acc, F, BoolList<b>> {
+#   using type = typename F<Acc, b>::type;
+# };
+#
+# template <typename Acc, template <typename Acc1, bool b1> class F, bool b0, bool b1, bool... bs>
+# struct FoldBoolsToType<Acc, F, BoolList<b0, b1, bs...>> {
+#   using L = BoolList<b0, b1, bs...>;
+#   using type = typename FoldBoolsToType<typename FoldBoolsToType<Acc, F, typename ListFirstHalf<L>::type>::type,
 #                                         F,
-#                                         bs...>::type;
+#                                         typename ListSecondHalf<L>::type>::type;
 # };
-_define_template(name='FoldBoolsToType',
-                 result_element_name='type',
-                 main_definition=_specialization(args=(_type_arg_decl('Acc'),
-                                                       _template_template_arg_decl('F', _type_arg_type(), _bool_arg_type()),
-                                                       _variadic_bool_arg_decl('bs')),
-                                                 type_expr=_local_type('Acc')),
-                 specializations=(_specialization(args=(_type_arg_decl('Acc'),
-                                                        _template_template_arg_decl('F', _type_arg_type(), _bool_arg_type()),
-                                                        _bool_arg_decl('b'),
-                                                        _variadic_bool_arg_decl('bs'),),
-                                                  patterns=(_local_type('Acc'),
-                                                            ir0.AtomicTypeLiteral.for_local('F', ir0.TemplateType((_type_arg_type(), _bool_arg_type())), is_variadic=False),
-                                                            _local_bool('b'),
-                                                            ir0.VariadicTypeExpansion(_local_variadic_bool('bs')),),
-                                                  type_expr=_fold_bools_to_type(_local_metafunction_call('F',
-                                                                                                         arg_types=(_type_arg_type(), _bool_arg_type()),
-                                                                                                         args=(_local_type('Acc'),
-                                                                                                               _local_bool('b')),
-                                                                                                         instantiation_might_trigger_static_asserts=True,
-                                                                                                         member_name='type',
-                                                                                                         member_type=ir0.TypeType()),
-                                                                                ir0.AtomicTypeLiteral.for_local('F', ir0.TemplateType((_type_arg_type(), _bool_arg_type())), is_variadic=False),
-                                                                                ir0.VariadicTypeExpansion(_local_variadic_bool('bs')))),))
+_define_fold_template(name='FoldBoolsToType',
+                      elem_arg_type=_bool_arg_type(),
+                      elem_arg_decl=_bool_arg_decl,
+                      variadic_elem_arg_decl=_variadic_bool_arg_decl,
+                      local_elem=_local_bool,
+                      local_variadic_elem=_local_variadic_bool,
+                      list_of=_bool_list_of,
+                      fold=_fold_bools_to_type,
+                      elem_name='b')
 
 
 
@@ -469,7 +621,7 @@ _define_template(name='FoldBoolsToType',
 #
 # template <bool... bs>
 # struct BoolListToSet<BoolList<bs...>> {
-#   using type = typename FoldBoolsToType<BoolList<>, AddToBoolSet, bs...>::type;
+#   using type = typename FoldBoolsToType<BoolList<>, AddToBoolSet, BoolList<bs...>>::type;
 # };
 _define_template_with_single_specialization(name='BoolListToSet',
                                             main_definition_args=(_type_arg_decl('L'),),
@@ -477,50 +629,42 @@ _define_template_with_single_specialization(name='BoolListToSet',
                                             patterns=(_bool_list_of(ir0.VariadicTypeExpansion(_local_variadic_bool('bs'))),),
                                             type_expr=_fold_bools_to_type(_bool_list_of(),
                                                                           GlobalLiterals.ADD_TO_BOOL_SET,
-                                                                          ir0.VariadicTypeExpansion(_local_variadic_bool('bs'))))
+                                                                          _bool_list_of(ir0.VariadicTypeExpansion(_local_variadic_bool('bs')))))
 
 
-# template <typename Acc, template <typename Acc1, int64_t n1> class F, int64_t... ns>
+# template <typename Acc, template <typename Acc1, int64_t n1> class F, typename L>
 # struct FoldInt64sToType {
 #   using type = Acc;
 # };
 #
-# template <typename Acc, template <typename Acc1, int64_t n1> class F, int64_t n, int64_t... ns>
-# struct FoldInt64sToType<Acc, F, n, ns...> {
-#   using type = typename FoldInt64sToType<typename F<Acc, n>::type,
+# template <typename Acc, template <typename Acc1, int64_t n1> class F, int64_t n>
+# struct FoldInt64sToType<Acc, F, Int64List<n>> {
+#   using type = typename F<Acc, n>::type;
+# };
+#
+# template <typename Acc, template <typename Acc1, int64_t n1> class F, int64_t n0, int64_t n1, int64_t... ns>
+# struct FoldInt64sToType<Acc, F, Int64List<n0, n1, ns...>> {
+#   using L = Int64List<n0, n1, ns...>;
+#   using type = typename FoldInt64sToType<typename FoldInt64sToType<Acc, F, typename ListFirstHalf<L>::type>::type,
 #                                          F,
-#                                          ns...>::type;
+#                                          typename ListSecondHalf<L>::type>::type;
 # };
-_define_template(name='FoldInt64sToType',
-                 result_element_name='type',
-                 main_definition=_specialization(args=(_type_arg_decl('Acc'),
-                                                       _template_template_arg_decl('F', _type_arg_type(), _int64_arg_type()),
-                                                       _variadic_int64_arg_decl('ns')),
-                                                 type_expr=_local_type('Acc')),
-                 specializations=(_specialization(args=(_type_arg_decl('Acc'),
-                                                        _template_template_arg_decl('F', _type_arg_type(), _int64_arg_type()),
-                                                        _int64_arg_decl('n'),
-                                                        _variadic_int64_arg_decl('ns'),),
-                                                  patterns=(_local_type('Acc'),
-                                                            ir0.AtomicTypeLiteral.for_local('F', ir0.TemplateType((_type_arg_type(), _int64_arg_type())), is_variadic=False),
-                                                            _local_int('n'),
-                                                            ir0.VariadicTypeExpansion(_local_variadic_int('ns')),),
-                                                  type_expr=_fold_int64s_to_type(_local_metafunction_call('F',
-                                                                                                          arg_types=(_type_arg_type(), _int64_arg_type()),
-                                                                                                          args=(_local_type('Acc'),
-                                                                                                                _local_int('n')),
-                                                                                                          instantiation_might_trigger_static_asserts=True,
-                                                                                                          member_name='type',
-                                                                                                          member_type=ir0.TypeType()),
-                                                                                 ir0.AtomicTypeLiteral.for_local('F', ir0.TemplateType((_type_arg_type(), _int64_arg_type())), is_variadic=False),
-                                                                                 ir0.VariadicTypeExpansion(_local_variadic_int('ns')))),))
+_define_fold_template(name='FoldInt64sToType',
+                      elem_arg_type=_int64_arg_type(),
+                      elem_arg_decl=_int64_arg_decl,
+                      variadic_elem_arg_decl=_variadic_int64_arg_decl,
+                      local_elem=_local_int,
+                      local_variadic_elem=_local_variadic_int,
+                      list_of=_int_list_of,
+                      fold=_fold_int64s_to_type,
+                      elem_name='n')
 
 # template <typename L>
 # struct Int64ListToSet;
 #
 # template <int64_t... ns>
 # struct Int64ListToSet<Int64List<ns...>> {
-#   using type = typename FoldInt64sToType<Int64List<>, AddToInt64Set, ns...>::type;
+#   using type = typename FoldInt64sToType<Int64List<>, AddToInt64Set, Int64List<ns...>>::type;
 # };
 _define_template_with_single_specialization(name='Int64ListToSet',
                                             main_definition_args=(_type_arg_decl('L'),),
@@ -528,51 +672,43 @@ _define_template_with_single_specialization(name='Int64ListToSet',
                                             patterns=(_int_list_of(ir0.VariadicTypeExpansion(_local_variadic_int('ns'))),),
                                             type_expr=_fold_int64s_to_type(_int_list_of(),
                                                                            GlobalLiterals.ADD_TO_INT64_SET,
-                                                                           ir0.VariadicTypeExpansion(_local_variadic_int('ns'))))
+                                                                           _int_list_of(ir0.VariadicTypeExpansion(_local_variadic_int('ns')))))
 
 
 
-# template <typename Acc, template <typename Acc1, typename T1> class F, typename... Ts>
+# template <typename Acc, template <typename Acc1, typename T1> class F, typename L>
 # struct FoldTypesToType {
 #   using type = Acc;
 # };
 #
-# template <typename Acc, template <typename Acc1, typename T1> class F, typename T, typename... Ts>
-# struct FoldTypesToType<Acc, F, T, Ts...> {
-#   using type = typename FoldTypesToType<typename F<Acc, T>::type,
-#                                          F,
-#                                          Ts...>::type;
+# template <typename Acc, template <typename Acc1, typename T1> class F, typename T>
+# struct FoldTypesToType<Acc, F, List<T>> {
+#   using type = typename F<Acc, T>::type;
 # };
-_define_template(name='FoldTypesToType',
-                 result_element_name='type',
-                 main_definition=_specialization(args=(_type_arg_decl('Acc'),
-                                                       _template_template_arg_decl('F', _type_arg_type(), _type_arg_type()),
-                                                       _variadic_type_arg_decl('Ts')),
-                                                 type_expr=_local_type('Acc')),
-                 specializations=(_specialization(args=(_type_arg_decl('Acc'),
-                                                        _template_template_arg_decl('F', _type_arg_type(), _type_arg_type()),
-                                                        _type_arg_decl('T'),
-                                                        _variadic_type_arg_decl('Ts'),),
-                                                  patterns=(_local_type('Acc'),
-                                                            ir0.AtomicTypeLiteral.for_local('F', ir0.TemplateType((_type_arg_type(), _type_arg_type())), is_variadic=False),
-                                                            _local_type('T'),
-                                                            ir0.VariadicTypeExpansion(_local_variadic_type('Ts')),),
-                                                  type_expr=_fold_types_to_type(_local_metafunction_call('F',
-                                                                                                         arg_types=(_type_arg_type(), _type_arg_type()),
-                                                                                                         args=(_local_type('Acc'),
-                                                                                                               _local_type('T')),
-                                                                                                         instantiation_might_trigger_static_asserts=True,
-                                                                                                         member_name='type',
-                                                                                                         member_type=ir0.TypeType()),
-                                                                                ir0.AtomicTypeLiteral.for_local('F', ir0.TemplateType((_type_arg_type(), _type_arg_type())), is_variadic=False),
-                                                                                ir0.VariadicTypeExpansion(_local_variadic_type('Ts')))),))
+#
+# template <typename Acc, template <typename Acc1, typename T1> class F, typename T0, typename T1, typename... Ts>
+# struct FoldTypesToType<Acc, F, List<T0, T1, Ts...>> {
+#   using L = List<T0, T1, Ts...>;
+#   using type = typename FoldTypesToType<typename FoldTypesToType<Acc, F, typename ListFirstHalf<L>::type>::type,
+#                                         F,
+#                                         typename ListSecondHalf<L>::type>::type;
+# };
+_define_fold_template(name='FoldTypesToType',
+                      elem_arg_type=_type_arg_type(),
+                      elem_arg_decl=_type_arg_decl,
+                      variadic_elem_arg_decl=_variadic_type_arg_decl,
+                      local_elem=_local_type,
+                      local_variadic_elem=_local_variadic_type,
+                      list_of=_type_list_of,
+                      fold=_fold_types_to_type,
+                      elem_name='T')
 
 # template <typename L>
 # struct TypeListToSet;
 #
 # template <typename... Ts>
 # struct TypeListToSet<List<Ts...>> {
-#   using type = typename FoldTypesToType<List<>, AddToTypeSet, Ts...>::type;
+#   using type = typename FoldTypesToType<List<>, AddToTypeSet, List<Ts...>>::type;
 # };
 _define_template_with_single_specialization(name='TypeListToSet',
                                             main_definition_args=(_type_arg_decl('L'),),
@@ -580,7 +716,91 @@ _define_template_with_single_specialization(name='TypeListToSet',
                                             patterns=(_type_list_of(ir0.VariadicTypeExpansion(_local_variadic_type('Ts'))),),
                                             type_expr=_fold_types_to_type(_type_list_of(),
                                                                           GlobalLiterals.ADD_TO_TYPE_SET,
-                                                                          ir0.VariadicTypeExpansion(_local_variadic_type('Ts'))))
+                                                                          _type_list_of(ir0.VariadicTypeExpansion(_local_variadic_type('Ts')))))
+
+# template <typename Error, typename T>
+# struct UpdateFirstError {
+#   using type = Error;
+# };
+#
+# template <typename T>
+# struct UpdateFirstError<void, T> {
+#   using type = T;
+# };
+#
+# template <typename... Ts>
+# struct GetFirstError {
+#   using type = void;
+# };
+#
+# template <typename T, typename... Ts>
+# struct GetFirstError<T, Ts...> {
+#   using type = typename FoldTypesToType<T, UpdateFirstError, List<Ts...>>::type;
+# };
+_define_template(name='UpdateFirstError',
+                 result_element_name='type',
+                 main_definition=_specialization(args=(_type_arg_decl('Error'),
+                                                       _type_arg_decl('T')),
+                                                 type_expr=_local_type('Error')),
+                 specializations=(_specialization(args=(_type_arg_decl('T'),),
+                                                  patterns=(GlobalLiterals.VOID, _local_type('T')),
+                                                  type_expr=_local_type('T')),))
+
+_define_template(name='GetFirstError',
+                 result_element_name='type',
+                 main_definition=_specialization(args=(_variadic_type_arg_decl('Ts'),),
+                                                 type_expr=GlobalLiterals.VOID),
+                 specializations=(_specialization(args=(_type_arg_decl('T'),
+                                                        _variadic_type_arg_decl('Ts')),
+                                                  patterns=(_local_type('T'),
+                                                            ir0.VariadicTypeExpansion(_local_variadic_type('Ts'))),
+                                                  type_expr=_fold_types_to_type(_local_type('T'),
+                                                                                GlobalLiterals.UPDATE_FIRST_ERROR,
+                                                                                _type_list_of(ir0.VariadicTypeExpansion(_local_variadic_type('Ts'))))),))
+
+# template <typename L, typename Keys>
+# struct TypeListSortByKeys {
+#   using type = typename TypeListSelect<L, typename Int64ListSortedIndexes<Keys>::type>::type;
+# };
+#
+# template <typename L, typename Keys>
+# struct TypeListUniqueByKeys {
+#   using type = typename TypeListSelect<L, typename Int64ListUniqueSortedIndexes<Keys>::type>::type;
+# };
+#
+# (and similarly for lists of bools and int64s)
+# Keys is an Int64List with a key for each element of L. The indexes are computed with a merge sort that splits the
+# lists in halves, so the instantiation depth is O(log(n)) (see Int64ListSortedIndexes in tmppy.h).
+def _define_list_sort_templates(elem_kind_name: str,
+                                list_select_literal: ir0.AtomicTypeLiteral):
+    def select_indexes(indexes_literal: ir0.AtomicTypeLiteral):
+        indexes = _metafunction_call(template_expr=indexes_literal,
+                                     args=(_local_type('Keys'),),
+                                     instantiation_might_trigger_static_asserts=False,
+                                     member_name='type',
+                                     member_type=ir0.TypeType())
+        return _metafunction_call(template_expr=list_select_literal,
+                                  args=(_local_type('L'), indexes),
+                                  instantiation_might_trigger_static_asserts=False,
+                                  member_name='type',
+                                  member_type=ir0.TypeType())
+
+    _define_template_with_no_specializations(name='%sListSortByKeys' % elem_kind_name,
+                                             args=(_type_arg_decl('L'), _type_arg_decl('Keys')),
+                                             type_expr=select_indexes(GlobalLiterals.INT64_LIST_SORTED_INDEXES))
+
+    _define_template_with_no_specializations(name='%sListUniqueByKeys' % elem_kind_name,
+                                             args=(_type_arg_decl('L'), _type_arg_decl('Keys')),
+                                             type_expr=select_indexes(GlobalLiterals.INT64_LIST_UNIQUE_SORTED_INDEXES))
+
+_define_list_sort_templates(elem_kind_name='Bool',
+                            list_select_literal=GlobalLiterals.BOOL_LIST_SELECT)
+
+_define_list_sort_templates(elem_kind_name='Int64',
+                            list_select_literal=GlobalLiterals.INT64_LIST_SELECT)
+
+_define_list_sort_templates(elem_kind_name='Type',
+                            list_select_literal=GlobalLiterals.TYPE_LIST_SELECT)
 
 def main():
     parser = argparse.ArgumentParser(description='Converts python source code into C++ metafunctions.')
@@ -605,11 +825,12 @@ def main():
                                                    check_if_error_specializations=module_info.ir0_header.check_if_error_specializations,
                                                    toplevel_content=module_info.ir0_header.toplevel_content,
                                                    public_names=module_info.ir0_header.public_names,
-                                                   split_template_name_by_old_name_and_result_element_name=module_info.ir0_header.split_template_name_by_old_name_and_result_element_name))
+                                                   split_template_name_by_old_name_and_result_element_name=module_info.ir0_header.split_template_name_by_old_name_and_result_element_name),
+                             source_location_by_template_name=module_info.source_location_by_template_name)
     object_file_content = ObjectFileContent({module_name: module_info})
 
     with open(args.o, 'wb') as output_file:
-        output_file.write(pickle.dumps(object_file_content))
+        output_file.write(serialize_object_file_content(object_file_content))
 
 
 if __name__ == '__main__':
@@ -0,0 +1,89 @@
+#  Copyright 2017 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS-IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+from dataclasses import dataclass
+from typing import Dict, Set, AbstractSet, Union
+
+from _py2tmp.ir0 import ir0, compute_template_dependency_graph
+
+@dataclass(frozen=True)
+class HeaderShards:
+    # The templates and toplevel elems needed by more than one shard. These don't depend on any shard.
+    core: ir0.Header
+    # Each shard has the templates and toplevel elems needed (only) by a public name. These can depend on the core.
+    shard_by_public_name: Dict[str, ir0.Header]
+    # The rest, i.e. the elems not needed by any public name (e.g. the toplevel static_asserts). These can depend on the
+    # core and on any shard.
+    rest: ir0.Header
+
+def _compute_dependency_graph(header: ir0.Header):
+    template_defn_by_name = {template_defn.name: template_defn
+                             for template_defn in header.template_defns}
+    graph = compute_template_dependency_graph(header.template_defns, template_defn_by_name)
+
+    # The toplevel constants/typedefs can also be referenced (e.g. the ones introduced by
+    # eliminate_common_closed_subexpressions_across_templates()), so they're nodes too.
+    toplevel_defn_by_name: Dict[str, Union[ir0.ConstantDef, ir0.Typedef]] = {elem.name: elem
+                                                                             for elem in header.toplevel_content
+                                                                             if isinstance(elem, (ir0.ConstantDef, ir0.Typedef))}
+    for elem in toplevel_defn_by_name.values():
+        graph.add_node(elem.name)
+    for elem in (*header.template_defns, *toplevel_defn_by_name.values()):
+        for identifier in elem.referenced_identifiers:
+            if identifier in toplevel_defn_by_name and identifier != elem.name:
+                graph.add_edge(elem.name, identifier)
+    return graph
+
+def _select_elems(header: ir0.Header, names: AbstractSet[str], include_other_toplevel_elems: bool):
+    return ir0.Header(template_defns=tuple(template_defn
+                                           for template_defn in header.template_defns
+                                           if template_defn.name in names),
+                      check_if_error_specializations=(),
+                      toplevel_content=tuple(elem
+                                             for elem in header.toplevel_content
+                                             if (elem.name in names
+                                                 if isinstance(elem, (ir0.ConstantDef, ir0.Typedef))
+                                                 else include_other_toplevel_elems)),
+                      public_names=frozenset(name for name in header.public_names if name in names),
+                      split_template_name_by_old_name_and_result_element_name=header.split_template_name_by_old_name_and_result_element_name)
+
+# Splits a (linked) header so that the code that only uses some public names can include just the templates needed by
+# those, i.e. the transitive dependencies of those names. CheckIfError is public too, but it's only used by the other
+# templates so it doesn't get a shard.
+def split_header_into_shards(header: ir0.Header) -> HeaderShards:
+    assert not header.check_if_error_specializations
+
+    graph = _compute_dependency_graph(header)
+    public_names = sorted(name
+                          for name in header.public_names
+                          if name != 'CheckIfError' and graph.has_node(name))
+    dependencies_by_public_name: Dict[str, Set[str]] = {name: {name, *graph.descendants(name)}
+                                                        for name in public_names}
+
+    # The core is closed under dependencies: the dependencies of an elem needed by multiple public names are also needed
+    # by all those public names. For the same reason, a dependency cycle is never split between the core and a shard.
+    num_dependent_public_names_by_name: Dict[str, int] = dict()
+    for dependencies in dependencies_by_public_name.values():
+        for name in dependencies:
+            num_dependent_public_names_by_name[name] = num_dependent_public_names_by_name.get(name, 0) + 1
+    core_names = {name
+                  for name, num_dependent_public_names in num_dependent_public_names_by_name.items()
+                  if num_dependent_public_names > 1}
+
+    return HeaderShards(core=_select_elems(header, core_names, include_other_toplevel_elems=False),
+                        shard_by_public_name={name: _select_elems(header, dependencies - core_names, include_other_toplevel_elems=False)
+                                              for name, dependencies in dependencies_by_public_name.items()},
+                        rest=_select_elems(header,
+                                           set(graph.nodes) - num_dependent_public_names_by_name.keys(),
+                                           include_other_toplevel_elems=True))
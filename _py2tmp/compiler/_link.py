@@ -12,12 +12,16 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 import itertools
-from typing import Iterator, Tuple, Dict
+import os
+import re
+from typing import Iterator, Tuple, Dict, Optional, List
 
-from _py2tmp.compiler.output_files import ObjectFileContent
-from _py2tmp.compiler.stages import header_to_cpp
+from _py2tmp.compiler._header_shards import split_header_into_shards
+from _py2tmp.compiler.output_files import ObjectFileContent, SourceMap
+from _py2tmp.compiler.stages import header_to_cpp, CppTarget
 from _py2tmp.ir0 import ir0
-from _py2tmp.ir0_optimization import optimize_header
+from _py2tmp.ir0_optimization import optimize_header, eliminate_common_closed_subexpressions_across_templates, \
+    remove_unreachable_specializations, LookaheadIdentifierGenerator
 
 
 def compute_merged_header_for_linking(main_module_name: str,
@@ -63,21 +67,101 @@ def compute_merged_header_for_linking(main_module_name: str,
                                                                                              for k, v in split_template_name_by_old_name_and_result_element_name.items()),
                                public_names=public_names)
 
-    if coverage_collection_enabled:
-        return merged_header
+    header = optimize_header(header=merged_header,
+                             context_object_file_content=ObjectFileContent({}),
+                             identifier_generator=identifier_generator,
+                             linking_final_header=True,
+                             coverage_collection_enabled=coverage_collection_enabled)
+    # This must be done before eliminate_common_closed_subexpressions_across_templates(), since after that some of the
+    # args of the instantiations are just references to the hoisted exprs.
+    header = remove_unreachable_specializations(header)
+    return eliminate_common_closed_subexpressions_across_templates(header, identifier_generator)
 
-    return optimize_header(header=merged_header,
-                           context_object_file_content=ObjectFileContent({}),
-                           identifier_generator=identifier_generator,
-                           linking_final_header=True)
+def _identifier_generator() -> Iterator[str]:
+    return LookaheadIdentifierGenerator('TmppyInternal_' + str(i) for i in itertools.count())
 
 def link(main_module_name: str,
          object_file_content: ObjectFileContent,
-         coverage_collection_enabled: bool):
-    def identifier_generator_fun() -> Iterator[str]:
-        for i in itertools.count():
-            yield 'TmppyInternal_' + str(i)
-    identifier_generator = identifier_generator_fun()
+         coverage_collection_enabled: bool,
+         use_clang_format: bool = True,
+         source_map: Optional[SourceMap] = None,
+         target: CppTarget = CppTarget(),
+         short_circuit_bool_ops: bool = False,
+         coverage_markers_in_object_file: bool = False):
+    identifier_generator = _identifier_generator()
 
     header = compute_merged_header_for_linking(main_module_name, object_file_content, identifier_generator, coverage_collection_enabled=coverage_collection_enabled)
-    return header_to_cpp(header, identifier_generator, coverage_collection_enabled=coverage_collection_enabled)
+    if source_map is not None:
+        for module_info in object_file_content.modules_by_name.values():
+            source_map.add_known_source_locations(module_info.source_location_by_template_name or ())
+    return header_to_cpp(header,
+                         identifier_generator,
+                         coverage_collection_enabled=coverage_collection_enabled,
+                         use_clang_format=use_clang_format,
+                         source_map=source_map,
+                         target=target,
+                         short_circuit_bool_ops=short_circuit_bool_ops,
+                         coverage_markers_in_object_file=coverage_markers_in_object_file)
+
+def _include_guard_macro_name(file_name: str):
+    return 'TMPPY_GENERATED_' + re.sub('[^A-Za-z0-9]', '_', os.path.basename(file_name)).upper()
+
+def _add_include_guard_and_includes(file_name: str, cpp_source: str, included_file_names: List[str]):
+    macro_name = _include_guard_macro_name(file_name)
+    return ''.join(('#ifndef %s\n' % macro_name,
+                    '#define %s\n' % macro_name,
+                    *('#include "%s"\n' % os.path.basename(included_file_name)
+                      for included_file_name in included_file_names),
+                    cpp_source,
+                    '#endif // %s\n' % macro_name))
+
+# Like link(), but returns the content of the output files, by file name.
+# If shard_header is True, header_file_name is an "umbrella" header that includes a separate header for each public
+# name (<name>_shard_<public name>.h) that only contains the templates needed by that public name. The templates needed
+# by multiple public names go in a shared header (<name>_core.h), included by those shards.
+# If cpp20_module_file_name is specified, a C++20 module interface unit with the whole header (exporting the public
+# names) is also written there. The module has the same name as the main module.
+def link_to_files(main_module_name: str,
+                  object_file_content: ObjectFileContent,
+                  coverage_collection_enabled: bool,
+                  header_file_name: str,
+                  use_clang_format: bool = True,
+                  target: CppTarget = CppTarget(),
+                  short_circuit_bool_ops: bool = False,
+                  shard_header: bool = False,
+                  cpp20_module_file_name: Optional[str] = None,
+                  coverage_markers_in_object_file: bool = False) -> Dict[str, str]:
+    identifier_generator = _identifier_generator()
+    header = compute_merged_header_for_linking(main_module_name, object_file_content, identifier_generator, coverage_collection_enabled=coverage_collection_enabled)
+
+    def to_cpp(header: ir0.Header, cpp20_module_name: Optional[str] = None):
+        return header_to_cpp(header,
+                             identifier_generator,
+                             coverage_collection_enabled=coverage_collection_enabled,
+                             use_clang_format=use_clang_format,
+                             target=target,
+                             short_circuit_bool_ops=short_circuit_bool_ops,
+                             cpp20_module_name=cpp20_module_name,
+                             coverage_markers_in_object_file=coverage_markers_in_object_file)
+
+    cpp_source_by_file_name: Dict[str, str] = dict()
+    if shard_header:
+        shards = split_header_into_shards(header)
+        file_name_prefix = header_file_name[:-len('.h')] if header_file_name.endswith('.h') else header_file_name
+        core_file_name = file_name_prefix + '_core.h'
+        cpp_source_by_file_name[core_file_name] = _add_include_guard_and_includes(core_file_name, to_cpp(shards.core), [])
+        shard_file_names = []
+        for public_name, shard in shards.shard_by_public_name.items():
+            shard_file_name = '%s_shard_%s.h' % (file_name_prefix, public_name)
+            shard_file_names.append(shard_file_name)
+            cpp_source_by_file_name[shard_file_name] = _add_include_guard_and_includes(shard_file_name, to_cpp(shard), [core_file_name])
+        cpp_source_by_file_name[header_file_name] = _add_include_guard_and_includes(header_file_name,
+                                                                                    to_cpp(shards.rest),
+                                                                                    [core_file_name, *shard_file_names])
+    else:
+        cpp_source_by_file_name[header_file_name] = to_cpp(header)
+
+    if cpp20_module_file_name is not None:
+        cpp_source_by_file_name[cpp20_module_file_name] = to_cpp(header, cpp20_module_name=main_module_name)
+
+    return cpp_source_by_file_name
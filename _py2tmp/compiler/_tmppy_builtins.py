@@ -34,30 +34,3 @@ def IsInInt64List(n: int, l: List[int]):
 
 def IsInTypeList(x: Type, l: List[Type]):
     return any([x == y for y in l])
-
-def AddToBoolSet(l: List[bool], b: bool):
-    if b in l:
-        return l
-    else:
-        return [b] + l
-
-def AddToInt64Set(l: List[int], n: int):
-    if n in l:
-        return l
-    else:
-        return [n] + l
-
-def AddToTypeSet(l: List[Type], x: Type):
-    if x in l:
-        return l
-    else:
-        return [x] + l
-
-def BoolSetEquals(x: List[bool], y: List[bool]):
-    return all([x1 in y for x1 in x]) and all([y1 in x for y1 in y])
-
-def Int64SetEquals(x: List[int], y: List[int]):
-    return all([x1 in y for x1 in x]) and all([y1 in x for y1 in y])
-
-def TypeSetEquals(x: List[Type], y: List[Type]):
-    return all([x1 in y for x1 in x]) and all([y1 in x for y1 in y])
@@ -12,4 +12,8 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from ._tmppy_object_file import ObjectFileContent, ModuleInfo, merge_object_files, load_object_files
+from ._source_map import SourceLocation, SourceMap, SourceMapEntry, compute_source_location_by_template_name, \
+    compute_source_location_by_toplevel_name, SOURCE_MAP_FORMAT_VERSION
+from ._tmppy_object_file import ObjectFileContent, ModuleInfo, merge_object_files
+from ._tmppyc_format import serialize_object_file_content, load_object_file, load_object_files, ObjectFileFormatError, \
+    FORMAT_VERSION
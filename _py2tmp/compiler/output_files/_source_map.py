@@ -0,0 +1,140 @@
+#  Copyright 2017 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS-IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+import ast
+import re
+from dataclasses import dataclass
+from typing import Dict, Iterable, List, Mapping, Tuple
+
+from _py2tmp.ir0 import ir0, compute_template_dependency_graph
+
+# Bump this when changing the JSON format of source maps (see SourceMap.to_json()).
+SOURCE_MAP_FORMAT_VERSION = 1
+
+@dataclass(frozen=True)
+class SourceLocation:
+    # The toplevel TMPPy function (or class) that the code was generated from.
+    function_name: str
+    file_name: str
+    line: int
+
+def compute_source_location_by_toplevel_name(source_ast: ast.Module, file_name: str) -> Dict[str, SourceLocation]:
+    return {stmt.name: SourceLocation(function_name=stmt.name, file_name=file_name, line=stmt.lineno)
+            for stmt in source_ast.body
+            if isinstance(stmt, (ast.FunctionDef, ast.ClassDef))}
+
+# Most templates don't correspond directly to a TMPPy function (e.g. the ones generated for the branches of an if-else,
+# for list comprehensions or by the optimizer when splitting a template); each of those is attributed to the nearest
+# template with a known source location that (transitively) references it. Ties are broken by source location, so that
+# the result is deterministic.
+def compute_source_location_by_template_name(header: ir0.Header,
+                                             known_source_location_by_template_name: Mapping[str, SourceLocation]) -> Dict[str, SourceLocation]:
+    template_defn_by_name = {template_defn.name: template_defn
+                             for template_defn in header.template_defns}
+    source_location_by_template_name = {template_name: source_location
+                                        for template_name, source_location in known_source_location_by_template_name.items()
+                                        if template_name in template_defn_by_name}
+    for (old_template_name, _), new_template_name in header.split_template_name_by_old_name_and_result_element_name:
+        source_location = known_source_location_by_template_name.get(old_template_name)
+        if source_location is not None and new_template_name in template_defn_by_name:
+            source_location_by_template_name.setdefault(new_template_name, source_location)
+
+    template_dependency_graph = compute_template_dependency_graph(header.template_defns, template_defn_by_name)
+    template_names_to_visit = sorted(source_location_by_template_name.keys(),
+                                     key=lambda template_name: (source_location_by_template_name[template_name].file_name,
+                                                                source_location_by_template_name[template_name].line,
+                                                                template_name))
+    while template_names_to_visit:
+        next_template_names_to_visit = []
+        for template_name in template_names_to_visit:
+            for referenced_template_name in sorted(template_dependency_graph.successors(template_name)):
+                if referenced_template_name not in source_location_by_template_name:
+                    source_location_by_template_name[referenced_template_name] = source_location_by_template_name[template_name]
+                    next_template_names_to_visit.append(referenced_template_name)
+        template_names_to_visit = next_template_names_to_visit
+
+    return source_location_by_template_name
+
+@dataclass(frozen=True)
+class SourceMapEntry:
+    source_location: SourceLocation
+    # The (1-based) lines of the generated C++ code where the main definition and the specializations of the template
+    # start (i.e. the "struct Foo" lines).
+    cpp_lines: Tuple[int, ...]
+
+# Matches a toplevel "struct Foo" line (possibly preceded by the template params, e.g. after clang-format).
+_TOPLEVEL_STRUCT_REGEX = re.compile(r'(?:template\s*<.*>\s*)?struct\s+([A-Za-z_][A-Za-z_0-9]*)(.*)$')
+
+# Maps the templates defined in a generated C++ header to the TMPPy code they come from.
+# This is written as a sidecar of the header, and it's then used e.g. to attribute the compilation time reported by the
+# C++ compiler to TMPPy functions.
+class SourceMap:
+    def __init__(self) -> None:
+        self.known_source_location_by_template_name: Dict[str, SourceLocation] = dict()
+        self.entry_by_cpp_template_name: Dict[str, SourceMapEntry] = dict()
+
+    def add_known_source_locations(self, source_location_by_template_name: Iterable[Tuple[str, SourceLocation]]):
+        self.known_source_location_by_template_name.update(source_location_by_template_name)
+
+    def add_header(self, header: ir0.Header, cpp_source: str):
+        source_location_by_template_name = compute_source_location_by_template_name(header,
+                                                                                    self.known_source_location_by_template_name)
+
+        cpp_lines_by_template_name: Dict[str, List[int]] = dict()
+        unattributed_template_names = []
+        for line_number, line in enumerate(cpp_source.splitlines(), start=1):
+            match = _TOPLEVEL_STRUCT_REGEX.match(line)
+            if not match or match.group(2).strip() == ';':
+                # Not a definition (or just a forward declaration).
+                continue
+            template_name = match.group(1)
+            cpp_lines_by_template_name.setdefault(template_name, []).append(line_number)
+            if template_name in source_location_by_template_name:
+                # Helper templates generated while converting the IR0 to C++ (e.g. for Select1st* workarounds) are
+                # written just before the specialization that uses them.
+                for unattributed_template_name in unattributed_template_names:
+                    source_location_by_template_name.setdefault(unattributed_template_name,
+                                                                source_location_by_template_name[template_name])
+                unattributed_template_names = []
+            else:
+                unattributed_template_names.append(template_name)
+
+        for template_name, cpp_lines in cpp_lines_by_template_name.items():
+            source_location = source_location_by_template_name.get(template_name)
+            if source_location is not None:
+                self.entry_by_cpp_template_name[template_name] = SourceMapEntry(source_location=source_location,
+                                                                                cpp_lines=tuple(cpp_lines))
+
+    def to_json(self):
+        return {
+            'format_version': SOURCE_MAP_FORMAT_VERSION,
+            'templates': {template_name: {'function': entry.source_location.function_name,
+                                          'file': entry.source_location.file_name,
+                                          'line': entry.source_location.line,
+                                          'cpp_lines': list(entry.cpp_lines)}
+                          for template_name, entry in sorted(self.entry_by_cpp_template_name.items())},
+        }
+
+    @staticmethod
+    def from_json(json_content) -> 'SourceMap':
+        if json_content.get('format_version') != SOURCE_MAP_FORMAT_VERSION:
+            raise ValueError('Unsupported source map format version: %s (expected: %s)' % (
+                json_content.get('format_version'), SOURCE_MAP_FORMAT_VERSION))
+        source_map = SourceMap()
+        for template_name, entry in json_content['templates'].items():
+            source_map.entry_by_cpp_template_name[template_name] = SourceMapEntry(
+                source_location=SourceLocation(function_name=entry['function'],
+                                               file_name=entry['file'],
+                                               line=entry['line']),
+                cpp_lines=tuple(entry['cpp_lines']))
+        return source_map
@@ -11,14 +11,16 @@
 # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 # See the License for the specific language governing permissions and
 # limitations under the License.
-import pickle
+import dataclasses
 from dataclasses import dataclass
-from functools import lru_cache
-from typing import Dict, List, Optional, Tuple
+from functools import cached_property
+from typing import Dict, List, Optional, Tuple, Mapping
 
 from _py2tmp.ir2 import ir2
 from _py2tmp.ir1 import ir1
 from _py2tmp.ir0 import ir0
+from _py2tmp.utils import LazyMapping
+from _py2tmp.compiler.output_files._source_map import SourceLocation
 
 @dataclass(frozen=True)
 class ModuleInfo:
@@ -26,24 +28,58 @@ class ModuleInfo:
     ir0_header: ir0.Header
     ir0_header_before_optimization: Optional[ir0.Header] = None
     ir1_module: Optional[ir1.Module] = None
+    # The TMPPy code that each template in ir0_header comes from (see compute_source_location_by_template_name()).
+    source_location_by_template_name: Optional[Tuple[Tuple[str, SourceLocation], ...]] = None
+
+    # Unlike checking ir2_module, this doesn't need to decode the module when it's loaded lazily from an object file.
+    @property
+    def has_ir2_module(self):
+        return self.ir2_module is not None
+
+    # These are also stored in a small per-module index in object files, so that they can be computed without decoding
+    # the IR0 header.
+    @property
+    def ir0_template_names(self) -> Tuple[str, ...]:
+        return tuple(template_defn.name for template_defn in self.ir0_header.template_defns)
+
+    @property
+    def split_template_name_by_old_name_and_result_element_name(self) -> Tuple[Tuple[Tuple[str, str], str], ...]:
+        return self.ir0_header.split_template_name_by_old_name_and_result_element_name
+
+    def without_ir2_module(self) -> 'ModuleInfo':
+        return dataclasses.replace(self, ir2_module=None)
 
 @dataclass(frozen=True)
 class ObjectFileContent:
     modules_by_name: Dict[str, ModuleInfo]
 
+    # The IR0 templates defined in these modules (if multiple modules define a template, the last one wins).
+    # The IR0 header of a module is only decoded when one of its templates is looked up.
+    @cached_property
+    def template_defn_by_name(self) -> Mapping[str, ir0.TemplateDefn]:
+        module_name_by_template_name = {template_name: module_name
+                                        for module_name, module_info in self.modules_by_name.items()
+                                        for template_name in module_info.ir0_template_names}
+        template_defn_by_name_by_module_name = LazyMapping(self.modules_by_name.keys(),
+                                                           lambda module_name: {template_defn.name: template_defn
+                                                                                for template_defn in self.modules_by_name[module_name].ir0_header.template_defns})
+        return LazyMapping(module_name_by_template_name.keys(),
+                           lambda template_name: template_defn_by_name_by_module_name[module_name_by_template_name[template_name]][template_name])
+
+    @cached_property
+    def split_template_name_by_old_name_and_result_element_name(self) -> Dict[Tuple[str, str], str]:
+        return {key: value
+                for module_info in self.modules_by_name.values()
+                for key, value in module_info.split_template_name_by_old_name_and_result_element_name}
+
+    def __getstate__(self):
+        # The cached properties above are not picklable, and they're cheap to recompute.
+        return {'modules_by_name': self.modules_by_name}
+
 def merge_object_files(object_files: List[ObjectFileContent]):
     modules_by_name = dict()
     for object_file in object_files:
         for name, module_info in object_file.modules_by_name.items():
-            if name not in modules_by_name or modules_by_name[name].ir2_module is None:
+            if name not in modules_by_name or not modules_by_name[name].has_ir2_module:
                 modules_by_name[name] = module_info
     return ObjectFileContent(modules_by_name)
-
-@lru_cache()
-def load_object_files(object_file_paths: Tuple[str, ...]) -> ObjectFileContent:
-    object_file_contents = []
-    for context_module_file_name in object_file_paths:
-        with open(context_module_file_name, 'rb') as file:
-            object_file_contents.append(pickle.loads(file.read()))
-
-    return merge_object_files(object_file_contents)
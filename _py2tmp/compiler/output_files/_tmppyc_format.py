@@ -0,0 +1,304 @@
+#  Copyright 2017 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS-IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+import io
+import mmap
+import os
+import pickle
+import struct
+from dataclasses import fields
+from functools import lru_cache
+from typing import Dict, List, Optional, Tuple
+
+from _py2tmp.compiler.output_files._tmppy_object_file import ObjectFileContent, ModuleInfo, merge_object_files
+
+# Layout of a .tmppyc file (all integers are little-endian):
+#
+# * The file header (_FILE_HEADER): magic, format version, offset and size of the table of contents.
+# * For each module, its chunks (stored contiguously, but that's not required):
+#   * The string table of the module: the number of strings N, then N+1 offsets (in characters) into the UTF-8 encoded
+#     concatenation of all strings, then that concatenation.
+#   * The index of the module: a (plain) pickle of the names of the IR0 templates defined in the module and of its
+#     split_template_name_by_old_name_and_result_element_name.
+#   * A section for each non-None ModuleInfo field. Each is a pickle stream where strings (including field names) are
+#     replaced by (persistent) indexes into the string table of the module.
+# * The table of contents (TOC): the number of modules, then for each module the size of its UTF-8 encoded name, the
+#   name, and offset/size of each chunk of the module (offset 0 means that the chunk is missing).
+#
+# Nothing is decoded when loading the file except for the TOC. The index of a module is decoded when its templates
+# are looked up, and the string table and the other sections when the corresponding ModuleInfo field is first
+# accessed. So (e.g.) a compilation that only imports from a single module never decodes the IR2 of the other ones.
+#
+# Since each module only references its own chunks, modules can be copied from an object file to another without
+# decoding (and re-encoding) them.
+#
+# Bump this when changing the layout above.
+FORMAT_VERSION = 3
+
+_MAGIC = b'TMPPYC\r\n'
+_FILE_HEADER = struct.Struct('<8sIQQ')
+_TOC_HEADER = struct.Struct('<I')
+_TOC_MODULE_NAME_SIZE = struct.Struct('<I')
+_SECTION_FIELD_NAMES = ('ir2_module', 'ir0_header', 'ir0_header_before_optimization', 'ir1_module',
+                        'source_location_by_template_name')
+_STRING_TABLE_CHUNK_INDEX = 0
+_INDEX_CHUNK_INDEX = 1
+_FIRST_SECTION_CHUNK_INDEX = 2
+_NUM_CHUNKS = _FIRST_SECTION_CHUNK_INDEX + len(_SECTION_FIELD_NAMES)
+_TOC_MODULE_CHUNK_LOCATIONS = struct.Struct('<%sQ' % (2 * _NUM_CHUNKS))
+_PICKLE_PROTOCOL = 4
+
+ChunkLocations = Tuple[Optional[Tuple[int, int]], ...]
+
+class ObjectFileFormatError(Exception):
+    pass
+
+class _StringTableBuilder:
+    def __init__(self):
+        self.index_by_string: Dict[str, int] = dict()
+
+    def index(self, s: str):
+        index = self.index_by_string.get(s)
+        if index is None:
+            index = len(self.index_by_string)
+            self.index_by_string[s] = index
+        return index
+
+    def serialize(self) -> bytes:
+        strings = list(self.index_by_string.keys())
+        offsets = [0]
+        for s in strings:
+            offsets.append(offsets[-1] + len(s))
+        return (struct.pack('<I%sI' % len(offsets), len(strings), *offsets)
+                + ''.join(strings).encode('utf-8', errors='surrogatepass'))
+
+class _SectionPickler(pickle.Pickler):
+    def __init__(self, file: io.BytesIO, string_table_builder: _StringTableBuilder):
+        super().__init__(file, protocol=_PICKLE_PROTOCOL)
+        self.string_table_builder = string_table_builder
+
+    def persistent_id(self, obj):
+        if obj.__class__ is str:
+            return self.string_table_builder.index(obj)
+        return None
+
+def _serialize_module_info(module_info: ModuleInfo) -> List[Optional[bytes]]:
+    string_table_builder = _StringTableBuilder()
+    sections = []
+    for field_name in _SECTION_FIELD_NAMES:
+        value = getattr(module_info, field_name)
+        if value is None:
+            sections.append(None)
+        else:
+            file = io.BytesIO()
+            _SectionPickler(file, string_table_builder).dump(value)
+            sections.append(file.getvalue())
+    index = pickle.dumps((module_info.ir0_template_names,
+                          module_info.split_template_name_by_old_name_and_result_element_name),
+                         protocol=_PICKLE_PROTOCOL)
+    return [string_table_builder.serialize(), index, *sections]
+
+def serialize_object_file_content(object_file_content: ObjectFileContent) -> bytes:
+    chunks: List[bytes] = []
+    offset = _FILE_HEADER.size
+    toc = [_TOC_HEADER.pack(len(object_file_content.modules_by_name))]
+    for module_name, module_info in object_file_content.modules_by_name.items():
+        if isinstance(module_info, _LazyModuleInfo):
+            module_chunks = module_info.get_raw_chunks()
+        else:
+            module_chunks = _serialize_module_info(module_info)
+        locations = []
+        for chunk in module_chunks:
+            if chunk is None:
+                locations += [0, 0]
+            else:
+                locations += [offset, len(chunk)]
+                chunks.append(chunk)
+                offset += len(chunk)
+        encoded_module_name = module_name.encode('utf-8', errors='surrogatepass')
+        toc += [_TOC_MODULE_NAME_SIZE.pack(len(encoded_module_name)),
+                encoded_module_name,
+                _TOC_MODULE_CHUNK_LOCATIONS.pack(*locations)]
+    toc = b''.join(toc)
+
+    return b''.join((_FILE_HEADER.pack(_MAGIC, FORMAT_VERSION, offset, len(toc)),
+                     *chunks,
+                     toc))
+
+class _MappedObjectFile:
+    def __init__(self, path: str):
+        self.path = path
+        with open(path, 'rb') as file:
+            stat = os.fstat(file.fileno())
+            # Used to check that the file didn't change when it's re-opened (e.g. in another process).
+            self.identity = (stat.st_ino, stat.st_size, stat.st_mtime_ns)
+            try:
+                # The mapping stays valid after closing the file.
+                self.data = mmap.mmap(file.fileno(), 0, access=mmap.ACCESS_READ)
+            except ValueError:
+                # Empty files can't be mapped.
+                self.data = b''
+        self.strings_by_location: Dict[Tuple[int, int], List[str]] = dict()
+
+    def check(self, condition: bool):
+        if not condition:
+            raise ObjectFileFormatError('The object file %s is corrupted.' % self.path)
+
+    def read_toc(self) -> List[Tuple[str, ChunkLocations]]:
+        if self.data[:len(_MAGIC)] != _MAGIC:
+            raise ObjectFileFormatError('%s is not a TMPPy object file (or it was generated by an old version of TMPPy).' % self.path)
+        self.check(len(self.data) >= _FILE_HEADER.size)
+        _, version, toc_offset, toc_size = _FILE_HEADER.unpack_from(self.data, 0)
+        if version != FORMAT_VERSION:
+            raise ObjectFileFormatError('The object file %s has format version %s, but this version of TMPPy only supports version %s. Please re-generate it.' % (
+                self.path, version, FORMAT_VERSION))
+        self.check(toc_offset + toc_size <= len(self.data) and toc_size >= _TOC_HEADER.size)
+
+        toc = self.data[toc_offset:toc_offset + toc_size]
+        [num_modules] = _TOC_HEADER.unpack_from(toc, 0)
+        position = _TOC_HEADER.size
+        result = []
+        for _ in range(num_modules):
+            self.check(position + _TOC_MODULE_NAME_SIZE.size <= toc_size)
+            [module_name_size] = _TOC_MODULE_NAME_SIZE.unpack_from(toc, position)
+            position += _TOC_MODULE_NAME_SIZE.size
+            self.check(position + module_name_size + _TOC_MODULE_CHUNK_LOCATIONS.size <= toc_size)
+            module_name = toc[position:position + module_name_size].decode('utf-8', errors='surrogatepass')
+            position += module_name_size
+            locations = _TOC_MODULE_CHUNK_LOCATIONS.unpack_from(toc, position)
+            position += _TOC_MODULE_CHUNK_LOCATIONS.size
+            chunk_locations = tuple(None if locations[i] == 0 else (locations[i], locations[i + 1])
+                                    for i in range(0, len(locations), 2))
+            for location in chunk_locations:
+                self.check(location is None or location[0] + location[1] <= toc_offset)
+            self.check(chunk_locations[_STRING_TABLE_CHUNK_INDEX] is not None
+                       and chunk_locations[_INDEX_CHUNK_INDEX] is not None)
+            result.append((module_name, chunk_locations))
+        self.check(position == toc_size)
+        return result
+
+    def get_chunk(self, location: Tuple[int, int]) -> bytes:
+        offset, size = location
+        return self.data[offset:offset + size]
+
+    def get_strings(self, location: Tuple[int, int]) -> List[str]:
+        strings = self.strings_by_location.get(location)
+        if strings is None:
+            table = self.get_chunk(location)
+            self.check(len(table) >= 4)
+            [num_strings] = struct.unpack_from('<I', table, 0)
+            offsets_size = 4 * (num_strings + 1)
+            self.check(len(table) >= 4 + offsets_size)
+            offsets = struct.unpack_from('<%sI' % (num_strings + 1), table, 4)
+            text = table[4 + offsets_size:].decode('utf-8', errors='surrogatepass')
+            self.check(offsets[-1] == len(text))
+            strings = [text[offsets[i]:offsets[i + 1]] for i in range(num_strings)]
+            self.strings_by_location[location] = strings
+        return strings
+
+    def decode_section(self, location: Tuple[int, int], string_table_location: Tuple[int, int]):
+        unpickler = pickle.Unpickler(io.BytesIO(self.get_chunk(location)))
+        # This is a C function, so (unlike a Python method) it's cheap to call for each string.
+        unpickler.persistent_load = self.get_strings(string_table_location).__getitem__
+        return unpickler.load()
+
+    def decode_index(self, location: Tuple[int, int]):
+        return pickle.loads(self.get_chunk(location))
+
+class _LazyModuleInfo(ModuleInfo):
+    def __init__(self, object_file: _MappedObjectFile, chunk_locations: ChunkLocations):
+        # ModuleInfo is frozen, so we can't just assign the attributes.
+        object.__setattr__(self, '_object_file', object_file)
+        object.__setattr__(self, '_chunk_locations', chunk_locations)
+        object.__setattr__(self, '_decoded_chunks', dict())
+
+    def _get_chunk(self, index: int):
+        if index not in self._decoded_chunks:
+            location = self._chunk_locations[index]
+            if location is None:
+                value = None
+            elif index == _INDEX_CHUNK_INDEX:
+                value = self._object_file.decode_index(location)
+            else:
+                value = self._object_file.decode_section(location, self._chunk_locations[_STRING_TABLE_CHUNK_INDEX])
+            self._decoded_chunks[index] = value
+        return self._decoded_chunks[index]
+
+    ir2_module = property(lambda self: self._get_chunk(_FIRST_SECTION_CHUNK_INDEX))
+    ir0_header = property(lambda self: self._get_chunk(_FIRST_SECTION_CHUNK_INDEX + 1))
+    ir0_header_before_optimization = property(lambda self: self._get_chunk(_FIRST_SECTION_CHUNK_INDEX + 2))
+    ir1_module = property(lambda self: self._get_chunk(_FIRST_SECTION_CHUNK_INDEX + 3))
+    source_location_by_template_name = property(lambda self: self._get_chunk(_FIRST_SECTION_CHUNK_INDEX + 4))
+
+    @property
+    def has_ir2_module(self):
+        return self._chunk_locations[_FIRST_SECTION_CHUNK_INDEX] is not None
+
+    @property
+    def ir0_template_names(self):
+        return self._get_chunk(_INDEX_CHUNK_INDEX)[0]
+
+    @property
+    def split_template_name_by_old_name_and_result_element_name(self):
+        return self._get_chunk(_INDEX_CHUNK_INDEX)[1]
+
+    def without_ir2_module(self):
+        chunk_locations = list(self._chunk_locations)
+        chunk_locations[_FIRST_SECTION_CHUNK_INDEX] = None
+        result = _LazyModuleInfo(self._object_file, tuple(chunk_locations))
+        result._decoded_chunks.update(self._decoded_chunks)
+        result._decoded_chunks.pop(_FIRST_SECTION_CHUNK_INDEX, None)
+        return result
+
+    def get_raw_chunks(self) -> List[Optional[bytes]]:
+        return [None if location is None else self._object_file.get_chunk(location)
+                for location in self._chunk_locations]
+
+    def __reduce__(self):
+        # E.g. when sending this to another process we send the location of the module, not its (decoded) content.
+        return _load_lazy_module_info, (self._object_file.path, self._object_file.identity, self._chunk_locations)
+
+assert tuple(field.name for field in fields(ModuleInfo)) == _SECTION_FIELD_NAMES
+
+def _get_file_identity(path: str):
+    stat = os.stat(path)
+    return stat.st_ino, stat.st_size, stat.st_mtime_ns
+
+@lru_cache()
+def _map_object_file_with_identity(path: str, identity: Tuple[int, int, int]):
+    object_file = _MappedObjectFile(path)
+    if object_file.identity != identity:
+        raise ObjectFileFormatError('The object file %s was modified during the compilation.' % path)
+    return object_file
+
+def _load_lazy_module_info(path: str, identity: Tuple[int, int, int], chunk_locations: ChunkLocations):
+    return _LazyModuleInfo(_map_object_file_with_identity(path, identity), chunk_locations)
+
+def load_object_file(path: str) -> ObjectFileContent:
+    object_file = _MappedObjectFile(path)
+    return ObjectFileContent({module_name: _LazyModuleInfo(object_file, chunk_locations)
+                              for module_name, chunk_locations in object_file.read_toc()})
+
+def load_object_files(object_file_paths: Tuple[str, ...]) -> ObjectFileContent:
+    # The identities are part of the cache key, so that (e.g. in batch mode) an object file is re-loaded if it's
+    # re-generated.
+    return _load_object_files_with_identities(object_file_paths,
+                                              tuple(_get_file_identity(object_file_path)
+                                                    for object_file_path in object_file_paths))
+
+@lru_cache()
+def _load_object_files_with_identities(object_file_paths: Tuple[str, ...], identities: Tuple[Tuple[int, int, int], ...]):
+    # The identities are only used as part of the cache key.
+    del identities
+    return merge_object_files([load_object_file(object_file_path)
+                               for object_file_path in object_file_paths])
@@ -14,13 +14,14 @@
 import itertools
 import re
 import textwrap
-from typing import List, Tuple, Dict, Optional, Union, Callable, Iterator, Set
+from typing import List, Tuple, Dict, Optional, Union, Callable, Iterator, Set, Mapping
 
 import ast
 
 from _py2tmp.compiler.output_files import ObjectFileContent
 from _py2tmp.coverage import SourceBranch
 from _py2tmp.ir2 import ir2, get_free_variables, get_return_type
+from _py2tmp.utils import LazyMapping
 
 
 class Symbol:
@@ -74,7 +75,7 @@ class CompilationContext:
     def __init__(self,
                  symbol_table: SymbolTable,
                  custom_types_symbol_table: SymbolTable,
-                 external_ir2_symbols_by_name_by_module: Dict[str, Dict[str, Union[ir2.FunctionDefn, ir2.CustomType]]],
+                 external_ir2_symbols_by_name_by_module: Mapping[str, Dict[str, Union[ir2.FunctionDefn, ir2.CustomType]]],
                  filename: str,
                  source_lines: List[str],
                  identifier_generator: Iterator[str],
@@ -262,16 +263,21 @@ def _first_stmt_line(stmt: ast.AST):
     else:
         return stmt.lineno
 
+def _compute_public_ir2_symbols_by_name(module: ir2.Module):
+    return {elem.name: elem
+            for elem in itertools.chain(module.function_defns, module.custom_types)
+            if elem.name in module.public_names}
+
 def module_ast_to_ir2(module_ast_node: ast.Module,
                       filename: str,
                       source_lines: List[str],
                       identifier_generator: Iterator[str],
                       context_object_files: ObjectFileContent):
-    external_ir2_symbols_by_name_by_module = {module_name: {elem.name: elem
-                                                            for elem in itertools.chain(module_info.ir2_module.function_defns, module_info.ir2_module.custom_types)
-                                                            if elem.name in module_info.ir2_module.public_names}
-                                              for module_name, module_info in context_object_files.modules_by_name.items()
-                                              if module_info.ir2_module}
+    # The IR2 of a module is only decoded when importing from it.
+    external_ir2_symbols_by_name_by_module = LazyMapping([module_name
+                                                          for module_name, module_info in context_object_files.modules_by_name.items()
+                                                          if module_info.has_ir2_module],
+                                                         lambda module_name: _compute_public_ir2_symbols_by_name(context_object_files.modules_by_name[module_name].ir2_module))
     compilation_context = CompilationContext(SymbolTable(),
                                              SymbolTable(),
                                              external_ir2_symbols_by_name_by_module,
@@ -392,7 +398,7 @@ def _import_from_ast_to_ir2(ast_node: ast.ImportFrom, compilation_context: Compi
                                    'TMPPy only supports imports of the form "from some_module import some_symbol, some_other_symbol".')
 
     builtin_imports_by_module = {
-        'tmppy': ('Type', 'empty_list', 'empty_set', 'match'),
+        'tmppy': ('Type', 'empty_list', 'empty_set', 'match', 'unique'),
         'typing': ('List', 'Set', 'Callable'),
         'dataclasses': ('dataclass',),
     }
@@ -1665,6 +1671,20 @@ def expression_ast_to_ir2(ast_node: ast.AST,
                                                 check_var_reference,
                                                 match_lambda_argument_names,
                                                 current_stmt_line)
+    elif isinstance(ast_node, ast.Call) and isinstance(ast_node.func, ast.Name) and ast_node.func.id == 'range':
+        return int_range_expr_ast_to_ir2(ast_node,
+                                         compilation_context,
+                                         in_match_pattern,
+                                         check_var_reference,
+                                         match_lambda_argument_names,
+                                         current_stmt_line)
+    elif isinstance(ast_node, ast.Call) and isinstance(ast_node.func, ast.Name) and ast_node.func.id in ('sorted', 'unique'):
+        return sorted_or_unique_expr_ast_to_ir2(ast_node,
+                                                compilation_context,
+                                                in_match_pattern,
+                                                check_var_reference,
+                                                match_lambda_argument_names,
+                                                current_stmt_line)
     elif isinstance(ast_node, ast.Call) and isinstance(ast_node.func, ast.Name) and ast_node.func.id == 'all':
         return bool_iterable_all_expr_ast_to_ir2(ast_node,
                                                  compilation_context,
@@ -1806,6 +1826,13 @@ def expression_ast_to_ir2(ast_node: ast.AST,
                                                    check_var_reference,
                                                    match_lambda_argument_names,
                                                    current_stmt_line)
+    elif isinstance(ast_node, ast.Subscript) and isinstance(ast_node.ctx, ast.Load):
+        return subscript_expression_ast_to_ir2(ast_node,
+                                               compilation_context,
+                                               in_match_pattern,
+                                               check_var_reference,
+                                               match_lambda_argument_names,
+                                               current_stmt_line)
     elif isinstance(ast_node, ast.ListComp):
         return list_comprehension_ast_to_ir2(ast_node,
                                              compilation_context,
@@ -2166,6 +2193,146 @@ def int_iterable_sum_expr_ast_to_ir2(ast_node: ast.Call,
     else:
         return ir2.IntSetSumExpr(set_expr=arg_expr)
 
+def int_range_expr_ast_to_ir2(ast_node: ast.Call,
+                              compilation_context: CompilationContext,
+                              in_match_pattern: bool,
+                              check_var_reference: Callable[[ast.Name], None],
+                              match_lambda_argument_names: Set[str],
+                              current_stmt_line: int):
+    if in_match_pattern:
+        raise CompilationError(compilation_context, ast_node,
+                               'range() is not allowed in match patterns')
+
+    if ast_node.keywords:
+        raise CompilationError(compilation_context, ast_node.keywords[0].value, 'Keyword arguments are not supported.')
+    if len(ast_node.args) == 3:
+        raise CompilationError(compilation_context, ast_node.args[2], 'range() with a step is not supported.')
+    if len(ast_node.args) not in (1, 2):
+        raise CompilationError(compilation_context, ast_node, 'range() takes 1 or 2 arguments. Got: %s' % len(ast_node.args))
+
+    arg_exprs = []
+    for arg in ast_node.args:
+        arg_expr = expression_ast_to_ir2(arg,
+                                         compilation_context,
+                                         in_match_pattern,
+                                         check_var_reference,
+                                         match_lambda_argument_names,
+                                         current_stmt_line)
+        if arg_expr.expr_type != ir2.IntType():
+            raise CompilationError(compilation_context, arg,
+                                   'The arguments of range() must be ints, but this value has type %s.' % str(arg_expr.expr_type))
+        arg_exprs.append(arg_expr)
+
+    if len(arg_exprs) == 1:
+        [end_expr] = arg_exprs
+        return ir2.IntRangeExpr(begin_expr=ir2.IntLiteral(value=0), end_expr=end_expr)
+    else:
+        [begin_expr, end_expr] = arg_exprs
+        return ir2.IntRangeExpr(begin_expr=begin_expr, end_expr=end_expr)
+
+def sorted_or_unique_expr_ast_to_ir2(ast_node: ast.Call,
+                                     compilation_context: CompilationContext,
+                                     in_match_pattern: bool,
+                                     check_var_reference: Callable[[ast.Name], None],
+                                     match_lambda_argument_names: Set[str],
+                                     current_stmt_line: int):
+    assert isinstance(ast_node.func, ast.Name)
+    fun_name = ast_node.func.id
+    if in_match_pattern:
+        raise CompilationError(compilation_context, ast_node,
+                               '%s() is not allowed in match patterns' % fun_name)
+
+    for keyword_arg in ast_node.keywords:
+        if keyword_arg.arg != 'key':
+            raise CompilationError(compilation_context, keyword_arg.value,
+                                   'The only keyword argument supported in %s() is "key".' % fun_name)
+    if len(ast_node.args) != 1:
+        raise CompilationError(compilation_context, ast_node, '%s() takes 1 argument. Got: %s' % (fun_name, len(ast_node.args)))
+    [arg] = ast_node.args
+    arg_expr = expression_ast_to_ir2(arg,
+                                     compilation_context,
+                                     in_match_pattern,
+                                     check_var_reference,
+                                     match_lambda_argument_names,
+                                     current_stmt_line)
+    if not isinstance(arg_expr.expr_type, (ir2.ListType, ir2.SetType)):
+        raise CompilationError(compilation_context, arg,
+                               'The argument of %s() must be a list or a set. Got type: %s' % (fun_name, str(arg_expr.expr_type)))
+
+    if ast_node.keywords:
+        [keyword_arg] = ast_node.keywords
+        key_expr = expression_ast_to_ir2(keyword_arg.value,
+                                         compilation_context,
+                                         in_match_pattern,
+                                         check_var_reference,
+                                         match_lambda_argument_names,
+                                         current_stmt_line)
+        expected_key_type = ir2.FunctionType(argtypes=(arg_expr.expr_type.elem_type,),
+                                             argnames=None,
+                                             returns=ir2.IntType())
+        if key_expr.expr_type != expected_key_type:
+            raise CompilationError(compilation_context, keyword_arg.value,
+                                   'The key of %s() must have type %s. Got type: %s' % (
+                                       fun_name, str(expected_key_type), str(key_expr.expr_type)))
+    else:
+        key_expr = None
+        if not isinstance(arg_expr.expr_type.elem_type, ir2.IntType):
+            raise CompilationError(compilation_context, arg,
+                                   '%s() without a key can only be called on a List[int] or a Set[int]. Got type: %s' % (
+                                       fun_name, str(arg_expr.expr_type)))
+
+    if fun_name == 'sorted':
+        return ir2.ListSortedExpr(list_expr=arg_expr, key_expr=key_expr)
+    else:
+        return ir2.ListUniqueExpr(list_expr=arg_expr, key_expr=key_expr)
+
+def subscript_expression_ast_to_ir2(ast_node: ast.Subscript,
+                                    compilation_context: CompilationContext,
+                                    in_match_pattern: bool,
+                                    check_var_reference: Callable[[ast.Name], None],
+                                    match_lambda_argument_names: Set[str],
+                                    current_stmt_line: int):
+    if in_match_pattern:
+        raise CompilationError(compilation_context, ast_node,
+                               'Indexing and slicing are not allowed in match patterns')
+
+    list_expr = expression_ast_to_ir2(ast_node.value,
+                                      compilation_context,
+                                      in_match_pattern,
+                                      check_var_reference,
+                                      match_lambda_argument_names,
+                                      current_stmt_line)
+    if not isinstance(list_expr.expr_type, ir2.ListType):
+        raise CompilationError(compilation_context, ast_node.value,
+                               'Indexing and slicing are only supported for lists, but this value has type %s.' % str(list_expr.expr_type))
+
+    def int_expression_ast_to_ir2(int_ast_node: ast.AST):
+        expr = expression_ast_to_ir2(int_ast_node,
+                                     compilation_context,
+                                     in_match_pattern,
+                                     check_var_reference,
+                                     match_lambda_argument_names,
+                                     current_stmt_line)
+        if expr.expr_type != ir2.IntType():
+            raise CompilationError(compilation_context, int_ast_node,
+                                   'List indexes and slice bounds must be ints, but this value has type %s.' % str(expr.expr_type))
+        return expr
+
+    # Before Python 3.9 the index is wrapped in an ast.Index.
+    slice_ast_node = ast_node.slice.value if isinstance(ast_node.slice, ast.Index) else ast_node.slice
+    if isinstance(slice_ast_node, ast.Slice):
+        if slice_ast_node.step:
+            raise CompilationError(compilation_context, slice_ast_node.step, 'Slices with a step are not supported.')
+        # A missing bound is equivalent to the corresponding end of the list; the end bound is clamped to the length
+        # of the list so the largest int64 value works for any list.
+        begin_expr = int_expression_ast_to_ir2(slice_ast_node.lower) if slice_ast_node.lower else ir2.IntLiteral(value=0)
+        end_expr = int_expression_ast_to_ir2(slice_ast_node.upper) if slice_ast_node.upper else ir2.IntLiteral(value=2**63 - 1)
+        return ir2.ListSliceExpr(list_expr=list_expr, begin_expr=begin_expr, end_expr=end_expr)
+    elif isinstance(slice_ast_node, (ast.ExtSlice, ast.Tuple)):
+        raise CompilationError(compilation_context, ast_node, 'Multi-dimensional indexing is not supported.')
+    else:
+        return ir2.ListIndexExpr(list_expr=list_expr, index_expr=int_expression_ast_to_ir2(slice_ast_node))
+
 def bool_iterable_all_expr_ast_to_ir2(ast_node: ast.Call,
                                       compilation_context: CompilationContext,
                                       in_match_pattern: bool,
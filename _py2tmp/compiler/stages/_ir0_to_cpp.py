@@ -13,17 +13,57 @@
 # limitations under the License.
 import dataclasses
 from dataclasses import dataclass
-from typing import Iterator, Tuple, Union, Callable, Iterable, Optional
+from typing import Iterator, Tuple, Union, Callable, Iterable, Optional, Set, Mapping, FrozenSet
 
-from _py2tmp.ir0 import ir0, compute_template_dependency_graph, Visitor, is_expr_variadic
+from _py2tmp.compiler.output_files import SourceMap
+from _py2tmp.ir0 import ir0, compute_template_dependency_graph, Visitor, is_expr_variadic, NameReplacementTransformation, \
+    Transformation, ToplevelWriter as PlainToplevelWriter
 from _py2tmp.utils import clang_format, compute_condensation_in_topological_order
-from _py2tmp.cpp import Writer, ToplevelWriter, TemplateElemWriter, ExprWriter
+from _py2tmp.cpp import Writer, ToplevelWriter, TemplateElemWriter, ExprWriter, indent_template_body
+
+CPP_STANDARDS = ('c++11', 'c++14', 'c++17', 'c++20')
+CPP_COMPILERS = ('generic', 'gcc', 'clang', 'msvc')
+
+# The C++ standard and compiler that the generated code is meant for. The generated code only depends on features that
+# are also available in the older standards / other compilers when using the default target (C++11, any compiler);
+# newer targets allow using constructs that are cheaper to compile (e.g. fold expressions instead of recursive
+# templates, or compiler intrinsics instead of instantiating the std:: type traits).
+@dataclass(frozen=True)
+class CppTarget:
+    standard: str = 'c++11'
+    compiler: str = 'generic'
+
+    def __post_init__(self):
+        if self.standard not in CPP_STANDARDS:
+            raise ValueError('Unsupported C++ standard: %s (supported: %s)' % (self.standard, ', '.join(CPP_STANDARDS)))
+        if self.compiler not in CPP_COMPILERS:
+            raise ValueError('Unsupported C++ compiler: %s (supported: %s)' % (self.compiler, ', '.join(CPP_COMPILERS)))
+
+    @property
+    def supports_fold_expressions(self):
+        return CPP_STANDARDS.index(self.standard) >= CPP_STANDARDS.index('c++17')
+
+    @property
+    def supports_is_same_intrinsic(self):
+        return self.compiler in ('gcc', 'clang')
+
+    @property
+    def supports_is_base_of_intrinsic(self):
+        return self.compiler in ('gcc', 'clang', 'msvc')
 
 @dataclass(frozen=True)
 class Context:
     enclosing_function_defn_args: Tuple[ir0.TemplateArgDecl, ...]
     coverage_collection_enabled: bool
     writer: Writer
+    target: CppTarget = CppTarget()
+    short_circuit_bool_ops: bool = False
+    # Only set when generating a C++20 module interface unit (and only at namespace scope): the names that the module
+    # exports.
+    cpp20_module_exported_names: Optional[FrozenSet[str]] = None
+    # If True (and coverage_collection_enabled is True) the coverage markers are strings in the object file, instead of
+    # compiler warnings. See TmppyCoverageMarker in tmppy.h (this is only supported by GCC and Clang).
+    coverage_markers_in_object_file: bool = False
 
 def expr_to_cpp(expr: ir0.Expr,
                 context: Context) -> str:
@@ -99,10 +139,21 @@ def static_assert_to_cpp(assert_stmt: ir0.StaticAssert,
             static_assert({always_true_id}<{template_param}>::value && {cpp_meta_expr}, "{message}");
             '''.format(**locals()))
 
+def _char_literal_to_cpp(c: int):
+    if 32 <= c < 127 and chr(c) not in ('\'', '\\'):
+        return "'%s'" % chr(c)
+    return "'\\x%02x'" % c
+
 def no_op_stmt_to_cpp(stmt: ir0.NoOpStmt, context: Context):
     if context.coverage_collection_enabled:
         branch = stmt.source_branch
         message = f'<fruit-coverage-internal-marker file_name=\'{branch.file_name}\' source_line=\'{branch.source_line}\' dest_line=\'{branch.dest_line}\' />'
+        if context.coverage_markers_in_object_file:
+            marker_class = context.writer.new_id()
+            chars = ', '.join(_char_literal_to_cpp(c) for c in message.encode('utf-8'))
+            context.writer.write_template_body_elem('struct %s;' % marker_class)
+            context.writer.write_template_body_elem('static_assert(tmppyCoverageMarker<%s, %s>(), "");' % (marker_class, chars))
+            return
         fun = context.writer.new_id()
         var = context.writer.new_id()
         context.writer.write_template_body_elem('[[deprecated("%s")]] constexpr int %s() { return 0; }' % (message, fun))
@@ -119,8 +170,15 @@ def constant_def_to_cpp(constant_def: ir0.ConstantDef,
 
     name = constant_def.name
     cpp_meta_expr = expr_to_cpp(constant_def.expr, context)
+    if context.cpp20_module_exported_names is None:
+        specifiers = 'static constexpr'
+    elif name in context.cpp20_module_exported_names:
+        specifiers = 'export inline constexpr'
+    else:
+        # Not static, since exported templates can't reference names with internal linkage.
+        specifiers = 'inline constexpr'
     context.writer.write_template_body_elem('''\
-        static constexpr {type_cpp} {name} = {cpp_meta_expr};
+        {specifiers} {type_cpp} {name} = {cpp_meta_expr};
         '''.format(**locals()))
 
 def typedef_to_cpp(typedef: ir0.Typedef,
@@ -149,6 +207,8 @@ def typedef_to_cpp(typedef: ir0.Typedef,
         description = '// ' + typedef.description + '\n'
     else:
         description = ''
+    if context.cpp20_module_exported_names is not None and name in context.cpp20_module_exported_names:
+        description += 'export '
 
     if not typedef.template_args:
         context.writer.write_template_body_elem('''\
@@ -186,7 +246,10 @@ def template_specialization_to_cpp(specialization: ir0.TemplateSpecialization,
                                    cxx_name: str,
                                    context: Context):
     template_elem_writer = context.writer.create_child_writer()
-    template_body_context = dataclasses.replace(context, enclosing_function_defn_args=specialization.args, writer=template_elem_writer)
+    template_body_context = dataclasses.replace(context,
+                                                enclosing_function_defn_args=specialization.args,
+                                                writer=template_elem_writer,
+                                                cpp20_module_exported_names=None)
     for elem in specialization.body:
         if isinstance(elem, ir0.StaticAssert):
             static_assert_to_cpp(elem, template_body_context)
@@ -201,7 +264,7 @@ def template_specialization_to_cpp(specialization: ir0.TemplateSpecialization,
         else:
             raise NotImplementedError('Unsupported element: ' + str(elem))
 
-    asserts_and_assignments_str = ''.join(template_elem_writer.strings)
+    asserts_and_assignments_str = indent_template_body(template_elem_writer.strings)
     template_args = ', '.join(template_arg_decl_to_cpp(arg)
                               for arg in specialization.args)
     if specialization.patterns is not None:
@@ -210,27 +273,27 @@ def template_specialization_to_cpp(specialization: ir0.TemplateSpecialization,
             patterns_str = ', '.join(expr_to_cpp(pattern, dataclasses.replace(template_body_context, writer=expr_writer))
                                      for pattern in specialization.patterns)
         assert not expr_writer.strings
-        context.writer.write_template_body_elem('''\
-            template <{template_args}>
-            struct {cxx_name}<{patterns_str}> {{
-              {asserts_and_assignments_str}
-            }};
-            '''.format(**locals()))
+        context.writer.write_template_body_elem('template <{template_args}>\n'
+                                                'struct {cxx_name}<{patterns_str}> {{\n'
+                                                '{asserts_and_assignments_str}'
+                                                '}};\n'.format(**locals()))
     else:
-        context.writer.write_template_body_elem('''\
-            template <{template_args}>
-            struct {cxx_name} {{
-              {asserts_and_assignments_str}
-            }};
-            '''.format(**locals()))
+        context.writer.write_template_body_elem('template <{template_args}>\n'
+                                                'struct {cxx_name} {{\n'
+                                                '{asserts_and_assignments_str}'
+                                                '}};\n'.format(**locals()))
 
 def template_defn_to_cpp_forward_decl(template_defn: ir0.TemplateDefn,
                                       context: Context):
     template_name = template_defn.name
     template_args = ', '.join(template_arg_decl_to_cpp(arg)
                               for arg in template_defn.args)
+    if context.cpp20_module_exported_names is not None and template_name in context.cpp20_module_exported_names:
+        export = 'export '
+    else:
+        export = ''
     context.writer.write_toplevel_elem('''\
-        template <{template_args}>
+        {export}template <{template_args}>
         struct {template_name};
         '''.format(**locals()))
 
@@ -258,7 +321,7 @@ def template_defn_to_cpp_simple(template_defn: ir0.TemplateDefn,
                       coverage_collection_enabled=False,
                       writer=writer)
     template_defn_to_cpp(template_defn, context)
-    return clang_format(''.join(writer.strings))
+    return ''.join(writer.strings)
 
 def toplevel_elem_to_cpp_simple(elem: Union[ir0.StaticAssert, ir0.ConstantDef, ir0.Typedef],
                                 identifier_generator: Iterator[str]):
@@ -267,7 +330,7 @@ def toplevel_elem_to_cpp_simple(elem: Union[ir0.StaticAssert, ir0.ConstantDef, i
                       coverage_collection_enabled=False,
                       writer=writer)
     toplevel_elem_to_cpp(elem, context)
-    return clang_format(''.join(writer.strings))
+    return ''.join(writer.strings)
 
 def literal_to_cpp(literal: ir0.Literal):
     if isinstance(literal.value, bool):
@@ -296,11 +359,126 @@ def int64_binary_op_expr_to_cpp(expr: ir0.Int64BinaryOpExpr,
 
 def bool_binary_op_expr_to_cpp(expr: ir0.BoolBinaryOpExpr,
                                context: Context):
+    if context.short_circuit_bool_ops and not (isinstance(context.writer, ExprWriter) and context.writer.is_in_pattern):
+        short_circuit_cpp = _short_circuit_bool_binary_op_expr_to_cpp(expr, context)
+        if short_circuit_cpp is not None:
+            return short_circuit_cpp
+
     return '(%s) %s (%s)' % (
         expr_to_cpp(expr.lhs, context),
         expr.op,
         expr_to_cpp(expr.rhs, context))
 
+_LIST_LITERAL_BY_ELEM_KIND = {
+    ir0.ExprKind.BOOL: 'BoolList',
+    ir0.ExprKind.INT64: 'Int64List',
+    ir0.ExprKind.TYPE: 'List',
+}
+
+_CHEAP_TEMPLATE_NAMES = ('std::is_same', 'std::is_base_of', 'AlwaysTrueFromBool', 'AlwaysTrueFromInt64',
+                         'AlwaysTrueFromType')
+
+def _is_cheap_template_instantiation(expr: ir0.TemplateInstantiation):
+    return (isinstance(expr.template_expr, ir0.AtomicTypeLiteral)
+            and (expr.template_expr.cpp_type in _CHEAP_TEMPLATE_NAMES
+                 or expr.template_expr.cpp_type.startswith('Select1st')))
+
+def _may_be_expensive_to_evaluate(expr: ir0.Expr):
+    # A rough approximation: the expr is considered cheap if it doesn't instantiate templates (except for a few simple
+    # ones) and it doesn't do per-element work on a variadic pack.
+    return any(isinstance(subexpr, ir0.VariadicTypeExpansion)
+               or (isinstance(subexpr, ir0.ClassMemberAccess)
+                   and isinstance(subexpr.inner_expr, ir0.TemplateInstantiation)
+                   and not _is_cheap_template_instantiation(subexpr.inner_expr))
+               for subexpr in expr.transitive_subexpressions)
+
+def _collect_variadic_var_names(expr: ir0.Expr, is_in_expansion: bool, expanded_var_names: Set[str], unexpanded_var_names: Set[str]):
+    if isinstance(expr, ir0.AtomicTypeLiteral):
+        if expr.is_local and expr.is_variadic:
+            (expanded_var_names if is_in_expansion else unexpanded_var_names).add(expr.cpp_type)
+    elif isinstance(expr, ir0.VariadicTypeExpansion):
+        _collect_variadic_var_names(expr.inner_expr, True, expanded_var_names, unexpanded_var_names)
+    else:
+        for subexpr in expr.direct_subexpressions:
+            _collect_variadic_var_names(subexpr, is_in_expansion, expanded_var_names, unexpanded_var_names)
+
+# Emits "A && B" as LazyBoolAnd<A, BHolder>::value (and similarly for "||"), where BHolder is a class with a "value"
+# member equal to B. As long as A determines the result BHolder is not instantiated, while with "A && B" the C++
+# compiler instantiates all the templates in both operands.
+# Returns None if expr must be emitted as usual (e.g. if B is cheap to evaluate anyway).
+def _short_circuit_bool_binary_op_expr_to_cpp(expr: ir0.BoolBinaryOpExpr, context: Context) -> Optional[str]:
+    rhs = expr.rhs
+    if not _may_be_expensive_to_evaluate(rhs):
+        return None
+    lazy_template_name = {
+        '&&': 'LazyBoolAnd',
+        '||': 'LazyBoolOr',
+    }[expr.op]
+
+    if (isinstance(rhs, ir0.ClassMemberAccess)
+            and rhs.member_name == 'value'
+            and isinstance(rhs.inner_expr, ir0.TemplateInstantiation)
+            and isinstance(rhs.inner_expr.template_expr, ir0.AtomicTypeLiteral)
+            and not any(_may_be_expensive_to_evaluate(arg) for arg in rhs.inner_expr.args)):
+        # The instantiation already holds the value of B: we can use it directly, since it's only instantiated when
+        # accessing its "value" member.
+        rhs_holder_cpp = template_instantiation_to_cpp(rhs.inner_expr, context)
+    else:
+        # We need a helper template holding the value of B. Its params are the variables referenced by B (renamed,
+        # since a template param can't shadow a param of the enclosing template). Variadic vars are passed wrapped in a
+        # list, since a template can't have more than 1 variadic param.
+        expanded_var_names = set()
+        unexpanded_var_names = set()
+        _collect_variadic_var_names(rhs, False, expanded_var_names, unexpanded_var_names)
+        free_vars = sorted(rhs.free_vars, key=lambda var: var.cpp_type)
+        if (not free_vars
+                or unexpanded_var_names
+                or any(var.is_variadic and var.expr_type.kind not in _LIST_LITERAL_BY_ELEM_KIND for var in free_vars)):
+            # Without params the C++ compiler would evaluate the body of the helper template eagerly.
+            # Vars expanded outside of B would have to be forwarded one element at a time, we don't do that for now.
+            return None
+
+        helper_name = context.writer.new_id()
+        helper_arg_decls = tuple(ir0.TemplateArgDecl(expr_type=var.expr_type,
+                                                     name=context.writer.new_id(),
+                                                     is_variadic=var.is_variadic)
+                                 for var in free_vars)
+        renamed_rhs = NameReplacementTransformation({var.cpp_type: arg_decl.name
+                                                     for var, arg_decl in zip(free_vars, helper_arg_decls)}).transform_expr(rhs)
+
+        helper_body_writer = TemplateElemWriter(context.writer.toplevel_writer)
+        helper_context = dataclasses.replace(context,
+                                             enclosing_function_defn_args=helper_arg_decls,
+                                             writer=helper_body_writer)
+        constant_def_to_cpp(ir0.ConstantDef(name='value', expr=renamed_rhs), helper_context)
+        helper_body_str = indent_template_body(helper_body_writer.strings)
+        helper_specialization_params = ', '.join(template_arg_decl_to_cpp(arg_decl) for arg_decl in helper_arg_decls)
+        if any(var.is_variadic for var in free_vars):
+            helper_main_definition_params = ', '.join('typename' if var.is_variadic else _type_to_template_param_declaration(var.expr_type, is_variadic=False)
+                                                      for var in free_vars)
+            helper_patterns = ', '.join('%s<%s...>' % (_LIST_LITERAL_BY_ELEM_KIND[arg_decl.expr_type.kind], arg_decl.name)
+                                        if arg_decl.is_variadic else arg_decl.name
+                                        for arg_decl in helper_arg_decls)
+            context.writer.write_template_body_elem('template <{helper_main_definition_params}>\n'
+                                                    'struct {helper_name};\n'
+                                                    'template <{helper_specialization_params}>\n'
+                                                    'struct {helper_name}<{helper_patterns}> {{\n'
+                                                    '{helper_body_str}'
+                                                    '}};\n'.format(**locals()))
+        else:
+            context.writer.write_template_body_elem('template <{helper_specialization_params}>\n'
+                                                    'struct {helper_name} {{\n'
+                                                    '{helper_body_str}'
+                                                    '}};\n'.format(**locals()))
+
+        helper_args_cpp = ', '.join('%s<%s...>' % (_LIST_LITERAL_BY_ELEM_KIND[var.expr_type.kind], var.cpp_type)
+                                    if var.is_variadic else var.cpp_type
+                                    for var in free_vars)
+        rhs_holder_cpp = '{helper_name}<{helper_args_cpp}>'.format(**locals())
+
+    lhs_cpp = expr_to_cpp(expr.lhs, context)
+    return '{lazy_template_name}<({lhs_cpp}), {rhs_holder_cpp}>::value'.format(**locals())
+
 def _select_best_arg_decl_for_select1st(args: Tuple[ir0.TemplateArgDecl, ...]):
     for arg in args:
         if not isinstance(arg.expr_type, ir0.TemplateType):
@@ -376,15 +554,13 @@ def template_instantiation_to_cpp(instantiation_expr: ir0.TemplateInstantiation,
                                                                                               is_variadic=is_variadic))
                     typedef_to_cpp(select1st_variant_body, select1st_variant_context)
 
-                select1st_variant_body_str = ''.join(select1st_variant_body_writer.strings)
+                select1st_variant_body_str = indent_template_body(select1st_variant_body_writer.strings)
 
-                context.writer.write_template_body_elem('''
-                    // Custom Select1st* template
-                    template <{template_param_decl1} {forwarded_param_id}, {template_param_decl2}>
-                    struct {select1st_variant} {{
-                      {select1st_variant_body_str}
-                    }};
-                    '''.format(**locals()))
+                context.writer.write_template_body_elem('// Custom Select1st* template\n'
+                                                        'template <{template_param_decl1} {forwarded_param_id}, {template_param_decl2}>\n'
+                                                        'struct {select1st_variant} {{\n'
+                                                        '{select1st_variant_body_str}'
+                                                        '}};\n'.format(**locals()))
 
             select1st_type = ir0.TemplateType(args=(
                 ir0.TemplateArgType(expr_type=arg_to_replace.expr_type, is_variadic=is_variadic),
@@ -420,6 +596,10 @@ def class_member_access_to_cpp(expr: ir0.ClassMemberAccess,
                                context: Context,
                                omit_typename: bool = False,
                                parent_expr_is_template_instantiation: bool = False):
+    target_specific_cpp = _class_member_access_to_target_specific_cpp(expr, context, omit_typename)
+    if target_specific_cpp is not None:
+        return target_specific_cpp
+
     if isinstance(expr.inner_expr, ir0.TemplateInstantiation):
         cpp_fun = template_instantiation_to_cpp(expr.inner_expr, context, omit_typename=True)
     elif isinstance(expr.inner_expr, ir0.ClassMemberAccess):
@@ -444,6 +624,141 @@ def class_member_access_to_cpp(expr: ir0.ClassMemberAccess,
         raise NotImplementedError('Member type: %s' % expr.expr_type.__class__.__name__)
     return cpp_str_template.format(**locals())
 
+def _get_variadic_list_elem(list_expr: ir0.Expr, list_template_name: str) -> Optional[ir0.VariadicTypeExpansion]:
+    # Returns the expansion X if list_expr is e.g. BoolList<X...>, otherwise None.
+    if (isinstance(list_expr, ir0.TemplateInstantiation)
+            and isinstance(list_expr.template_expr, ir0.AtomicTypeLiteral)
+            and list_expr.template_expr.cpp_type == list_template_name
+            and len(list_expr.args) == 1
+            and isinstance(list_expr.args[0], ir0.VariadicTypeExpansion)):
+        return list_expr.args[0]
+    return None
+
+def _get_select1st_constant(expr: ir0.Expr) -> Optional[ir0.Literal]:
+    # Returns b if expr is e.g. Select1stBoolType<b, T>::value, with b a literal. Otherwise returns None.
+    if (isinstance(expr, ir0.ClassMemberAccess)
+            and expr.member_name == 'value'
+            and isinstance(expr.inner_expr, ir0.TemplateInstantiation)
+            and isinstance(expr.inner_expr.template_expr, ir0.AtomicTypeLiteral)
+            and expr.inner_expr.template_expr.cpp_type.startswith('Select1st')
+            and isinstance(expr.inner_expr.args[0], ir0.Literal)):
+        return expr.inner_expr.args[0]
+    return None
+
+# The list template of the last arg of these builtins, and the template in tmppy.h that wraps each element of the list
+# in the fold expression emitted for them (see FoldAcc in tmppy.h).
+_LIST_TEMPLATE_NAME_AND_FOLD_STEP_TEMPLATE_NAME_BY_FOLD_TEMPLATE_NAME = {
+    'FoldBoolsToType': ('BoolList', 'BoolFoldStep'),
+    'FoldInt64sToType': ('Int64List', 'Int64FoldStep'),
+    'FoldTypesToType': ('List', 'TypeFoldStep'),
+}
+
+def _shift_operator_fold_to_cpp(acc_cpp: str,
+                                elems: Tuple[ir0.Expr, ...],
+                                elem_cpp_to_fold_step_cpp: Callable[[str], str],
+                                context: Context):
+    # Applies the operator<< overloads in tmppy.h to FoldAcc<acc_cpp>{} and to (the fold step of) each element, from left
+    # to right. Each pack expansion in elems becomes a fold expression, that starts from the result of the previous ones.
+    cpp = 'FoldAcc<{acc_cpp}>{{}}'.format(**locals())
+    for elem in elems:
+        if isinstance(elem, ir0.VariadicTypeExpansion):
+            fold_step_cpp = elem_cpp_to_fold_step_cpp(expr_to_cpp(elem.inner_expr, context))
+            cpp = '({cpp} << ... << {fold_step_cpp})'.format(**locals())
+        else:
+            fold_step_cpp = elem_cpp_to_fold_step_cpp(expr_to_cpp(elem, context))
+            cpp = '({cpp} << {fold_step_cpp})'.format(**locals())
+    return 'decltype({cpp})::type'.format(**locals())
+
+# Some builtins (and the code generated for all(), any() and sum()) are emitted more cheaply when the target allows
+# it. Returns None if expr must be emitted as usual.
+def _class_member_access_to_target_specific_cpp(expr: ir0.ClassMemberAccess,
+                                                context: Context,
+                                                omit_typename: bool) -> Optional[str]:
+    if (not isinstance(expr.inner_expr, ir0.TemplateInstantiation)
+            or not isinstance(expr.inner_expr.template_expr, ir0.AtomicTypeLiteral)
+            or (isinstance(context.writer, ExprWriter) and context.writer.is_in_pattern)):
+        return None
+    template_name = expr.inner_expr.template_expr.cpp_type
+    args = expr.inner_expr.args
+    target = context.target
+    maybe_typename = '' if omit_typename else 'typename '
+
+    if expr.member_name == 'type' and target.supports_fold_expressions:
+        # These would otherwise instantiate FoldTypesToType (or similar) recursively on the halves of the list.
+        if template_name == 'GetFirstError':
+            fold_cpp = _shift_operator_fold_to_cpp('void',
+                                                   args,
+                                                   lambda elem_cpp: 'GetFirstErrorFoldStep<%s>{}' % elem_cpp,
+                                                   context)
+            return maybe_typename + fold_cpp
+        if template_name in _LIST_TEMPLATE_NAME_AND_FOLD_STEP_TEMPLATE_NAME_BY_FOLD_TEMPLATE_NAME and len(args) == 3:
+            list_template_name, fold_step_template_name = _LIST_TEMPLATE_NAME_AND_FOLD_STEP_TEMPLATE_NAME_BY_FOLD_TEMPLATE_NAME[template_name]
+            acc, f, l = args
+            if (isinstance(l, ir0.TemplateInstantiation)
+                    and isinstance(l.template_expr, ir0.AtomicTypeLiteral)
+                    and l.template_expr.cpp_type == list_template_name):
+                f_cpp = expr_to_cpp(f, context)
+                if list_template_name == 'List':
+                    elem_cpp_to_fold_step_cpp = lambda elem_cpp: '%s<%s, %s>{}' % (fold_step_template_name, f_cpp, elem_cpp)
+                else:
+                    elem_cpp_to_fold_step_cpp = lambda elem_cpp: '%s<%s, (%s)>{}' % (fold_step_template_name, f_cpp, elem_cpp)
+                fold_cpp = _shift_operator_fold_to_cpp(expr_to_cpp(acc, context), l.args, elem_cpp_to_fold_step_cpp, context)
+                return maybe_typename + fold_cpp
+
+    if expr.inner_expr.instantiation_might_trigger_static_asserts or expr.member_name != 'value':
+        return None
+
+    if template_name == 'std::is_same' and len(args) == 2 and not any(isinstance(arg, ir0.VariadicTypeExpansion) for arg in args):
+        if target.supports_fold_expressions:
+            # all([...]) and any([...]) are converted to e.g.
+            # std::is_same<BoolList<(f(x))...>, BoolList<(Select1stBoolInt64<true, x>::value)...>>::value
+            # that can be replaced by a fold expression, since both lists expand the same pack. The Select1st* is
+            # only there to expand the pack, so it's not instantiated.
+            lhs_elem = _get_variadic_list_elem(args[0], 'BoolList')
+            rhs_elem = _get_variadic_list_elem(args[1], 'BoolList')
+            constant = _get_select1st_constant(rhs_elem.inner_expr) if rhs_elem is not None else None
+            if lhs_elem is not None and constant is not None and isinstance(constant.value, bool):
+                lhs_pack_names = {var.cpp_type for var in lhs_elem.inner_expr.free_vars if var.is_variadic}
+                rhs_pack_names = {var.cpp_type for var in rhs_elem.inner_expr.free_vars if var.is_variadic}
+                if lhs_pack_names & rhs_pack_names:
+                    lhs_elem_cpp = expr_to_cpp(lhs_elem.inner_expr, context)
+                    if constant.value:
+                        return '(true && ... && ({lhs_elem_cpp}))'.format(**locals())
+                    else:
+                        return '!(false || ... || ({lhs_elem_cpp}))'.format(**locals())
+        if target.supports_is_same_intrinsic:
+            lhs_cpp = expr_to_cpp(args[0], context)
+            rhs_cpp = expr_to_cpp(args[1], context)
+            # See TMPPY_IS_SAME in tmppy.h, this is __is_same or __is_same_as depending on the compiler version.
+            return 'TMPPY_IS_SAME({lhs_cpp}, {rhs_cpp})'.format(**locals())
+
+    if (template_name == 'std::is_base_of' and len(args) == 2 and not any(isinstance(arg, ir0.VariadicTypeExpansion) for arg in args)
+            and target.supports_is_base_of_intrinsic):
+        base_cpp = expr_to_cpp(args[0], context)
+        derived_cpp = expr_to_cpp(args[1], context)
+        return '__is_base_of({base_cpp}, {derived_cpp})'.format(**locals())
+
+    if template_name == 'Int64ListSum' and len(args) == 1 and target.supports_fold_expressions:
+        # This would otherwise instantiate Int64ListSum recursively on the halves of the list.
+        if not (isinstance(args[0], ir0.TemplateInstantiation)
+                and isinstance(args[0].template_expr, ir0.AtomicTypeLiteral)
+                and args[0].template_expr.cpp_type == 'Int64List'):
+            # The elements are not known here, so they're summed by Int64ListFoldSum (in tmppy.h).
+            list_cpp = expr_to_cpp(args[0], context)
+            return 'Int64ListFoldSum<{list_cpp}>::value'.format(**locals())
+        summands = []
+        for elem in args[0].args:
+            elem_cpp = expr_to_cpp(elem.inner_expr if isinstance(elem, ir0.VariadicTypeExpansion) else elem, context)
+            if isinstance(elem, ir0.VariadicTypeExpansion):
+                summands.append('(0LL + ... + ({elem_cpp}))'.format(**locals()))
+            else:
+                summands.append('({elem_cpp})'.format(**locals()))
+        if not summands:
+            return '0LL'
+        return '(%s)' % ' + '.join(summands)
+
+    return None
+
 def variadic_type_expansion_to_cpp(expr: ir0.VariadicTypeExpansion,
                                    context: Context):
     cpp = expr_to_cpp(expr.inner_expr, context)
@@ -549,12 +864,54 @@ def compute_template_defns_that_must_come_before(template_defn: ir0.TemplateDefn
             for specialization in specializations
             for template_name in compute_template_defns_that_must_come_before_specialization(specialization)}
 
+class _InlineToplevelDefnsTransformation(Transformation):
+    def __init__(self, toplevel_defn_by_name: Mapping[str, Union[ir0.ConstantDef, ir0.Typedef]]):
+        super().__init__()
+        self.toplevel_defn_by_name = toplevel_defn_by_name
+
+    def transform_type_literal(self, type_literal: ir0.AtomicTypeLiteral):
+        toplevel_defn = self.toplevel_defn_by_name.get(type_literal.cpp_type) if not type_literal.is_local else None
+        if toplevel_defn is not None:
+            return self.transform_expr(toplevel_defn.expr)
+        return type_literal
+
+def _inline_toplevel_defns(template_defn: ir0.TemplateDefn,
+                           toplevel_defn_by_name: Mapping[str, Union[ir0.ConstantDef, ir0.Typedef]]):
+    transformation = _InlineToplevelDefnsTransformation(toplevel_defn_by_name)
+    writer = PlainToplevelWriter()
+    with transformation.set_writer(writer):
+        transformation.transform_template_defn(template_defn)
+    [template_defn] = writer.template_defns
+    return template_defn
+
+# The toplevel constants/typedefs referenced by the templates (e.g. the ones introduced by
+# eliminate_common_closed_subexpressions_across_templates()) are emitted just before the first template that references
+# them. Returns the names of the toplevel elems emitted here.
 def template_defns_to_cpp(template_defns: Iterable[ir0.TemplateDefn],
-                          context: Context):
+                          context: Context,
+                          toplevel_defn_by_name: Mapping[str, Union[ir0.ConstantDef, ir0.Typedef]] = {}) -> Set[str]:
     template_defn_by_template_name = {elem.name: elem
                                       for elem in template_defns}
-
-    template_dependency_graph = compute_template_dependency_graph(template_defns, template_defn_by_template_name)
+    emitted_toplevel_defn_names = set()
+
+    # The templates used to compute the order, where the references to the toplevel constants/typedefs are replaced by
+    # their definitions (the templates referenced there also need to come before).
+    ordering_template_defn_by_template_name = {name: (_inline_toplevel_defns(template_defn, toplevel_defn_by_name)
+                                                      if any(identifier in toplevel_defn_by_name
+                                                             for identifier in template_defn.referenced_identifiers)
+                                                      else template_defn)
+                                               for name, template_defn in template_defn_by_template_name.items()}
+
+    def emit_referenced_toplevel_defns(elem: Union[ir0.TemplateDefn, ir0.ConstantDef, ir0.Typedef]):
+        for identifier in elem.referenced_identifiers:
+            toplevel_defn = toplevel_defn_by_name.get(identifier)
+            if toplevel_defn is not None and identifier not in emitted_toplevel_defn_names:
+                emitted_toplevel_defn_names.add(identifier)
+                emit_referenced_toplevel_defns(toplevel_defn)
+                toplevel_elem_to_cpp(toplevel_defn, context)
+
+    template_dependency_graph = compute_template_dependency_graph(ordering_template_defn_by_template_name.values(),
+                                                                  template_defn_by_template_name)
     if template_dependency_graph.number_of_nodes():
         template_dependency_graph_condensed = compute_condensation_in_topological_order(template_dependency_graph)
     else:
@@ -575,10 +932,13 @@ def template_defns_to_cpp(template_defns: Iterable[ir0.TemplateDefn],
                 # There's no loop here, but this template has only specializations and no main definition, so we need the
                 # forward declaration anyway.
                 template_defn_to_cpp_forward_decl(template_defn, context)
+            elif context.cpp20_module_exported_names is not None and template_defn.name in context.cpp20_module_exported_names:
+                # Only the first declaration can be exported, so an exported template always gets a forward declaration.
+                template_defn_to_cpp_forward_decl(template_defn, context)
 
         template_defns_that_must_be_last = set()
         for template_defn in connected_component:
-            template_order_dependencies = compute_template_defns_that_must_come_before(template_defn)
+            template_order_dependencies = compute_template_defns_that_must_come_before(ordering_template_defn_by_template_name[template_defn.name])
             if any(template_name in connected_component_names
                    for template_name in template_order_dependencies):
                 # This doesn't only need to be before the ones it immediately references, it really needs to be last
@@ -589,18 +949,22 @@ def template_defns_to_cpp(template_defns: Iterable[ir0.TemplateDefn],
 
         for template_defn in connected_component:
             if template_defn.name not in template_defns_that_must_be_last:
+                emit_referenced_toplevel_defns(template_defn)
                 template_defn_to_cpp(template_defn, context)
 
         for template_defn in connected_component:
             if template_defn.name in template_defns_that_must_be_last:
-                specializations = list(template_defn.specializations or tuple())
+                emit_referenced_toplevel_defns(template_defn)
+                ordering_template_defn = ordering_template_defn_by_template_name[template_defn.name]
+                specializations = list(zip(template_defn.specializations or tuple(),
+                                           ordering_template_defn.specializations or tuple()))
                 if template_defn.main_definition:
-                    specializations.append(template_defn.main_definition)
+                    specializations.append((template_defn.main_definition, ordering_template_defn.main_definition))
 
                 last_specialization: Optional[ir0.TemplateSpecialization] = None
-                for specialization in specializations:
+                for specialization, ordering_specialization in specializations:
                     if any(template_name in connected_component_names
-                           for template_name in compute_template_defns_that_must_come_before_specialization(specialization)):
+                           for template_name in compute_template_defns_that_must_come_before_specialization(ordering_specialization)):
                         assert last_specialization is None, 'Found multiple specializations of ' + template_defn.name + ' that must appear before each other: ' + ', '.join(template_defns_that_must_be_last)
                         last_specialization = specialization
                     else:
@@ -617,22 +981,61 @@ def template_defns_to_cpp(template_defns: Iterable[ir0.TemplateDefn],
                                                    cxx_name=template_defn.name,
                                                    context=context)
 
-def header_to_cpp(header: ir0.Header, identifier_generator: Iterator[str], coverage_collection_enabled: bool):
+    return emitted_toplevel_defn_names
+
+# The generated code is already indented consistently, so clang-format is only worth running on output meant to be
+# read by humans (e.g. the final header), not e.g. on the debugging output generated at every optimization step.
+# If source_map is specified, the templates in the generated code are added to it.
+def header_to_cpp(header: ir0.Header,
+                  identifier_generator: Iterator[str],
+                  coverage_collection_enabled: bool,
+                  use_clang_format: bool = False,
+                  source_map: Optional[SourceMap] = None,
+                  target: CppTarget = CppTarget(),
+                  short_circuit_bool_ops: bool = False,
+                  cpp20_module_name: Optional[str] = None,
+                  coverage_markers_in_object_file: bool = False):
     writer = ToplevelWriter(identifier_generator)
-    writer.write_toplevel_elem('''\
-        #include <tmppy/tmppy.h>
-        #include <tuple>
-        #include <type_traits>
-        ''')
+    if cpp20_module_name is None:
+        writer.write_toplevel_elem('''\
+            #include <tmppy/tmppy.h>
+            #include <tuple>
+            #include <type_traits>
+            ''')
+        cpp20_module_exported_names = None
+    else:
+        # A module interface unit, where the includes go in the global module fragment and only the public names are
+        # exported.
+        writer.write_toplevel_elem('''\
+            module;
+            #include <tmppy/tmppy.h>
+            #include <tuple>
+            #include <type_traits>
+            export module {cpp20_module_name};
+            '''.format(**locals()))
+        cpp20_module_exported_names = frozenset(header.public_names)
     context = Context(enclosing_function_defn_args=(),
                       coverage_collection_enabled=coverage_collection_enabled,
-                      writer=writer)
+                      writer=writer,
+                      target=target,
+                      short_circuit_bool_ops=short_circuit_bool_ops,
+                      cpp20_module_exported_names=cpp20_module_exported_names,
+                      coverage_markers_in_object_file=coverage_markers_in_object_file)
 
-    template_defns_to_cpp(header.template_defns, context)
+    toplevel_defn_by_name = {elem.name: elem
+                             for elem in header.toplevel_content
+                             if isinstance(elem, (ir0.ConstantDef, ir0.Typedef))}
+    emitted_toplevel_defn_names = template_defns_to_cpp(header.template_defns, context, toplevel_defn_by_name)
 
     for elem in header.toplevel_content:
-        toplevel_elem_to_cpp(elem, context)
-    return clang_format(''.join(writer.strings))
+        if not (isinstance(elem, (ir0.ConstantDef, ir0.Typedef)) and elem.name in emitted_toplevel_defn_names):
+            toplevel_elem_to_cpp(elem, context)
+    cpp_source = ''.join(writer.strings)
+    if use_clang_format:
+        cpp_source = clang_format(cpp_source)
+    if source_map is not None:
+        source_map.add_header(header, cpp_source)
+    return cpp_source
 
 def type_expr_to_cpp(expr: ir0.Expr,
                      context: Context):
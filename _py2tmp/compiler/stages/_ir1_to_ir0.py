@@ -162,6 +162,8 @@ def expr_to_ir0(expr: ir1.Expr, writer: Writer) -> Tuple[Optional[ir0.Expr], Opt
         return equality_comparison_to_ir0(expr, writer)
     elif isinstance(expr, ir1.IsInListExpr):
         return is_in_list_expr_to_ir0(expr, writer)
+    elif isinstance(expr, ir1.IsInSetExpr):
+        return is_in_set_expr_to_ir0(expr, writer)
     elif isinstance(expr, ir1.AttributeAccessExpr):
         return attribute_access_expr_to_ir0(expr)
     elif isinstance(expr, ir1.NotExpr):
@@ -200,6 +202,16 @@ def expr_to_ir0(expr: ir1.Expr, writer: Writer) -> Tuple[Optional[ir0.Expr], Opt
         return bool_list_any_expr_to_ir0(expr, writer), None
     elif isinstance(expr, ir1.ListConcatExpr):
         return list_concat_expr_to_ir0(expr, writer), None
+    elif isinstance(expr, ir1.ListIndexExpr):
+        return list_index_expr_to_ir0(expr, writer), None
+    elif isinstance(expr, ir1.ListSliceExpr):
+        return list_slice_expr_to_ir0(expr, writer), None
+    elif isinstance(expr, ir1.IntRangeExpr):
+        return int_range_expr_to_ir0(expr, writer), None
+    elif isinstance(expr, ir1.ListSortByKeysExpr):
+        return list_sort_by_keys_expr_to_ir0(expr, writer), None
+    elif isinstance(expr, ir1.ListUniqueByKeysExpr):
+        return list_unique_by_keys_expr_to_ir0(expr, writer), None
     elif isinstance(expr, ir1.TemplateInstantiationPatternExpr):
         return template_instantiation_pattern_expr_to_ir0(expr, writer), None
     elif isinstance(expr, ir1.SetToListExpr):
@@ -577,6 +589,19 @@ def is_in_list_expr_to_ir0(expr: ir1.IsInListExpr, writer: Writer):
                                      member_type=ir0.BoolType(),
                                      writer=writer)
 
+def is_in_set_expr_to_ir0(expr: ir1.IsInSetExpr, writer: Writer):
+    lhs = var_reference_to_ir0(expr.lhs)
+    rhs = var_reference_to_ir0(expr.rhs)
+    template_expr = {
+        ir0.ExprKind.BOOL: GlobalLiterals.IS_IN_BOOL_SET,
+        ir0.ExprKind.INT64: GlobalLiterals.IS_IN_INT64_SET,
+        ir0.ExprKind.TYPE: GlobalLiterals.IS_IN_TYPE_SET,
+    }[lhs.expr_type.kind]
+    return _create_metafunction_call(template_expr=template_expr,
+                                     args=(lhs, rhs),
+                                     member_type=ir0.BoolType(),
+                                     writer=writer)
+
 def attribute_access_expr_to_ir0(attribute_access_expr: ir1.AttributeAccessExpr):
     class_expr = var_reference_to_ir0(attribute_access_expr.var)
     assert isinstance(class_expr.expr_type, ir0.TypeType)
@@ -1685,6 +1710,117 @@ def list_concat_expr_to_ir0(expr: ir1.ListConcatExpr, writer: Writer):
                                  member_name='type',
                                  expr_type=type_to_ir0(expr.expr_type))
 
+def list_index_expr_to_ir0(expr: ir1.ListIndexExpr, writer: Writer):
+    # l[i]
+    #
+    # Becomes (if l is a list of ints):
+    #
+    # Int64ListGet<l, i>::value
+    #
+    # The element is selected without recursing on the list, see TypeListGet in tmppy.h.
+
+    elem_type = type_to_ir0(expr.expr_type)
+    if elem_type.kind == ir0.ExprKind.BOOL:
+        list_get_template_name = 'BoolListGet'
+    elif elem_type.kind == ir0.ExprKind.INT64:
+        list_get_template_name = 'Int64ListGet'
+    elif elem_type.kind == ir0.ExprKind.TYPE:
+        list_get_template_name = 'TypeListGet'
+    else:
+        raise NotImplementedError('elem_kind: %s' % elem_type.kind)
+
+    # This triggers a static_assert if the index is out of range.
+    template_instantiation = _create_template_instantiation(template_name=list_get_template_name,
+                                                            arg_exprs=[expr.var, expr.index],
+                                                            instantiation_might_trigger_static_asserts=True,
+                                                            writer=writer)
+
+    return ir0.ClassMemberAccess(inner_expr=template_instantiation,
+                                 member_name='type' if elem_type.kind == ir0.ExprKind.TYPE else 'value',
+                                 expr_type=elem_type)
+
+def list_slice_expr_to_ir0(expr: ir1.ListSliceExpr, writer: Writer):
+    # l[begin:end]
+    #
+    # Becomes (if l is a list of ints):
+    #
+    # Int64ListSlice<l, begin, end>::type
+
+    elem_kind = type_to_ir0(expr.expr_type.elem_type).kind
+    if elem_kind == ir0.ExprKind.BOOL:
+        list_slice_template_name = 'BoolListSlice'
+    elif elem_kind == ir0.ExprKind.INT64:
+        list_slice_template_name = 'Int64ListSlice'
+    elif elem_kind == ir0.ExprKind.TYPE:
+        list_slice_template_name = 'TypeListSlice'
+    else:
+        raise NotImplementedError('elem_kind: %s' % elem_kind)
+
+    template_instantiation = _create_template_instantiation(template_name=list_slice_template_name,
+                                                            arg_exprs=[expr.var, expr.begin, expr.end],
+                                                            instantiation_might_trigger_static_asserts=False,
+                                                            writer=writer)
+
+    return ir0.ClassMemberAccess(inner_expr=template_instantiation,
+                                 member_name='type',
+                                 expr_type=type_to_ir0(expr.expr_type))
+
+def int_range_expr_to_ir0(expr: ir1.IntRangeExpr, writer: Writer):
+    # range(begin, end)
+    #
+    # Becomes:
+    #
+    # Int64Range<begin, end>::type
+
+    template_instantiation = _create_template_instantiation(template_name='Int64Range',
+                                                            arg_exprs=[expr.begin, expr.end],
+                                                            instantiation_might_trigger_static_asserts=False,
+                                                            writer=writer)
+
+    return ir0.ClassMemberAccess(inner_expr=template_instantiation,
+                                 member_name='type',
+                                 expr_type=ir0.TypeType())
+
+def _list_by_keys_expr_to_ir0(expr: Union[ir1.ListSortByKeysExpr, ir1.ListUniqueByKeysExpr],
+                              template_name_suffix: str,
+                              writer: Writer):
+    elem_kind = type_to_ir0(expr.expr_type.elem_type).kind
+    if elem_kind == ir0.ExprKind.BOOL:
+        template_name = 'BoolList' + template_name_suffix
+    elif elem_kind == ir0.ExprKind.INT64:
+        template_name = 'Int64List' + template_name_suffix
+    elif elem_kind == ir0.ExprKind.TYPE:
+        template_name = 'TypeList' + template_name_suffix
+    else:
+        raise NotImplementedError('elem_kind: %s' % elem_kind)
+
+    template_instantiation = _create_template_instantiation(template_name=template_name,
+                                                            arg_exprs=[expr.var, expr.keys],
+                                                            instantiation_might_trigger_static_asserts=False,
+                                                            writer=writer)
+
+    return ir0.ClassMemberAccess(inner_expr=template_instantiation,
+                                 member_name='type',
+                                 expr_type=type_to_ir0(expr.expr_type))
+
+def list_sort_by_keys_expr_to_ir0(expr: ir1.ListSortByKeysExpr, writer: Writer):
+    # sort_by_keys(l, keys)
+    #
+    # Becomes (if l is a list of ints):
+    #
+    # Int64ListSortByKeys<l, keys>::type
+
+    return _list_by_keys_expr_to_ir0(expr, 'SortByKeys', writer)
+
+def list_unique_by_keys_expr_to_ir0(expr: ir1.ListUniqueByKeysExpr, writer: Writer):
+    # unique_by_keys(l, keys)
+    #
+    # Becomes (if l is a list of ints):
+    #
+    # Int64ListUniqueByKeys<l, keys>::type
+
+    return _list_by_keys_expr_to_ir0(expr, 'UniqueByKeys', writer)
+
 def template_instantiation_pattern_expr_to_ir0(expr: ir1.TemplateInstantiationPatternExpr, writer: Writer):
     arg_exprs = list(expr.arg_exprs)
     if expr.list_extraction_arg_expr:
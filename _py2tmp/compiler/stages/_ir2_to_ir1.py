@@ -290,6 +290,16 @@ def expr_to_ir1(expr: ir2.Expr, writer: StmtWriter) -> ir1.VarReference:
         return int_binary_op_expr_to_ir1(expr, writer)
     elif isinstance(expr, ir2.ListConcatExpr):
         return list_concat_expr_to_ir1(expr, writer)
+    elif isinstance(expr, ir2.ListIndexExpr):
+        return list_index_expr_to_ir1(expr, writer)
+    elif isinstance(expr, ir2.ListSliceExpr):
+        return list_slice_expr_to_ir1(expr, writer)
+    elif isinstance(expr, ir2.IntRangeExpr):
+        return int_range_expr_to_ir1(expr, writer)
+    elif isinstance(expr, ir2.ListSortedExpr):
+        return list_sorted_expr_to_ir1(expr, writer)
+    elif isinstance(expr, ir2.ListUniqueExpr):
+        return list_unique_expr_to_ir1(expr, writer)
     elif isinstance(expr, ir2.ListComprehension):
         return list_comprehension_expr_to_ir1(expr, writer)
     elif isinstance(expr, ir2.SetComprehension):
@@ -470,8 +480,12 @@ def equality_comparison_to_ir1(comparison_expr: ir2.EqualityComparison, writer:
                                                               rhs=expr_to_ir1(comparison_expr.rhs, writer)))
 
 def in_expr_to_ir1(expr: ir2.InExpr, writer: StmtWriter):
-    return writer.new_var_for_expr(ir1.IsInListExpr(lhs=expr_to_ir1(expr.lhs, writer),
-                                                    rhs=expr_to_ir1(expr.rhs, writer)))
+    if isinstance(expr.rhs.expr_type, ir2.SetType):
+        return writer.new_var_for_expr(ir1.IsInSetExpr(lhs=expr_to_ir1(expr.lhs, writer),
+                                                       rhs=expr_to_ir1(expr.rhs, writer)))
+    else:
+        return writer.new_var_for_expr(ir1.IsInListExpr(lhs=expr_to_ir1(expr.lhs, writer),
+                                                        rhs=expr_to_ir1(expr.rhs, writer)))
 
 def attribute_access_expr_to_ir1(attribute_access_expr: ir2.AttributeAccessExpr, writer: StmtWriter):
     return writer.new_var_for_expr(ir1.AttributeAccessExpr(var=expr_to_ir1(attribute_access_expr.expr, writer),
@@ -572,12 +586,64 @@ def list_concat_expr_to_ir1(expr: ir2.ListConcatExpr, writer: StmtWriter):
     return writer.new_var_for_expr(ir1.ListConcatExpr(lhs=expr_to_ir1(expr.lhs, writer),
                                                       rhs=expr_to_ir1(expr.rhs, writer)))
 
+def list_index_expr_to_ir1(expr: ir2.ListIndexExpr, writer: StmtWriter):
+    return writer.new_var_for_expr(ir1.ListIndexExpr(var=expr_to_ir1(expr.list_expr, writer),
+                                                     index=expr_to_ir1(expr.index_expr, writer)))
+
+def list_slice_expr_to_ir1(expr: ir2.ListSliceExpr, writer: StmtWriter):
+    return writer.new_var_for_expr(ir1.ListSliceExpr(var=expr_to_ir1(expr.list_expr, writer),
+                                                     begin=expr_to_ir1(expr.begin_expr, writer),
+                                                     end=expr_to_ir1(expr.end_expr, writer)))
+
+def int_range_expr_to_ir1(expr: ir2.IntRangeExpr, writer: StmtWriter):
+    return writer.new_var_for_expr(ir1.IntRangeExpr(begin=expr_to_ir1(expr.begin_expr, writer),
+                                                    end=expr_to_ir1(expr.end_expr, writer)))
+
+def _list_and_keys_to_ir1(list_expr: ir2.Expr, key_expr: Optional[ir2.Expr], writer: StmtWriter):
+    # sorted(l, key=f)
+    #
+    # Becomes:
+    #
+    # keys = [f(x)
+    #         for x in l]  # (in fact, this will be converted further)
+    # sort_by_keys(l, keys)
+
+    l_var = expr_to_ir1(list_expr, writer)
+    if isinstance(list_expr.expr_type, ir2.SetType):
+        l_var = writer.new_var_for_expr(ir1.SetToListExpr(l_var))
+
+    if key_expr is None:
+        return l_var, l_var
+
+    loop_var = ir2.VarReference(expr_type=list_expr.expr_type.elem_type,
+                                name=writer.new_id(),
+                                is_global_function=False,
+                                is_function_that_may_throw=False)
+    may_throw = not isinstance(key_expr, ir2.VarReference) or key_expr.is_function_that_may_throw
+    keys_var = deconstructed_list_comprehension_expr_to_ir1(list_var=l_var,
+                                                            loop_var=loop_var,
+                                                            result_elem_expr=ir2.FunctionCall(fun_expr=key_expr,
+                                                                                              args=(loop_var,),
+                                                                                              may_throw=may_throw),
+                                                            writer=writer,
+                                                            loop_body_start_branch=None,
+                                                            loop_exit_branch=None)
+    return l_var, keys_var
+
+def list_sorted_expr_to_ir1(expr: ir2.ListSortedExpr, writer: StmtWriter):
+    l_var, keys_var = _list_and_keys_to_ir1(expr.list_expr, expr.key_expr, writer)
+    return writer.new_var_for_expr(ir1.ListSortByKeysExpr(var=l_var, keys=keys_var))
+
+def list_unique_expr_to_ir1(expr: ir2.ListUniqueExpr, writer: StmtWriter):
+    l_var, keys_var = _list_and_keys_to_ir1(expr.list_expr, expr.key_expr, writer)
+    return writer.new_var_for_expr(ir1.ListUniqueByKeysExpr(var=l_var, keys=keys_var))
+
 def deconstructed_list_comprehension_expr_to_ir1(list_var: ir2.VarReference,
                                                  loop_var: ir1.VarReference,
                                                  result_elem_expr: ir1.Expr,
                                                  writer: StmtWriter,
-                                                 loop_body_start_branch: SourceBranch,
-                                                 loop_exit_branch: SourceBranch):
+                                                 loop_body_start_branch: Optional[SourceBranch],
+                                                 loop_exit_branch: Optional[SourceBranch]):
     # [f(x, y) * 2
     #  for x in l]
     #
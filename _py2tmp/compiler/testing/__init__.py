@@ -21,5 +21,11 @@ from _py2tmp.compiler.testing._utils import (
     assert_code_optimizes_to,
     compile,
     link,
+    link_to_files,
     expect_cpp_code_success,
-    check_compilation_error)
+    expect_cpp_code_compiles_for_target,
+    expect_cpp20_module_compiles,
+    compile_and_extract_coverage_markers,
+    check_compilation_error,
+    builtins_object_file_path,
+    CompilationSettings)
@@ -13,18 +13,21 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
+import concurrent.futures
 import difflib
+import hashlib
 import inspect
 import itertools
 import json
 import os
-import pickle
 import re
 import subprocess
 import sys
 import shlex
+import shutil
 import tempfile
 import textwrap
+import threading
 import traceback
 import unittest
 from collections import defaultdict
@@ -43,16 +46,43 @@ from coverage.python import PythonFileReporter
 from _py2tmp import ir2, ir1, ir0
 from _py2tmp.compiler._compile import compile_source_code
 from _py2tmp.compiler._link import compute_merged_header_for_linking
-from _py2tmp.compiler.output_files import ObjectFileContent, merge_object_files
-from _py2tmp.compiler.stages import CompilationError
+from _py2tmp.compiler.output_files import ObjectFileContent, merge_object_files, load_object_file, SourceMap
+from _py2tmp.compiler.stages import CompilationError, CppTarget
 from _py2tmp.coverage import report_covered, is_coverage_collection_enabled, SourceBranch
-from _py2tmp.ir0_optimization import ConfigurationKnobs, DEFAULT_VERBOSE_SETTING
+from _py2tmp.ir0_optimization import ConfigurationKnobs, DEFAULT_VERBOSE_SETTING, OptimizationProfile, \
+    OptimizationCheckpoints
 from py2tmp.testing.pytest_plugin import TmppyFixture
 
 CHECK_TESTS_WERE_FULLY_OPTIMIZED = True
 
+# If True, the compilations of a test share an OptimizationCheckpoints, so e.g. when bisecting the optimization steps
+# each compilation only performs the steps after the ones that it has in common with the previous compilations.
+USE_OPTIMIZATION_CHECKPOINTS = True
+
 TEST_MODULE_NAME = 'test_module'
 
+class CompilationSettings:
+    # If set, the results of the C++ compilations are cached in this directory (also across test runs), keyed by the
+    # C++ source, the compiler and the compiler flags.
+    cache_dir: Optional[str] = None
+
+    # The number of compilations whose result was found in cache_dir.
+    cache_hit_counter = 0
+
+    # If True, the C++ sources that a test expects to compile and run successfully (e.g. the source generated with and
+    # without optimizations) are compiled together, in a single translation unit. If that fails, the test is re-run
+    # compiling each source separately, so that the failure is reported as usual.
+    batch_compilations = False
+
+    # The max number of compilations of a test that are executed in parallel (when batch_compilations is True).
+    num_jobs = 1
+
+    # If True (and coverage collection is enabled), the generated code stores the coverage markers as strings in the
+    # object file (see TmppyCoverageMarker in tmppy.h) and the covered branches are read from the compiler's output file
+    # in a single pass, instead of making the compiler report each marker as a warning and scraping its stderr.
+    # This is only supported by GCC and Clang.
+    coverage_markers_in_object_file = config.CXX_COMPILER_NAME != 'MSVC'
+
 
 class TestFailedException(Exception):
     pass
@@ -74,6 +104,25 @@ def bisect_with_predicate(last_known_good: int, first_known_bad: int, is_good: C
 
 # run takes a bool allow_toplevel_static_asserts_after_optimization and returns the cpp source.
 def run_test_with_optional_optimization(run: Callable[[bool], str], allow_reaching_max_optimization_loops=False):
+    if not USE_OPTIMIZATION_CHECKPOINTS or ConfigurationKnobs.optimization_checkpoints is not None:
+        _run_test_with_optional_optimization(run, allow_reaching_max_optimization_loops)
+        return
+
+    checkpoints = OptimizationCheckpoints()
+    def run_with_checkpoints(allow_toplevel_static_asserts_after_optimization: bool):
+        checkpoints.start_compilation()
+        return run(allow_toplevel_static_asserts_after_optimization)
+
+    ConfigurationKnobs.optimization_checkpoints = checkpoints
+    try:
+        _run_test_with_optional_optimization(run_with_checkpoints, allow_reaching_max_optimization_loops)
+    finally:
+        ConfigurationKnobs.optimization_checkpoints = None
+
+def _run_test_with_optional_optimization(run: Callable[[bool], str], allow_reaching_max_optimization_loops: bool):
+    if CompilationSettings.batch_compilations and _run_test_with_batched_compilations(run, allow_reaching_max_optimization_loops):
+        return
+
     try:
         ConfigurationKnobs.verbose = DEFAULT_VERBOSE_SETTING
 
@@ -153,6 +202,107 @@ def run_test_with_optional_optimization(run: Callable[[bool], str], allow_reachi
         pytest.fail(message, pytrace=False)
 
 
+# The C++ sources that expect_cpp_code_success() should compile and run, while they're being collected by
+# _run_test_with_batched_compilations().
+_deferred_cpp_sources: Optional[List[str]] = None
+
+def _run_test_with_batched_compilations(run: Callable[[bool], str], allow_reaching_max_optimization_loops: bool):
+    # Executes the same steps as run_test_with_optional_optimization() when the test passes, but the sources that
+    # expect_cpp_code_success() would compile are just collected, and then compiled together.
+    # Returns False if the test might have failed, in which case it has to be re-run normally.
+    global _deferred_cpp_sources
+    assert _deferred_cpp_sources is None
+    _deferred_cpp_sources = []
+    try:
+        ConfigurationKnobs.verbose = DEFAULT_VERBOSE_SETTING
+        ConfigurationKnobs.max_num_optimization_steps = 0
+        run(True)
+
+        ConfigurationKnobs.max_num_optimization_steps = -1
+        ConfigurationKnobs.optimization_step_counter = 0
+        ConfigurationKnobs.reached_max_num_remaining_loops_counter = 0
+        run(True)
+        if ConfigurationKnobs.reached_max_num_remaining_loops_counter != 0 and not allow_reaching_max_optimization_loops:
+            return False
+
+        if CHECK_TESTS_WERE_FULLY_OPTIMIZED:
+            run(False)
+        cpp_sources = _deferred_cpp_sources
+    except (TestFailedException, AttributeError, AssertionError):
+        return False
+    finally:
+        _deferred_cpp_sources = None
+
+    return _compile_and_run_cpp_sources(cpp_sources)
+
+def _add_main_if_missing(cxx_source: str):
+    if 'main(' not in cxx_source:
+        cxx_source += textwrap.dedent('''
+            int main() {
+            }
+            ''')
+    return cxx_source
+
+def _can_be_batched(cxx_source: str):
+    # Sources with a main() can't be batched, nor sources with preprocessor directives other than #include (that are
+    # moved to the beginning of the batched source).
+    return 'main(' not in cxx_source and all(line.startswith('#include ')
+                                             for line in cxx_source.splitlines()
+                                             if line.startswith('#'))
+
+def _batch_cpp_sources(cxx_sources: List[str]):
+    # Each source is put in a separate namespace, so that the names defined in the different sources don't conflict.
+    # The #includes are all moved to the top, so they're only expanded once (and not within a namespace).
+    includes: List[str] = []
+    bodies: List[str] = []
+    for i, cxx_source in enumerate(cxx_sources):
+        body_lines = []
+        for line in cxx_source.splitlines():
+            if line.startswith('#include '):
+                if line not in includes:
+                    includes.append(line)
+            else:
+                body_lines.append(line)
+        bodies.append('namespace tmppy_batched_source_%s {\n%s\n} // namespace tmppy_batched_source_%s\n' % (i, '\n'.join(body_lines), i))
+    return _add_main_if_missing('\n'.join(includes) + '\n' + ''.join(bodies))
+
+def _compile_and_run_cpp_sources(cxx_sources: List[str]):
+    # Returns True if all the sources were compiled and ran successfully.
+    cxx_sources = list(dict.fromkeys(cxx_sources))
+    batchable_cxx_sources = [cxx_source for cxx_source in cxx_sources if _can_be_batched(cxx_source)]
+    translation_units = [_add_main_if_missing(cxx_source)
+                         for cxx_source in cxx_sources
+                         if not _can_be_batched(cxx_source)]
+    if len(batchable_cxx_sources) == 1:
+        translation_units.append(_add_main_if_missing(batchable_cxx_sources[0]))
+    elif batchable_cxx_sources:
+        translation_units.append(_batch_cpp_sources(batchable_cxx_sources))
+
+    if CompilationSettings.num_jobs <= 1 or len(translation_units) <= 1 or is_coverage_collection_enabled():
+        # The coverage markers in the compiler's output must be reported in this thread.
+        return all(_try_compiling_and_running(translation_unit) for translation_unit in translation_units)
+    with concurrent.futures.ThreadPoolExecutor(max_workers=CompilationSettings.num_jobs) as executor:
+        return all(executor.map(_try_compiling_and_running, translation_units))
+
+def _try_compiling_and_running(cxx_source: str):
+    source_file_name = _create_temporary_file(cxx_source, file_name_suffix='.cpp')
+    executable_suffix = {'posix': '', 'nt': '.exe'}[os.name]
+    output_file_name = _create_temporary_file('', executable_suffix)
+    try:
+        compiler.compile_and_link(
+            source=source_file_name,
+            include_dirs=[config.MPYL_INCLUDE_DIR],
+            output_file_name=output_file_name,
+            args=[])
+        run_compiled_executable(output_file_name)
+        return True
+    except CommandFailedException:
+        return False
+    finally:
+        try_remove_temporary_file(source_file_name)
+        try_remove_temporary_file(output_file_name)
+
+
 def pretty_print_command(command: Sequence[str]):
     return ' '.join(shlex.quote(x) for x in command)
 
@@ -205,11 +355,11 @@ class CommandFailedException(Exception):
                     stderr=self.stderr)
 
 
-def run_command(executable: str, args: List[str] = ()):
+def run_command(executable: str, args: List[str] = (), cwd: Optional[str] = None):
     command = [executable, *args]
     # print('Executing command:', pretty_print_command(command))
     try:
-        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True)
+        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True, cwd=cwd)
         (stdout, stderr) = p.communicate()
     except Exception as e:
         raise Exception("While executing: %s" % command)
@@ -243,10 +393,82 @@ class CompilationFailedException(Exception):
 
 _EXTRACT_SOURCE_BRANCHES_REGEX = re.compile('<fruit-coverage-internal-marker file_name=\'([^\']*)\' source_line=\'([^\']*)\' dest_line=\'([^\']*)\' />')
 
-def _extract_covered_source_branches(compiler_stderr: str):
-    for file_name, source_line, dest_line in _EXTRACT_SOURCE_BRANCHES_REGEX.findall(compiler_stderr):
+def _extract_covered_source_branches(compiler_output: str):
+    for file_name, source_line, dest_line in _EXTRACT_SOURCE_BRANCHES_REGEX.findall(compiler_output):
         report_covered(SourceBranch(file_name, source_line, dest_line))
 
+def _are_coverage_markers_in_object_file():
+    return is_coverage_collection_enabled() and CompilationSettings.coverage_markers_in_object_file
+
+def _extract_covered_source_branches_from_output_file(output_file_name: str):
+    # The markers are NUL-terminated UTF-8 strings in the data of the object file (or executable).
+    with open(output_file_name, 'rb') as file:
+        _extract_covered_source_branches(file.read().decode('utf-8', errors='replace'))
+
+def _compute_compilation_cache_key(executable: str, args: List[str], source: str, output_file_name: Optional[str]):
+    # The names of the (temporary) source and output files don't affect the result, but the content of the source does.
+    # tmppy.h is included by all the generated sources, so its content is part of the key too.
+    def normalize_arg(arg: str):
+        if arg == source:
+            return '<source>'
+        if output_file_name and output_file_name in arg:
+            return arg.replace(output_file_name, '<output>')
+        return arg
+    normalized_args = [normalize_arg(arg) for arg in args]
+    hasher = hashlib.sha256()
+    hasher.update(json.dumps([executable, config.CXX_COMPILER_NAME, config.CXX_COMPILER_VERSION, normalized_args]).encode('utf-8'))
+    for file_name in (source, os.path.join(config.MPYL_INCLUDE_DIR, 'tmppy', 'tmppy.h')):
+        with open(file_name, 'rb') as file:
+            hasher.update(file.read())
+    return hasher.hexdigest()
+
+# The compilations of a test might run in parallel threads (see CompilationSettings.num_jobs).
+_cache_hit_counter_lock = threading.Lock()
+
+def _run_compiler(executable: str, args: List[str], source: str, output_file_name: Optional[str]):
+    cache_dir = CompilationSettings.cache_dir
+    if cache_dir is None:
+        return run_command(executable, args)
+
+    key = _compute_compilation_cache_key(executable, args, source, output_file_name)
+    result_file_name = os.path.join(cache_dir, key + '.json')
+    cached_output_file_name = os.path.join(cache_dir, key + '.out')
+    try:
+        with open(result_file_name, 'r') as file:
+            result = json.load(file)
+        if output_file_name and result['error_code'] == 0:
+            shutil.copy(cached_output_file_name, output_file_name)
+        with _cache_hit_counter_lock:
+            CompilationSettings.cache_hit_counter += 1
+    except (OSError, ValueError):
+        result = None
+
+    if result is None:
+        try:
+            stdout, stderr = run_command(executable, args)
+            result = {'stdout': stdout, 'stderr': stderr, 'error_code': 0}
+        except CommandFailedException as e:
+            result = {'stdout': e.stdout, 'stderr': e.stderr, 'error_code': e.error_code}
+        # The files are written atomically, so that concurrent test runs that share the cache don't see partial files.
+        os.makedirs(cache_dir, exist_ok=True)
+        if output_file_name and result['error_code'] == 0:
+            _write_file_atomically(cached_output_file_name, lambda file_name: shutil.copy(output_file_name, file_name))
+        _write_file_atomically(result_file_name, lambda file_name: _write_json(file_name, result))
+
+    if result['error_code'] != 0:
+        raise CommandFailedException([executable, *args], result['stdout'], result['stderr'], result['error_code'])
+    return result['stdout'], result['stderr']
+
+def _write_json(file_name: str, value: Any):
+    with open(file_name, 'w') as file:
+        json.dump(value, file)
+
+def _write_file_atomically(file_name: str, write: Callable[[str], Any]):
+    file_descriptor, temporary_file_name = tempfile.mkstemp(dir=os.path.dirname(file_name))
+    os.close(file_descriptor)
+    write(temporary_file_name)
+    os.replace(temporary_file_name, file_name)
+
 class PosixCompiler:
     def __init__(self) -> None:
         self.executable = config.CXX
@@ -254,8 +476,14 @@ class PosixCompiler:
 
     def compile_discarding_output(self, source: str, include_dirs: List[str], args: List[str] = ()):
         try:
+            if _are_coverage_markers_in_object_file():
+                # The object file is needed to extract the coverage markers.
+                with tempfile.TemporaryDirectory() as temp_dir:
+                    object_file_name = os.path.join(temp_dir, 'output.o')
+                    args = args + ['-c', source, '-o', object_file_name]
+                    return self._compile(include_dirs, args=args, source=source, output_file_name=object_file_name)
             args = args + ['-c', source, '-o', os.path.devnull]
-            return self._compile(include_dirs, args=args)
+            return self._compile(include_dirs, args=args, source=source)
         except CommandFailedException as e:
             raise CompilationFailedException(e.command, e.stderr)
 
@@ -267,19 +495,24 @@ class PosixCompiler:
                     + config.ADDITIONAL_LINKER_FLAGS.split()
                     + args
                     + ['-o', output_file_name]
-            ))
+            ),
+            source=source,
+            output_file_name=output_file_name)
 
-    def _compile(self, include_dirs: List[str], args: List[str]):
+    def _compile(self, include_dirs: List[str], args: List[str], source: str, output_file_name: Optional[str] = None):
         all_args = ['-W', '-Wall', '-g0', '-std=c++11']
-        if not is_coverage_collection_enabled():
+        if not is_coverage_collection_enabled() or _are_coverage_markers_in_object_file():
             all_args.append('-Werror')
         for include_dir in include_dirs:
             all_args.append('-I%s' % include_dir)
         all_args += config.ADDITIONAL_COMPILER_FLAGS.split()
         all_args += args
-        stdout, stderr = run_command(self.executable, all_args)
+        stdout, stderr = _run_compiler(self.executable, all_args, source, output_file_name)
         assert not stdout
-        _extract_covered_source_branches(stderr)
+        if _are_coverage_markers_in_object_file():
+            _extract_covered_source_branches_from_output_file(output_file_name)
+        else:
+            _extract_covered_source_branches(stderr)
 
 
 class MsvcCompiler:
@@ -290,7 +523,7 @@ class MsvcCompiler:
     def compile_discarding_output(self, source: str, include_dirs: List[str], args: List[str] = ()):
         try:
             args = args + ['/c', source]
-            return self._compile(include_dirs, args=args)
+            return self._compile(include_dirs, args=args, source=source)
         except CommandFailedException as e:
             # Note that we use stdout here, unlike above. MSVC reports compilation warnings and errors on stdout.
             raise CompilationFailedException(e.command, e.stdout)
@@ -303,9 +536,11 @@ class MsvcCompiler:
                     + config.ADDITIONAL_LINKER_FLAGS.split()
                     + args
                     + ['/Fe' + output_file_name]
-            ))
+            ),
+            source=source,
+            output_file_name=output_file_name)
 
-    def _compile(self, include_dirs: List[str], args: List[str]):
+    def _compile(self, include_dirs: List[str], args: List[str], source: str, output_file_name: Optional[str] = None):
         all_args = ['/nologo', '/FS', '/W4', '/D_SCL_SECURE_NO_WARNINGS']
         if not is_coverage_collection_enabled():
             all_args.append('/WX')
@@ -313,7 +548,7 @@ class MsvcCompiler:
             all_args.append('-I%s' % include_dir)
         all_args += config.ADDITIONAL_COMPILER_FLAGS.split()
         all_args += args
-        stdout, stderr = run_command(self.executable, all_args)
+        stdout, stderr = _run_compiler(self.executable, all_args, source, output_file_name)
         assert not stdout
         _extract_covered_source_branches(stderr)
 
@@ -659,13 +894,13 @@ def expect_cpp_code_success(tmppy_source: str,
     :param cxx_source: The C++ source code. This will be dedented.
     """
 
+    if _deferred_cpp_sources is not None:
+        _deferred_cpp_sources.append(cxx_source)
+        return
+
     main_module = object_file_content.modules_by_name[main_module_name]
 
-    if 'main(' not in cxx_source:
-        cxx_source += textwrap.dedent('''
-            int main() {
-            }
-            ''')
+    cxx_source = _add_main_if_missing(cxx_source)
 
     source_file_name = _create_temporary_file(cxx_source, file_name_suffix='.cpp')
     executable_suffix = {'posix': '', 'nt': '.exe'}[os.name]
@@ -753,8 +988,7 @@ def builtins_object_file_path() -> str:
 
 @lru_cache()
 def get_builtins_object_file_content():
-    with open(builtins_object_file_path(), 'rb') as file:
-        object_file = pickle.loads(file.read())
+    object_file = load_object_file(builtins_object_file_path())
     assert isinstance(object_file, ObjectFileContent)
     return object_file
 
@@ -958,11 +1192,138 @@ def compile(python_source: str,
 
 
 def link(object_file_content: ObjectFileContent,
-         main_module_name=TEST_MODULE_NAME):
+         main_module_name=TEST_MODULE_NAME,
+         use_clang_format=True,
+         source_map: Optional[SourceMap] = None,
+         target: CppTarget = CppTarget(),
+         short_circuit_bool_ops: bool = False):
     from _py2tmp.compiler._link import link
     return link(main_module_name=main_module_name,
                 object_file_content=object_file_content,
-                coverage_collection_enabled=is_coverage_collection_enabled())
+                coverage_collection_enabled=is_coverage_collection_enabled(),
+                use_clang_format=use_clang_format,
+                source_map=source_map,
+                target=target,
+                short_circuit_bool_ops=short_circuit_bool_ops,
+                coverage_markers_in_object_file=CompilationSettings.coverage_markers_in_object_file)
+
+def link_to_files(object_file_content: ObjectFileContent,
+                  header_file_name: str,
+                  main_module_name=TEST_MODULE_NAME,
+                  use_clang_format=True,
+                  target: CppTarget = CppTarget(),
+                  shard_header: bool = False,
+                  cpp20_module_file_name: Optional[str] = None):
+    from _py2tmp.compiler._link import link_to_files
+    return link_to_files(main_module_name=main_module_name,
+                         object_file_content=object_file_content,
+                         coverage_collection_enabled=is_coverage_collection_enabled(),
+                         header_file_name=header_file_name,
+                         use_clang_format=use_clang_format,
+                         target=target,
+                         shard_header=shard_header,
+                         cpp20_module_file_name=cpp20_module_file_name,
+                         coverage_markers_in_object_file=CompilationSettings.coverage_markers_in_object_file)
+
+def expect_cpp_code_compiles_for_target(cxx_source: str,
+                                        target: CppTarget,
+                                        other_file_content_by_name: Optional[Dict[str, str]] = None,
+                                        extra_cxx_flags: Sequence[str] = ()):
+    """
+    Tests that the given source compiles with the C++ standard of the target.
+
+    If other_file_content_by_name is specified, those files are written in a temporary directory that the source can
+    #include from (e.g. the headers generated by link_to_files()).
+
+    extra_cxx_flags are appended to the compiler command line (e.g. to lower the maximum template instantiation depth).
+
+    The code is compiled without the pre-compiled headers (that are built for C++11), so this is only supported with
+    GCC and Clang. With other compilers (or if the target requires a different compiler) this does nothing.
+    """
+    if config.CXX_COMPILER_NAME not in ('GNU', 'Clang', 'AppleClang') or target.compiler not in ('generic', 'gcc', 'clang'):
+        return
+    with tempfile.TemporaryDirectory() as include_dir:
+        for file_name, file_content in (other_file_content_by_name or {}).items():
+            with open(os.path.join(include_dir, file_name), 'w') as file:
+                file.write(file_content)
+        _expect_cpp_code_compiles_for_target(cxx_source, target, include_dir, extra_cxx_flags)
+
+def expect_cpp20_module_compiles(module_interface_source: str, cxx_source: str):
+    """
+    Tests that the given module interface unit compiles and that the given source (that imports the module) compiles
+    too.
+
+    This is only supported with GCC (using -fmodules-ts), with other compilers this does nothing.
+    """
+    if config.CXX_COMPILER_NAME != 'GNU':
+        return
+    with tempfile.TemporaryDirectory() as build_dir:
+        # GCC writes the compiled module interface in the gcm.cache subdirectory of the current directory.
+        for file_name, file_content in (('module.cppm', module_interface_source), ('main.cpp', cxx_source)):
+            with open(os.path.join(build_dir, file_name), 'w') as file:
+                file.write(file_content)
+            try:
+                run_command(config.CXX, ['-W', '-Wall', '-g0', '-Werror', '-std=c++20', '-fmodules-ts', '-x', 'c++',
+                                         '-I' + config.MPYL_INCLUDE_DIR, '-c', file_name, '-o', file_name + '.o'],
+                            cwd=build_dir)
+            except CommandFailedException as e:
+                raise Exception(textwrap.dedent('''\
+                    The C++20 module (or the code that imports it) doesn't compile.
+                    Compiler command line: {command}
+                    Error message was:
+                    {error_message}
+                    C++ source code:
+                    {cxx_source}
+                    ''').format(command=pretty_print_command(e.command),
+                                 error_message=textwrap.indent(e.stderr, '  '),
+                                 cxx_source=_cap_to_lines(add_line_numbers(file_content), 200)))
+
+def compile_and_extract_coverage_markers(cxx_source: str) -> Optional[Set[SourceBranch]]:
+    """
+    Compiles the given source (generated with coverage_markers_in_object_file=True) and returns the source branches of
+    the coverage markers in the resulting object file, i.e. the ones that the compilation covered.
+
+    This is only supported with GCC and Clang, with other compilers this returns None.
+    """
+    if config.CXX_COMPILER_NAME not in ('GNU', 'Clang', 'AppleClang'):
+        return None
+    with tempfile.TemporaryDirectory() as build_dir:
+        with open(os.path.join(build_dir, 'main.cpp'), 'w') as file:
+            file.write(cxx_source)
+        try:
+            run_command(config.CXX, ['-W', '-Wall', '-g0', '-Werror', '-std=c++11', '-I' + config.MPYL_INCLUDE_DIR,
+                                     '-c', 'main.cpp', '-o', 'main.o'],
+                        cwd=build_dir)
+        except CommandFailedException as e:
+            raise CompilationFailedException(e.command, e.stderr)
+        with open(os.path.join(build_dir, 'main.o'), 'rb') as file:
+            object_file_content = file.read().decode('utf-8', errors='replace')
+    return {SourceBranch(file_name, int(source_line), int(dest_line))
+            for file_name, source_line, dest_line in _EXTRACT_SOURCE_BRANCHES_REGEX.findall(object_file_content)}
+
+def _expect_cpp_code_compiles_for_target(cxx_source: str,
+                                         target: CppTarget,
+                                         include_dir: str,
+                                         extra_cxx_flags: Sequence[str]):
+    source_file_name = _create_temporary_file(cxx_source, file_name_suffix='.cpp')
+    try:
+        run_command(config.CXX, ['-W', '-Wall', '-g0', '-Werror', '-std=' + target.standard, '-fsyntax-only',
+                                 '-I' + config.MPYL_INCLUDE_DIR, '-I' + include_dir, *extra_cxx_flags,
+                                 source_file_name])
+    except CommandFailedException as e:
+        raise Exception(textwrap.dedent('''\
+            The generated C++ code doesn't compile with {standard}.
+            Compiler command line: {command}
+            Error message was:
+            {error_message}
+            C++ source code:
+            {cxx_source}
+            ''').format(standard=target.standard,
+                         command=pretty_print_command(e.command),
+                         error_message=textwrap.indent(e.stderr, '  '),
+                         cxx_source=_cap_to_lines(add_line_numbers(cxx_source), 200)))
+    finally:
+        try_remove_temporary_file(source_file_name)
 
 
 def _convert_to_cpp_expecting_success(tmppy_source: str,
@@ -1049,10 +1410,52 @@ def assert_compilation_succeeds(extra_cpp_prelude: str='', always_allow_toplevel
     return eval
 
 
-def assert_code_optimizes_to(expected_cpp_source: str, extra_cpp_prelude=''):
+def assert_code_optimizes_to(expected_cpp_source: str,
+                             extra_cpp_prelude='',
+                             num_optimization_processes: int = 1,
+                             use_optimization_cache: bool = False,
+                             collect_optimization_profile: bool = False,
+                             max_inlining_instantiation_count_increase: int = -1,
+                             max_inlined_body_size: int = -1,
+                             max_inlining_fan_out: int = -1,
+                             max_num_evaluated_template_instantiations: Optional[int] = None):
     def eval(f):
         @wraps(f)
         def wrapper(tmppy: TmppyFixture = TmppyFixture(ObjectFileContent({}))):
+            ConfigurationKnobs.num_optimization_processes = num_optimization_processes
+            ConfigurationKnobs.max_inlining_instantiation_count_increase = max_inlining_instantiation_count_increase
+            ConfigurationKnobs.max_inlined_body_size = max_inlined_body_size
+            ConfigurationKnobs.max_inlining_fan_out = max_inlining_fan_out
+            default_max_num_evaluated_template_instantiations = ConfigurationKnobs.max_num_evaluated_template_instantiations
+            if max_num_evaluated_template_instantiations is not None:
+                ConfigurationKnobs.max_num_evaluated_template_instantiations = max_num_evaluated_template_instantiations
+            if collect_optimization_profile:
+                ConfigurationKnobs.optimization_profile = OptimizationProfile()
+            try:
+                if use_optimization_cache:
+                    # The test compiles the code multiple times, so the last compilation reuses the cached results.
+                    with tempfile.TemporaryDirectory() as optimization_cache_dir:
+                        ConfigurationKnobs.optimization_cache_dir = optimization_cache_dir
+                        ConfigurationKnobs.optimization_cache_hit_counter = 0
+                        _check_code_optimizes_to(tmppy, f)
+                        assert ConfigurationKnobs.optimization_cache_hit_counter > 0, 'The optimization cache was never hit'
+                else:
+                    _check_code_optimizes_to(tmppy, f)
+                if collect_optimization_profile:
+                    optimization_stats_by_name = ConfigurationKnobs.optimization_profile.to_json()['optimizations']
+                    assert optimization_stats_by_name, 'No optimizations were recorded in the profile'
+                    assert all(stats['num_calls'] >= stats['num_calls_that_changed_ir']
+                               for stats in optimization_stats_by_name.values())
+            finally:
+                ConfigurationKnobs.num_optimization_processes = 1
+                ConfigurationKnobs.optimization_cache_dir = None
+                ConfigurationKnobs.optimization_profile = None
+                ConfigurationKnobs.max_inlining_instantiation_count_increase = -1
+                ConfigurationKnobs.max_inlined_body_size = -1
+                ConfigurationKnobs.max_inlining_fan_out = -1
+                ConfigurationKnobs.max_num_evaluated_template_instantiations = default_max_num_evaluated_template_instantiations
+
+        def _check_code_optimizes_to(tmppy: TmppyFixture, f):
             tmppy_source = _get_function_body(f)
 
             def run_test(allow_toplevel_static_asserts_after_optimization: bool):
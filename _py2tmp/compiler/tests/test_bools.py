@@ -12,7 +12,12 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from _py2tmp.compiler.testing import main, assert_compilation_succeeds, assert_conversion_fails
+import itertools
+
+from _py2tmp.compiler.stages import CppTarget, header_to_cpp
+from _py2tmp.compiler.testing import main, assert_compilation_succeeds, assert_conversion_fails, compile, link, \
+    expect_cpp_code_success, expect_cpp_code_compiles_for_target
+from _py2tmp.ir0 import ir0
 
 @assert_compilation_succeeds()
 def test_not_false():
@@ -157,5 +162,69 @@ def test_or_int_bool_error():
                 or True)
         return True
 
+def test_short_circuit_bool_ops():
+    tmppy_source = '''\
+from typing import Set
+def sets_equal(s1: Set[int], s2: Set[int]) -> bool:
+    return s1 == s2
+'''
+    checks = '''
+static_assert(sets_equal<Int64List<1, 2>, Int64List<2, 1>>::value, "");
+static_assert(!sets_equal<Int64List<1, 2>, Int64List<2, 3>>::value, "");
+static_assert(!sets_equal<Int64List<1, 2>, Int64List<1>>::value, "");
+static_assert(!sets_equal<Int64List<1>, Int64List<1, 2>>::value, "");
+'''
+    object_file_content = compile(tmppy_source)
+    cpp_source = link(object_file_content, use_clang_format=False, short_circuit_bool_ops=True)
+    assert 'LazyBoolAnd<' in cpp_source, cpp_source
+    expect_cpp_code_success(tmppy_source, object_file_content, cpp_source + checks)
+
+def test_short_circuit_bool_ops_do_not_instantiate_unneeded_rhs():
+    b = ir0.AtomicTypeLiteral.for_local(cpp_type='b', expr_type=ir0.BoolType(), is_variadic=False)
+    t = ir0.AtomicTypeLiteral.for_local(cpp_type='T', expr_type=ir0.TypeType(), is_variadic=False)
+    fail = ir0.AtomicTypeLiteral.for_nonlocal_template(cpp_type='Fail',
+                                                       args=(ir0.TemplateArgType(ir0.TypeType(), is_variadic=False),),
+                                                       is_metafunction_that_may_return_error=False,
+                                                       may_be_alias=False)
+    fail_value = ir0.ClassMemberAccess(inner_expr=ir0.TemplateInstantiation(template_expr=fail,
+                                                                            args=(t,),
+                                                                            instantiation_might_trigger_static_asserts=True),
+                                       member_name='value',
+                                       expr_type=ir0.BoolType())
+    def template_defn(name: str, value_expr: ir0.Expr):
+        args = (ir0.TemplateArgDecl(expr_type=ir0.BoolType(), name='b', is_variadic=False),
+                ir0.TemplateArgDecl(expr_type=ir0.TypeType(), name='T', is_variadic=False))
+        return ir0.TemplateDefn(args=args,
+                                main_definition=ir0.TemplateSpecialization(args=args,
+                                                                           patterns=None,
+                                                                           body=(ir0.ConstantDef(name='value', expr=value_expr),),
+                                                                           is_metafunction=True),
+                                specializations=(),
+                                name=name,
+                                description='',
+                                result_element_names=frozenset(('value',)))
+    header = ir0.Header(template_defns=(template_defn('And', ir0.BoolBinaryOpExpr(lhs=b, rhs=fail_value, op='&&')),
+                                        # This needs a helper template, since the RHS is not just a member access.
+                                        template_defn('Or', ir0.BoolBinaryOpExpr(lhs=b, rhs=ir0.NotExpr(fail_value), op='||'))),
+                        check_if_error_specializations=(),
+                        toplevel_content=(),
+                        public_names=frozenset(),
+                        split_template_name_by_old_name_and_result_element_name=())
+
+    cpp_source = header_to_cpp(header, iter('TmppyInternal_%s' % i for i in itertools.count()),
+                               coverage_collection_enabled=False,
+                               short_circuit_bool_ops=True)
+    assert 'LazyBoolAnd<' in cpp_source and 'LazyBoolOr<' in cpp_source, cpp_source
+    expect_cpp_code_compiles_for_target('''
+template <typename T>
+struct Fail {
+  static_assert(sizeof(T) == 0, "Fail<T> should not be instantiated");
+  static constexpr bool value = true;
+};
+''' + cpp_source + '''
+static_assert(!And<false, int>::value, "");
+static_assert(Or<true, int>::value, "");
+''', CppTarget())
+
 if __name__== '__main__':
     main()
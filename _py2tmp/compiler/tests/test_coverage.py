@@ -0,0 +1,169 @@
+#  Copyright 2017 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS-IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import itertools
+import multiprocessing
+
+from _py2tmp.compiler._compile import compile_source_code
+from _py2tmp.compiler._link import compute_merged_header_for_linking
+from _py2tmp.compiler.output_files import ObjectFileContent
+from _py2tmp.compiler.stages import header_to_cpp
+from _py2tmp.compiler.testing import main, compile_and_extract_coverage_markers
+from _py2tmp.ir0 import ir0, Visitor
+from _py2tmp.ir0_optimization import ConfigurationKnobs
+
+class _CollectCoverageMarkers(Visitor):
+    def __init__(self):
+        self.branches = set()
+
+    def visit_no_op_stmt(self, stmt: ir0.NoOpStmt):
+        self.branches.add((stmt.source_branch.source_line, stmt.source_branch.dest_line))
+
+def _compute_coverage_markers(header: ir0.Header):
+    visitor = _CollectCoverageMarkers()
+    visitor.visit_header(header)
+    return visitor.branches
+
+def test_optimizations_preserve_coverage_markers():
+    tmppy_source = '''\
+def _f(b: bool):
+    if b:
+        return 3
+    else:
+        return 5
+def g(b: bool):
+    return _f(b) + _f(not b)
+assert g(True) == 8
+'''
+    object_file_content = compile_source_code(module_name='test_module',
+                                              source_code=tmppy_source,
+                                              context_object_file_content=ObjectFileContent({}),
+                                              include_intermediate_irs_for_debugging=True,
+                                              coverage_collection_enabled=True)
+    module_info = object_file_content.modules_by_name['test_module']
+    coverage_markers = _compute_coverage_markers(module_info.ir0_header_before_optimization)
+    assert coverage_markers
+    assert module_info.ir0_header != module_info.ir0_header_before_optimization
+    assert _compute_coverage_markers(module_info.ir0_header) == coverage_markers
+
+    def identifier_generator():
+        for i in itertools.count():
+            yield 'TmppyInternal_' + str(i)
+    header = compute_merged_header_for_linking(main_module_name='test_module',
+                                               object_file_content=object_file_content,
+                                               identifier_generator=identifier_generator(),
+                                               coverage_collection_enabled=True)
+    # _f is inlined into g (and at toplevel), but its coverage markers are kept.
+    assert not any(template_defn.name == '_f' for template_defn in header.template_defns)
+    assert _compute_coverage_markers(header) == coverage_markers
+
+def test_coverage_markers_in_object_file():
+    tmppy_source = '''\
+def f(b: bool):
+    if b:
+        return 3
+    else:
+        return 5
+'''
+    object_file_content = compile_source_code(module_name='test_module',
+                                              source_code=tmppy_source,
+                                              context_object_file_content=ObjectFileContent({}),
+                                              include_intermediate_irs_for_debugging=False,
+                                              coverage_collection_enabled=True)
+    def identifier_generator():
+        for i in itertools.count():
+            yield 'TmppyInternal_' + str(i)
+    identifier_generator = identifier_generator()
+    header = compute_merged_header_for_linking(main_module_name='test_module',
+                                               object_file_content=object_file_content,
+                                               identifier_generator=identifier_generator,
+                                               coverage_collection_enabled=True)
+    cpp_source = header_to_cpp(header,
+                               identifier_generator,
+                               coverage_collection_enabled=True,
+                               coverage_markers_in_object_file=True)
+    assert 'deprecated' not in cpp_source
+
+    covered_branches = compile_and_extract_coverage_markers(cpp_source)
+    if covered_branches is None:
+        # Not supported by this compiler.
+        return
+    # Only the markers in the specializations that are instantiated get into the object file.
+    for cxx_source, expected_branches in (('static_assert(f<true>::value == 3, "");', {(-1, 2), (2, 3), (3, -1)}),
+                                          ('static_assert(f<false>::value == 5, "");', {(-1, 2), (2, 5), (5, -1)})):
+        new_covered_branches = compile_and_extract_coverage_markers(cpp_source + cxx_source) - covered_branches
+        assert {(branch.source_line, branch.dest_line) for branch in new_covered_branches} == expected_branches
+
+def test_parallel_optimization_does_not_depend_on_the_start_method_of_the_worker_processes():
+    tmppy_source = '''\
+def _fact(n: int) -> int:
+    if n <= 1:
+        return 1
+    else:
+        return n * _fact(n - 1)
+def f(b: bool):
+    if b:
+        return _fact(4)
+    else:
+        return _fact(5)
+def g(b: bool):
+    if b:
+        return _fact(6)
+    else:
+        return _fact(7)
+'''
+    object_file_content = compile_source_code(module_name='test_module',
+                                              source_code=tmppy_source,
+                                              context_object_file_content=ObjectFileContent({}),
+                                              include_intermediate_irs_for_debugging=False,
+                                              coverage_collection_enabled=True)
+    def compute_header(num_optimization_processes: int, start_method=None):
+        def identifier_generator():
+            for i in itertools.count():
+                yield 'TmppyInternal_' + str(i)
+        ConfigurationKnobs.num_optimization_processes = num_optimization_processes
+        ConfigurationKnobs.optimization_processes_start_method = start_method
+        ConfigurationKnobs.optimization_step_counter = 0
+        try:
+            header = compute_merged_header_for_linking(main_module_name='test_module',
+                                                       object_file_content=object_file_content,
+                                                       identifier_generator=identifier_generator(),
+                                                       coverage_collection_enabled=True)
+        finally:
+            ConfigurationKnobs.num_optimization_processes = 1
+            ConfigurationKnobs.optimization_processes_start_method = None
+        return header, ConfigurationKnobs.optimization_step_counter
+
+    # Knobs with non-default values must also be used by the worker processes, even when they don't inherit them.
+    default_max_num_evaluated_template_instantiations = ConfigurationKnobs.max_num_evaluated_template_instantiations
+    ConfigurationKnobs.max_num_evaluated_template_instantiations = 0
+    try:
+        header, _ = compute_header(num_optimization_processes=1)
+        header_with_spawn, num_steps_with_spawn = compute_header(num_optimization_processes=2, start_method='spawn')
+        # The steps performed in the worker processes are counted too.
+        assert num_steps_with_spawn > 0
+        # f and g are optimized in different processes, but the coverage markers are still preserved.
+        assert _compute_coverage_markers(header_with_spawn) == _compute_coverage_markers(header)
+        if 'fork' in multiprocessing.get_all_start_methods():
+            header_with_fork, num_steps_with_fork = compute_header(num_optimization_processes=2, start_method='fork')
+            def header_to_cpp_source(header: ir0.Header):
+                return header_to_cpp(header, iter('TmppyInternal_x%s' % i for i in itertools.count()),
+                                     coverage_collection_enabled=True)
+            assert header_to_cpp_source(header_with_spawn) == header_to_cpp_source(header_with_fork)
+            assert num_steps_with_spawn == num_steps_with_fork
+    finally:
+        ConfigurationKnobs.max_num_evaluated_template_instantiations = default_max_num_evaluated_template_instantiations
+
+if __name__== '__main__':
+    main()
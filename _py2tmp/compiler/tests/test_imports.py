@@ -12,10 +12,16 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from _py2tmp.compiler.output_files import merge_object_files
-from _py2tmp.compiler.stages import CompilationError
+import os
+import tempfile
+
+import pytest
+
+from _py2tmp.compiler.output_files import merge_object_files, serialize_object_file_content, load_object_file, \
+    ObjectFileFormatError
+from _py2tmp.compiler.stages import CompilationError, CppTarget
 from _py2tmp.compiler.testing import compile, link, expect_cpp_code_success, check_compilation_error, \
-    assert_conversion_fails
+    assert_conversion_fails, expect_cpp_code_compiles_for_target, link_to_files, expect_cpp20_module_compiles
 from py2tmp.testing import main, assert_compilation_succeeds
 
 
@@ -259,5 +265,168 @@ def h(b: bool):
                             cxx_source=cpp_source,
                             main_module_name=module_baz_name)
 
+def _write_object_file(file_content: bytes):
+    file_descriptor, file_name = tempfile.mkstemp(suffix='.tmppyc')
+    with os.fdopen(file_descriptor, 'wb') as file:
+        file.write(file_content)
+    return file_name
+
+def test_import_from_serialized_object_file_ok():
+    module_foo_name = 'foo'
+    module_foo_source = '''\
+def f(b: bool):
+    if b:
+        return 3
+    else:
+        return 4
+'''
+    object_file_name = _write_object_file(serialize_object_file_content(compile(module_foo_source,
+                                                                                module_name=module_foo_name)))
+    try:
+        loaded_module_foo = load_object_file(object_file_name)
+        # The modules are only decoded when needed.
+        assert loaded_module_foo.modules_by_name[module_foo_name].has_ir2_module
+
+        module_bar_name = 'bar'
+        module_bar_source = '''\
+from foo import f
+def g(b: bool):
+    return f(b) + 1
+'''
+        compiled_module_bar = compile(module_bar_source,
+                                      module_name=module_bar_name,
+                                      context_object_file_content=loaded_module_foo)
+
+        cpp_source = link(compiled_module_bar, main_module_name=module_bar_name)
+
+        expect_cpp_code_success(tmppy_source=module_foo_source + module_bar_source,
+                                object_file_content=compiled_module_bar,
+                                cxx_source=cpp_source,
+                                main_module_name=module_bar_name)
+    finally:
+        os.remove(object_file_name)
+
+def test_import_with_modules_copied_between_serialized_object_files_ok():
+    module_foo_name = 'foo'
+    module_foo_source = '''\
+def f(b: bool):
+    if b:
+        return 3
+    else:
+        return 4
+'''
+    module_bar_name = 'bar'
+    module_bar_source = '''\
+from foo import f
+def g(b: bool):
+    return f(b) + 1
+'''
+    module_baz_name = 'baz'
+    module_baz_source = '''\
+from bar import g
+def h(b: bool):
+    return g(b) * 2
+'''
+    object_file_names = []
+    try:
+        object_file_names.append(_write_object_file(serialize_object_file_content(compile(module_foo_source,
+                                                                                          module_name=module_foo_name))))
+        # The (still undecoded) module foo is copied as-is into this object file.
+        object_file_names.append(_write_object_file(serialize_object_file_content(compile(module_bar_source,
+                                                                                          module_name=module_bar_name,
+                                                                                          context_object_file_content=load_object_file(object_file_names[0])))))
+        loaded_modules = load_object_file(object_file_names[1])
+        assert not loaded_modules.modules_by_name[module_foo_name].has_ir2_module
+        assert loaded_modules.modules_by_name[module_bar_name].has_ir2_module
+
+        compiled_module_baz = compile(module_baz_source,
+                                      module_name=module_baz_name,
+                                      context_object_file_content=loaded_modules)
+
+        cpp_source = link(compiled_module_baz, main_module_name=module_baz_name)
+
+        expect_cpp_code_success(tmppy_source=module_foo_source + module_bar_source + module_baz_source,
+                                object_file_content=compiled_module_baz,
+                                cxx_source=cpp_source,
+                                main_module_name=module_baz_name)
+    finally:
+        for object_file_name in object_file_names:
+            os.remove(object_file_name)
+
+def test_load_object_file_with_wrong_format_error():
+    object_file_name = _write_object_file(b'not a tmppyc file')
+    try:
+        with pytest.raises(ObjectFileFormatError, match='is not a TMPPy object file'):
+            load_object_file(object_file_name)
+    finally:
+        os.remove(object_file_name)
+
+def test_sharded_header():
+    tmppy_source = '''\
+from typing import List
+from tmppy import empty_list
+def _factorial(n: int) -> int:
+    if n <= 0:
+        return 1
+    else:
+        return n * _factorial(n - 1)
+def factorial(n: int):
+    return _factorial(n)
+def factorial_plus_one(n: int):
+    return _factorial(n) + 1
+def is_empty(l: List[int]):
+    return l == empty_list(int)
+'''
+    object_file_content = compile(tmppy_source)
+    cpp_source_by_file_name = link_to_files(object_file_content, 'generated.h', use_clang_format=False, shard_header=True)
+    assert sorted(cpp_source_by_file_name.keys()) == ['generated.h',
+                                                      'generated_core.h',
+                                                      'generated_shard_factorial.h',
+                                                      'generated_shard_factorial_plus_one.h',
+                                                      'generated_shard_is_empty.h']
+
+    # The template generated for _factorial is used by both factorial and factorial_plus_one, so it goes in the core.
+    assert 'struct factorial ' not in cpp_source_by_file_name['generated_core.h']
+    assert 'Split that generates value of: _factorial' in cpp_source_by_file_name['generated_core.h']
+    assert 'struct is_empty ' not in cpp_source_by_file_name['generated_shard_factorial.h']
+    assert 'struct factorial_plus_one ' not in cpp_source_by_file_name['generated_shard_factorial.h']
+    assert 'Split that generates value of: _factorial' not in cpp_source_by_file_name['generated_shard_factorial.h']
+    assert '_factorial' not in cpp_source_by_file_name['generated_shard_is_empty.h']
+
+    expect_cpp_code_compiles_for_target('''
+#include "generated_shard_factorial.h"
+static_assert(factorial<4>::value == 24, "");
+''', CppTarget(), cpp_source_by_file_name)
+    expect_cpp_code_compiles_for_target('''
+#include "generated_shard_is_empty.h"
+#include "generated.h"
+static_assert(is_empty<Int64List<>>::value, "");
+static_assert(!is_empty<Int64List<1>>::value, "");
+static_assert(factorial_plus_one<3>::value == 7, "");
+''', CppTarget(), cpp_source_by_file_name)
+
+def test_cpp20_module():
+    tmppy_source = '''\
+from tmppy import Type
+def _plus(n: int, m: int):
+    return n + m
+def inc(n: int):
+    return _plus(n, 1)
+def add_pointer(x: Type):
+    return Type.pointer(x)
+'''
+    object_file_content = compile(tmppy_source)
+    target = CppTarget(standard='c++20')
+    cpp_source_by_file_name = link_to_files(object_file_content, 'generated.h', use_clang_format=False, target=target,
+                                            cpp20_module_file_name='generated.cppm')
+    module_interface_source = cpp_source_by_file_name['generated.cppm']
+    assert 'export module test_module;' in module_interface_source, module_interface_source
+    assert 'export template <int64_t' in module_interface_source, module_interface_source
+    expect_cpp20_module_compiles(module_interface_source, '''
+import test_module;
+static_assert(inc<3>::value == 4, "");
+static_assert(__is_same(add_pointer<int>::type, int*), "");
+''')
+
 if __name__== '__main__':
     main()
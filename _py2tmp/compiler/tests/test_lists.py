@@ -13,7 +13,9 @@
 # limitations under the License.
 from dataclasses import dataclass
 
-from _py2tmp.compiler.testing import main, assert_compilation_succeeds, assert_conversion_fails, assert_compilation_fails_with_static_assert_error
+from _py2tmp.compiler.stages import CppTarget
+from _py2tmp.compiler.testing import main, assert_compilation_succeeds, assert_conversion_fails, assert_compilation_fails_with_static_assert_error, \
+    compile, link, expect_cpp_code_compiles_for_target
 
 @assert_conversion_fails
 def test_empty_list_expression_error():
@@ -367,6 +369,27 @@ def test_list_comprehension_from_bool_list_throws_in_function_caught_success():
             return [e.b]
     assert g(True) == [True]
 
+@assert_compilation_succeeds()
+def test_list_comprehension_from_long_int_list_throws_in_function_caught_success():
+    class MyError(Exception):
+        def __init__(self, n: int):
+            self.message = 'Something went wrong'
+            self.n = n
+    def f(n: int):
+        if n == 70:
+            raise MyError(n)
+        return True
+    def g(b: bool):
+        try:
+            return [f(x) for x in [0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+                                   15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29,
+                                   30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44,
+                                   45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59,
+                                   60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71, 72, 73, 74]]
+        except MyError as e:
+            return [e.n == 70]
+    assert g(True) == [True]
+
 @assert_compilation_fails_with_static_assert_error('Something went wrong')
 def test_list_comprehension_from_int_list_throws_toplevel():
     from tmppy import empty_list
@@ -508,6 +531,38 @@ def test_sum_empty_list_success():
     from tmppy import empty_list
     assert sum(empty_list(int)) == 0
 
+def test_sum_all_any_long_list_with_low_template_depth():
+    tmppy_source = '''\
+from typing import List
+class MyError(Exception):
+    def __init__(self, n: int):
+        self.message = 'error'
+        self.n = n
+def check_nonzero(n: int) -> int:
+    if n == 0:
+        raise MyError(n)
+    return n
+def list_sum(l: List[int]) -> int:
+    return sum([check_nonzero(x) for x in l])
+def all_positive(l: List[int]) -> bool:
+    return all([x > 0 for x in l])
+def any_big(l: List[int]) -> bool:
+    return any([x > 599 for x in l])
+'''
+    # The lists are only known in the C++ code, so these can't be evaluated by the optimizer. With the template depth
+    # capped at 32 this only compiles if the builtins recurse on the two halves of the list (or use fold expressions)
+    # instead of once per element.
+    long_list = 'Int64List<{}>'.format(', '.join(str(n) for n in range(1, 601)))
+    checks = '''
+static_assert(list_sum<{long_list}>::value == 180300, "");
+static_assert(all_positive<{long_list}>::value, "");
+static_assert(any_big<{long_list}>::value, "");
+'''.format(long_list=long_list)
+    object_file_content = compile(tmppy_source)
+    for target in (CppTarget(), CppTarget(standard='c++17', compiler='gcc')):
+        cpp_source = link(object_file_content, use_clang_format=False, target=target)
+        expect_cpp_code_compiles_for_target(cpp_source + checks, target, extra_cxx_flags=('-ftemplate-depth=32',))
+
 @assert_conversion_fails
 def test_sum_bool_list_error():
     assert sum([True, False]) == 40  # error: The argument of sum\(\) must have type List\[int\] or Set\[int\]. Got type: List\[bool\]
@@ -526,6 +581,236 @@ def test_sum_with_keyword_argument_error():
 def test_sum_with_multiple_arguments_error():
     assert sum([True, False], 0) == 40  # error: sum\(\) takes 1 argument. Got: 2
 
+@assert_compilation_succeeds()
+def test_int_list_index_success():
+    assert [5, 1, 34][1] == 1
+
+@assert_compilation_succeeds()
+def test_bool_list_index_success():
+    assert [True, True, False][2] == False
+
+@assert_compilation_succeeds()
+def test_type_list_index_success():
+    from tmppy import Type
+    assert [Type('int'), Type('float'), Type('int')][1] == Type('float')
+
+@assert_compilation_succeeds()
+def test_list_index_negative_success():
+    assert [5, 1, 34][-1] == 34
+    assert [5, 1, 34][-3] == 5
+
+@assert_compilation_succeeds()
+def test_list_index_in_function_success():
+    from typing import List
+    def f(l: List[int], i: int):
+        return l[i] + l[i + 1]
+    assert f([5, 1, 34], 1) == 35
+
+@assert_compilation_succeeds()
+def test_list_index_long_list_success():
+    assert [x * 2 for x in range(200)][177] == 354
+
+@assert_compilation_fails_with_static_assert_error('list index out of range')
+def test_list_index_out_of_range_error():
+    from typing import List
+    def f(l: List[int], i: int):
+        return l[i]
+    assert f([5, 1, 34], 3) == 5
+
+@assert_conversion_fails
+def test_list_index_with_non_int_index_error():
+    assert [5, 1, 34][True] == 1  # error: List indexes and slice bounds must be ints, but this value has type bool.
+
+@assert_conversion_fails
+def test_index_of_non_list_error():
+    from tmppy import Type
+    def f(x: Type):
+        return x[0]  # error: Indexing and slicing are only supported for lists, but this value has type Type.
+
+@assert_compilation_succeeds()
+def test_list_slice_success():
+    assert [5, 1, 34, 8][1:3] == [1, 34]
+    assert [True, False, True][1:] == [False, True]
+    assert [5, 1, 34, 8][:-1] == [5, 1, 34]
+    assert [5, 1, 34, 8][:] == [5, 1, 34, 8]
+
+@assert_compilation_succeeds()
+def test_type_list_slice_success():
+    from tmppy import Type
+    assert [Type('int'), Type('float'), Type('double')][-2:] == [Type('float'), Type('double')]
+
+@assert_compilation_succeeds()
+def test_list_slice_out_of_range_bounds_success():
+    from tmppy import empty_list
+    assert [5, 1, 34][-10:10] == [5, 1, 34]
+    assert [5, 1, 34][2:1] == empty_list(int)
+    assert [5, 1, 34][5:] == empty_list(int)
+
+@assert_compilation_succeeds()
+def test_list_slice_in_function_success():
+    from typing import List
+    def f(l: List[int], n: int):
+        return l[n:] + l[:n]
+    assert f([1, 2, 3, 4], 1) == [2, 3, 4, 1]
+
+@assert_conversion_fails
+def test_list_slice_with_step_error():
+    assert [5, 1, 34][0:2:1] == [5, 1]  # error: Slices with a step are not supported.
+
+@assert_compilation_succeeds()
+def test_range_success():
+    from tmppy import empty_list
+    assert range(4) == [0, 1, 2, 3]
+    assert range(2, 5) == [2, 3, 4]
+    assert range(0) == empty_list(int)
+    assert range(5, 2) == empty_list(int)
+    assert range(-2, 1) == [-2, -1, 0]
+
+@assert_compilation_succeeds()
+def test_range_in_function_success():
+    def f(n: int):
+        return sum([x * x for x in range(n)])
+    assert f(4) == 14
+
+@assert_compilation_succeeds()
+def test_range_long_success():
+    assert sum(range(200)) == 19900
+
+@assert_conversion_fails
+def test_range_with_non_int_argument_error():
+    assert range(True) == [0]  # error: The arguments of range\(\) must be ints, but this value has type bool.
+
+@assert_conversion_fails
+def test_range_with_step_error():
+    assert range(0, 4, 2) == [0, 2]  # error: range\(\) with a step is not supported.
+
+@assert_conversion_fails
+def test_range_with_no_arguments_error():
+    assert range() == [0]  # error: range\(\) takes 1 or 2 arguments. Got: 0
+
+@assert_compilation_succeeds()
+def test_sorted_success():
+    from tmppy import empty_list
+    assert sorted([5, 1, 34, 8, 1]) == [1, 1, 5, 8, 34]
+    assert sorted([-3, 7, 0]) == [-3, 0, 7]
+    assert sorted(empty_list(int)) == empty_list(int)
+
+@assert_compilation_succeeds()
+def test_sorted_in_function_success():
+    from typing import List
+    def f(l: List[int]):
+        return sorted(l)
+    assert f([5, 1, 34, 8, 1]) == [1, 1, 5, 8, 34]
+    assert f([2]) == [2]
+
+@assert_compilation_succeeds()
+def test_sorted_set_success():
+    from typing import Set
+    def f(s: Set[int]):
+        return sorted(s)
+    assert f({5, 1, 34}) == [1, 5, 34]
+
+@assert_compilation_succeeds()
+def test_sorted_with_key_is_stable_success():
+    from typing import List
+    def key(x: int):
+        return x // 10
+    def f(l: List[int]):
+        return sorted(l, key=key)
+    assert f([31, 12, 35, 11, 20]) == [12, 11, 20, 31, 35]
+
+@assert_compilation_succeeds()
+def test_sorted_type_list_with_key_success():
+    from typing import List
+    from tmppy import Type, match
+    def key(x: Type):
+        return match(x)(lambda T: {
+            Type.pointer(T):
+                1,
+            T:
+                0,
+        })
+    def f(l: List[Type]):
+        return sorted(l, key=key)
+    assert f([Type.pointer(Type('int')), Type('float'), Type.pointer(Type('char')), Type('void')]) == [Type('float'), Type('void'), Type.pointer(Type('int')), Type.pointer(Type('char'))]
+
+@assert_compilation_succeeds()
+def test_sorted_bool_list_with_key_success():
+    from typing import List
+    def key(b: bool):
+        if b:
+            return 0
+        else:
+            return 1
+    def f(l: List[bool]):
+        return sorted(l, key=key)
+    assert f([False, True, False, True]) == [True, True, False, False]
+
+@assert_compilation_succeeds()
+def test_sorted_long_list_success():
+    assert sorted([(x * 37) % 200 for x in range(200)]) == range(200)
+
+@assert_compilation_succeeds()
+def test_unique_success():
+    from tmppy import unique, empty_list
+    assert unique([5, 1, 34, 5, 8, 1]) == [1, 5, 8, 34]
+    assert unique(empty_list(int)) == empty_list(int)
+
+@assert_compilation_succeeds()
+def test_unique_in_function_success():
+    from typing import List
+    from tmppy import unique
+    def f(l: List[int]):
+        return unique(l)
+    assert f([5, 1, 34, 5, 8, 1]) == [1, 5, 8, 34]
+    assert f([3, 3, 3]) == [3]
+
+@assert_compilation_succeeds()
+def test_unique_with_key_keeps_first_elem_success():
+    from typing import List
+    from tmppy import unique
+    def key(x: int):
+        return x // 10
+    def f(l: List[int]):
+        return unique(l, key=key)
+    assert f([31, 12, 35, 11, 20]) == [12, 20, 31]
+
+@assert_compilation_succeeds()
+def test_unique_type_list_with_key_success():
+    from typing import List
+    from tmppy import Type, match, unique
+    def key(x: Type):
+        return match(x)(lambda T: {
+            Type.pointer(T):
+                1,
+            T:
+                0,
+        })
+    def f(l: List[Type]):
+        return unique(l, key=key)
+    assert f([Type.pointer(Type('int')), Type('float'), Type.pointer(Type('char')), Type('void')]) == [Type('float'), Type.pointer(Type('int'))]
+
+@assert_conversion_fails
+def test_sorted_type_list_without_key_error():
+    from tmppy import Type
+    assert sorted([Type('int')]) == [Type('int')]  # error: sorted\(\) without a key can only be called on a List\[int\] or a Set\[int\]. Got type: List\[Type\]
+
+@assert_conversion_fails
+def test_sorted_with_key_of_wrong_type_error():
+    from tmppy import Type
+    def key(x: int):
+        return Type('int')
+    assert sorted([1, 2], key=key) == [1, 2]  # error: The key of sorted\(\) must have type \(int\) -> int. Got type: \(int\) -> Type
+
+@assert_conversion_fails
+def test_sorted_with_unsupported_keyword_argument_error():
+    assert sorted([1, 2], reverse=True) == [2, 1]  # error: The only keyword argument supported in sorted\(\) is "key".
+
+@assert_conversion_fails
+def test_unique_with_non_list_error():
+    from tmppy import unique
+    assert unique(3) == [3]  # error: The argument of unique\(\) must be a list or a set. Got type: int
+
 @assert_compilation_succeeds()
 def test_all_success_returns_true():
     assert all([True, True, True]) == True
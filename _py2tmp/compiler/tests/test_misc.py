@@ -12,7 +12,19 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from _py2tmp.compiler.testing import main, assert_conversion_fails, assert_compilation_succeeds
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+from _py2tmp.compiler.output_files import SourceMap
+from _py2tmp.compiler.stages import CppTarget
+from _py2tmp.compiler.testing import main, assert_conversion_fails, assert_compilation_succeeds, compile, link, \
+    expect_cpp_code_success, expect_cpp_code_compiles_for_target, CompilationSettings, builtins_object_file_path
+from _py2tmp.coverage import is_coverage_collection_enabled
+import py2tmp
+from py2tmp.time_trace_report import compute_times_by_function, NOT_GENERATED_BY_TMPPY
 
 @assert_conversion_fails
 def test_global_variable_error():
@@ -53,5 +65,220 @@ def test_in_expr_not_list_nor_set():
     def f(b: bool):
         return 1 in 2  # error: The object on the RHS of "in" must be a list or a set, but found type: int
 
+def test_generated_code_is_indented_without_clang_format():
+    tmppy_source = '''\
+from tmppy import Type
+def f(t: Type, n: int) -> Type:
+    if n == 0:
+        return t
+    else:
+        return f(Type.pointer(t), n-1)
+'''
+    object_file_content = compile(tmppy_source)
+    cpp_source = link(object_file_content, use_clang_format=False)
+
+    nesting_depth = 0
+    for line in cpp_source.splitlines():
+        stripped_line = line.lstrip()
+        assert stripped_line, 'Unexpected empty line in:\n' + cpp_source
+        expected_indentation = 2 * (nesting_depth - 1 if stripped_line.startswith('}') else nesting_depth)
+        assert len(line) - len(stripped_line) == expected_indentation, 'Unexpected indentation of line "%s" in:\n%s' % (line, cpp_source)
+        nesting_depth += line.count('{') - line.count('}')
+    assert nesting_depth == 0
+
+    expect_cpp_code_success(tmppy_source, object_file_content, cpp_source)
+
+def test_source_map_and_time_trace_report():
+    tmppy_source = '''\
+from tmppy import Type
+def f(t: Type, n: int) -> Type:
+    if n == 0:
+        return t
+    else:
+        return f(Type.pointer(t), n-1)
+
+def g(t: Type) -> Type:
+    return f(t, 2)
+'''
+    object_file_content = compile(tmppy_source)
+    source_map = SourceMap()
+    cpp_source = link(object_file_content, source_map=source_map)
+    cpp_lines = cpp_source.splitlines()
+
+    source_map = SourceMap.from_json(json.loads(json.dumps(source_map.to_json())))
+    for function_name, line in (('f', 2), ('g', 8)):
+        entry = source_map.entry_by_cpp_template_name[function_name]
+        assert (entry.source_location.function_name, entry.source_location.line) == (function_name, line)
+        assert entry.cpp_lines
+        for cpp_line in entry.cpp_lines:
+            assert 'struct ' + function_name in cpp_lines[cpp_line - 1], cpp_source
+
+    def instantiation(detail: str, ts: int, dur: int):
+        return {'ph': 'X', 'pid': 1, 'tid': 1, 'name': 'InstantiateClass', 'ts': ts, 'dur': dur, 'args': {'detail': detail}}
+    time_trace = {'traceEvents': [
+        instantiation('g<int>', ts=0, dur=100),
+        instantiation('f<int, 2>', ts=10, dur=80),
+        instantiation('f<int*, 1>', ts=20, dur=50),
+        instantiation('std::is_same<int, int>', ts=30, dur=5),
+        # Not an instantiation, ignored.
+        {'ph': 'X', 'pid': 1, 'tid': 1, 'name': 'ParseClass', 'ts': 0, 'dur': 1000},
+    ]}
+    times_by_function = compute_times_by_function(source_map, [json.dumps(time_trace)])
+    times_by_function = {function_name: (times.num_instantiations, times.self_time_us, times.total_time_us)
+                         for (function_name, _), times in times_by_function.items()}
+    assert times_by_function == {
+        'g': (1, 20, 100),
+        'f': (2, 75, 80),
+        NOT_GENERATED_BY_TMPPY[0]: (1, 5, 5),
+    }
+
+def test_cpp17_target_uses_fold_expressions_and_intrinsics():
+    tmppy_source = '''\
+from tmppy import Type
+from typing import List, Set
+def all_big(l: List[int]) -> bool:
+    return all([x > 3 for x in l])
+def any_big(l: List[int]) -> bool:
+    return any([x > 3 for x in l])
+def double_sum(l: List[int]) -> int:
+    return sum([x * 2 for x in l])
+def is_in_list(t: Type, l: List[Type]) -> bool:
+    return t in l
+def is_in_set(n: int, s: Set[int]) -> bool:
+    return n in s
+def to_pointer_set(s: Set[Type]) -> Set[Type]:
+    return {Type.pointer(x) for x in s}
+class MyError(Exception):
+    def __init__(self, n: int):
+        self.message = 'error'
+        self.n = n
+def f(n: int) -> bool:
+    if n == 0:
+        raise MyError(n)
+    return True
+def g(l: List[int]) -> List[bool]:
+    try:
+        return [f(x) for x in l]
+    except MyError as e:
+        return [False]
+'''
+    checks = '''
+static_assert(all_big<Int64List<4, 5, 6>>::value, "");
+static_assert(!all_big<Int64List<4, 1, 6>>::value, "");
+static_assert(all_big<Int64List<>>::value, "");
+static_assert(any_big<Int64List<1, 5, 2>>::value, "");
+static_assert(!any_big<Int64List<1, 2>>::value, "");
+static_assert(!any_big<Int64List<>>::value, "");
+static_assert(double_sum<Int64List<1, 2, 3>>::value == 12, "");
+static_assert(double_sum<Int64List<>>::value == 0, "");
+static_assert(is_in_list<int, List<float, int>>::value, "");
+static_assert(!is_in_list<int, List<float>>::value, "");
+static_assert(is_in_set<3, Int64List<1, 3>>::value, "");
+static_assert(!is_in_set<2, Int64List<1, 3>>::value, "");
+static_assert(std::is_same<to_pointer_set<List<int, float>>::type, List<float*, int*>>::value, "");
+static_assert(std::is_same<g<Int64List<1, 2>>::type, BoolList<true, true>>::value, "");
+static_assert(std::is_same<g<Int64List<1, 0, 2>>::type, BoolList<false>>::value, "");
+'''
+    object_file_content = compile(tmppy_source)
+
+    default_cpp_source = link(object_file_content, use_clang_format=False)
+    for construct in ('... &&', '... ||', '... +', 'TMPPY_IS_SAME', '__is_base_of'):
+        assert construct not in default_cpp_source, default_cpp_source
+    expect_cpp_code_success(tmppy_source, object_file_content, default_cpp_source + checks)
+
+    target = CppTarget(standard='c++17', compiler='gcc')
+    cpp_source = link(object_file_content, use_clang_format=False, target=target)
+    for construct in ('(true && ... && (', '!(false || ... || (', '(0LL + ... + (', 'TMPPY_IS_SAME(', '__is_base_of(',
+                      'TypeFoldStep<', 'GetFirstErrorFoldStep<'):
+        assert construct in cpp_source, cpp_source
+    assert 'std::is_same<' not in cpp_source, cpp_source
+    expect_cpp_code_compiles_for_target(cpp_source + checks, target)
+
+def test_batched_and_cached_compilations():
+    @assert_compilation_succeeds()
+    def check():
+        '''
+        from tmppy import Type
+        def f(x: Type):
+            return Type.pointer(x)
+        assert f(Type('int')) == Type.pointer(Type('int'))
+        '''
+    with tempfile.TemporaryDirectory() as cache_dir:
+        CompilationSettings.cache_dir = cache_dir
+        CompilationSettings.batch_compilations = True
+        CompilationSettings.num_jobs = 2
+        CompilationSettings.cache_hit_counter = 0
+        try:
+            check()
+            # The sources generated with and without optimizations are compiled together.
+            assert len(os.listdir(cache_dir)) == 2, os.listdir(cache_dir)
+            assert CompilationSettings.cache_hit_counter == 0
+            # This time the result is taken from the cache.
+            check()
+            assert len(os.listdir(cache_dir)) == 2, os.listdir(cache_dir)
+            assert CompilationSettings.cache_hit_counter == 1
+        finally:
+            CompilationSettings.cache_dir = None
+            CompilationSettings.batch_compilations = False
+            CompilationSettings.num_jobs = 1
+
+def test_batch_mode():
+    sources_by_file_name = {
+        'foo.py': 'def f(n: int):\n    return n + 1\n',
+        'bar.py': 'from foo import f\ndef g(n: int):\n    return f(n) * 2\n',
+        'baz.py': 'def h(n: int):\n    return undefined_variable\n',
+    }
+    batch = '''\
+# The IRs printed with --verbose must go to stderr, not in the outcomes on stdout.
+--verbose true -o foo.tmppyc foo.py
+-o bar.h bar.py foo.tmppyc
+--no_such_flag -o foo2.tmppyc foo.py
+-o baz.tmppyc baz.py
+'unterminated quote
+-o bar.tmppyc bar.py foo.tmppyc
+'''
+    main_script = os.path.join(os.path.dirname(os.path.abspath(py2tmp.__file__)), 'main.py')
+    repo_root = os.path.dirname(os.path.dirname(os.path.abspath(py2tmp.__file__)))
+    env = dict(os.environ)
+    env['PYTHONPATH'] = os.pathsep.join([repo_root, *([env['PYTHONPATH']] if env.get('PYTHONPATH') else [])])
+    with tempfile.TemporaryDirectory() as temp_dir:
+        for file_name, source in sources_by_file_name.items():
+            with open(os.path.join(temp_dir, file_name), 'w') as file:
+                file.write(source)
+        process = subprocess.run([sys.executable, main_script,
+                                  '--builtins-path', os.path.abspath(builtins_object_file_path()),
+                                  '--enable_coverage', 'true' if is_coverage_collection_enabled() else 'false',
+                                  '--clang_format', 'false',
+                                  '--batch', '-'],
+                                 input=batch,
+                                 cwd=temp_dir,
+                                 env=env,
+                                 stdout=subprocess.PIPE,
+                                 stderr=subprocess.PIPE,
+                                 universal_newlines=True)
+
+        assert process.returncode == 1, process.stderr
+        # Every line of stdout is the JSON outcome of a command, in order.
+        outcomes = [json.loads(line) for line in process.stdout.splitlines()]
+        assert [(outcome['output'], outcome['success']) for outcome in outcomes] == [
+            ('foo.tmppyc', True),
+            ('bar.h', True),
+            (None, False),
+            ('baz.tmppyc', False),
+            (None, False),
+            ('bar.tmppyc', True),
+        ], process.stdout
+        assert 'Invalid batch command' in outcomes[2]['error'], outcomes[2]
+        assert 'undefined_variable' in outcomes[3]['error'], outcomes[3]
+        assert 'Invalid batch command' in outcomes[4]['error'], outcomes[4]
+        assert 'TMPPy IR0:' in process.stderr, process.stderr
+        assert '--no_such_flag' in process.stderr, process.stderr
+
+        with open(os.path.join(temp_dir, 'bar.h')) as file:
+            assert 'struct g' in file.read()
+        assert os.path.exists(os.path.join(temp_dir, 'bar.tmppyc'))
+        assert not os.path.exists(os.path.join(temp_dir, 'foo2.tmppyc'))
+        assert not os.path.exists(os.path.join(temp_dir, 'baz.tmppyc'))
+
 if __name__== '__main__':
     main()
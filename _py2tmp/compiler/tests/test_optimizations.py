@@ -12,7 +12,10 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from _py2tmp.compiler.testing import main, assert_code_optimizes_to, assert_compilation_fails_with_generic_error
+from _py2tmp.compiler.testing import main, assert_code_optimizes_to, assert_compilation_fails_with_generic_error, \
+    assert_compilation_succeeds, compile, link
+from _py2tmp.ir0_optimization import ConfigurationKnobs, OptimizationCheckpoints, LookaheadIdentifierGenerator
+from _py2tmp.ir0_optimization._expression_simplification import fold_int64_binary_op, fold_int64_unary_minus
 
 @assert_code_optimizes_to(r'''
 template <typename T> struct CheckIfError { using type = void; };
@@ -25,6 +28,31 @@ def test_optimization_one_function():
     def inc(n: int):
         return n + 1
 
+@assert_code_optimizes_to(r'''
+template <typename T> struct CheckIfError { using type = void; };
+template <int64_t tmppy_internal_test_module_x5> struct g {
+  using error = void;
+  static constexpr int64_t value =
+      ((tmppy_internal_test_module_x5) + (1LL)) + (3LL);
+};
+template <int64_t tmppy_internal_test_module_x5> struct f {
+  using error = void;
+  static constexpr int64_t value =
+      ((tmppy_internal_test_module_x5) + (1LL)) * (2LL);
+};
+template <int64_t tmppy_internal_test_module_x5> struct inc {
+  using error = void;
+  static constexpr int64_t value = (tmppy_internal_test_module_x5) + (1LL);
+};
+''', num_optimization_processes=2)
+def test_optimization_of_independent_functions_in_parallel():
+    def inc(n: int):
+        return n + 1
+    def f(n: int):
+        return inc(n) * 2
+    def g(n: int):
+        return inc(n) + 3
+
 @assert_code_optimizes_to(r'''
 template <typename T> struct CheckIfError { using type = void; };
 ''')
@@ -74,6 +102,252 @@ def test_optimization_two_functions_with_call():
     def inc(n: int):
         return _plus(n, 1)
 
+@assert_code_optimizes_to(r'''
+template <typename T> struct CheckIfError { using type = void; };
+template <int64_t tmppy_internal_test_module_x5> struct inc {
+  using error = void;
+  static constexpr int64_t value = (tmppy_internal_test_module_x5) + (1LL);
+};
+''', use_optimization_cache=True)
+def test_optimization_two_functions_with_call_using_optimization_cache():
+    def _plus(n: int, m: int):
+        return n + m
+    def inc(n: int):
+        return _plus(n, 1)
+
+@assert_code_optimizes_to(r'''
+template <typename T> struct CheckIfError { using type = void; };
+template <int64_t tmppy_internal_test_module_x5> struct inc {
+  using error = void;
+  static constexpr int64_t value = (tmppy_internal_test_module_x5) + (1LL);
+};
+''', collect_optimization_profile=True)
+def test_optimization_two_functions_with_call_collecting_optimization_profile():
+    def _plus(n: int, m: int):
+        return n + m
+    def inc(n: int):
+        return _plus(n, 1)
+
+@assert_code_optimizes_to(r'''
+template <typename T> struct CheckIfError { using type = void; };
+// Split that generates value of: _f
+template <int64_t tmppy_internal_test_module_x5,
+          int64_t tmppy_internal_test_module_x6>
+struct tmppy_internal_test_module_x17 {
+  static constexpr int64_t value =
+      (((tmppy_internal_test_module_x5) * (tmppy_internal_test_module_x6)) +
+       (tmppy_internal_test_module_x5)) -
+      (tmppy_internal_test_module_x6);
+};
+template <int64_t tmppy_internal_test_module_x5> struct dec {
+  using error = void;
+  static constexpr int64_t value =
+      tmppy_internal_test_module_x17<tmppy_internal_test_module_x5,
+                                     -1LL>::value;
+};
+template <int64_t tmppy_internal_test_module_x5> struct inc {
+  using error = void;
+  static constexpr int64_t value =
+      tmppy_internal_test_module_x17<tmppy_internal_test_module_x5,
+                                     1LL>::value;
+};
+''', max_inlining_fan_out=1)
+def test_optimization_function_with_multiple_callers_not_inlined_due_to_fan_out():
+    def _f(n: int, m: int):
+        return n * m + n - m
+    def inc(n: int):
+        return _f(n, 1)
+    def dec(n: int):
+        return _f(n, -1)
+
+@assert_code_optimizes_to(r'''
+template <typename T> struct CheckIfError { using type = void; };
+template <int64_t tmppy_internal_test_module_x5> struct inc {
+  using error = void;
+  static constexpr int64_t value =
+      ((tmppy_internal_test_module_x5) + (tmppy_internal_test_module_x5)) +
+      (-1LL);
+};
+''', max_inlining_fan_out=1)
+def test_optimization_function_with_single_caller_inlined_despite_fan_out_limit():
+    def _f(n: int, m: int):
+        return n * m + n - m
+    def inc(n: int):
+        return _f(n, 1)
+
+@assert_code_optimizes_to(r'''
+template <typename T> struct CheckIfError { using type = void; };
+// Split that generates value of: _f
+template <int64_t tmppy_internal_test_module_x5,
+          int64_t tmppy_internal_test_module_x6>
+struct tmppy_internal_test_module_x21 {
+  static constexpr int64_t value =
+      (((tmppy_internal_test_module_x5) * (tmppy_internal_test_module_x6)) +
+       (tmppy_internal_test_module_x5)) -
+      (tmppy_internal_test_module_x6);
+};
+static constexpr int64_t TmppyInternal_6 =
+    tmppy_internal_test_module_x21<3LL, 4LL>::value;
+template <int64_t tmppy_internal_test_module_x5> struct dec {
+  using error = void;
+  static constexpr int64_t value =
+      (tmppy_internal_test_module_x5) - (TmppyInternal_6);
+};
+template <int64_t tmppy_internal_test_module_x5> struct inc {
+  using error = void;
+  static constexpr int64_t value =
+      (tmppy_internal_test_module_x5) + (TmppyInternal_6);
+};
+''', max_inlining_fan_out=1, max_num_evaluated_template_instantiations=0)
+def test_optimization_common_closed_subexpression_hoisted_out_of_templates():
+    def _f(n: int, m: int):
+        return n * m + n - m
+    def inc(n: int):
+        return n + _f(3, 4)
+    def dec(n: int):
+        return n - _f(3, 4)
+
+@assert_code_optimizes_to(r'''
+template <typename T> struct CheckIfError { using type = void; };
+template <bool tmppy_internal_test_module_x18>
+struct tmppy_internal_test_module_x30;
+// Split that generates type of: (meta)function generated for an if-else
+// statement
+template <> struct tmppy_internal_test_module_x30<true> {
+  template <typename tmppy_internal_test_module_x10,
+            typename tmppy_internal_test_module_x9>
+  using type = void;
+};
+// Split that generates type of: (meta)function generated for an if-else
+// statement
+template <> struct tmppy_internal_test_module_x30<false> {
+  template <typename tmppy_internal_test_module_x10,
+            typename tmppy_internal_test_module_x9>
+  using type = tmppy_internal_test_module_x9;
+};
+template <typename tmppy_internal_test_module_x14>
+struct tmppy_internal_test_module_x26;
+// Split that generates type of: (meta)function wrapping a match expression
+template <typename tmppy_internal_test_module_x6>
+struct tmppy_internal_test_module_x26<tmppy_internal_test_module_x6 *> {
+  using type = tmppy_internal_test_module_x6;
+};
+// Split that generates value of: The is_error (meta)function
+template <typename tmppy_internal_test_module_x1>
+struct tmppy_internal_test_module_x20 {
+  static constexpr bool value =
+      !(std::is_same<tmppy_internal_test_module_x1, void>::value);
+};
+// Split that generates type of: _f
+template <typename tmppy_internal_test_module_x5>
+struct tmppy_internal_test_module_x32 {
+  using type = typename tmppy_internal_test_module_x30<
+      tmppy_internal_test_module_x20<void>::value>::
+      template type<void, typename tmppy_internal_test_module_x26<
+                              tmppy_internal_test_module_x5>::type>;
+};
+// Split that generates type of: g
+template <typename tmppy_internal_test_module_x5>
+struct tmppy_internal_test_module_x34 {
+  using type = typename tmppy_internal_test_module_x32<
+      tmppy_internal_test_module_x5 *>::type;
+};
+template <typename tmppy_internal_test_module_x5> struct g {
+  using error = void;
+  using type = typename tmppy_internal_test_module_x34<
+      tmppy_internal_test_module_x5>::type;
+};
+''', max_inlined_body_size=1, max_num_evaluated_template_instantiations=0)
+def test_optimization_unreachable_specializations_removed():
+    from tmppy import Type, match
+    def _f(t: Type):
+        return match(t)(lambda T: {
+            Type.pointer(T):
+                T,
+            Type.const(T):
+                T,
+        })
+    def g(t: Type):
+        return _f(Type.pointer(t))
+
+@assert_code_optimizes_to(r'''
+template <typename T> struct CheckIfError { using type = void; };
+template <typename tmppy_internal_test_module_x5,
+          int64_t tmppy_internal_test_module_x6>
+struct tmppy_internal_test_module_x21;
+// Split that generates value of: g
+template <int64_t... tmppy_internal_test_module_x15,
+          int64_t tmppy_internal_test_module_x6>
+struct tmppy_internal_test_module_x21<
+    Int64List<tmppy_internal_test_module_x15...>,
+    tmppy_internal_test_module_x6> {
+  static constexpr bool value = std::is_same<
+      typename Int64ListSlice<Int64List<(tmppy_internal_test_module_x15)...>,
+                              1LL, tmppy_internal_test_module_x6>::type,
+      typename Int64Range<1LL, tmppy_internal_test_module_x6>::type>::value;
+};
+template <typename tmppy_internal_test_module_x5,
+          int64_t tmppy_internal_test_module_x6>
+struct g {
+  using error = void;
+  static constexpr bool value =
+      tmppy_internal_test_module_x21<tmppy_internal_test_module_x5,
+                                     tmppy_internal_test_module_x6>::value;
+};
+template <typename tmppy_internal_test_module_x5>
+struct tmppy_internal_test_module_x19;
+// Split that generates type of: f
+template <typename... tmppy_internal_test_module_x14>
+struct tmppy_internal_test_module_x19<List<tmppy_internal_test_module_x14...>> {
+  template <int64_t tmppy_internal_test_module_x6>
+  using type =
+      typename TypeListGet<List<tmppy_internal_test_module_x14...>,
+                           tmppy_internal_test_module_x6>::type *;
+};
+template <typename tmppy_internal_test_module_x5,
+          int64_t tmppy_internal_test_module_x6>
+struct f {
+  using error = void;
+  using type = typename tmppy_internal_test_module_x19<
+      tmppy_internal_test_module_x5>::template type<tmppy_internal_test_module_x6>;
+};
+''')
+def test_optimization_list_index_and_slice_with_unknown_args():
+    from typing import List
+    from tmppy import Type
+    def f(l: List[Type], n: int):
+        return Type.pointer(l[n])
+    def g(l: List[int], n: int):
+        return l[1:n] == range(1, n)
+
+@assert_code_optimizes_to(r'''
+template <typename T> struct CheckIfError { using type = void; };
+template <typename tmppy_internal_test_module_x5>
+struct g {
+  using error = void;
+  using type = List<float, tmppy_internal_test_module_x5, int>;
+};
+template <typename tmppy_internal_test_module_x5>
+struct f {
+  using error = void;
+  static constexpr bool value = true;
+};
+template <typename tmppy_internal_test_module_x5>
+struct key {
+  using error = void;
+  static constexpr int64_t value = 1LL;
+};
+''')
+def test_optimization_sorted_and_unique_with_known_args():
+    from typing import List
+    from tmppy import Type, unique
+    def key(x: Type):
+        return 1
+    def f(x: Type):
+        return sorted([3, 1, 2]) == [1, 2, 3] and unique([5, 1, 5, 2]) == [1, 2, 5]
+    def g(x: Type):
+        return sorted([Type('float'), x, Type('int')], key=key)
+
 @assert_code_optimizes_to(r'''
 template <typename T> struct CheckIfError { using type = void; };
 ''')
@@ -82,6 +356,85 @@ def test_optimization_function_call_at_toplevel():
         return n + m
     assert _plus(3, 1) == 4
 
+@assert_code_optimizes_to(r'''
+template <typename T> struct CheckIfError { using type = void; };
+''')
+def test_optimization_recursive_function_call_at_toplevel_evaluated():
+    def _sum_up_to(n: int) -> int:
+        if n == 0:
+            return 0
+        else:
+            return n + _sum_up_to(n - 1)
+    assert _sum_up_to(100) == 5050
+
+@assert_code_optimizes_to(r'''
+template <typename T> struct CheckIfError { using type = void; };
+''')
+def test_optimization_recursive_function_returning_list_at_toplevel_evaluated():
+    from typing import List
+    from tmppy import empty_list
+    def _iota(n: int) -> List[int]:
+        if n == 0:
+            return empty_list(int)
+        else:
+            return _iota(n - 1) + [n]
+    assert _iota(5) == [1, 2, 3, 4, 5]
+
+@assert_code_optimizes_to(r'''
+template <typename T> struct CheckIfError { using type = void; };
+template <int64_t tmppy_internal_test_module_x5> struct f {
+  using error = void;
+  static constexpr int64_t value = (tmppy_internal_test_module_x5) + (1275LL);
+};
+''')
+def test_optimization_recursive_function_call_with_known_args_in_function_evaluated():
+    def _sum_up_to(n: int) -> int:
+        if n == 0:
+            return 0
+        else:
+            return n + _sum_up_to(n - 1)
+    def f(n: int):
+        return n + _sum_up_to(50)
+
+# The C++ division rounds towards zero, so the optimized code must get the same results as the non-optimized one.
+@assert_compilation_succeeds()
+def test_optimization_division_and_modulus_of_negative_numbers():
+    def _half(n: int):
+        return n // 2
+    def _mod2(n: int):
+        return n % 2
+    def f(n: int):
+        return _half(n) * 10 + _mod2(n)
+    assert _half(-7) == -3
+    assert _mod2(-7) == -1
+    assert f(-7) == -31
+    assert f(7) == 31
+
+def test_optimization_int64_folding():
+    assert fold_int64_binary_op('/', -7, 2) == -3
+    assert fold_int64_binary_op('%', -7, 2) == -1
+    assert fold_int64_binary_op('/', 7, -2) == -3
+    assert fold_int64_binary_op('%', 7, -2) == 1
+    assert fold_int64_binary_op('/', 1, 0) is None
+    assert fold_int64_binary_op('%', 1, 0) is None
+    assert fold_int64_binary_op('/', -2**63, -1) is None
+    assert fold_int64_binary_op('%', -2**63, -1) is None
+    assert fold_int64_binary_op('+', 2**63 - 1, 1) is None
+    assert fold_int64_binary_op('-', -2**63, 1) is None
+    assert fold_int64_binary_op('*', 2**32, 2**31) is None
+    assert fold_int64_binary_op('*', -2**32, 2**31) == -2**63
+    assert fold_int64_unary_minus(-2**63) is None
+    assert fold_int64_unary_minus(2**63 - 1) == -2**63 + 1
+
+@assert_compilation_fails_with_generic_error('TMPPy assertion failed')
+def test_optimization_recursive_function_call_at_toplevel_evaluated_failing_assertion():
+    def _sum_up_to(n: int) -> int:
+        if n == 0:
+            return 0
+        else:
+            return n + _sum_up_to(n - 1)
+    assert _sum_up_to(100) == 5051
+
 @assert_code_optimizes_to(r'''
 template <typename T> struct CheckIfError { using type = void; };
 template <bool tmppy_internal_test_module_x5,
@@ -575,37 +928,20 @@ def test_optimization_multiple_list_comprehensions():
 
 @assert_code_optimizes_to(r'''
 template <typename T> struct CheckIfError { using type = void; };
-template <typename L1, typename L2> struct BoolListConcat;
-template <bool... bs1, bool... bs2>
-struct BoolListConcat<BoolList<bs1...>, BoolList<bs2...>> {
-  using type = BoolList<(bs1)..., (bs2)...>;
+template <bool is_present, typename S> struct AddToBoolSetHelper {
+  template <bool b> using type = S;
 };
-template <bool tmppy_internal_tmppy_builtins_x123>
-struct tmppy_internal_tmppy_builtins_x246;
-// Split that generates type of: (meta)function generated for an if-else
-// statement
-template <> struct tmppy_internal_tmppy_builtins_x246<true> {
-  template <typename tmppy_internal_tmppy_builtins_x7,
-            bool tmppy_internal_tmppy_builtins_x21>
-  using type = tmppy_internal_tmppy_builtins_x7;
-};
-// Split that generates type of: (meta)function generated for an if-else
-// statement
-template <> struct tmppy_internal_tmppy_builtins_x246<false> {
-  template <typename tmppy_internal_tmppy_builtins_x7,
-            bool tmppy_internal_tmppy_builtins_x21>
-  using type =
-      typename BoolListConcat<BoolList<tmppy_internal_tmppy_builtins_x21>,
-                              tmppy_internal_tmppy_builtins_x7>::type;
+template <bool... bs> struct AddToBoolSetHelper<false, BoolList<bs...>> {
+  template <bool b> using type = BoolList<b, (bs)...>;
 };
 template <bool tmppy_internal_test_module_x5,
           bool tmppy_internal_test_module_x6>
 struct set_of {
   using error = void;
-  using type = typename tmppy_internal_tmppy_builtins_x246<
-      (tmppy_internal_test_module_x6) == (tmppy_internal_test_module_x5)>::
-      template type<BoolList<tmppy_internal_test_module_x5>,
-                    tmppy_internal_test_module_x6>;
+  using type = typename AddToBoolSetHelper<
+      (tmppy_internal_test_module_x6) == (tmppy_internal_test_module_x5),
+      BoolList<tmppy_internal_test_module_x5>>::
+      template type<tmppy_internal_test_module_x6>;
 };
 ''')
 def test_optimization_set_with_two_bools():
@@ -615,37 +951,20 @@ def test_optimization_set_with_two_bools():
 
 @assert_code_optimizes_to(r'''
 template <typename T> struct CheckIfError { using type = void; };
-template <typename L1, typename L2> struct Int64ListConcat;
-template <int64_t... ns, int64_t... ms>
-struct Int64ListConcat<Int64List<ns...>, Int64List<ms...>> {
-  using type = Int64List<(ns)..., (ms)...>;
+template <bool is_present, typename S> struct AddToInt64SetHelper {
+  template <int64_t n> using type = S;
 };
-template <bool tmppy_internal_tmppy_builtins_x126>
-struct tmppy_internal_tmppy_builtins_x250;
-// Split that generates type of: (meta)function generated for an if-else
-// statement
-template <> struct tmppy_internal_tmppy_builtins_x250<true> {
-  template <typename tmppy_internal_tmppy_builtins_x7,
-            int64_t tmppy_internal_tmppy_builtins_x28>
-  using type = tmppy_internal_tmppy_builtins_x7;
-};
-// Split that generates type of: (meta)function generated for an if-else
-// statement
-template <> struct tmppy_internal_tmppy_builtins_x250<false> {
-  template <typename tmppy_internal_tmppy_builtins_x7,
-            int64_t tmppy_internal_tmppy_builtins_x28>
-  using type =
-      typename Int64ListConcat<Int64List<tmppy_internal_tmppy_builtins_x28>,
-                               tmppy_internal_tmppy_builtins_x7>::type;
+template <int64_t... ns> struct AddToInt64SetHelper<false, Int64List<ns...>> {
+  template <int64_t n> using type = Int64List<n, (ns)...>;
 };
 template <int64_t tmppy_internal_test_module_x5,
           int64_t tmppy_internal_test_module_x6>
 struct set_of {
   using error = void;
-  using type = typename tmppy_internal_tmppy_builtins_x250<
-      (tmppy_internal_test_module_x6) == (tmppy_internal_test_module_x5)>::
-      template type<Int64List<tmppy_internal_test_module_x5>,
-                    tmppy_internal_test_module_x6>;
+  using type = typename AddToInt64SetHelper<
+      (tmppy_internal_test_module_x6) == (tmppy_internal_test_module_x5),
+      Int64List<tmppy_internal_test_module_x5>>::
+      template type<tmppy_internal_test_module_x6>;
 };
 ''')
 def test_optimization_set_with_two_ints():
@@ -655,36 +974,21 @@ def test_optimization_set_with_two_ints():
 
 @assert_code_optimizes_to(r'''
 template <typename T> struct CheckIfError { using type = void; };
-template <typename L1, typename L2> struct TypeListConcat;
-template <typename... Ts, typename... Us>
-struct TypeListConcat<List<Ts...>, List<Us...>> {
-  using type = List<Ts..., Us...>;
-};
-template <bool tmppy_internal_tmppy_builtins_x129>
-struct tmppy_internal_tmppy_builtins_x254;
-// Split that generates type of: (meta)function generated for an if-else
-// statement
-template <> struct tmppy_internal_tmppy_builtins_x254<true> {
-  template <typename tmppy_internal_tmppy_builtins_x7,
-            typename tmppy_internal_tmppy_builtins_x5>
-  using type = tmppy_internal_tmppy_builtins_x7;
+template <bool is_present, typename S> struct AddToTypeSetHelper {
+  template <typename T> using type = S;
 };
-// Split that generates type of: (meta)function generated for an if-else
-// statement
-template <> struct tmppy_internal_tmppy_builtins_x254<false> {
-  template <typename tmppy_internal_tmppy_builtins_x7,
-            typename tmppy_internal_tmppy_builtins_x5>
-  using type = typename TypeListConcat<List<tmppy_internal_tmppy_builtins_x5>,
-                                       tmppy_internal_tmppy_builtins_x7>::type;
+template <typename... Ts> struct AddToTypeSetHelper<false, List<Ts...>> {
+  template <typename T> using type = List<T, Ts...>;
 };
 template <typename tmppy_internal_test_module_x5,
           typename tmppy_internal_test_module_x6>
 struct set_of {
   using error = void;
-  using type = typename tmppy_internal_tmppy_builtins_x254<std::is_same<
-      tmppy_internal_test_module_x6, tmppy_internal_test_module_x5>::value>::
-      template type<List<tmppy_internal_test_module_x5>,
-                    tmppy_internal_test_module_x6>;
+  using type = typename AddToTypeSetHelper<
+      std::is_same<tmppy_internal_test_module_x6,
+                   tmppy_internal_test_module_x5>::value,
+      List<tmppy_internal_test_module_x5>>::
+      template type<tmppy_internal_test_module_x6>;
 };
 ''')
 def test_optimization_set_with_two_types():
@@ -705,11 +1009,8 @@ struct tmppy_internal_test_module_x20<
     tmppy_internal_test_module_x5,
     BoolList<tmppy_internal_test_module_x15...>> {
   static constexpr bool value =
-      !(std::is_same<
-          BoolList<((tmppy_internal_test_module_x5) ==
-                    (tmppy_internal_test_module_x15))...>,
-          BoolList<(Select1stBoolBool<
-                    false, tmppy_internal_test_module_x15>::value)...>>::value);
+      std::is_base_of<BoolSetIndexElem<tmppy_internal_test_module_x5>,
+                      BoolSetIndex<(tmppy_internal_test_module_x15)...>>::value;
 };
 template <bool tmppy_internal_test_module_x5,
           typename tmppy_internal_test_module_x6>
@@ -738,11 +1039,8 @@ struct tmppy_internal_test_module_x20<
     tmppy_internal_test_module_x5,
     Int64List<tmppy_internal_test_module_x15...>> {
   static constexpr bool value =
-      !(std::is_same<
-          BoolList<((tmppy_internal_test_module_x5) ==
-                    (tmppy_internal_test_module_x15))...>,
-          BoolList<(Select1stBoolInt64<
-                    false, tmppy_internal_test_module_x15>::value)...>>::value);
+      std::is_base_of<Int64SetIndexElem<tmppy_internal_test_module_x5>,
+                      Int64SetIndex<(tmppy_internal_test_module_x15)...>>::value;
 };
 template <int64_t tmppy_internal_test_module_x5,
           typename tmppy_internal_test_module_x6>
@@ -770,11 +1068,8 @@ template <typename tmppy_internal_test_module_x5,
 struct tmppy_internal_test_module_x20<tmppy_internal_test_module_x5,
                                       List<tmppy_internal_test_module_x15...>> {
   static constexpr bool value =
-      !(std::is_same<
-          BoolList<(std::is_same<tmppy_internal_test_module_x5,
-                                 tmppy_internal_test_module_x15>::value)...>,
-          BoolList<(Select1stBoolType<
-                    false, tmppy_internal_test_module_x15>::value)...>>::value);
+      std::is_base_of<TypeSetIndexElem<tmppy_internal_test_module_x5>,
+                      TypeSetIndex<tmppy_internal_test_module_x15...>>::value;
 };
 template <typename tmppy_internal_test_module_x5,
           typename tmppy_internal_test_module_x6>
@@ -794,85 +1089,6 @@ def test_optimization_is_in_type_set():
 
 @assert_code_optimizes_to(r'''
 template <typename T> struct CheckIfError { using type = void; };
-template <typename tmppy_internal_tmppy_builtins_x5,
-          bool tmppy_internal_tmppy_builtins_x58>
-struct tmppy_internal_tmppy_builtins_x260;
-// Split that generates value of: (meta)function wrapping the result expression
-// in a list/set comprehension from the function BoolSetEquals
-template <bool... tmppy_internal_tmppy_builtins_x131,
-          bool tmppy_internal_tmppy_builtins_x58>
-struct tmppy_internal_tmppy_builtins_x260<
-    BoolList<tmppy_internal_tmppy_builtins_x131...>,
-    tmppy_internal_tmppy_builtins_x58> {
-  static constexpr bool value =
-      !(std::is_same<
-          BoolList<((tmppy_internal_tmppy_builtins_x58) ==
-                    (tmppy_internal_tmppy_builtins_x131))...>,
-          BoolList<(Select1stBoolBool<
-                    false, tmppy_internal_tmppy_builtins_x131>::value)...>>::
-            value);
-};
-template <typename L> struct tmppy_internal_tmppy_builtins_x268;
-// Split that generates type of: tmppy_internal_tmppy_builtins_x138
-template <bool... elems>
-struct tmppy_internal_tmppy_builtins_x268<BoolList<elems...>> {
-  template <typename tmppy_internal_tmppy_builtins_x5>
-  using type = BoolList<(tmppy_internal_tmppy_builtins_x260<
-                         tmppy_internal_tmppy_builtins_x5, elems>::value)...>;
-};
-template <typename tmppy_internal_tmppy_builtins_x7>
-struct tmppy_internal_tmppy_builtins_x196;
-// Split that generates value of: BoolListAll
-template <bool... tmppy_internal_tmppy_builtins_x90>
-struct tmppy_internal_tmppy_builtins_x196<
-    BoolList<tmppy_internal_tmppy_builtins_x90...>> {
-  static constexpr bool value = std::is_same<
-      BoolList<(tmppy_internal_tmppy_builtins_x90)...>,
-      BoolList<(Select1stBoolBool<
-                true, tmppy_internal_tmppy_builtins_x90>::value)...>>::value;
-};
-template <typename tmppy_internal_tmppy_builtins_x35,
-          typename tmppy_internal_tmppy_builtins_x5,
-          bool tmppy_internal_tmppy_builtins_x143>
-struct tmppy_internal_tmppy_builtins_x276;
-// Split that generates value of: (meta)function generated for an if-else
-// statement
-template <typename tmppy_internal_tmppy_builtins_x35,
-          typename tmppy_internal_tmppy_builtins_x5>
-struct tmppy_internal_tmppy_builtins_x276<
-    tmppy_internal_tmppy_builtins_x35, tmppy_internal_tmppy_builtins_x5, true> {
-  static constexpr bool value = tmppy_internal_tmppy_builtins_x196<
-      typename tmppy_internal_tmppy_builtins_x268<
-          tmppy_internal_tmppy_builtins_x35>::
-          template type<tmppy_internal_tmppy_builtins_x5>>::value;
-};
-// Split that generates value of: (meta)function generated for an if-else
-// statement
-template <typename tmppy_internal_tmppy_builtins_x35,
-          typename tmppy_internal_tmppy_builtins_x5>
-struct tmppy_internal_tmppy_builtins_x276<tmppy_internal_tmppy_builtins_x35,
-                                          tmppy_internal_tmppy_builtins_x5,
-                                          false> {
-  static constexpr bool value = false;
-};
-template <typename tmppy_internal_tmppy_builtins_x35,
-          bool tmppy_internal_tmppy_builtins_x51>
-struct tmppy_internal_tmppy_builtins_x258;
-// Split that generates value of: (meta)function wrapping the result expression
-// in a list/set comprehension from the function BoolSetEquals
-template <bool... tmppy_internal_tmppy_builtins_x130,
-          bool tmppy_internal_tmppy_builtins_x51>
-struct tmppy_internal_tmppy_builtins_x258<
-    BoolList<tmppy_internal_tmppy_builtins_x130...>,
-    tmppy_internal_tmppy_builtins_x51> {
-  static constexpr bool value =
-      !(std::is_same<
-          BoolList<((tmppy_internal_tmppy_builtins_x51) ==
-                    (tmppy_internal_tmppy_builtins_x130))...>,
-          BoolList<(Select1stBoolBool<
-                    false, tmppy_internal_tmppy_builtins_x130>::value)...>>::
-            value);
-};
 template <typename tmppy_internal_test_module_x5,
           typename tmppy_internal_test_module_x6>
 struct tmppy_internal_test_module_x23;
@@ -882,15 +1098,22 @@ template <bool... tmppy_internal_test_module_x17,
 struct tmppy_internal_test_module_x23<
     BoolList<tmppy_internal_test_module_x17...>,
     BoolList<tmppy_internal_test_module_x18...>> {
-  static constexpr bool value = tmppy_internal_tmppy_builtins_x276<
-      BoolList<(tmppy_internal_test_module_x18)...>,
-      BoolList<(tmppy_internal_test_module_x17)...>,
-      std::is_same<
-          BoolList<(tmppy_internal_tmppy_builtins_x258<
-                    BoolList<(tmppy_internal_test_module_x18)...>,
-                    tmppy_internal_test_module_x17>::value)...>,
-          BoolList<(Select1stBoolBool<true, tmppy_internal_test_module_x17>::
-                        value)...>>::value>::value;
+  static constexpr bool value =
+      (std::is_same<
+          BoolList<(std::is_base_of<
+                    BoolSetIndexElem<tmppy_internal_test_module_x17>,
+                    BoolSetIndex<(tmppy_internal_test_module_x18)...>>::
+                        value)...>,
+          BoolList<(Select1stBoolBool<
+                    true, tmppy_internal_test_module_x17>::value)...>>::
+           value) &&
+      (std::is_same<
+          BoolList<(std::is_base_of<
+                    BoolSetIndexElem<tmppy_internal_test_module_x18>,
+                    BoolSetIndex<(tmppy_internal_test_module_x17)...>>::
+                        value)...>,
+          BoolList<(Select1stBoolBool<
+                    true, tmppy_internal_test_module_x18>::value)...>>::value);
 };
 template <typename tmppy_internal_test_module_x5,
           typename tmppy_internal_test_module_x6>
@@ -909,85 +1132,6 @@ def test_optimization_bool_set_equals():
 
 @assert_code_optimizes_to(r'''
 template <typename T> struct CheckIfError { using type = void; };
-template <typename tmppy_internal_tmppy_builtins_x5,
-          int64_t tmppy_internal_tmppy_builtins_x58>
-struct tmppy_internal_tmppy_builtins_x286;
-// Split that generates value of: (meta)function wrapping the result expression
-// in a list/set comprehension from the function Int64SetEquals
-template <int64_t... tmppy_internal_tmppy_builtins_x148,
-          int64_t tmppy_internal_tmppy_builtins_x58>
-struct tmppy_internal_tmppy_builtins_x286<
-    Int64List<tmppy_internal_tmppy_builtins_x148...>,
-    tmppy_internal_tmppy_builtins_x58> {
-  static constexpr bool value =
-      !(std::is_same<
-          BoolList<((tmppy_internal_tmppy_builtins_x58) ==
-                    (tmppy_internal_tmppy_builtins_x148))...>,
-          BoolList<(Select1stBoolInt64<
-                    false, tmppy_internal_tmppy_builtins_x148>::value)...>>::
-            value);
-};
-template <typename L> struct tmppy_internal_tmppy_builtins_x294;
-// Split that generates type of: tmppy_internal_tmppy_builtins_x155
-template <int64_t... elems>
-struct tmppy_internal_tmppy_builtins_x294<Int64List<elems...>> {
-  template <typename tmppy_internal_tmppy_builtins_x5>
-  using type = BoolList<(tmppy_internal_tmppy_builtins_x286<
-                         tmppy_internal_tmppy_builtins_x5, elems>::value)...>;
-};
-template <typename tmppy_internal_tmppy_builtins_x7>
-struct tmppy_internal_tmppy_builtins_x196;
-// Split that generates value of: BoolListAll
-template <bool... tmppy_internal_tmppy_builtins_x90>
-struct tmppy_internal_tmppy_builtins_x196<
-    BoolList<tmppy_internal_tmppy_builtins_x90...>> {
-  static constexpr bool value = std::is_same<
-      BoolList<(tmppy_internal_tmppy_builtins_x90)...>,
-      BoolList<(Select1stBoolBool<
-                true, tmppy_internal_tmppy_builtins_x90>::value)...>>::value;
-};
-template <typename tmppy_internal_tmppy_builtins_x35,
-          typename tmppy_internal_tmppy_builtins_x5,
-          bool tmppy_internal_tmppy_builtins_x160>
-struct tmppy_internal_tmppy_builtins_x302;
-// Split that generates value of: (meta)function generated for an if-else
-// statement
-template <typename tmppy_internal_tmppy_builtins_x35,
-          typename tmppy_internal_tmppy_builtins_x5>
-struct tmppy_internal_tmppy_builtins_x302<
-    tmppy_internal_tmppy_builtins_x35, tmppy_internal_tmppy_builtins_x5, true> {
-  static constexpr bool value = tmppy_internal_tmppy_builtins_x196<
-      typename tmppy_internal_tmppy_builtins_x294<
-          tmppy_internal_tmppy_builtins_x35>::
-          template type<tmppy_internal_tmppy_builtins_x5>>::value;
-};
-// Split that generates value of: (meta)function generated for an if-else
-// statement
-template <typename tmppy_internal_tmppy_builtins_x35,
-          typename tmppy_internal_tmppy_builtins_x5>
-struct tmppy_internal_tmppy_builtins_x302<tmppy_internal_tmppy_builtins_x35,
-                                          tmppy_internal_tmppy_builtins_x5,
-                                          false> {
-  static constexpr bool value = false;
-};
-template <typename tmppy_internal_tmppy_builtins_x35,
-          int64_t tmppy_internal_tmppy_builtins_x51>
-struct tmppy_internal_tmppy_builtins_x284;
-// Split that generates value of: (meta)function wrapping the result expression
-// in a list/set comprehension from the function Int64SetEquals
-template <int64_t... tmppy_internal_tmppy_builtins_x147,
-          int64_t tmppy_internal_tmppy_builtins_x51>
-struct tmppy_internal_tmppy_builtins_x284<
-    Int64List<tmppy_internal_tmppy_builtins_x147...>,
-    tmppy_internal_tmppy_builtins_x51> {
-  static constexpr bool value =
-      !(std::is_same<
-          BoolList<((tmppy_internal_tmppy_builtins_x51) ==
-                    (tmppy_internal_tmppy_builtins_x147))...>,
-          BoolList<(Select1stBoolInt64<
-                    false, tmppy_internal_tmppy_builtins_x147>::value)...>>::
-            value);
-};
 template <typename tmppy_internal_test_module_x5,
           typename tmppy_internal_test_module_x6>
 struct tmppy_internal_test_module_x23;
@@ -997,15 +1141,22 @@ template <int64_t... tmppy_internal_test_module_x17,
 struct tmppy_internal_test_module_x23<
     Int64List<tmppy_internal_test_module_x17...>,
     Int64List<tmppy_internal_test_module_x18...>> {
-  static constexpr bool value = tmppy_internal_tmppy_builtins_x302<
-      Int64List<(tmppy_internal_test_module_x18)...>,
-      Int64List<(tmppy_internal_test_module_x17)...>,
-      std::is_same<
-          BoolList<(tmppy_internal_tmppy_builtins_x284<
-                    Int64List<(tmppy_internal_test_module_x18)...>,
-                    tmppy_internal_test_module_x17>::value)...>,
-          BoolList<(Select1stBoolInt64<true, tmppy_internal_test_module_x17>::
-                        value)...>>::value>::value;
+  static constexpr bool value =
+      (std::is_same<
+          BoolList<(std::is_base_of<
+                    Int64SetIndexElem<tmppy_internal_test_module_x17>,
+                    Int64SetIndex<(tmppy_internal_test_module_x18)...>>::
+                        value)...>,
+          BoolList<(Select1stBoolInt64<
+                    true, tmppy_internal_test_module_x17>::value)...>>::
+           value) &&
+      (std::is_same<
+          BoolList<(std::is_base_of<
+                    Int64SetIndexElem<tmppy_internal_test_module_x18>,
+                    Int64SetIndex<(tmppy_internal_test_module_x17)...>>::
+                        value)...>,
+          BoolList<(Select1stBoolInt64<
+                    true, tmppy_internal_test_module_x18>::value)...>>::value);
 };
 template <typename tmppy_internal_test_module_x5,
           typename tmppy_internal_test_module_x6>
@@ -1024,104 +1175,31 @@ def test_optimization_int_set_equals():
 
 @assert_code_optimizes_to(r'''
 template <typename T> struct CheckIfError { using type = void; };
-template <typename tmppy_internal_tmppy_builtins_x5,
-          typename tmppy_internal_tmppy_builtins_x58>
-struct tmppy_internal_tmppy_builtins_x312;
-// Split that generates value of: (meta)function wrapping the result expression
-// in a list/set comprehension from the function TypeSetEquals
-template <typename... tmppy_internal_tmppy_builtins_x165,
-          typename tmppy_internal_tmppy_builtins_x58>
-struct tmppy_internal_tmppy_builtins_x312<
-    List<tmppy_internal_tmppy_builtins_x165...>,
-    tmppy_internal_tmppy_builtins_x58> {
-  static constexpr bool value =
-      !(std::is_same<
-          BoolList<(
-              std::is_same<tmppy_internal_tmppy_builtins_x58,
-                           tmppy_internal_tmppy_builtins_x165>::value)...>,
-          BoolList<(Select1stBoolType<
-                    false, tmppy_internal_tmppy_builtins_x165>::value)...>>::
-            value);
-};
-template <typename L> struct tmppy_internal_tmppy_builtins_x320;
-// Split that generates type of: tmppy_internal_tmppy_builtins_x172
-template <typename... elems>
-struct tmppy_internal_tmppy_builtins_x320<List<elems...>> {
-  template <typename tmppy_internal_tmppy_builtins_x5>
-  using type = BoolList<(tmppy_internal_tmppy_builtins_x312<
-                         tmppy_internal_tmppy_builtins_x5, elems>::value)...>;
-};
-template <typename tmppy_internal_tmppy_builtins_x7>
-struct tmppy_internal_tmppy_builtins_x196;
-// Split that generates value of: BoolListAll
-template <bool... tmppy_internal_tmppy_builtins_x90>
-struct tmppy_internal_tmppy_builtins_x196<
-    BoolList<tmppy_internal_tmppy_builtins_x90...>> {
-  static constexpr bool value = std::is_same<
-      BoolList<(tmppy_internal_tmppy_builtins_x90)...>,
-      BoolList<(Select1stBoolBool<
-                true, tmppy_internal_tmppy_builtins_x90>::value)...>>::value;
-};
-template <typename tmppy_internal_tmppy_builtins_x35,
-          typename tmppy_internal_tmppy_builtins_x5,
-          bool tmppy_internal_tmppy_builtins_x177>
-struct tmppy_internal_tmppy_builtins_x328;
-// Split that generates value of: (meta)function generated for an if-else
-// statement
-template <typename tmppy_internal_tmppy_builtins_x35,
-          typename tmppy_internal_tmppy_builtins_x5>
-struct tmppy_internal_tmppy_builtins_x328<
-    tmppy_internal_tmppy_builtins_x35, tmppy_internal_tmppy_builtins_x5, true> {
-  static constexpr bool value = tmppy_internal_tmppy_builtins_x196<
-      typename tmppy_internal_tmppy_builtins_x320<
-          tmppy_internal_tmppy_builtins_x35>::
-          template type<tmppy_internal_tmppy_builtins_x5>>::value;
-};
-// Split that generates value of: (meta)function generated for an if-else
-// statement
-template <typename tmppy_internal_tmppy_builtins_x35,
-          typename tmppy_internal_tmppy_builtins_x5>
-struct tmppy_internal_tmppy_builtins_x328<tmppy_internal_tmppy_builtins_x35,
-                                          tmppy_internal_tmppy_builtins_x5,
-                                          false> {
-  static constexpr bool value = false;
-};
-template <typename tmppy_internal_tmppy_builtins_x35,
-          typename tmppy_internal_tmppy_builtins_x51>
-struct tmppy_internal_tmppy_builtins_x310;
-// Split that generates value of: (meta)function wrapping the result expression
-// in a list/set comprehension from the function TypeSetEquals
-template <typename... tmppy_internal_tmppy_builtins_x164,
-          typename tmppy_internal_tmppy_builtins_x51>
-struct tmppy_internal_tmppy_builtins_x310<
-    List<tmppy_internal_tmppy_builtins_x164...>,
-    tmppy_internal_tmppy_builtins_x51> {
-  static constexpr bool value =
-      !(std::is_same<
-          BoolList<(
-              std::is_same<tmppy_internal_tmppy_builtins_x51,
-                           tmppy_internal_tmppy_builtins_x164>::value)...>,
-          BoolList<(Select1stBoolType<
-                    false, tmppy_internal_tmppy_builtins_x164>::value)...>>::
-            value);
-};
 template <typename tmppy_internal_test_module_x5,
           typename tmppy_internal_test_module_x6>
 struct tmppy_internal_test_module_x23;
 // Split that generates value of: eq
 template <typename... tmppy_internal_test_module_x17,
           typename... tmppy_internal_test_module_x18>
-struct tmppy_internal_test_module_x23<List<tmppy_internal_test_module_x17...>,
-                                      List<tmppy_internal_test_module_x18...>> {
-  static constexpr bool value = tmppy_internal_tmppy_builtins_x328<
-      List<tmppy_internal_test_module_x18...>,
-      List<tmppy_internal_test_module_x17...>,
-      std::is_same<
-          BoolList<(tmppy_internal_tmppy_builtins_x310<
-                    List<tmppy_internal_test_module_x18...>,
-                    tmppy_internal_test_module_x17>::value)...>,
-          BoolList<(Select1stBoolType<true, tmppy_internal_test_module_x17>::
-                        value)...>>::value>::value;
+struct tmppy_internal_test_module_x23<
+    List<tmppy_internal_test_module_x17...>,
+    List<tmppy_internal_test_module_x18...>> {
+  static constexpr bool value =
+      (std::is_same<
+          BoolList<(std::is_base_of<
+                    TypeSetIndexElem<tmppy_internal_test_module_x17>,
+                    TypeSetIndex<tmppy_internal_test_module_x18...>>::
+                        value)...>,
+          BoolList<(Select1stBoolType<
+                    true, tmppy_internal_test_module_x17>::value)...>>::
+           value) &&
+      (std::is_same<
+          BoolList<(std::is_base_of<
+                    TypeSetIndexElem<tmppy_internal_test_module_x18>,
+                    TypeSetIndex<tmppy_internal_test_module_x17...>>::
+                        value)...>,
+          BoolList<(Select1stBoolType<
+                    true, tmppy_internal_test_module_x18>::value)...>>::value);
 };
 template <typename tmppy_internal_test_module_x5,
           typename tmppy_internal_test_module_x6>
@@ -1139,5 +1217,73 @@ def test_optimization_type_set_equals():
         return x == y
     assert eq({Type('int')}, {Type('float')}) == False
 
+def test_optimization_checkpoints():
+    tmppy_source = '''\
+from typing import List
+def _factorial(n: int) -> int:
+    if n <= 0:
+        return 1
+    else:
+        return n * _factorial(n - 1)
+def f(n: int):
+    return _factorial(n) + _factorial(n + 1)
+def g(l: List[int]):
+    return [_factorial(n) for n in l]
+'''
+    def compile_and_link(max_num_optimization_steps: int):
+        ConfigurationKnobs.max_num_optimization_steps = max_num_optimization_steps
+        ConfigurationKnobs.optimization_step_counter = 0
+        return link(compile(tmppy_source), use_clang_format=False)
+
+    try:
+        cpp_source_by_max_num_optimization_steps = {-1: compile_and_link(-1)}
+        num_optimization_steps = ConfigurationKnobs.optimization_step_counter
+        assert num_optimization_steps > 20
+        for n in (0, 5, 20):
+            cpp_source_by_max_num_optimization_steps[n] = compile_and_link(n)
+
+        checkpoints = OptimizationCheckpoints()
+        ConfigurationKnobs.optimization_checkpoints = checkpoints
+        for n in (-1, 20, 0, 5, -1):
+            checkpoints.start_compilation()
+            assert compile_and_link(n) == cpp_source_by_max_num_optimization_steps[n]
+        assert checkpoints.num_performed_steps + checkpoints.num_replayed_steps == 2 * num_optimization_steps + 20 + 5
+        # The first compilation performs all the steps, the others replay almost all of them (all except the ones with
+        # side effects).
+        assert checkpoints.num_performed_steps - num_optimization_steps < checkpoints.num_replayed_steps / 10
+    finally:
+        ConfigurationKnobs.max_num_optimization_steps = -1
+        ConfigurationKnobs.optimization_checkpoints = None
+
+def test_optimization_checkpoints_identifiers_differ_partway_through_step():
+    num_identifiers_to_take = 3
+    def optimization():
+        return tuple(next(recording_identifier_generator) for _ in range(num_identifiers_to_take)), False
+
+    checkpoints = OptimizationCheckpoints()
+    elems = ('elem',)
+    with checkpoints.recording_identifiers(iter(['x0', 'x1', 'x2', 'x3'])) as recording_identifier_generator:
+        assert checkpoints.perform_step('opt', elems, optimization, has_side_effects=False) == (('x0', 'x1', 'x2'), False)
+
+    # The first 2 identifiers are the same as in the recorded step, but then they differ. So the step is performed
+    # again, and it must get the same identifiers as if there were no checkpoints. The ones that it doesn't take (even
+    # if they were looked at) must still be available afterwards.
+    checkpoints.start_compilation()
+    identifier_generator = LookaheadIdentifierGenerator(iter(['x0', 'x1', 'y2', 'y3']))
+    num_identifiers_to_take = 1
+    with checkpoints.recording_identifiers(identifier_generator) as recording_identifier_generator:
+        assert checkpoints.perform_step('opt', elems, optimization, has_side_effects=False) == (('x0',), False)
+    assert list(identifier_generator) == ['x1', 'y2', 'y3']
+    assert checkpoints.num_replayed_steps == 0
+    assert checkpoints.num_performed_steps == 2
+
+    # Now the identifiers are the same as in the recorded step, so it's replayed.
+    checkpoints.start_compilation()
+    identifier_generator = LookaheadIdentifierGenerator(iter(['x0', 'x1', 'y2', 'y3']))
+    with checkpoints.recording_identifiers(identifier_generator) as recording_identifier_generator:
+        assert checkpoints.perform_step('opt', elems, optimization, has_side_effects=False) == (('x0',), False)
+    assert list(identifier_generator) == ['x1', 'y2', 'y3']
+    assert checkpoints.num_replayed_steps == 1
+
 if __name__== '__main__':
     main()
@@ -87,6 +87,14 @@ def test_set_of_ints_with_duplicates_ok():
 def test_set_of_ints_with_different_order_equal():
     assert {1, 2, 3} == {3, 2, 1}
 
+@assert_compilation_succeeds()
+def test_is_in_set_with_non_constant_elements_in_function_ok():
+    def f(n: int):
+        return n in {1, 2, 3, 4, 5, 6, n + 6, n + 7}
+    assert f(3)
+    assert not f(-5)
+    assert not f(7)
+
 @assert_conversion_fails
 def test_set_concat_not_supported_error():
     assert {1} + {2, 3} == {1, 2, 3}  # error: The "\+" operator is only supported for ints and lists, but this value has type Set\[int\].
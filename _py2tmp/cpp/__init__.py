@@ -12,4 +12,4 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from ._writers import Writer, ToplevelWriter, TemplateElemWriter, ExprWriter
+from ._writers import Writer, ToplevelWriter, TemplateElemWriter, ExprWriter, indent_template_body
@@ -11,8 +11,23 @@
 # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 # See the License for the specific language governing permissions and
 # limitations under the License.
+import textwrap
 from contextlib import contextmanager
-from typing import Iterator
+from typing import Iterator, List
+
+# Elements written with write_toplevel_elem() and write_template_body_elem() can be indented arbitrarily (typically
+# they're indented to match the surrounding Python code); they're normalized so that the generated code is stably
+# indented without having to run clang-format on it:
+# * The common indentation is removed, as well as any trailing whitespace.
+# * Empty lines are removed.
+# * Every element ends with a newline.
+def _normalize_elem(s: str) -> str:
+    lines = [line.rstrip() for line in textwrap.dedent(s).split('\n')]
+    return ''.join(line + '\n' for line in lines if line)
+
+# Indents the (already normalized) elements of a template body, so that they can be written inside a "struct { ... }".
+def indent_template_body(elems: List[str]) -> str:
+    return ''.join('  ' + line + '\n' for line in ''.join(elems).splitlines())
 
 
 class Writer:
@@ -36,7 +51,7 @@ class ToplevelWriter(Writer):
         return next(self.identifier_generator)
 
     def write_toplevel_elem(self, s: str):
-        self.strings.append(s)
+        self.strings.append(_normalize_elem(s))
 
     def write_template_body_elem(self, s: str):
         self.write_toplevel_elem(s)
@@ -63,7 +78,7 @@ class TemplateElemWriter(Writer):
         self.toplevel_writer.write_toplevel_elem(s)
 
     def write_template_body_elem(self, s: str):
-        self.strings.append(s)
+        self.strings.append(_normalize_elem(s))
 
     def write_expr_fragment(self, s: str):
         self.strings.append(s)
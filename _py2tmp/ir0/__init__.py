@@ -18,3 +18,4 @@ from ._transformation import Transformation, Writer, ToplevelWriter, TemplateBod
 from ._is_variadic import is_expr_variadic
 from ._builtin_literals import GlobalLiterals, GLOBAL_LITERALS_BY_NAME, select1st_literal
 from ._template_dependency_graph import compute_template_dependency_graph
+from ._interning import ExprInterner, intern_exprs_in_header
@@ -97,6 +97,11 @@ class GlobalLiterals:
                                                                  is_metafunction_that_may_return_error=False,
                                                                  may_be_alias=False)
 
+    UPDATE_FIRST_ERROR = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='UpdateFirstError',
+                                                                    args=(_type_arg_type(), _type_arg_type()),
+                                                                    is_metafunction_that_may_return_error=False,
+                                                                    may_be_alias=False)
+
     ALWAYS_TRUE_FROM_TYPE = ir.AtomicTypeLiteral.for_nonlocal_template('AlwaysTrueFromType',
                                                                        args=(_type_arg_type(),),
                                                                        is_metafunction_that_may_return_error=False,
@@ -137,24 +142,21 @@ class GlobalLiterals:
                                                                   may_be_alias=False)
 
     ADD_TO_BOOL_SET_HELPER = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='AddToBoolSetHelper',
-                                                                        args=(_type_arg_type(),
-                                                                              _type_arg_type(),
+                                                                        args=(_bool_arg_type(),
                                                                               _type_arg_type(),
                                                                               _bool_arg_type()),
                                                                         is_metafunction_that_may_return_error=False,
                                                                         may_be_alias=False)
 
     ADD_TO_INT64_SET_HELPER = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='AddToInt64SetHelper',
-                                                                         args=(_type_arg_type(),
-                                                                               _type_arg_type(),
+                                                                         args=(_bool_arg_type(),
                                                                                _type_arg_type(),
                                                                                _int64_arg_type()),
                                                                          is_metafunction_that_may_return_error=False,
                                                                          may_be_alias=False)
 
     ADD_TO_TYPE_SET_HELPER = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='AddToTypeSetHelper',
-                                                                        args=(_type_arg_type(),
-                                                                              _type_arg_type(),
+                                                                        args=(_bool_arg_type(),
                                                                               _type_arg_type(),
                                                                               _type_arg_type()),
                                                                         is_metafunction_that_may_return_error=False,
@@ -179,7 +181,7 @@ class GlobalLiterals:
                                                                     args=(_type_arg_type(),
                                                                           _template_template_arg_type(_type_arg_type(),
                                                                                                       _bool_arg_type()),
-                                                                          _variadic_bool_arg_type()),
+                                                                          _type_arg_type()),
                                                                     is_metafunction_that_may_return_error=True,
                                                                     may_be_alias=False)
 
@@ -187,7 +189,7 @@ class GlobalLiterals:
                                                                      args=(_type_arg_type(),
                                                                            _template_template_arg_type(_type_arg_type(),
                                                                                                        _int64_arg_type()),
-                                                                           _variadic_int64_arg_type()),
+                                                                           _type_arg_type()),
                                                                      is_metafunction_that_may_return_error=True,
                                                                      may_be_alias=False)
 
@@ -195,7 +197,7 @@ class GlobalLiterals:
                                                                     args=(_type_arg_type(),
                                                                           _template_template_arg_type(_type_arg_type(),
                                                                                                       _type_arg_type()),
-                                                                          _variadic_type_arg_type()),
+                                                                          _type_arg_type()),
                                                                     is_metafunction_that_may_return_error=True,
                                                                     may_be_alias=False)
 
@@ -219,6 +221,172 @@ class GlobalLiterals:
                                                                  is_metafunction_that_may_return_error=False,
                                                                  may_be_alias=False)
 
+    STD_IS_BASE_OF = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='std::is_base_of',
+                                                                is_metafunction_that_may_return_error=False,
+                                                                args=(_type_arg_type(),
+                                                                      _type_arg_type()),
+                                                                may_be_alias=False)
+
+    BOOL_SET_INDEX_ELEM = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='BoolSetIndexElem',
+                                                                     args=(_bool_arg_type(),),
+                                                                     is_metafunction_that_may_return_error=False,
+                                                                     may_be_alias=False)
+
+    INT64_SET_INDEX_ELEM = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='Int64SetIndexElem',
+                                                                      args=(_int64_arg_type(),),
+                                                                      is_metafunction_that_may_return_error=False,
+                                                                      may_be_alias=False)
+
+    TYPE_SET_INDEX_ELEM = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='TypeSetIndexElem',
+                                                                     args=(_type_arg_type(),),
+                                                                     is_metafunction_that_may_return_error=False,
+                                                                     may_be_alias=False)
+
+    BOOL_SET_INDEX = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='BoolSetIndex',
+                                                                args=(_variadic_bool_arg_type(),),
+                                                                is_metafunction_that_may_return_error=False,
+                                                                may_be_alias=False)
+
+    INT64_SET_INDEX = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='Int64SetIndex',
+                                                                 args=(_variadic_int64_arg_type(),),
+                                                                 is_metafunction_that_may_return_error=False,
+                                                                 may_be_alias=False)
+
+    TYPE_SET_INDEX = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='TypeSetIndex',
+                                                                args=(_variadic_type_arg_type(),),
+                                                                is_metafunction_that_may_return_error=False,
+                                                                may_be_alias=False)
+
+    IS_IN_BOOL_SET = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='IsInBoolSet',
+                                                                args=(_bool_arg_type(), _type_arg_type()),
+                                                                is_metafunction_that_may_return_error=False,
+                                                                may_be_alias=False)
+
+    IS_IN_INT64_SET = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='IsInInt64Set',
+                                                                 args=(_int64_arg_type(), _type_arg_type()),
+                                                                 is_metafunction_that_may_return_error=False,
+                                                                 may_be_alias=False)
+
+    IS_IN_TYPE_SET = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='IsInTypeSet',
+                                                                args=(_type_arg_type(), _type_arg_type()),
+                                                                is_metafunction_that_may_return_error=False,
+                                                                may_be_alias=False)
+
+    BOOL_SET_IS_SUBSET_OF = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='BoolSetIsSubsetOf',
+                                                                       args=(_type_arg_type(), _type_arg_type()),
+                                                                       is_metafunction_that_may_return_error=False,
+                                                                       may_be_alias=False)
+
+    INT64_SET_IS_SUBSET_OF = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='Int64SetIsSubsetOf',
+                                                                        args=(_type_arg_type(), _type_arg_type()),
+                                                                        is_metafunction_that_may_return_error=False,
+                                                                        may_be_alias=False)
+
+    TYPE_SET_IS_SUBSET_OF = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='TypeSetIsSubsetOf',
+                                                                       args=(_type_arg_type(), _type_arg_type()),
+                                                                       is_metafunction_that_may_return_error=False,
+                                                                       may_be_alias=False)
+
+    INT64_RANGE = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='Int64Range',
+                                                             args=(_int64_arg_type(), _int64_arg_type()),
+                                                             is_metafunction_that_may_return_error=False,
+                                                             may_be_alias=False)
+
+    BOOL_LIST_GET = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='BoolListGet',
+                                                               args=(_type_arg_type(), _int64_arg_type()),
+                                                               is_metafunction_that_may_return_error=False,
+                                                               may_be_alias=False)
+
+    INT64_LIST_GET = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='Int64ListGet',
+                                                                args=(_type_arg_type(), _int64_arg_type()),
+                                                                is_metafunction_that_may_return_error=False,
+                                                                may_be_alias=False)
+
+    TYPE_LIST_GET = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='TypeListGet',
+                                                               args=(_type_arg_type(), _int64_arg_type()),
+                                                               is_metafunction_that_may_return_error=False,
+                                                               may_be_alias=False)
+
+    BOOL_LIST_SLICE = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='BoolListSlice',
+                                                                 args=(_type_arg_type(), _int64_arg_type(), _int64_arg_type()),
+                                                                 is_metafunction_that_may_return_error=False,
+                                                                 may_be_alias=False)
+
+    INT64_LIST_SLICE = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='Int64ListSlice',
+                                                                  args=(_type_arg_type(), _int64_arg_type(), _int64_arg_type()),
+                                                                  is_metafunction_that_may_return_error=False,
+                                                                  may_be_alias=False)
+
+    TYPE_LIST_SLICE = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='TypeListSlice',
+                                                                 args=(_type_arg_type(), _int64_arg_type(), _int64_arg_type()),
+                                                                 is_metafunction_that_may_return_error=False,
+                                                                 may_be_alias=False)
+
+    INT64_LIST_SORTED_INDEXES = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='Int64ListSortedIndexes',
+                                                                           args=(_type_arg_type(),),
+                                                                           is_metafunction_that_may_return_error=False,
+                                                                           may_be_alias=False)
+
+    INT64_LIST_UNIQUE_SORTED_INDEXES = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='Int64ListUniqueSortedIndexes',
+                                                                                  args=(_type_arg_type(),),
+                                                                                  is_metafunction_that_may_return_error=False,
+                                                                                  may_be_alias=False)
+
+    BOOL_LIST_SELECT = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='BoolListSelect',
+                                                                  args=(_type_arg_type(), _type_arg_type()),
+                                                                  is_metafunction_that_may_return_error=False,
+                                                                  may_be_alias=False)
+
+    INT64_LIST_SELECT = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='Int64ListSelect',
+                                                                   args=(_type_arg_type(), _type_arg_type()),
+                                                                   is_metafunction_that_may_return_error=False,
+                                                                   may_be_alias=False)
+
+    TYPE_LIST_SELECT = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='TypeListSelect',
+                                                                  args=(_type_arg_type(), _type_arg_type()),
+                                                                  is_metafunction_that_may_return_error=False,
+                                                                  may_be_alias=False)
+
+    LIST_FIRST_HALF = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='ListFirstHalf',
+                                                                 args=(_type_arg_type(),),
+                                                                 is_metafunction_that_may_return_error=False,
+                                                                 may_be_alias=False)
+
+    LIST_SECOND_HALF = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='ListSecondHalf',
+                                                                  args=(_type_arg_type(),),
+                                                                  is_metafunction_that_may_return_error=False,
+                                                                  may_be_alias=False)
+
+    BOOL_LIST_SORT_BY_KEYS = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='BoolListSortByKeys',
+                                                                        args=(_type_arg_type(), _type_arg_type()),
+                                                                        is_metafunction_that_may_return_error=False,
+                                                                        may_be_alias=False)
+
+    INT64_LIST_SORT_BY_KEYS = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='Int64ListSortByKeys',
+                                                                         args=(_type_arg_type(), _type_arg_type()),
+                                                                         is_metafunction_that_may_return_error=False,
+                                                                         may_be_alias=False)
+
+    TYPE_LIST_SORT_BY_KEYS = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='TypeListSortByKeys',
+                                                                        args=(_type_arg_type(), _type_arg_type()),
+                                                                        is_metafunction_that_may_return_error=False,
+                                                                        may_be_alias=False)
+
+    BOOL_LIST_UNIQUE_BY_KEYS = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='BoolListUniqueByKeys',
+                                                                          args=(_type_arg_type(), _type_arg_type()),
+                                                                          is_metafunction_that_may_return_error=False,
+                                                                          may_be_alias=False)
+
+    INT64_LIST_UNIQUE_BY_KEYS = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='Int64ListUniqueByKeys',
+                                                                           args=(_type_arg_type(), _type_arg_type()),
+                                                                           is_metafunction_that_may_return_error=False,
+                                                                           may_be_alias=False)
+
+    TYPE_LIST_UNIQUE_BY_KEYS = ir.AtomicTypeLiteral.for_nonlocal_template(cpp_type='TypeListUniqueByKeys',
+                                                                          args=(_type_arg_type(), _type_arg_type()),
+                                                                          is_metafunction_that_may_return_error=False,
+                                                                          may_be_alias=False)
+
 def select1st_literal(lhs_type: ir.ExprType, rhs_type: ir.ExprType):
     kind_to_string = {
         ir.ExprKind.BOOL: 'Bool',
@@ -0,0 +1,48 @@
+#  Copyright 2017 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS-IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+from typing import Dict
+
+from _py2tmp.ir0 import ir
+from _py2tmp.ir0._transformation import Transformation
+
+
+# Maps structurally-equal IR0 exprs to a single canonical instance.
+# The canonical instances are shared, so (since the IR is immutable and hashes are memoized) memory usage scales with
+# the number of distinct exprs rather than with the total number of occurrences, and most equality checks between
+# interned exprs become identity checks.
+class ExprInterner:
+    def __init__(self) -> None:
+        self.canonical_exprs: Dict[ir.Expr, ir.Expr] = dict()
+
+    def intern(self, expr: ir.Expr) -> ir.Expr:
+        return _InterningTransformation(self.canonical_exprs).transform_expr(expr)
+
+    def intern_header(self, header: ir.Header) -> ir.Header:
+        return _InterningTransformation(self.canonical_exprs).transform_header(header)
+
+class _InterningTransformation(Transformation):
+    def __init__(self, canonical_exprs: Dict[ir.Expr, ir.Expr]):
+        super().__init__()
+        self.canonical_exprs = canonical_exprs
+
+    def transform_expr(self, expr: ir.Expr) -> ir.Expr:
+        canonical_expr = self.canonical_exprs.get(expr)
+        if canonical_expr is not None:
+            return canonical_expr
+        # Intern the subexpressions first, so that the canonical expr only references canonical subexpressions.
+        expr = super().transform_expr(expr)
+        return self.canonical_exprs.setdefault(expr, expr)
+
+def intern_exprs_in_header(header: ir.Header) -> ir.Header:
+    return ExprInterner().intern_header(header)
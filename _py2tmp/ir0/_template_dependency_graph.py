@@ -15,13 +15,12 @@
 
 from typing import Dict, Iterable
 
-import networkx as nx
-
 from _py2tmp.ir0 import ir
+from _py2tmp.utils import DependencyGraph
 
 
 def compute_template_dependency_graph(template_defns: Iterable[ir.TemplateDefn], template_defn_by_name: Dict[str, ir.TemplateDefn]):
-    template_dependency_graph = nx.DiGraph()
+    template_dependency_graph = DependencyGraph()
     for template_defn in template_defns:
         template_dependency_graph.add_node(template_defn.name)
 
@@ -19,6 +19,12 @@ from _py2tmp.ir0._is_variadic import is_expr_variadic
 from _py2tmp.ir0._writers import Writer, ToplevelWriter, TemplateBodyWriter
 
 
+def _are_all_same_objects(new_elems: Tuple, old_elems: Tuple):
+    return len(new_elems) == len(old_elems) and all(new_elem is old_elem
+                                                    for new_elem, old_elem in zip(new_elems, old_elems))
+
+# The default implementations of the transform_* methods return (or write) the original element when none of its
+# sub-elements changed, so that unchanged subtrees are shared instead of being copied.
 # noinspection PyMethodMayBeStatic
 class Transformation:
     def __init__(self, identifier_generator: Optional[Iterator[str]] = None):
@@ -35,6 +41,11 @@ class Transformation:
             check_if_error_specializations = tuple(self.transform_template_specialization(specialization)
                                                    for specialization in header.check_if_error_specializations)
 
+        if (_are_all_same_objects(writer.template_defns, header.template_defns)
+                and _are_all_same_objects(writer.toplevel_elems, header.toplevel_content)
+                and _are_all_same_objects(check_if_error_specializations, header.check_if_error_specializations)):
+            return header
+
         return ir.Header(template_defns=tuple(writer.template_defns),
                          toplevel_content=tuple(writer.toplevel_elems),
                          public_names=header.public_names,
@@ -58,6 +69,11 @@ class Transformation:
         template_specialization = self.transform_template_specialization(template_defn.main_definition) if template_defn.main_definition is not None else None
         specializations = tuple(self.transform_template_specialization(specialization)
                                 for specialization in template_defn.specializations)
+        if (_are_all_same_objects(args, template_defn.args)
+                and template_specialization is template_defn.main_definition
+                and _are_all_same_objects(specializations, template_defn.specializations)):
+            self.writer.write(template_defn)
+            return
         self.writer.write(ir.TemplateDefn(args=args,
                                           main_definition=template_specialization,
                                           specializations=specializations,
@@ -67,6 +83,9 @@ class Transformation:
 
     def transform_static_assert(self, static_assert: ir.StaticAssert):
         expr = self.transform_expr(static_assert.expr)
+        if expr is static_assert.expr:
+            self.writer.write(static_assert)
+            return
         self.writer.write(ir.StaticAssert(expr=expr,
                                           message=static_assert.message))
 
@@ -75,15 +94,22 @@ class Transformation:
 
     def transform_constant_def(self, constant_def: ir.ConstantDef):
         expr = self.transform_expr(constant_def.expr)
+        if expr is constant_def.expr:
+            self.writer.write(constant_def)
+            return
         self.writer.write(ir.ConstantDef(name=constant_def.name, expr=expr))
 
     def transform_typedef(self, typedef: ir.Typedef):
         expr = self.transform_expr(typedef.expr)
+        template_args = tuple(self.transform_template_arg_decl(arg_decl)
+                              for arg_decl in typedef.template_args)
+        if expr is typedef.expr and _are_all_same_objects(template_args, typedef.template_args):
+            self.writer.write(typedef)
+            return
         self.writer.write(ir.Typedef(name=typedef.name,
                                      expr=expr,
                                      description=typedef.description,
-                                     template_args=tuple(self.transform_template_arg_decl(arg_decl)
-                                                         for arg_decl in typedef.template_args)))
+                                     template_args=template_args))
 
     def transform_template_arg_decl(self, arg_decl: ir.TemplateArgDecl) -> ir.TemplateArgDecl:
         return arg_decl
@@ -105,6 +131,11 @@ class Transformation:
 
         args = tuple(self.transform_template_arg_decl(arg_decl) for arg_decl in specialization.args)
         body = self.transform_template_body_elems(specialization.body)
+        if (_are_all_same_objects(args, specialization.args)
+                and (patterns is None if specialization.patterns is None
+                     else _are_all_same_objects(patterns, specialization.patterns))
+                and _are_all_same_objects(body, specialization.body)):
+            return specialization
         return ir.TemplateSpecialization(args=args,
                                          patterns=patterns,
                                          body=body,
@@ -170,78 +201,101 @@ class Transformation:
         return literal
 
     def transform_type_literal(self, type_literal: ir.AtomicTypeLiteral) -> ir.Expr:
-        return ir.AtomicTypeLiteral(cpp_type=type_literal.cpp_type,
-                                    is_metafunction_that_may_return_error=type_literal.is_metafunction_that_may_return_error,
-                                    expr_type=type_literal.expr_type,
-                                    is_local=type_literal.is_local,
-                                    may_be_alias=type_literal.may_be_alias,
-                                    is_variadic=type_literal.is_variadic)
+        return type_literal
 
     def transform_class_member_access(self, class_member_access: ir.ClassMemberAccess) -> ir.Expr:
         class_type_expr = self.transform_expr(class_member_access.inner_expr)
+        if class_type_expr is class_member_access.inner_expr:
+            return class_member_access
         return ir.ClassMemberAccess(inner_expr=class_type_expr,
                                     member_name=class_member_access.member_name,
                                     expr_type=class_member_access.expr_type)
 
     def transform_not_expr(self, not_expr: ir.NotExpr) -> ir.Expr:
         expr = self.transform_expr(not_expr.inner_expr)
+        if expr is not_expr.inner_expr:
+            return not_expr
         return ir.NotExpr(expr)
 
     def transform_unary_minus_expr(self, unary_minus: ir.UnaryMinusExpr) -> ir.Expr:
         expr = self.transform_expr(unary_minus.inner_expr)
+        if expr is unary_minus.inner_expr:
+            return unary_minus
         return ir.UnaryMinusExpr(expr)
 
     def transform_comparison_expr(self, comparison: ir.ComparisonExpr) -> ir.Expr:
         lhs, rhs = self.transform_exprs((comparison.lhs, comparison.rhs), comparison)
+        if lhs is comparison.lhs and rhs is comparison.rhs:
+            return comparison
         return ir.ComparisonExpr(lhs=lhs, rhs=rhs, op=comparison.op)
 
     def transform_int64_binary_op_expr(self, binary_op: ir.Int64BinaryOpExpr) -> ir.Expr:
         lhs, rhs = self.transform_exprs((binary_op.lhs, binary_op.rhs), binary_op)
+        if lhs is binary_op.lhs and rhs is binary_op.rhs:
+            return binary_op
         return ir.Int64BinaryOpExpr(lhs=lhs, rhs=rhs, op=binary_op.op)
 
     def transform_bool_binary_op_expr(self, binary_op: ir.BoolBinaryOpExpr) -> ir.Expr:
         lhs, rhs = self.transform_exprs((binary_op.lhs, binary_op.rhs), binary_op)
+        if lhs is binary_op.lhs and rhs is binary_op.rhs:
+            return binary_op
         return ir.BoolBinaryOpExpr(lhs=lhs, rhs=rhs, op=binary_op.op)
 
     def transform_template_instantiation(self, template_instantiation: ir.TemplateInstantiation) -> ir.Expr:
         [template_expr, *args] = self.transform_exprs((template_instantiation.template_expr, *template_instantiation.args), template_instantiation)
+        if template_expr is template_instantiation.template_expr and _are_all_same_objects(args, template_instantiation.args):
+            return template_instantiation
         return ir.TemplateInstantiation(template_expr=template_expr,
                                         args=tuple(args),
                                         instantiation_might_trigger_static_asserts=template_instantiation.instantiation_might_trigger_static_asserts)
 
     def transform_pointer_type_expr(self, expr: ir.PointerTypeExpr):
-        expr = self.transform_expr(expr.type_expr)
-        return ir.PointerTypeExpr(expr)
+        type_expr = self.transform_expr(expr.type_expr)
+        if type_expr is expr.type_expr:
+            return expr
+        return ir.PointerTypeExpr(type_expr)
 
     def transform_reference_type_expr(self, expr: ir.ReferenceTypeExpr):
-        expr = self.transform_expr(expr.type_expr)
-        return ir.ReferenceTypeExpr(expr)
+        type_expr = self.transform_expr(expr.type_expr)
+        if type_expr is expr.type_expr:
+            return expr
+        return ir.ReferenceTypeExpr(type_expr)
 
     def transform_rvalue_reference_type_expr(self, expr: ir.RvalueReferenceTypeExpr):
-        expr = self.transform_expr(expr.type_expr)
-        return ir.RvalueReferenceTypeExpr(expr)
+        type_expr = self.transform_expr(expr.type_expr)
+        if type_expr is expr.type_expr:
+            return expr
+        return ir.RvalueReferenceTypeExpr(type_expr)
 
     def transform_const_type_expr(self, expr: ir.ConstTypeExpr):
-        expr = self.transform_expr(expr.type_expr)
-        return ir.ConstTypeExpr(expr)
+        type_expr = self.transform_expr(expr.type_expr)
+        if type_expr is expr.type_expr:
+            return expr
+        return ir.ConstTypeExpr(type_expr)
 
     def transform_array_type_expr(self, expr: ir.ArrayTypeExpr):
-        expr = self.transform_expr(expr.type_expr)
-        return ir.ArrayTypeExpr(expr)
+        type_expr = self.transform_expr(expr.type_expr)
+        if type_expr is expr.type_expr:
+            return expr
+        return ir.ArrayTypeExpr(type_expr)
 
     def transform_function_type_expr(self, expr: ir.FunctionTypeExpr):
         result = self.transform_exprs((expr.return_type_expr, *expr.arg_exprs), expr)
         [return_type_expr, *arg_exprs] = result
+        if return_type_expr is expr.return_type_expr and _are_all_same_objects(arg_exprs, expr.arg_exprs):
+            return expr
         return ir.FunctionTypeExpr(return_type_expr=return_type_expr, arg_exprs=tuple(arg_exprs))
 
     def transform_variadic_type_expansion(self, expr: ir.VariadicTypeExpansion):
-        expr = self.transform_expr(expr.inner_expr)
-        if is_expr_variadic(expr):
-            return ir.VariadicTypeExpansion(expr)
+        inner_expr = self.transform_expr(expr.inner_expr)
+        if inner_expr is expr.inner_expr:
+            return expr
+        if is_expr_variadic(inner_expr):
+            return ir.VariadicTypeExpansion(inner_expr)
         else:
             # This is not just an optimization, it's an error to have a VariadicTypeExpansion() that doesn't contain
             # any variadic var refs.
-            return expr
+            return inner_expr
 
     @contextmanager
     def set_writer(self, new_writer: Optional[Writer]):
@@ -11,8 +11,9 @@
 # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 # See the License for the specific language governing permissions and
 # limitations under the License.
+import hashlib
 import re
-from dataclasses import dataclass, field
+from dataclasses import dataclass, field, fields, is_dataclass
 from enum import Enum
 from typing import Sequence, Set, Optional, Iterable, Union, Tuple, FrozenSet
 
@@ -26,18 +27,71 @@ class ExprKind(Enum):
     TYPE = 3
     TEMPLATE = 4
 
-class _TemplateBodyElementOrExprOrTemplateDefn:
+# IR0 nodes are immutable, so the results of these (potentially expensive) queries are computed once and then
+# memoized in these attributes. They're excluded from pickling (hashes of strings are only stable within a process).
+_MEMOIZED_ATTRIBUTE_NAMES = ('_memoized_hash',
+                             '_memoized_num_transitive_subexpressions',
+                             '_memoized_num_transitive_template_instantiations',
+                             '_memoized_has_class_member_access',
+                             '_memoized_has_instantiation_that_might_trigger_static_asserts',
+                             '_memoized_free_vars',
+                             '_memoized_referenced_identifiers',
+                             '_memoized_structural_digest')
+
+def _memoize(elem, attribute_name: str, compute):
+    result = elem.__dict__.get(attribute_name)
+    if result is None:
+        result = compute()
+        # These are frozen dataclasses, so we can't just assign `elem.<attribute_name>`.
+        object.__setattr__(elem, attribute_name, result)
+    return result
+
+def _unique(values: Iterable) -> tuple:
+    # dict.fromkeys() preserves the order of first occurrence, so that the result is deterministic.
+    return tuple(dict.fromkeys(values))
+
+class _MemoizedAttributesExcludedFromPickling:
+    def __getstate__(self):
+        return {name: value
+                for name, value in self.__dict__.items()
+                if name not in _MEMOIZED_ATTRIBUTE_NAMES}
+
+# Unlike hash(), this is stable across processes (and across runs), so it can be used as a key in persistent caches.
+# Elements with the same digest are structurally equal (barring hash collisions).
+def compute_structural_digest(value) -> bytes:
+    if isinstance(value, _MemoizedAttributesExcludedFromPickling):
+        return _memoize(value, '_memoized_structural_digest', lambda: _compute_structural_digest(value))
+    return _compute_structural_digest(value)
+
+def _compute_structural_digest(value) -> bytes:
+    digest = hashlib.blake2b(value.__class__.__name__.encode(), digest_size=16)
+    if is_dataclass(value):
+        for dataclass_field in fields(value):
+            digest.update(compute_structural_digest(getattr(value, dataclass_field.name)))
+    elif isinstance(value, tuple):
+        for elem in value:
+            digest.update(compute_structural_digest(elem))
+    elif isinstance(value, frozenset):
+        for elem_digest in sorted(compute_structural_digest(elem) for elem in value):
+            digest.update(elem_digest)
+    else:
+        assert isinstance(value, (str, bool, int, Enum)) or value is None, value.__class__.__name__
+        digest.update(repr(value).encode())
+    return digest.digest()
+
+class _TemplateBodyElementOrExprOrTemplateDefn(_MemoizedAttributesExcludedFromPickling):
     @property
     def referenced_identifiers(self) -> Iterable[str]:
-        for expr in self.transitive_subexpressions:
-            for identifier in expr.local_referenced_identifiers:
-                yield identifier
+        return _memoize(self, '_memoized_referenced_identifiers', self._compute_referenced_identifiers)
+
+    def _compute_referenced_identifiers(self):
+        return _unique(identifier
+                       for elem in (*self.direct_subelements, *self.direct_subexpressions)
+                       for identifier in elem.referenced_identifiers)
 
     # Returns all transitive subexpressions
     @property
     def transitive_subexpressions(self) -> Iterable['Expr']:
-        if isinstance(self, Expr):
-            yield self
         for elem in self.direct_subelements:
             for subexpr in elem.transitive_subexpressions:
                 yield subexpr
@@ -88,17 +142,65 @@ class Expr(_TemplateBodyElementOrExprOrTemplateDefn):
         return any(isinstance(expr, AtomicTypeLiteral) and expr.cpp_type in variables
                    for expr in self.transitive_subexpressions)
 
+    # Returns this expr and all its transitive subexpressions, in pre-order.
+    # This is iterative (instead of recursing through nested generators), so that iterating on deep exprs is still
+    # linear. The subexpressions are not memoized (that would take memory proportional to the size times the depth of
+    # the expr); the summaries below are memoized instead, since they're queried very often during optimization.
+    @property
+    def transitive_subexpressions(self) -> Iterable['Expr']:
+        stack = [self]
+        while stack:
+            expr = stack.pop()
+            yield expr
+            stack.extend(reversed(tuple(expr.direct_subexpressions)))
+
+    @property
+    def num_transitive_subexpressions(self) -> int:
+        return _memoize(self, '_memoized_num_transitive_subexpressions',
+                        lambda: 1 + sum(expr.num_transitive_subexpressions for expr in self.direct_subexpressions))
+
+    @property
+    def num_transitive_template_instantiations(self) -> int:
+        return _memoize(self, '_memoized_num_transitive_template_instantiations',
+                        lambda: (int(isinstance(self, TemplateInstantiation))
+                                 + sum(expr.num_transitive_template_instantiations for expr in self.direct_subexpressions)))
+
+    @property
+    def has_class_member_access(self) -> bool:
+        return _memoize(self, '_memoized_has_class_member_access',
+                        lambda: (isinstance(self, ClassMemberAccess)
+                                 or any(expr.has_class_member_access for expr in self.direct_subexpressions)))
+
+    @property
+    def has_instantiation_that_might_trigger_static_asserts(self) -> bool:
+        return _memoize(self, '_memoized_has_instantiation_that_might_trigger_static_asserts',
+                        lambda: ((isinstance(self, TemplateInstantiation) and self.instantiation_might_trigger_static_asserts)
+                                 or any(expr.has_instantiation_that_might_trigger_static_asserts
+                                        for expr in self.direct_subexpressions)))
+
+    # Returns the (distinct) local literals referenced in this expr, in order of first occurrence.
     @property
     def free_vars(self) -> Iterable['AtomicTypeLiteral']:
-        for expr in self.transitive_subexpressions:
-            if isinstance(expr, AtomicTypeLiteral) and expr.is_local:
-                yield expr
+        return _memoize(self, '_memoized_free_vars', self._compute_free_vars)
+
+    def _compute_free_vars(self) -> Tuple['AtomicTypeLiteral', ...]:
+        if isinstance(self, AtomicTypeLiteral):
+            return (self,) if self.is_local else ()
+        return _unique(var
+                       for expr in self.direct_subexpressions
+                       for var in expr.free_vars)
 
     @property
     def local_referenced_identifiers(self) -> Iterable[str]:
         if isinstance(self, AtomicTypeLiteral):
             yield self.cpp_type
 
+    def _compute_referenced_identifiers(self):
+        return _unique((*self.local_referenced_identifiers,
+                        *(identifier
+                          for expr in self.direct_subexpressions
+                          for identifier in expr.referenced_identifiers)))
+
     @property
     def direct_subelements(self) -> Iterable['TemplateBodyElement']:
         return []
@@ -190,7 +292,7 @@ class TemplateArgDecl:
 _non_identifier_char_pattern = re.compile('[^a-zA-Z0-9_]+')
 
 @dataclass(frozen=True)
-class TemplateSpecialization:
+class TemplateSpecialization(_MemoizedAttributesExcludedFromPickling):
     args: Tuple[TemplateArgDecl, ...]
     patterns: Optional[Tuple[Expr, ...]]
     body: Tuple[TemplateBodyElement, ...]
@@ -643,3 +745,34 @@ class Header:
     # Semantically, this is a map (old_name, result_element_name) -> split_template_name.
     split_template_name_by_old_name_and_result_element_name: Tuple[Tuple[Tuple[str, str], str], ...]
 
+def _memoize_hash_and_eq(cls):
+    generated_hash = cls.__hash__
+    generated_eq = cls.__eq__
+
+    def __hash__(self):
+        return _memoize(self, '_memoized_hash', lambda: generated_hash(self))
+
+    def __eq__(self, other):
+        if self is other:
+            return True
+        # The hashes are memoized, so this is a cheap way to quickly reject most non-equal elements without a full
+        # structural comparison.
+        if other.__class__ is self.__class__ and hash(self) != hash(other):
+            return False
+        return generated_eq(self, other)
+
+    cls.__hash__ = __hash__
+    cls.__eq__ = __eq__
+
+def _all_subclasses(cls):
+    result = set()
+    for subclass in cls.__subclasses__():
+        result.add(subclass)
+        result |= _all_subclasses(subclass)
+    return result
+
+# Each @dataclass generates __hash__ and __eq__ in the class itself (not inherited), so we need to wrap them in all
+# (data)classes.
+for _cls in _all_subclasses(_MemoizedAttributesExcludedFromPickling):
+    if '__hash__' in _cls.__dict__ and _cls.__hash__ is not None:
+        _memoize_hash_and_eq(_cls)
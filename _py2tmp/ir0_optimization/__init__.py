@@ -13,4 +13,9 @@
 # limitations under the License.
 
 from ._optimize import optimize_header
+from ._global_common_subexpression_elimination import eliminate_common_closed_subexpressions_across_templates
+from ._remove_unreachable_specializations import remove_unreachable_specializations
 from ._configuration_knobs import ConfigurationKnobs, DEFAULT_VERBOSE_SETTING
+from ._optimization_profile import OptimizationProfile
+from ._optimization_checkpoints import OptimizationCheckpoints, FrontendResult, LookaheadIdentifierGenerator
+from ._optimization_cache import RecordingIdentifierGenerator
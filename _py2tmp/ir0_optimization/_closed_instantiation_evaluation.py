@@ -0,0 +1,240 @@
+#  Copyright 2017 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS-IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import itertools
+from typing import Dict, Optional, Mapping, Set, Iterator, Tuple, Union
+
+from _py2tmp.ir0 import ir, Transformation, ToplevelWriter
+from _py2tmp.ir0_optimization._configuration_knobs import ConfigurationKnobs
+from _py2tmp.ir0_optimization._expression_simplification import ExpressionSimplificationTransformation
+from _py2tmp.ir0_optimization._optimization_execution import apply_elem_optimization, describe_template_defns, \
+    describe_toplevel_elems
+from _py2tmp.ir0_optimization._replace_var_with_expr import replace_var_with_expr_in_expr, \
+    VariadicVarReplacementNotPossibleException
+from _py2tmp.ir0_optimization._template_instantiation_inlining import compute_pattern_variable_values
+from _py2tmp.ir0_optimization._unify import unify_template_instantiation_with_definition
+
+# The max number of nested instantiations evaluated in a single (recursive) evaluation. When an evaluation needs to go
+# deeper, the innermost instantiation is evaluated first on its own and then the evaluation is retried (finding the
+# memoized result of that instantiation), so that long chains of instantiations (e.g. from recursive functions) don't
+# hit the Python recursion limit.
+_MAX_EVALUATION_DEPTH = 20
+
+_VALUE_EXPR_CLASSES = (ir.Literal,
+                       ir.AtomicTypeLiteral,
+                       ir.TemplateInstantiation,
+                       ir.PointerTypeExpr,
+                       ir.ReferenceTypeExpr,
+                       ir.RvalueReferenceTypeExpr,
+                       ir.ConstTypeExpr,
+                       ir.ArrayTypeExpr,
+                       ir.FunctionTypeExpr)
+
+def _is_value(expr: ir.Expr):
+    # A bool/int64 literal or a type (possibly a template instantiation, e.g. Int64List<1, 2>) that doesn't need further
+    # evaluation: no vars and no class member accesses.
+    return all(isinstance(subexpr, _VALUE_EXPR_CLASSES)
+               and not (isinstance(subexpr, ir.AtomicTypeLiteral) and (subexpr.is_local or subexpr.is_variadic))
+               for subexpr in expr.transitive_subexpressions)
+
+class _EvaluationDepthLimitReachedException(Exception):
+    def __init__(self, class_member_access: ir.ClassMemberAccess):
+        super().__init__()
+        self.class_member_access = class_member_access
+
+class _EvaluationBudgetExhaustedException(Exception):
+    pass
+
+# Evaluates class member accesses on instantiations of templates with known args (e.g. f<3>::value), replacing the
+# work that the C++ compiler would do in each translation unit that includes the header with a single evaluation here.
+# The instantiations are evaluated as the C++ compiler would: selecting the specialization (using the same unification
+# used for inlining), and then evaluating each element of its body. When the result isn't certain (e.g. if the
+# specialization depends on whether two types are aliases, or if a static_assert fails) the instantiation isn't
+# evaluated, so that the C++ compiler still reports the same errors.
+# The results are memoized, so each instantiation is evaluated at most once.
+class ClosedInstantiationEvaluator:
+    def __init__(self, template_defn_by_name: Mapping[str, ir.TemplateDefn]):
+        self.template_defn_by_name = template_defn_by_name
+        # The value is None for the class member accesses that can't be evaluated.
+        self.result_by_class_member_access: Dict[ir.ClassMemberAccess, Optional[ir.Expr]] = dict()
+        self.class_member_accesses_being_evaluated: Set[ir.ClassMemberAccess] = set()
+        self.depth = 0
+        self.num_remaining_instantiations = 0
+        # The identifiers generated during unification are never used in the result, so we use a separate generator
+        # for those (otherwise the identifiers used by later optimizations would depend on the memoized results).
+        self.identifier_generator = ('TmppyInternalEvaluation_%s' % i for i in itertools.count())
+
+    def can_evaluate(self, class_member_access: ir.ClassMemberAccess):
+        instantiation = class_member_access.inner_expr
+        return (isinstance(instantiation, ir.TemplateInstantiation)
+                and isinstance(instantiation.template_expr, ir.AtomicTypeLiteral)
+                and not instantiation.template_expr.is_local
+                and instantiation.template_expr.cpp_type in self.template_defn_by_name
+                and all(_is_value(arg) for arg in instantiation.args))
+
+    def evaluate(self, class_member_access: ir.ClassMemberAccess) -> Optional[ir.Expr]:
+        assert self.can_evaluate(class_member_access)
+        if class_member_access in self.result_by_class_member_access:
+            return self.result_by_class_member_access[class_member_access]
+
+        self.num_remaining_instantiations = ConfigurationKnobs.max_num_evaluated_template_instantiations
+        class_member_accesses_to_evaluate = [class_member_access]
+        try:
+            while class_member_accesses_to_evaluate:
+                try:
+                    self._evaluate_class_member_access(class_member_accesses_to_evaluate[-1])
+                    class_member_accesses_to_evaluate.pop()
+                except _EvaluationDepthLimitReachedException as e:
+                    class_member_accesses_to_evaluate.append(e.class_member_access)
+        except _EvaluationBudgetExhaustedException:
+            if ConfigurationKnobs.verbose:
+                print('Not evaluating %s because it needs more than %s template instantiations' % (
+                    class_member_access.inner_expr.template_expr.cpp_type,
+                    ConfigurationKnobs.max_num_evaluated_template_instantiations))
+            self.result_by_class_member_access[class_member_access] = None
+        return self.result_by_class_member_access[class_member_access]
+
+    def _evaluate_class_member_access(self, class_member_access: ir.ClassMemberAccess) -> Optional[ir.Expr]:
+        if class_member_access in self.result_by_class_member_access:
+            return self.result_by_class_member_access[class_member_access]
+        if class_member_access in self.class_member_accesses_being_evaluated:
+            # This depends on itself, so the C++ compiler would fail to instantiate it.
+            return None
+        if self.depth == _MAX_EVALUATION_DEPTH:
+            raise _EvaluationDepthLimitReachedException(class_member_access)
+        if self.num_remaining_instantiations == 0:
+            raise _EvaluationBudgetExhaustedException()
+        self.num_remaining_instantiations -= 1
+
+        self.class_member_accesses_being_evaluated.add(class_member_access)
+        self.depth += 1
+        try:
+            result = self._evaluate_instantiation(class_member_access)
+        finally:
+            self.depth -= 1
+            self.class_member_accesses_being_evaluated.remove(class_member_access)
+
+        self.result_by_class_member_access[class_member_access] = result
+        return result
+
+    def _evaluate_instantiation(self, class_member_access: ir.ClassMemberAccess) -> Optional[ir.Expr]:
+        instantiation = class_member_access.inner_expr
+        assert isinstance(instantiation, ir.TemplateInstantiation)
+        assert isinstance(instantiation.template_expr, ir.AtomicTypeLiteral)
+        unification = unify_template_instantiation_with_definition(instantiation,
+                                                                   local_var_definitions=dict(),
+                                                                   result_elem_name=class_member_access.member_name,
+                                                                   template_defn=self.template_defn_by_name[instantiation.template_expr.cpp_type],
+                                                                   identifier_generator=self.identifier_generator,
+                                                                   verbose=False)
+        if not unification:
+            return None
+
+        if isinstance(unification, ir.Expr):
+            # All the specializations that might be selected have the same result.
+            return self._evaluate_expr(unification)
+
+        # noinspection PyTupleAssignmentBalance
+        specialization, value_by_pattern_variable, value_by_expanded_pattern_variable = unification
+        if ConfigurationKnobs.preserve_coverage_markers and any(isinstance(elem, ir.NoOpStmt)
+                                                                for elem in specialization.body):
+            # The coverage markers are only emitted if the C++ compiler instantiates this.
+            return None
+
+        value_by_var, value_by_expanded_var = compute_pattern_variable_values(value_by_pattern_variable,
+                                                                              value_by_expanded_pattern_variable)
+        result = None
+        for elem in specialization.body:
+            if isinstance(elem, ir.NoOpStmt):
+                continue
+            if isinstance(elem, ir.Typedef) and elem.template_args:
+                return None
+            try:
+                expr = replace_var_with_expr_in_expr(elem.expr, value_by_var, value_by_expanded_var)
+            except VariadicVarReplacementNotPossibleException:
+                return None
+            value = self._evaluate_expr(expr)
+            if value is None:
+                return None
+            if isinstance(elem, ir.StaticAssert):
+                if not (isinstance(value, ir.Literal) and value.value is True):
+                    # The assertion fails. We leave this to the C++ compiler, so that the error is reported in the same
+                    # way as when the code is not optimized.
+                    return None
+            else:
+                assert isinstance(elem, (ir.ConstantDef, ir.Typedef))
+                value_by_var[elem.name] = value
+                if elem.name == class_member_access.member_name:
+                    result = value
+        return result
+
+    def _evaluate_expr(self, expr: ir.Expr) -> Optional[ir.Expr]:
+        expr = _ExprEvaluationTransformation(self).transform_expr(expr)
+        if not _is_value(expr) or expr.num_transitive_subexpressions > ConfigurationKnobs.max_evaluation_result_size:
+            return None
+        return expr
+
+class _ExprEvaluationTransformation(ExpressionSimplificationTransformation):
+    def __init__(self, evaluator: ClosedInstantiationEvaluator):
+        super().__init__()
+        self.evaluator = evaluator
+
+    def transform_class_member_access(self, class_member_access: ir.ClassMemberAccess):
+        result = super().transform_class_member_access(class_member_access)
+        if isinstance(result, ir.ClassMemberAccess) and self.evaluator.can_evaluate(result):
+            value = self.evaluator._evaluate_class_member_access(result)
+            if value is not None:
+                return value
+        return result
+
+class _ClosedInstantiationEvaluationTransformation(Transformation):
+    def __init__(self, evaluator: ClosedInstantiationEvaluator):
+        super().__init__()
+        self.evaluator = evaluator
+
+    def transform_class_member_access(self, class_member_access: ir.ClassMemberAccess):
+        class_member_access = super().transform_class_member_access(class_member_access)
+        if isinstance(class_member_access, ir.ClassMemberAccess) and self.evaluator.can_evaluate(class_member_access):
+            value = self.evaluator.evaluate(class_member_access)
+            if value is not None:
+                return value
+        return class_member_access
+
+def evaluate_closed_instantiations_in_template_defn(template_defn: ir.TemplateDefn,
+                                                    evaluator: ClosedInstantiationEvaluator,
+                                                    identifier_generator: Iterator[str]) -> Tuple[ir.TemplateDefn, bool]:
+    def perform_optimization() -> Tuple[Tuple[ir.TemplateDefn, ...], bool]:
+        transformation = _ClosedInstantiationEvaluationTransformation(evaluator)
+        writer = ToplevelWriter(allow_toplevel_elems=False)
+        with transformation.set_writer(writer):
+            transformation.transform_template_defn(template_defn)
+        return tuple(writer.template_defns), False
+
+    [template_defn], needs_another_loop = apply_elem_optimization((template_defn,),
+                                                                  perform_optimization,
+                                                                  lambda template_defns: describe_template_defns(template_defns, identifier_generator),
+                                                                  optimization_name='evaluate_closed_instantiations()')
+    return template_defn, needs_another_loop
+
+def evaluate_closed_instantiations_in_toplevel_elems(toplevel_elems: Tuple[Union[ir.StaticAssert, ir.ConstantDef, ir.Typedef], ...],
+                                                     evaluator: ClosedInstantiationEvaluator,
+                                                     identifier_generator: Iterator[str]):
+    def perform_optimization():
+        transformation = _ClosedInstantiationEvaluationTransformation(evaluator)
+        return transformation.transform_template_body_elems(toplevel_elems), False
+
+    return apply_elem_optimization(toplevel_elems,
+                                   perform_optimization,
+                                   lambda toplevel_elems: describe_toplevel_elems(toplevel_elems, identifier_generator),
+                                   optimization_name='evaluate_closed_instantiations()')
@@ -19,4 +19,48 @@ class ConfigurationKnobs:
     max_num_optimization_steps = -1
     optimization_step_counter = 0
     reached_max_num_remaining_loops_counter = 0
+    # The number of connected components whose optimized templates were found in the optimization cache.
+    optimization_cache_hit_counter = 0
     verbose = DEFAULT_VERBOSE_SETTING
+    # If this is >1, independent connected components of the template dependency graph are optimized in parallel, using
+    # (at most) this many processes.
+    num_optimization_processes = 1
+    # If this is not None, the worker processes used when num_optimization_processes>1 are started with this
+    # multiprocessing start method (e.g. "spawn") instead of the platform's default one.
+    optimization_processes_start_method = None
+    # If this is not None, optimized templates are cached in this directory, and reused in later compilations when the
+    # templates (and the ones they depend on) didn't change.
+    optimization_cache_dir = None
+    # If this is not None, it must be an OptimizationProfile, and statistics about each optimization are collected
+    # there.
+    optimization_profile = None
+    # If this is not None, it must be an OptimizationCheckpoints, and the results of the optimization steps are recorded
+    # there, so that later compilations of the same source can replay them instead of performing them again. This is
+    # ignored when optimizing connected components in parallel or using optimization_cache_dir.
+    optimization_checkpoints = None
+    # If True, the optimizations preserve the coverage markers (the NoOpStmts) instead of removing them, so that coverage
+    # can be collected on the optimized code. This is set by optimize_header() for the headers compiled with coverage
+    # collection enabled.
+    preserve_coverage_markers = False
+
+    # The limits used by the cost model of template instantiation inlining (see _inlining_cost_model.py). Inlining an
+    # instantiation saves the C++ compiler that instantiation, but it copies the body of the matching specialization into
+    # the caller, so inlining large bodies into many callers can make the final header slower to compile (and to
+    # parse). Each limit is disabled when set to -1 (the default), so by default everything that can be inlined is.
+    # If >=0, instantiations aren't inlined when that would increase the (estimated) number of template instantiations
+    # in the caller by more than this.
+    max_inlining_instantiation_count_increase = -1
+    # If >=0, instantiations aren't inlined when that would make the caller bigger and the inlined code has more than
+    # this many IR0 exprs.
+    max_inlined_body_size = -1
+    # If >=0, instantiations of templates referenced by more than this many other templates aren't inlined when that
+    # would make the caller bigger, since each of those callers would get its own copy of the body.
+    max_inlining_fan_out = -1
+
+    # The budget for evaluating the template instantiations with known args (e.g. f<3>::value) during the optimization
+    # (see _closed_instantiation_evaluation.py). This is the max number of template instantiations evaluated for each
+    # expr; if the evaluation needs more, the expr is left as-is for the C++ compiler. If 0, nothing is evaluated.
+    max_num_evaluated_template_instantiations = 10000
+    # The results of the evaluation with more than this many IR0 exprs are discarded, since in the generated code they
+    # could take more space (and more time to parse) than the instantiations that compute them.
+    max_evaluation_result_size = 1000
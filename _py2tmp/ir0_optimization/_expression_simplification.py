@@ -12,12 +12,73 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from typing import Tuple
+from typing import Tuple, Optional
 
 from _py2tmp.ir0 import ir, Transformation, is_expr_variadic, GlobalLiterals, select1st_literal
 from _py2tmp.ir0_optimization._compute_non_expanded_variadic_vars import compute_non_expanded_variadic_vars
 from _py2tmp.ir0_optimization._recalculate_template_instantiation_can_trigger_static_asserts_info import expr_can_trigger_static_asserts
 
+_LIST_TEMPLATE_NAME_BY_LIST_GET_TEMPLATE_NAME = {
+    'BoolListGet': 'BoolList',
+    'Int64ListGet': 'Int64List',
+    'TypeListGet': 'List',
+}
+
+_LIST_TEMPLATE_NAME_BY_LIST_SLICE_TEMPLATE_NAME = {
+    'BoolListSlice': 'BoolList',
+    'Int64ListSlice': 'Int64List',
+    'TypeListSlice': 'List',
+}
+
+_LIST_TEMPLATE_NAME_BY_LIST_SELECT_TEMPLATE_NAME = {
+    'BoolListSelect': 'BoolList',
+    'Int64ListSelect': 'Int64List',
+    'TypeListSelect': 'List',
+}
+
+_LIST_TEMPLATE_NAMES = ('BoolList', 'Int64List', 'List')
+
+_MIN_INT64 = -2**63
+_MAX_INT64 = 2**63 - 1
+
+def _int64_or_none(value: int) -> Optional[int]:
+    if _MIN_INT64 <= value <= _MAX_INT64:
+        return value
+    return None
+
+# These compute the result of an int64_t operation on literals with the C++ semantics. They return None when the result
+# is not a value in C++ (e.g. for an overflow or a division by zero, that the C++ compiler reports as an error), so that
+# the expr is left as-is.
+def fold_int64_unary_minus(value: int) -> Optional[int]:
+    return _int64_or_none(-value)
+
+def fold_int64_binary_op(op: str, lhs: int, rhs: int) -> Optional[int]:
+    if op == '+':
+        return _int64_or_none(lhs + rhs)
+    elif op == '-':
+        return _int64_or_none(lhs - rhs)
+    elif op == '*':
+        return _int64_or_none(lhs * rhs)
+    elif op in ('/', '%'):
+        # INT64_MIN / -1 overflows, and then INT64_MIN % -1 is undefined behavior too.
+        if rhs == 0 or (lhs == _MIN_INT64 and rhs == -1):
+            return None
+        # C++ rounds the quotient towards zero (while Python's // rounds it down).
+        quotient = abs(lhs) // abs(rhs)
+        if (lhs < 0) != (rhs < 0):
+            quotient = -quotient
+        if op == '/':
+            return quotient
+        else:
+            return lhs - rhs * quotient
+    else:
+        raise NotImplementedError('Unexpected op: %s' % op)
+
+def _is_list_with_known_elems(expr: ir.Expr, list_template_name: str):
+    return (isinstance(expr, ir.TemplateInstantiation)
+            and isinstance(expr.template_expr, ir.AtomicTypeLiteral)
+            and expr.template_expr.cpp_type == list_template_name
+            and not any(isinstance(arg, ir.VariadicTypeExpansion) for arg in expr.args))
 
 class ExpressionSimplificationTransformation(Transformation):
     def __init__(self) -> None:
@@ -67,7 +128,9 @@ class ExpressionSimplificationTransformation(Transformation):
         # -(3) => -3
         if isinstance(expr, ir.Literal):
             assert isinstance(expr.value, int)
-            return ir.Literal(-expr.value)
+            value = fold_int64_unary_minus(expr.value)
+            if value is not None:
+                return ir.Literal(value)
         # -(x - y) => y - x
         if isinstance(expr, ir.Int64BinaryOpExpr) and expr.op == '-':
             return ir.Int64BinaryOpExpr(lhs=expr.rhs, rhs=expr.lhs, op='-')
@@ -94,7 +157,9 @@ class ExpressionSimplificationTransformation(Transformation):
         if op == '+':
             # 3 + 5 => 8
             if isinstance(lhs, ir.Literal) and isinstance(rhs, ir.Literal):
-                return ir.Literal(lhs.value + rhs.value)
+                value = fold_int64_binary_op('+', lhs.value, rhs.value)
+                if value is not None:
+                    return ir.Literal(value)
             # 0 + x => x
             if isinstance(lhs, ir.Literal) and lhs.value == 0:
                 return rhs
@@ -105,7 +170,9 @@ class ExpressionSimplificationTransformation(Transformation):
         if op == '-':
             # 8 - 5 => 3
             if isinstance(lhs, ir.Literal) and isinstance(rhs, ir.Literal):
-                return ir.Literal(lhs.value - rhs.value)
+                value = fold_int64_binary_op('-', lhs.value, rhs.value)
+                if value is not None:
+                    return ir.Literal(value)
             # 0 - x => -x
             if isinstance(lhs, ir.Literal) and lhs.value == 0:
                 return ir.UnaryMinusExpr(rhs)
@@ -116,7 +183,9 @@ class ExpressionSimplificationTransformation(Transformation):
         if op == '*':
             # 3 * 5 => 15
             if isinstance(lhs, ir.Literal) and isinstance(rhs, ir.Literal):
-                return ir.Literal(lhs.value * rhs.value)
+                value = fold_int64_binary_op('*', lhs.value, rhs.value)
+                if value is not None:
+                    return ir.Literal(value)
             # 0 * x => 0
             if isinstance(lhs, ir.Literal) and lhs.value == 0:
                 if self._can_remove_subexpression(rhs):
@@ -134,16 +203,22 @@ class ExpressionSimplificationTransformation(Transformation):
 
         if op == '/':
             # 16 / 3 => 5
+            # -16 / 3 => -5
             if isinstance(lhs, ir.Literal) and isinstance(rhs, ir.Literal):
-                return ir.Literal(lhs.value // rhs.value)
+                value = fold_int64_binary_op('/', lhs.value, rhs.value)
+                if value is not None:
+                    return ir.Literal(value)
             # x / 1 => x
             if isinstance(rhs, ir.Literal) and rhs.value == 1:
                 return lhs
 
         if op == '%':
             # 16 % 3 => 1
+            # -16 % 3 => -1
             if isinstance(lhs, ir.Literal) and isinstance(rhs, ir.Literal):
-                return ir.Literal(lhs.value % rhs.value)
+                value = fold_int64_binary_op('%', lhs.value, rhs.value)
+                if value is not None:
+                    return ir.Literal(value)
             # x % 1 => 0
             if isinstance(rhs, ir.Literal) and rhs.value == 1:
                 return ir.Literal(0)
@@ -276,9 +351,30 @@ class ExpressionSimplificationTransformation(Transformation):
             if class_member_access.inner_expr.template_expr.cpp_type == 'std::is_same':
                 args = self.transform_exprs(class_member_access.inner_expr.args, original_parent_element=class_member_access.inner_expr)
                 return self.transform_is_same(args)
+            if class_member_access.inner_expr.template_expr.cpp_type == 'std::is_base_of':
+                args = self.transform_exprs(class_member_access.inner_expr.args, original_parent_element=class_member_access.inner_expr)
+                return self.transform_is_base_of(args)
             if class_member_access.inner_expr.template_expr.cpp_type.startswith('Select1st'):
                 args = self.transform_exprs(class_member_access.inner_expr.args, original_parent_element=class_member_access.inner_expr)
                 return self.transform_select1st(args)
+            if class_member_access.inner_expr.template_expr.cpp_type in _LIST_TEMPLATE_NAME_BY_LIST_GET_TEMPLATE_NAME:
+                args = self.transform_exprs(class_member_access.inner_expr.args, original_parent_element=class_member_access.inner_expr)
+                return self.transform_list_get(class_member_access, args)
+            if class_member_access.inner_expr.template_expr.cpp_type in _LIST_TEMPLATE_NAME_BY_LIST_SLICE_TEMPLATE_NAME:
+                args = self.transform_exprs(class_member_access.inner_expr.args, original_parent_element=class_member_access.inner_expr)
+                return self.transform_list_slice(class_member_access, args)
+            if class_member_access.inner_expr.template_expr.cpp_type == 'Int64Range':
+                args = self.transform_exprs(class_member_access.inner_expr.args, original_parent_element=class_member_access.inner_expr)
+                return self.transform_int64_range(class_member_access, args)
+            if class_member_access.inner_expr.template_expr.cpp_type in _LIST_TEMPLATE_NAME_BY_LIST_SELECT_TEMPLATE_NAME:
+                args = self.transform_exprs(class_member_access.inner_expr.args, original_parent_element=class_member_access.inner_expr)
+                return self.transform_list_select(class_member_access, args)
+            if class_member_access.inner_expr.template_expr.cpp_type in ('ListFirstHalf', 'ListSecondHalf'):
+                args = self.transform_exprs(class_member_access.inner_expr.args, original_parent_element=class_member_access.inner_expr)
+                return self.transform_list_half(class_member_access, args)
+            if class_member_access.inner_expr.template_expr.cpp_type in ('Int64ListSortedIndexes', 'Int64ListUniqueSortedIndexes'):
+                args = self.transform_exprs(class_member_access.inner_expr.args, original_parent_element=class_member_access.inner_expr)
+                return self.transform_int64_list_sorted_indexes(class_member_access, args)
 
         return super().transform_class_member_access(class_member_access)
 
@@ -353,6 +449,56 @@ class ExpressionSimplificationTransformation(Transformation):
 
         return self._create_is_same_expr(lhs, rhs)
 
+    def transform_is_base_of(self, args: Tuple[ir.Expr, ...]):
+        assert len(args) == 2
+        lhs, rhs = args
+        set_index_elem_names = {
+            'BoolSetIndexElem': 'BoolSetIndex',
+            'Int64SetIndexElem': 'Int64SetIndex',
+            'TypeSetIndexElem': 'TypeSetIndex',
+        }
+        if (isinstance(lhs, ir.TemplateInstantiation) and isinstance(lhs.template_expr, ir.AtomicTypeLiteral)
+                and lhs.template_expr.cpp_type in set_index_elem_names
+                and isinstance(rhs, ir.TemplateInstantiation) and isinstance(rhs.template_expr, ir.AtomicTypeLiteral)
+                and rhs.template_expr.cpp_type == set_index_elem_names[lhs.template_expr.cpp_type]
+                and not any(isinstance(arg, ir.VariadicTypeExpansion) for arg in rhs.args)):
+            [elem] = lhs.args
+
+            # std::is_base_of<TypeSetIndexElem<T>, TypeSetIndex<>>::value
+            # -> false
+            if not rhs.args:
+                return ir.Literal(False)
+
+            # std::is_base_of<TypeSetIndexElem<T>, TypeSetIndex<U1, U2, U3>>::value
+            # -> std::is_same<T, U1>::value || std::is_same<T, U2>::value || std::is_same<T, U3>::value
+            # (and similarly for bools/int64s, with ==)
+            # This is only done when it will simplify further (i.e. for a single element, or when all elements are
+            # known), otherwise it would undo the constant-time lookup.
+            if len(rhs.args) > 1 and any(True for arg in args for _ in arg.free_vars):
+                return self._create_is_base_of_expr(lhs, rhs)
+
+            result = None
+            for set_elem in rhs.args:
+                if isinstance(elem.expr_type, ir.TypeType):
+                    elem_result = self._create_is_same_expr(elem, set_elem)
+                else:
+                    elem_result = ir.ComparisonExpr(elem, set_elem, op='==')
+                if result:
+                    result = ir.BoolBinaryOpExpr(lhs=result, rhs=elem_result, op='||')
+                else:
+                    result = elem_result
+            return self.transform_expr(result)
+
+        return self._create_is_base_of_expr(lhs, rhs)
+
+    def _create_is_base_of_expr(self, lhs: ir.Expr, rhs: ir.Expr):
+        return ir.ClassMemberAccess(
+            inner_expr=ir.TemplateInstantiation(template_expr=GlobalLiterals.STD_IS_BASE_OF,
+                                                args=(lhs, rhs),
+                                                instantiation_might_trigger_static_asserts=False),
+            expr_type=ir.BoolType(),
+            member_name='value')
+
     def _create_is_same_expr(self, lhs: ir.Expr, rhs: ir.Expr):
         return ir.ClassMemberAccess(
             inner_expr=ir.TemplateInstantiation(template_expr=GlobalLiterals.STD_IS_SAME,
@@ -361,6 +507,114 @@ class ExpressionSimplificationTransformation(Transformation):
             expr_type=ir.BoolType(),
             member_name='value')
 
+    def _with_args(self, class_member_access: ir.ClassMemberAccess, args: Tuple[ir.Expr, ...]):
+        return ir.ClassMemberAccess(inner_expr=ir.TemplateInstantiation(template_expr=class_member_access.inner_expr.template_expr,
+                                                                        args=args,
+                                                                        instantiation_might_trigger_static_asserts=class_member_access.inner_expr.instantiation_might_trigger_static_asserts),
+                                    expr_type=class_member_access.expr_type,
+                                    member_name=class_member_access.member_name)
+
+    def transform_list_get(self, class_member_access: ir.ClassMemberAccess, args: Tuple[ir.Expr, ...]):
+        l, index = args
+        list_template_name = _LIST_TEMPLATE_NAME_BY_LIST_GET_TEMPLATE_NAME[class_member_access.inner_expr.template_expr.cpp_type]
+
+        # Int64ListGet<Int64List<n1, n2, n3>, 1>::value
+        # -> n2
+        # (and same for BoolListGet and TypeListGet)
+        # If the index is out of range, this is left as-is so that the static_assert in the template is triggered.
+        if (_is_list_with_known_elems(l, list_template_name)
+                and isinstance(index, ir.Literal)
+                and -len(l.args) <= index.value < len(l.args)):
+            return l.args[index.value]
+
+        return self._with_args(class_member_access, args)
+
+    def transform_list_slice(self, class_member_access: ir.ClassMemberAccess, args: Tuple[ir.Expr, ...]):
+        l, begin, end = args
+        list_template_name = _LIST_TEMPLATE_NAME_BY_LIST_SLICE_TEMPLATE_NAME[class_member_access.inner_expr.template_expr.cpp_type]
+
+        # Int64ListSlice<Int64List<n1, n2, n3>, 1, 3>::type
+        # -> Int64List<n2, n3>
+        # (and same for BoolListSlice and TypeListSlice)
+        # The bounds are clamped in the same way as in Python, so the slicing can be done here directly.
+        if (_is_list_with_known_elems(l, list_template_name)
+                and isinstance(begin, ir.Literal)
+                and isinstance(end, ir.Literal)):
+            return ir.TemplateInstantiation(template_expr=l.template_expr,
+                                            args=l.args[begin.value:end.value],
+                                            instantiation_might_trigger_static_asserts=False)
+
+        return self._with_args(class_member_access, args)
+
+    def transform_int64_range(self, class_member_access: ir.ClassMemberAccess, args: Tuple[ir.Expr, ...]):
+        begin, end = args
+
+        # Int64Range<2, 5>::type
+        # -> Int64List<2, 3, 4>
+        if isinstance(begin, ir.Literal) and isinstance(end, ir.Literal):
+            return ir.TemplateInstantiation(template_expr=GlobalLiterals.INT_LIST,
+                                            args=tuple(ir.Literal(n) for n in range(begin.value, end.value)),
+                                            instantiation_might_trigger_static_asserts=False)
+
+        return self._with_args(class_member_access, args)
+
+    def transform_list_select(self, class_member_access: ir.ClassMemberAccess, args: Tuple[ir.Expr, ...]):
+        l, indexes = args
+        list_template_name = _LIST_TEMPLATE_NAME_BY_LIST_SELECT_TEMPLATE_NAME[class_member_access.inner_expr.template_expr.cpp_type]
+
+        # Int64ListSelect<Int64List<n1, n2, n3>, Int64List<2, 0>>::type
+        # -> Int64List<n3, n1>
+        # (and same for BoolListSelect and TypeListSelect)
+        if (_is_list_with_known_elems(l, list_template_name)
+                and _is_list_with_known_elems(indexes, 'Int64List')
+                and all(isinstance(index, ir.Literal) and 0 <= index.value < len(l.args)
+                        for index in indexes.args)):
+            return ir.TemplateInstantiation(template_expr=l.template_expr,
+                                            args=tuple(l.args[index.value] for index in indexes.args),
+                                            instantiation_might_trigger_static_asserts=False)
+
+        return self._with_args(class_member_access, args)
+
+    def transform_list_half(self, class_member_access: ir.ClassMemberAccess, args: Tuple[ir.Expr, ...]):
+        [l] = args
+
+        # ListFirstHalf<Int64List<n1, n2, n3>>::type
+        # -> Int64List<n1>
+        # ListSecondHalf<Int64List<n1, n2, n3>>::type
+        # -> Int64List<n2, n3>
+        # (and same for BoolList and List)
+        if any(_is_list_with_known_elems(l, list_template_name) for list_template_name in _LIST_TEMPLATE_NAMES):
+            if class_member_access.inner_expr.template_expr.cpp_type == 'ListFirstHalf':
+                elems = l.args[:len(l.args) // 2]
+            else:
+                elems = l.args[len(l.args) // 2:]
+            return ir.TemplateInstantiation(template_expr=l.template_expr,
+                                            args=elems,
+                                            instantiation_might_trigger_static_asserts=False)
+
+        return self._with_args(class_member_access, args)
+
+    def transform_int64_list_sorted_indexes(self, class_member_access: ir.ClassMemberAccess, args: Tuple[ir.Expr, ...]):
+        [keys] = args
+
+        # Int64ListSortedIndexes<Int64List<5, 3, 5>>::type
+        # -> Int64List<1, 0, 2>
+        # Int64ListUniqueSortedIndexes<Int64List<5, 3, 5>>::type
+        # -> Int64List<1, 0>
+        if (_is_list_with_known_elems(keys, 'Int64List')
+                and all(isinstance(key, ir.Literal) for key in keys.args)):
+            # sorted() is stable, so equal keys keep their relative order.
+            indexes = sorted(range(len(keys.args)), key=lambda i: keys.args[i].value)
+            if class_member_access.inner_expr.template_expr.cpp_type == 'Int64ListUniqueSortedIndexes':
+                indexes = [index
+                           for i, index in enumerate(indexes)
+                           if i == 0 or keys.args[index].value != keys.args[indexes[i - 1]].value]
+            return ir.TemplateInstantiation(template_expr=GlobalLiterals.INT_LIST,
+                                            args=tuple(ir.Literal(index) for index in indexes),
+                                            instantiation_might_trigger_static_asserts=False)
+
+        return self._with_args(class_member_access, args)
+
     def transform_select1st(self, args: Tuple[ir.Expr, ...]):
         lhs, rhs = args
 
@@ -0,0 +1,92 @@
+#  Copyright 2017 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS-IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+from typing import Dict, Iterator, List, Union
+
+from _py2tmp.ir0 import ir, Visitor, Transformation
+
+# Like CommonSubexpressionEliminationTransformation, but across templates: the closed exprs (i.e. the ones with no free
+# vars) that occur more than once in the header (e.g. in the bodies of different templates) are evaluated once, in a
+# namespace-scope constant/typedef that the occurrences then reference.
+# This is only done when linking the final header, since that's the only point where all the templates that might share
+# these exprs are known.
+def eliminate_common_closed_subexpressions_across_templates(header: ir.Header, identifier_generator: Iterator[str]) -> ir.Header:
+    visitor = _CountClosedSubexpressionsVisitor()
+    visitor.visit_header(header)
+
+    toplevel_defns: List[Union[ir.ConstantDef, ir.Typedef]] = []
+    replacement_by_expr: Dict[ir.Expr, ir.Expr] = dict()
+    for expr, num_occurrences in visitor.num_occurrences_by_expr.items():
+        if num_occurrences < 2:
+            continue
+        name = next(identifier_generator)
+        if expr.expr_type.kind == ir.ExprKind.TYPE:
+            toplevel_defns.append(ir.Typedef(name=name, expr=expr))
+        else:
+            toplevel_defns.append(ir.ConstantDef(name=name, expr=expr))
+        replacement_by_expr[expr] = ir.AtomicTypeLiteral.for_nonlocal(cpp_type=name,
+                                                                      expr_type=expr.expr_type,
+                                                                      is_metafunction_that_may_return_error=False,
+                                                                      may_be_alias=True)
+
+    if not replacement_by_expr:
+        return header
+
+    header = _ReplaceClosedSubexpressionsTransformation(replacement_by_expr).transform_header(header)
+    return ir.Header(template_defns=header.template_defns,
+                     toplevel_content=(*toplevel_defns, *header.toplevel_content),
+                     public_names=header.public_names,
+                     split_template_name_by_old_name_and_result_element_name=header.split_template_name_by_old_name_and_result_element_name,
+                     check_if_error_specializations=header.check_if_error_specializations)
+
+def _can_be_hoisted(expr: ir.Expr):
+    if isinstance(expr, (ir.Literal, ir.AtomicTypeLiteral)) or expr.expr_type.kind == ir.ExprKind.TEMPLATE:
+        return False
+    if any(expr.free_vars):
+        return False
+    if not expr.has_class_member_access:
+        # Just naming a template instantiation (e.g. Int64List<1, 2>) doesn't instantiate it, so there's nothing to share.
+        return False
+    # The instantiations that might trigger static asserts are kept where they are, since evaluating them at namespace
+    # scope would trigger the static assert even if the template that contains them is never instantiated.
+    return not expr.has_instantiation_that_might_trigger_static_asserts
+
+class _CountClosedSubexpressionsVisitor(Visitor):
+    def __init__(self):
+        # The maximal closed subexprs that can be hoisted, in order of first occurrence.
+        self.num_occurrences_by_expr: Dict[ir.Expr, int] = dict()
+
+    def visit_pattern(self, expr: ir.Expr):
+        # Patterns are matched against the template args, so they must be spelled out.
+        pass
+
+    def visit_expr(self, expr: ir.Expr):
+        if _can_be_hoisted(expr):
+            self.num_occurrences_by_expr[expr] = self.num_occurrences_by_expr.get(expr, 0) + 1
+        else:
+            super().visit_expr(expr)
+
+class _ReplaceClosedSubexpressionsTransformation(Transformation):
+    def __init__(self, replacement_by_expr: Dict[ir.Expr, ir.Expr]):
+        super().__init__()
+        self.replacement_by_expr = replacement_by_expr
+
+    def transform_pattern(self, expr: ir.Expr):
+        return expr
+
+    def transform_expr(self, expr: ir.Expr):
+        replacement = self.replacement_by_expr.get(expr)
+        if replacement is not None:
+            return replacement
+        return super().transform_expr(expr)
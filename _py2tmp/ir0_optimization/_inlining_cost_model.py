@@ -0,0 +1,76 @@
+#  Copyright 2017 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS-IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+from dataclasses import dataclass
+from typing import Iterable, Tuple, Union
+
+from _py2tmp.ir0 import ir
+from _py2tmp.ir0_optimization._configuration_knobs import ConfigurationKnobs
+
+
+@dataclass(frozen=True)
+class InliningCost:
+    # The estimated change in the number of template instantiations in the caller (this is usually -1, since the
+    # inlined instantiation goes away, plus the instantiations in the inlined body).
+    instantiation_count_increase: int
+    # The change in the size (in IR0 exprs) of the caller.
+    size_increase: int
+    # The size (in IR0 exprs) of the inlined code.
+    body_size: int
+    # The number of templates that reference the inlined template, i.e. the number of times that the body might end up
+    # being duplicated.
+    fan_out: int
+
+def _count_exprs(elems: Iterable[Union[ir.Expr, ir.TemplateBodyElement]]) -> Tuple[int, int]:
+    num_exprs = 0
+    num_instantiations = 0
+    for elem in elems:
+        # Body elements don't have subelements, so their transitive subexprs are the ones of their direct subexprs.
+        for expr in (elem,) if isinstance(elem, ir.Expr) else elem.direct_subexpressions:
+            num_exprs += expr.num_transitive_subexpressions
+            num_instantiations += expr.num_transitive_template_instantiations
+    return num_exprs, num_instantiations
+
+def compute_inlining_cost(inlined_body: Tuple[ir.TemplateBodyElement, ...],
+                          inlined_result_expr: ir.Expr,
+                          replaced_expr: ir.Expr,
+                          fan_out: int) -> InliningCost:
+    body_size, num_instantiations_after = _count_exprs((*inlined_body, inlined_result_expr))
+    replaced_size, num_instantiations_before = _count_exprs((replaced_expr,))
+    return InliningCost(instantiation_count_increase=num_instantiations_after - num_instantiations_before,
+                        size_increase=body_size - replaced_size,
+                        body_size=body_size,
+                        fan_out=fan_out)
+
+def is_inlining_cost_model_enabled():
+    return (ConfigurationKnobs.max_inlining_instantiation_count_increase >= 0
+            or ConfigurationKnobs.max_inlined_body_size >= 0
+            or ConfigurationKnobs.max_inlining_fan_out >= 0)
+
+def compute_inlining_cost_model_cache_key() -> str:
+    # The knobs that affect the result of inlining, for the optimization cache.
+    return 'max_inlining_instantiation_count_increase=%s,max_inlined_body_size=%s,max_inlining_fan_out=%s' % (
+        ConfigurationKnobs.max_inlining_instantiation_count_increase,
+        ConfigurationKnobs.max_inlined_body_size,
+        ConfigurationKnobs.max_inlining_fan_out)
+
+def is_inlining_worth_it(cost: InliningCost):
+    if 0 <= ConfigurationKnobs.max_inlining_instantiation_count_increase < cost.instantiation_count_increase:
+        return False
+    if cost.size_increase > 0:
+        # Inlining code that's not bigger than the replaced expr is always fine, regardless of the size/fan-out limits.
+        if 0 <= ConfigurationKnobs.max_inlined_body_size < cost.body_size:
+            return False
+        if 0 <= ConfigurationKnobs.max_inlining_fan_out < cost.fan_out:
+            return False
+    return True
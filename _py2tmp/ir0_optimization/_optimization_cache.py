@@ -0,0 +1,142 @@
+#  Copyright 2017 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS-IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+import hashlib
+import os
+import pickle
+import tempfile
+from dataclasses import dataclass
+from functools import lru_cache
+from typing import Dict, Tuple, Optional, Iterable, Iterator, List
+
+from _py2tmp.compiler.output_files import ObjectFileContent
+from _py2tmp.ir0 import ir, NameReplacementTransformation, ToplevelWriter
+from _py2tmp.ir0_optimization._configuration_knobs import ConfigurationKnobs
+
+
+@dataclass(frozen=True)
+class CachedOptimizationResult:
+    optimized_template_defns: Tuple[ir.TemplateDefn, ...]
+    # The identifiers that were taken from the identifier generator while optimizing, in order.
+    generated_identifiers: Tuple[str, ...]
+
+# A persistent (on-disk) cache of optimized connected components of the template dependency graph.
+# The key of a connected component is a structural digest of the (non-optimized) templates in the component, of the
+# already-optimized templates that they can inline and of the templates of the context object files that they
+# (transitively) reference. So the cached result can be reused as long as none of those changed (and the compiler
+# itself didn't change).
+class OptimizationCache:
+    def __init__(self, cache_dir: str, context_object_file_content: ObjectFileContent):
+        self.cache_dir = cache_dir
+        os.makedirs(cache_dir, exist_ok=True)
+        self.context_template_defn_by_name = context_object_file_content.template_defn_by_name
+
+    def compute_key(self,
+                    template_defns: Iterable[ir.TemplateDefn],
+                    inlineable_template_defns: Iterable[ir.TemplateDefn],
+                    extra_key_data: Iterable[str] = ()) -> str:
+        template_defns = tuple(template_defns)
+        inlineable_template_defns = tuple(inlineable_template_defns)
+        context_template_defns = [self.context_template_defn_by_name[template_name]
+                                  for template_name in self._compute_referenced_context_template_names(template_defns + inlineable_template_defns)]
+
+        key = hashlib.blake2b(_compute_compiler_digest(), digest_size=20)
+        for template_defns_group in (template_defns, inlineable_template_defns, context_template_defns):
+            key.update(b'|')
+            for template_defn in sorted(template_defns_group, key=lambda template_defn: template_defn.name):
+                key.update(ir.compute_structural_digest(template_defn))
+        for extra_key_elem in extra_key_data:
+            key.update(b'|' + extra_key_elem.encode('utf-8'))
+        return key.hexdigest()
+
+    def _compute_referenced_context_template_names(self, template_defns: Tuple[ir.TemplateDefn, ...]):
+        result = set()
+        identifiers_to_visit = [identifier
+                                for template_defn in template_defns
+                                for identifier in template_defn.referenced_identifiers]
+        while identifiers_to_visit:
+            identifier = identifiers_to_visit.pop()
+            if identifier in result or identifier not in self.context_template_defn_by_name:
+                continue
+            result.add(identifier)
+            identifiers_to_visit.extend(self.context_template_defn_by_name[identifier].referenced_identifiers)
+        return result
+
+    def lookup(self, key: str) -> Optional[CachedOptimizationResult]:
+        try:
+            with open(os.path.join(self.cache_dir, key), 'rb') as file:
+                result = pickle.load(file)
+        except (OSError, EOFError, pickle.UnpicklingError, AttributeError, ImportError):
+            # A missing or unreadable entry (e.g. from an incompatible version) is just a cache miss.
+            return None
+        if not isinstance(result, CachedOptimizationResult):
+            return None
+        ConfigurationKnobs.optimization_cache_hit_counter += 1
+        return result
+
+    def store(self, key: str, result: CachedOptimizationResult):
+        # We write to a temporary file and then rename it, so that concurrent compilations using the same cache
+        # directory never see partially-written entries.
+        file_descriptor, temporary_file_name = tempfile.mkstemp(dir=self.cache_dir)
+        try:
+            with os.fdopen(file_descriptor, 'wb') as file:
+                pickle.dump(result, file)
+            os.replace(temporary_file_name, os.path.join(self.cache_dir, key))
+        except OSError:
+            try:
+                os.remove(temporary_file_name)
+            except OSError:
+                pass
+
+# Records the identifiers that are taken from the wrapped generator.
+class RecordingIdentifierGenerator:
+    def __init__(self, identifier_generator: Iterator[str]):
+        self.identifier_generator = identifier_generator
+        self.generated_identifiers: List[str] = []
+
+    def __iter__(self):
+        return self
+
+    def __next__(self) -> str:
+        identifier = next(self.identifier_generator)
+        self.generated_identifiers.append(identifier)
+        return identifier
+
+def apply_cached_optimization_result(result: CachedOptimizationResult,
+                                     identifier_generator: Iterator[str]) -> Dict[str, ir.TemplateDefn]:
+    # The identifiers generated when the result was computed might be used for something else in this compilation, so
+    # we replace them with new ones. Taking them in the same order as the non-cached optimization would have also has
+    # the nice effect that the result is the same as if the optimization had been performed.
+    transformation = NameReplacementTransformation({generated_identifier: next(identifier_generator)
+                                                    for generated_identifier in result.generated_identifiers})
+    writer = ToplevelWriter(allow_toplevel_elems=False)
+    with transformation.set_writer(writer):
+        for template_defn in result.optimized_template_defns:
+            transformation.transform_template_defn(template_defn)
+    return {template_defn.name: template_defn
+            for template_defn in writer.template_defns}
+
+@lru_cache()
+def _compute_compiler_digest() -> bytes:
+    # Any change to the compiler might change the result of the optimizations, so cached results are only reused by the
+    # exact same compiler sources.
+    import _py2tmp
+    digest = hashlib.blake2b(digest_size=16)
+    package_dir = os.path.dirname(os.path.abspath(_py2tmp.__file__))
+    for dir_path, _, file_names in sorted(os.walk(package_dir)):
+        for file_name in sorted(file_names):
+            if file_name.endswith('.py'):
+                with open(os.path.join(dir_path, file_name), 'rb') as file:
+                    digest.update(os.path.relpath(os.path.join(dir_path, file_name), package_dir).encode() + b'|')
+                    digest.update(file.read())
+    return digest.digest()
@@ -0,0 +1,155 @@
+#  Copyright 2017 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS-IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+from collections import deque
+from contextlib import contextmanager
+from dataclasses import dataclass
+from typing import Tuple, List, Optional, Callable, Iterator, Dict, Hashable, Deque
+
+from _py2tmp.ir0_optimization._optimization_cache import RecordingIdentifierGenerator
+
+@dataclass(frozen=True)
+class _OptimizationStep:
+    optimization_name: str
+    elems: Tuple
+    new_elems: Tuple
+    needs_another_loop: bool
+    # The identifiers taken from the identifier generator during the step, in order.
+    generated_identifiers: Tuple[str, ...]
+
+# An identifier generator whose next identifiers can be looked at without taking them.
+# The compilations wrap their identifier generators in this, so that the identifiers that the optimization checkpoints
+# look at (to check if a step can be replayed) are still the next ones returned, also after the optimization.
+class LookaheadIdentifierGenerator:
+    def __init__(self, identifier_generator: Iterator[str]):
+        self.identifier_generator = identifier_generator
+        self._lookahead: Deque[str] = deque()
+
+    def __iter__(self):
+        return self
+
+    def __next__(self) -> str:
+        if self._lookahead:
+            return self._lookahead.popleft()
+        return next(self.identifier_generator)
+
+    def peek(self, num_identifiers: int) -> Tuple[str, ...]:
+        while len(self._lookahead) < num_identifiers:
+            self._lookahead.append(next(self.identifier_generator))
+        return tuple(self._lookahead)[:num_identifiers]
+
+@dataclass(frozen=True)
+class FrontendResult:
+    # The results of the stages before the IR0 optimization (see compile_source_code()), as a tuple.
+    result: Tuple
+    generated_identifiers: Tuple[str, ...]
+
+# The state of the optimizer after each optimization step of a compilation, so that the following compilations of the
+# same source (e.g. with a different ConfigurationKnobs.max_num_optimization_steps, when bisecting the steps) can reuse
+# the result of each step instead of performing it again.
+# The optimizations are deterministic, so the same step in another compilation gets the same input as long as the
+# previous steps did, and then it's replayed (also taking the same identifiers from the identifier generator).
+# Otherwise (or if a step has side effects, e.g. if it also updates some other data structure) the step is performed
+# again, and from that point on the new results are recorded instead.
+# This is only valid as long as the ConfigurationKnobs that affect the result of the optimizations don't change.
+class OptimizationCheckpoints:
+    def __init__(self):
+        self._steps: List[_OptimizationStep] = []
+        self._next_step_index = 0
+        self._identifier_generator: Optional[RecordingIdentifierGenerator] = None
+        self._lookahead_identifier_generator: Optional[LookaheadIdentifierGenerator] = None
+        self._frontend_results: Dict[Hashable, Tuple[Tuple, FrontendResult]] = dict()
+        self.num_replayed_steps = 0
+        self.num_performed_steps = 0
+
+    def start_compilation(self):
+        self._next_step_index = 0
+
+    @contextmanager
+    def recording_identifiers(self, identifier_generator: Iterator[str]):
+        # The steps performed in this context take their identifiers from the returned generator (that wraps
+        # identifier_generator). If identifier_generator is not a LookaheadIdentifierGenerator, the identifiers looked at
+        # but not taken by the last step are lost when exiting this context.
+        previous_identifier_generator = self._identifier_generator
+        previous_lookahead_identifier_generator = self._lookahead_identifier_generator
+        if not isinstance(identifier_generator, LookaheadIdentifierGenerator):
+            identifier_generator = LookaheadIdentifierGenerator(identifier_generator)
+        self._lookahead_identifier_generator = identifier_generator
+        self._identifier_generator = RecordingIdentifierGenerator(identifier_generator)
+        try:
+            yield self._identifier_generator
+        finally:
+            self._identifier_generator = previous_identifier_generator
+            self._lookahead_identifier_generator = previous_lookahead_identifier_generator
+
+    def perform_step(self,
+                     optimization_name: str,
+                     elems: Tuple,
+                     optimization: Callable[[], Tuple[Tuple, bool]],
+                     has_side_effects: bool) -> Tuple[Tuple, bool]:
+        step_index = self._next_step_index
+        self._next_step_index += 1
+        identifier_generator = self._identifier_generator
+        if identifier_generator is None:
+            self.num_performed_steps += 1
+            return optimization()
+
+        recorded_step = self._steps[step_index] if step_index < len(self._steps) else None
+        if recorded_step is not None and (recorded_step.optimization_name != optimization_name
+                                          or not (recorded_step.elems is elems or recorded_step.elems == elems)):
+            recorded_step = None
+
+        if recorded_step is not None and not has_side_effects:
+            # The identifiers are only taken if the step is replayed, otherwise the optimization must get them.
+            num_identifiers = len(recorded_step.generated_identifiers)
+            if self._lookahead_identifier_generator.peek(num_identifiers) == recorded_step.generated_identifiers:
+                for _ in range(num_identifiers):
+                    next(identifier_generator)
+                self.num_replayed_steps += 1
+                return recorded_step.new_elems, recorded_step.needs_another_loop
+            recorded_step = None
+
+        self.num_performed_steps += 1
+        num_identifiers_before = len(identifier_generator.generated_identifiers)
+        new_elems, needs_another_loop = optimization()
+        step = _OptimizationStep(optimization_name=optimization_name,
+                                 elems=elems,
+                                 new_elems=new_elems,
+                                 needs_another_loop=needs_another_loop,
+                                 generated_identifiers=tuple(identifier_generator.generated_identifiers[num_identifiers_before:]))
+        if recorded_step is not None and recorded_step == step:
+            # A step with side effects, that had the same result as in the recorded compilation. The following
+            # recorded steps can still be replayed.
+            return new_elems, needs_another_loop
+
+        # The compilation diverged from the recorded one, the recorded results of this step and of the following ones
+        # can't be used.
+        del self._steps[step_index:]
+        if step_index == len(self._steps):
+            self._steps.append(step)
+        return new_elems, needs_another_loop
+
+    # The frontend results are only reused if the objects in the context are the same (e.g. the same ModuleInfo objects
+    # for the modules that the source imports), since comparing them could be as expensive as recomputing the result.
+    def lookup_frontend_result(self, key: Hashable, context: Tuple) -> Optional[FrontendResult]:
+        context_and_result = self._frontend_results.get(key)
+        if context_and_result is None:
+            return None
+        recorded_context, result = context_and_result
+        if len(recorded_context) != len(context) or any(x is not y for x, y in zip(recorded_context, context)):
+            return None
+        return result
+
+    def record_frontend_result(self, key: Hashable, context: Tuple, result: FrontendResult):
+        self._frontend_results[key] = (context, result)
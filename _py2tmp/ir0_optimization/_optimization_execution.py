@@ -13,6 +13,7 @@
 # limitations under the License.
 
 import difflib
+import time
 from typing import Iterator, Callable, Tuple, List, Union
 
 from _py2tmp.compiler.stages import header_to_cpp
@@ -23,14 +24,33 @@ def apply_elem_optimization(elems: Tuple,
                             optimization: Callable[[], Tuple[Tuple, bool]],
                             describe_elems: Callable[[Tuple], str],
                             optimization_name: str,
-                            other_context: Callable[[], str] = lambda: ''):
+                            other_context: Callable[[], str] = lambda: '',
+                            has_side_effects: bool = False):
     if ConfigurationKnobs.max_num_optimization_steps == 0:
         return elems, False
     ConfigurationKnobs.optimization_step_counter += 1
     if ConfigurationKnobs.max_num_optimization_steps > 0:
         ConfigurationKnobs.max_num_optimization_steps -= 1
 
-    new_elems, needs_another_loop = optimization()
+    if ConfigurationKnobs.optimization_profile is not None:
+        original_optimization = optimization
+
+        def optimization():
+            start_time = time.perf_counter()
+            new_elems, needs_another_loop = original_optimization()
+            ConfigurationKnobs.optimization_profile.record_optimization(optimization_name,
+                                                                        elems,
+                                                                        new_elems,
+                                                                        time.perf_counter() - start_time)
+            return new_elems, needs_another_loop
+
+    if ConfigurationKnobs.optimization_checkpoints is not None:
+        new_elems, needs_another_loop = ConfigurationKnobs.optimization_checkpoints.perform_step(optimization_name,
+                                                                                                 elems,
+                                                                                                 optimization,
+                                                                                                 has_side_effects)
+    else:
+        new_elems, needs_another_loop = optimization()
 
     if ConfigurationKnobs.verbose:
         original_cpp = describe_elems(elems)
@@ -78,13 +98,3 @@ def combine_optimizations(ir, optimizations):
         needs_another_loop |= needs_another_loop1
 
     return ir, needs_another_loop
-
-def optimize_list(list, optimization):
-    needs_another_loop = False
-    result_list = []
-    for elem in list:
-        elem, needs_another_loop1 = optimization(elem)
-        needs_another_loop |= needs_another_loop1
-        result_list.append(elem)
-
-    return result_list, needs_another_loop
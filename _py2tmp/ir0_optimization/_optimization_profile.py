@@ -0,0 +1,177 @@
+#  Copyright 2017 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS-IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+import time
+from collections import defaultdict
+from contextlib import contextmanager
+from dataclasses import dataclass
+from typing import Dict, Tuple, List, Optional, Iterable
+
+from _py2tmp.ir0 import ir
+
+@dataclass
+class OptimizationStats:
+    num_calls: int = 0
+    # How many of the calls returned different elems.
+    num_calls_that_changed_ir: int = 0
+    time_seconds: float = 0.0
+    # The total (over all calls) number of IR nodes in the elems passed to / returned by the optimization.
+    ir_size_before: int = 0
+    ir_size_after: int = 0
+
+    def merge(self, other: 'OptimizationStats'):
+        self.num_calls += other.num_calls
+        self.num_calls_that_changed_ir += other.num_calls_that_changed_ir
+        self.time_seconds += other.time_seconds
+        self.ir_size_before += other.ir_size_before
+        self.ir_size_after += other.ir_size_after
+
+    def to_json(self):
+        return {
+            'num_calls': self.num_calls,
+            'num_calls_that_changed_ir': self.num_calls_that_changed_ir,
+            'time_seconds': self.time_seconds,
+            'ir_size_before': self.ir_size_before,
+            'ir_size_after': self.ir_size_after,
+        }
+
+# Used for the optimizations that are not performed as part of the optimization of a connected component of the
+# template dependency graph (e.g. the optimization of the toplevel content).
+_NO_CONNECTED_COMPONENT = ''
+
+# Collects statistics about each optimization (as named in apply_elem_optimization()), broken down by connected
+# component of the template dependency graph and by optimized template.
+# This only adds a small constant overhead to each optimization step (plus the cost of computing the IR size, that's
+# linear in the number of template body elements, since expr sizes are memoized), so unlike verbose mode it can be
+# used on real builds.
+class OptimizationProfile:
+    def __init__(self):
+        # (connected component, optimized templates, optimization name) -> stats
+        self.stats_by_key: Dict[Tuple[str, str, str], OptimizationStats] = defaultdict(OptimizationStats)
+        self.time_seconds_by_connected_component: Dict[str, float] = defaultdict(float)
+        # Each entry is a (connected component, max number of loops) pair.
+        self.connected_components_that_reached_max_num_remaining_loops: List[Tuple[str, int]] = []
+        self.current_connected_component = _NO_CONNECTED_COMPONENT
+
+    @contextmanager
+    def connected_component_scope(self, connected_component: Iterable[str]):
+        previous_connected_component = self.current_connected_component
+        self.current_connected_component = ', '.join(sorted(connected_component))
+        start_time = time.perf_counter()
+        try:
+            yield
+        finally:
+            self.time_seconds_by_connected_component[self.current_connected_component] += time.perf_counter() - start_time
+            self.current_connected_component = previous_connected_component
+
+    def record_optimization(self, optimization_name: str, elems: Tuple, new_elems: Tuple, time_seconds: float):
+        stats = self.stats_by_key[(self.current_connected_component, _describe_optimized_elems(elems), optimization_name)]
+        stats.num_calls += 1
+        if len(elems) != len(new_elems) or not all(_is_same_elem(elem, new_elem) for elem, new_elem in zip(elems, new_elems)):
+            stats.num_calls_that_changed_ir += 1
+        stats.time_seconds += time_seconds
+        stats.ir_size_before += sum(_compute_ir_size(elem) for elem in elems)
+        stats.ir_size_after += sum(_compute_ir_size(elem) for elem in new_elems)
+
+    def record_reached_max_num_remaining_loops(self, max_num_loops: int):
+        self.connected_components_that_reached_max_num_remaining_loops.append((self.current_connected_component, max_num_loops))
+
+    # Used to merge the profiles collected in worker processes.
+    def merge(self, other: 'OptimizationProfile'):
+        for key, stats in other.stats_by_key.items():
+            self.stats_by_key[key].merge(stats)
+        for connected_component, time_seconds in other.time_seconds_by_connected_component.items():
+            self.time_seconds_by_connected_component[connected_component] += time_seconds
+        self.connected_components_that_reached_max_num_remaining_loops += other.connected_components_that_reached_max_num_remaining_loops
+
+    def _aggregate(self, key_index: Optional[int]) -> Dict[Tuple[str, str], OptimizationStats]:
+        result: Dict[Tuple[str, str], OptimizationStats] = defaultdict(OptimizationStats)
+        for key, stats in self.stats_by_key.items():
+            result[(key[key_index] if key_index is not None else '', key[2])].merge(stats)
+        return result
+
+    def to_json(self):
+        def stats_list_to_json(stats_by_key: Dict[Tuple[str, str], OptimizationStats], group_key_name: str):
+            stats_by_optimization_name_by_group_key = defaultdict(dict)
+            for (group_key, optimization_name), stats in sorted(stats_by_key.items()):
+                stats_by_optimization_name_by_group_key[group_key][optimization_name] = stats.to_json()
+            return [{group_key_name: group_key, 'optimizations': stats_by_optimization_name}
+                    for group_key, stats_by_optimization_name in stats_by_optimization_name_by_group_key.items()]
+
+        return {
+            'optimizations': {optimization_name: stats.to_json()
+                              for (_, optimization_name), stats in sorted(self._aggregate(None).items())},
+            'by_connected_component': [dict(elem, time_seconds=self.time_seconds_by_connected_component.get(elem['connected_component'], 0.0))
+                                       for elem in stats_list_to_json(self._aggregate(0), 'connected_component')],
+            'by_template': stats_list_to_json(self._aggregate(1), 'templates'),
+            'connected_components_that_reached_max_num_remaining_loops': [
+                {'connected_component': connected_component, 'max_num_loops': max_num_loops}
+                for connected_component, max_num_loops in self.connected_components_that_reached_max_num_remaining_loops],
+        }
+
+    def to_table(self, max_num_rows: int = 20) -> str:
+        lines = []
+        def add_table(title: str, stats_by_key: Dict[Tuple[str, str], OptimizationStats]):
+            lines.append(title)
+            lines.append('%10s %8s %8s %12s %12s  %s' % ('time (s)', 'calls', 'changed', 'size before', 'size after', 'optimization'))
+            rows = sorted(stats_by_key.items(), key=lambda item: item[1].time_seconds, reverse=True)
+            for (group_key, optimization_name), stats in rows[:max_num_rows]:
+                lines.append('%10.3f %8d %8d %12d %12d  %s' % (
+                    stats.time_seconds, stats.num_calls, stats.num_calls_that_changed_ir, stats.ir_size_before,
+                    stats.ir_size_after, optimization_name + (' [%s]' % group_key if group_key else '')))
+            if len(rows) > max_num_rows:
+                lines.append('(%s more rows omitted)' % (len(rows) - max_num_rows))
+            lines.append('')
+
+        add_table('Optimizations:', self._aggregate(None))
+        add_table('Optimizations by connected component:', self._aggregate(0))
+        add_table('Optimizations by template:', self._aggregate(1))
+        if self.connected_components_that_reached_max_num_remaining_loops:
+            lines.append('Connected components that reached the maximum number of optimization loops:')
+            for connected_component, max_num_loops in self.connected_components_that_reached_max_num_remaining_loops:
+                lines.append('  %s (%s loops)' % (connected_component or '<toplevel content>', max_num_loops))
+            lines.append('')
+        return '\n'.join(lines)
+
+def _describe_optimized_elems(elems: Tuple):
+    names = [elem.name
+             for elem in elems
+             if isinstance(elem, ir.TemplateDefn)]
+    if len(names) == len(elems):
+        return ', '.join(names)
+    elif all(isinstance(elem, ir.Header) for elem in elems):
+        return '<header>'
+    else:
+        return '<toplevel content>'
+
+def _is_same_elem(elem, new_elem):
+    # Transformations return the same objects for unchanged subtrees, so in most cases this is just an identity check.
+    # Otherwise, the comparison is still cheap when the elems are different, since hashes are memoized.
+    if elem is new_elem:
+        return True
+    try:
+        return elem == new_elem
+    except TypeError:
+        # Some passes (e.g. on whole headers) temporarily use lists instead of tuples in the IR, so it can't be hashed.
+        return False
+
+def _compute_ir_size(elem) -> int:
+    if isinstance(elem, ir.Expr):
+        return elem.num_transitive_subexpressions
+    elif isinstance(elem, ir.Header):
+        return (sum(_compute_ir_size(template_defn) for template_defn in elem.template_defns)
+                + sum(_compute_ir_size(toplevel_elem) for toplevel_elem in elem.toplevel_content))
+    else:
+        return (1
+                + sum(_compute_ir_size(subelem) for subelem in elem.direct_subelements)
+                + sum(_compute_ir_size(expr) for expr in elem.direct_subexpressions))
@@ -12,29 +12,39 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from typing import Iterator, Any, Callable, Tuple
-
-import networkx as nx
+import collections
+import concurrent.futures
+import contextlib
+import itertools
+import multiprocessing
+from typing import Iterator, Any, Callable, Tuple, List, Dict, Set, Optional, Mapping
 
 from _py2tmp.compiler.output_files import ObjectFileContent
 from _py2tmp.compiler.stages import template_defn_to_cpp_simple, toplevel_elem_to_cpp_simple
-from _py2tmp.ir0 import compute_template_dependency_graph
+from _py2tmp.ir0 import compute_template_dependency_graph, intern_exprs_in_header
 from _py2tmp.ir0 import ir
+from _py2tmp.ir0_optimization._closed_instantiation_evaluation import ClosedInstantiationEvaluator, \
+    evaluate_closed_instantiations_in_template_defn, evaluate_closed_instantiations_in_toplevel_elems
 from _py2tmp.ir0_optimization._configuration_knobs import ConfigurationKnobs
+from _py2tmp.ir0_optimization._inlining_cost_model import is_inlining_cost_model_enabled, \
+    compute_inlining_cost_model_cache_key
 from _py2tmp.ir0_optimization._local_optimizations import perform_local_optimizations_on_template_defn, \
     perform_local_optimizations_on_toplevel_elems
+from _py2tmp.ir0_optimization._optimization_cache import OptimizationCache, CachedOptimizationResult, \
+    RecordingIdentifierGenerator, apply_cached_optimization_result
 from _py2tmp.ir0_optimization._optimization_execution import apply_elem_optimization, describe_template_defns, \
-    combine_optimizations, optimize_list, describe_headers
+    combine_optimizations, describe_headers
+from _py2tmp.ir0_optimization._optimization_profile import OptimizationProfile
 from _py2tmp.ir0_optimization._recalculate_template_instantiation_can_trigger_static_asserts_info import \
     recalculate_template_instantiation_can_trigger_static_asserts_info
 from _py2tmp.ir0_optimization._remove_unused_toplevel_elems import remove_unused_toplevel_elems
 from _py2tmp.ir0_optimization._split_template_defn_with_multiple_outputs import \
     split_template_defn_with_multiple_outputs, replace_metafunction_calls_with_split_template_calls
 from _py2tmp.ir0_optimization._template_instantiation_inlining import perform_template_inlining, \
-    perform_template_inlining_on_toplevel_elems
+    perform_template_inlining_on_toplevel_elems, with_global_inlineable_templates
 from _py2tmp.ir0_optimization.replace_templates_with_templated_using_declarations import \
     move_template_args_to_using_declarations
-from _py2tmp.utils import compute_condensation_in_topological_order
+from _py2tmp.utils import compute_condensation_in_topological_order, DependencyGraph
 
 
 def _calculate_max_num_optimization_loops(size: int):
@@ -50,9 +60,7 @@ def _optimize_header_first_pass(header: ir.Header,
         # overwrite split_template_name_by_old_name_and_result_element_name).
         return header
 
-    split_template_name_by_old_name_and_result_element_name = {key: value
-                                                               for module_info in context_object_file_content.modules_by_name.values()
-                                                               for key, value in module_info.ir0_header.split_template_name_by_old_name_and_result_element_name}
+    split_template_name_by_old_name_and_result_element_name = dict(context_object_file_content.split_template_name_by_old_name_and_result_element_name)
 
     new_template_defns = []
     for template_defn in header.template_defns:
@@ -61,7 +69,9 @@ def _optimize_header_first_pass(header: ir.Header,
                                                                                                                 split_template_name_by_old_name_and_result_element_name,
                                                                                                                 identifier_generator),
                                                               lambda template_defns: describe_template_defns(template_defns, identifier_generator),
-                                                              optimization_name='split_template_defn_with_specializations_and_multiple_outputs()')
+                                                              optimization_name='split_template_defn_with_specializations_and_multiple_outputs()',
+                                                              # This also updates split_template_name_by_old_name_and_result_element_name.
+                                                              has_side_effects=True)
         assert not needs_another_loop
 
         for result in results:
@@ -73,10 +83,17 @@ def _optimize_header_first_pass(header: ir.Header,
                                                                         new_template_defns,
                                                                         split_template_name_by_old_name_and_result_element_name),),
                   False),
-        lambda header: describe_headers([header], identifier_generator),
+        lambda headers: describe_headers(headers, identifier_generator),
         optimization_name='replace_metafunction_calls_with_split_template_calls')
     return header
 
+def _report_reached_max_num_optimization_loops(size: int, description: str):
+    ConfigurationKnobs.reached_max_num_remaining_loops_counter += 1
+    if ConfigurationKnobs.optimization_profile is not None:
+        ConfigurationKnobs.optimization_profile.record_reached_max_num_remaining_loops(_calculate_max_num_optimization_loops(size))
+    print('Hit max_num_remaining_loops == %s while optimizing:\n%s' % (_calculate_max_num_optimization_loops(size),
+                                                                       description))
+
 def _iterate_optimization(ir: Any,
                           optimize: Callable[[Any], Tuple[Any, bool]],
                           size: int,
@@ -88,57 +105,365 @@ def _iterate_optimization(ir: Any,
         ir, needs_another_loop = optimize(ir)
 
     if not max_num_remaining_loops:
-        ConfigurationKnobs.reached_max_num_remaining_loops_counter += 1
-        print('Hit max_num_remaining_loops == %s while optimizing:\n%s' % (_calculate_max_num_optimization_loops(size),
-                                                                           describe_optimization_target(ir)))
+        _report_reached_max_num_optimization_loops(size, describe_optimization_target(ir))
 
     return ir
 
-def _optimize_header_second_pass(header: ir.Header,
-                                 identifier_generator: Iterator[str],
-                                 context_object_file_content: ObjectFileContent):
-    new_template_defns = {elem.name: elem
-                          for elem in header.template_defns}
+def _iterate_optimization_with_worklist(template_names: List[str],
+                                        optimizations: List[Callable[[ir.TemplateDefn], Tuple[ir.TemplateDefn, bool]]],
+                                        template_defn_by_name: Dict[str, ir.TemplateDefn],
+                                        describe_optimization_target: Callable[[], str]):
+    # A template is optimized again only when an optimization asked for another loop on it, instead of re-optimizing
+    # all the templates in the connected component until none of them changes.
+    # The optimizations only read the definitions of templates outside the connected component (see
+    # _compute_inlineable_refs()), and those don't change here, so a change in a template never requires re-optimizing
+    # another one.
+    worklist = collections.deque(template_names)
+    # The indexes of the optimizations that already ran on the current version of each template without changing it,
+    # so they can't fire again until the template changes.
+    exhausted_optimization_indexes_by_template_name: Dict[str, Set[int]] = {template_name: set()
+                                                                           for template_name in template_names}
+    # The budget is shared by the whole connected component. This allows as many template optimization loops as
+    # optimizing all the templates together for _calculate_max_num_optimization_loops() rounds.
+    max_num_remaining_loops = _calculate_max_num_optimization_loops(len(template_names)) * len(template_names)
 
-    template_dependency_graph = compute_template_dependency_graph(header.template_defns, new_template_defns)
+    while worklist and max_num_remaining_loops:
+        max_num_remaining_loops -= 1
+        template_name = worklist.popleft()
+
+        exhausted_optimization_indexes = exhausted_optimization_indexes_by_template_name[template_name]
+        needs_another_loop = False
+        for optimization_index, optimization in enumerate(optimizations):
+            if optimization_index in exhausted_optimization_indexes:
+                continue
+            old_template_defn = template_defn_by_name[template_name]
+            template_defn, needs_another_loop1 = optimization(old_template_defn)
+            template_defn_by_name[template_name] = template_defn
+            needs_another_loop |= needs_another_loop1
+            if template_defn is old_template_defn or template_defn == old_template_defn:
+                if not needs_another_loop1:
+                    exhausted_optimization_indexes.add(optimization_index)
+            else:
+                exhausted_optimization_indexes.clear()
 
-    template_dependency_graph_transitive_closure = nx.transitive_closure(template_dependency_graph)
-    assert isinstance(template_dependency_graph_transitive_closure, nx.DiGraph)
+        if needs_another_loop:
+            worklist.append(template_name)
 
+    if worklist:
+        _report_reached_max_num_optimization_loops(len(template_names), describe_optimization_target())
+
+def _compute_inlineable_refs(template_name: str, template_dependency_graph: DependencyGraph):
+    # The templates that this template depends on (directly or not) that don't depend on it.
+    return template_dependency_graph.descendants_outside_strongly_connected_component(template_name)
+
+def _optimize_connected_component(connected_component: List[str],
+                                  inlineable_refs_by_template_name: Dict[str, Set[str]],
+                                  template_defn_by_name: Dict[str, ir.TemplateDefn],
+                                  identifier_generator: Iterator[str],
+                                  context_object_file_content: ObjectFileContent,
+                                  num_referrers_by_template_name: Mapping[str, int]):
+    # The templates in this connected component can only use the results of the templates outside of it (the same ones
+    # that can be inlined), since those don't change while optimizing the connected component.
+    evaluator = ClosedInstantiationEvaluator(with_global_inlineable_templates(context_object_file_content,
+                                                                              [template_defn_by_name[template_name]
+                                                                               for template_name in sorted(set().union(*inlineable_refs_by_template_name.values()))]))
     optimizations = [
+        lambda template_defn: evaluate_closed_instantiations_in_template_defn(template_defn,
+                                                                              evaluator,
+                                                                              identifier_generator),
         lambda template_defn: perform_template_inlining(template_defn,
-                                                        {other_node
-                                                         for other_node in template_dependency_graph_transitive_closure.successors(template_defn.name)
-                                                         if not template_dependency_graph_transitive_closure.has_edge(other_node, template_defn.name)},
-                                                        new_template_defns,
+                                                        inlineable_refs_by_template_name[template_defn.name],
+                                                        template_defn_by_name,
                                                         identifier_generator,
-                                                        context_object_file_content),
+                                                        context_object_file_content,
+                                                        num_referrers_by_template_name),
         lambda template_defn: perform_local_optimizations_on_template_defn(template_defn,
                                                                            identifier_generator,
                                                                            inline_template_instantiations_with_multiple_references=False),
     ]
 
-    for connected_component in reversed(list(
-            compute_condensation_in_topological_order(template_dependency_graph))):
-        def optimize(template_name: str):
-            new_template_defns[template_name], needs_another_loop = combine_optimizations(new_template_defns[template_name], optimizations)
-            return None, needs_another_loop
+    with (ConfigurationKnobs.optimization_profile.connected_component_scope(connected_component)
+          if ConfigurationKnobs.optimization_profile is not None
+          else contextlib.nullcontext()):
+        _iterate_optimization_with_worklist(sorted(connected_component, key=lambda node: template_defn_by_name[node].name),
+                                            optimizations,
+                                            template_defn_by_name,
+                                            lambda: '\n'.join(template_defn_to_cpp_simple(template_defn_by_name[template_name], identifier_generator)
+                                                               for template_name in connected_component))
+
+def _compute_cache_key(optimization_cache: OptimizationCache,
+                       connected_component: List[str],
+                       inlineable_refs_by_template_name: Dict[str, Set[str]],
+                       template_defn_by_name: Dict[str, ir.TemplateDefn],
+                       num_referrers_by_template_name: Mapping[str, int]):
+    inlineable_refs = set().union(*inlineable_refs_by_template_name.values())
+    if is_inlining_cost_model_enabled():
+        # The result of the inlining also depends on the cost model and on the fan-out of the inlineable templates.
+        extra_key_data = (compute_inlining_cost_model_cache_key(),
+                          *('%s:%s' % (template_name, num_referrers_by_template_name.get(template_name, 1))
+                            for template_name in sorted(inlineable_refs)))
+    else:
+        extra_key_data = ()
+    if ConfigurationKnobs.preserve_coverage_markers:
+        extra_key_data = ('preserve_coverage_markers', *extra_key_data)
+    extra_key_data = ('evaluation_budget:%s:%s' % (ConfigurationKnobs.max_num_evaluated_template_instantiations,
+                                                   ConfigurationKnobs.max_evaluation_result_size),
+                      *extra_key_data)
+    return optimization_cache.compute_key((template_defn_by_name[template_name]
+                                           for template_name in connected_component),
+                                          (template_defn_by_name[template_name]
+                                           for template_name in inlineable_refs),
+                                          extra_key_data)
+
+def _optimize_connected_component_using_cache(optimization_cache: Optional[OptimizationCache],
+                                              connected_component: List[str],
+                                              inlineable_refs_by_template_name: Dict[str, Set[str]],
+                                              template_defn_by_name: Dict[str, ir.TemplateDefn],
+                                              identifier_generator: Iterator[str],
+                                              context_object_file_content: ObjectFileContent,
+                                              num_referrers_by_template_name: Mapping[str, int]):
+    if optimization_cache is None:
+        _optimize_connected_component(connected_component,
+                                      inlineable_refs_by_template_name,
+                                      template_defn_by_name,
+                                      identifier_generator,
+                                      context_object_file_content,
+                                      num_referrers_by_template_name)
+        return
+
+    key = _compute_cache_key(optimization_cache, connected_component, inlineable_refs_by_template_name, template_defn_by_name,
+                             num_referrers_by_template_name)
+    cached_result = optimization_cache.lookup(key)
+    if cached_result:
+        template_defn_by_name.update(apply_cached_optimization_result(cached_result, identifier_generator))
+        return
+
+    recording_identifier_generator = RecordingIdentifierGenerator(identifier_generator)
+    reached_max_num_remaining_loops_counter = ConfigurationKnobs.reached_max_num_remaining_loops_counter
+    _optimize_connected_component(connected_component,
+                                  inlineable_refs_by_template_name,
+                                  template_defn_by_name,
+                                  recording_identifier_generator,
+                                  context_object_file_content,
+                                  num_referrers_by_template_name)
+    # We don't cache the results of optimizations that were cut short, so that we still report them in later runs.
+    if ConfigurationKnobs.reached_max_num_remaining_loops_counter == reached_max_num_remaining_loops_counter:
+        optimization_cache.store(key, CachedOptimizationResult(optimized_template_defns=tuple(template_defn_by_name[template_name]
+                                                                                              for template_name in connected_component),
+                                                               generated_identifiers=tuple(recording_identifier_generator.generated_identifiers)))
+
+def _connected_component_identifier_generator(base_identifier: str) -> Iterator[str]:
+    for i in itertools.count():
+        yield base_identifier + '_' + str(i)
+
+# The ConfigurationKnobs that affect the result of the optimizations. Worker processes don't necessarily inherit their
+# values from this process (e.g. they don't with the "spawn" and "forkserver" start methods), so these are sent to each
+# worker process when it starts.
+_KNOBS_SENT_TO_WORKER_PROCESSES = (
+    'max_num_optimization_steps',
+    'verbose',
+    'preserve_coverage_markers',
+    'max_inlining_instantiation_count_increase',
+    'max_inlined_body_size',
+    'max_inlining_fan_out',
+    'max_num_evaluated_template_instantiations',
+    'max_evaluation_result_size',
+)
+
+# The ConfigurationKnobs counters that can be incremented while optimizing a connected component. Each job of a worker
+# process returns its own counts, that are then added to the counters of this process.
+_COUNTERS_RETURNED_BY_WORKER_PROCESSES = (
+    'optimization_step_counter',
+    'reached_max_num_remaining_loops_counter',
+    'optimization_cache_hit_counter',
+)
 
-        _iterate_optimization(None,
-                              lambda _: optimize_list(sorted(connected_component, key=lambda node: new_template_defns[node].name),
-                                                      lambda template_name: optimize(template_name)),
-                              len(connected_component),
-                              lambda _: '\n'.join(template_defn_to_cpp_simple(new_template_defns[template_name], identifier_generator)
-                                                  for template_name in connected_component))
+# The context is the same for all the connected components, so it's sent to each worker process only once (when the
+# process starts) instead of together with each connected component.
+_worker_context_object_file_content: Optional[ObjectFileContent] = None
 
+def _initialize_worker_process(context_object_file_content: ObjectFileContent, knob_values: Dict[str, Any]):
+    global _worker_context_object_file_content
+    _worker_context_object_file_content = context_object_file_content
+    for knob_name, value in knob_values.items():
+        setattr(ConfigurationKnobs, knob_name, value)
+    # Checkpoints are never used when optimizing in parallel (see _optimize_header_with_checkpoints()).
+    ConfigurationKnobs.optimization_checkpoints = None
 
+def _optimize_connected_component_in_worker_process(connected_component: List[str],
+                                                    inlineable_refs_by_template_name: Dict[str, Set[str]],
+                                                    template_defn_by_name: Dict[str, ir.TemplateDefn],
+                                                    num_referrers_by_template_name: Mapping[str, int],
+                                                    base_identifier: str,
+                                                    collect_optimization_profile: bool):
+    for counter_name in _COUNTERS_RETURNED_BY_WORKER_PROCESSES:
+        setattr(ConfigurationKnobs, counter_name, 0)
+    ConfigurationKnobs.optimization_profile = OptimizationProfile() if collect_optimization_profile else None
+    identifier_generator = RecordingIdentifierGenerator(_connected_component_identifier_generator(base_identifier))
+    _optimize_connected_component(connected_component,
+                                  inlineable_refs_by_template_name,
+                                  template_defn_by_name,
+                                  identifier_generator,
+                                  _worker_context_object_file_content,
+                                  num_referrers_by_template_name)
+    return (CachedOptimizationResult(optimized_template_defns=tuple(template_defn_by_name[template_name]
+                                                                    for template_name in connected_component),
+                                     generated_identifiers=tuple(identifier_generator.generated_identifiers)),
+            {counter_name: getattr(ConfigurationKnobs, counter_name)
+             for counter_name in _COUNTERS_RETURNED_BY_WORKER_PROCESSES},
+            ConfigurationKnobs.optimization_profile)
 
+def _should_optimize_connected_components_in_parallel():
+    # Bisecting optimization steps (max_num_optimization_steps>=0) relies on the steps being done in a fixed global
+    # order, and the verbose output of different processes would be interleaved, so in those cases we always optimize
+    # in this process.
+    return (ConfigurationKnobs.num_optimization_processes > 1
+            and ConfigurationKnobs.max_num_optimization_steps < 0
+            and not ConfigurationKnobs.verbose)
+
+def _compute_connected_components_by_level(template_dependency_graph: DependencyGraph) -> List[List[List[str]]]:
+    # The connected components with level 0 don't depend on other components, and those with level N only depend on
+    # components with level <N. So components with the same level can be optimized independently.
+    level_by_template_name: Dict[str, int] = dict()
+    connected_components_by_level: List[List[List[str]]] = []
+    for connected_component in reversed(list(compute_condensation_in_topological_order(template_dependency_graph))):
+        level = max((level_by_template_name[dependency] + 1
+                     for template_name in connected_component
+                     for dependency in template_dependency_graph.successors(template_name)
+                     if dependency in level_by_template_name),
+                    default=0)
+        for template_name in connected_component:
+            level_by_template_name[template_name] = level
+        if level == len(connected_components_by_level):
+            connected_components_by_level.append([])
+        connected_components_by_level[level].append(connected_component)
+    return connected_components_by_level
+
+def _should_use_optimization_cache():
+    # As for parallel optimization, bisection and verbose mode need all optimization steps to be actually performed.
+    return (ConfigurationKnobs.optimization_cache_dir is not None
+            and ConfigurationKnobs.max_num_optimization_steps < 0
+            and not ConfigurationKnobs.verbose)
+
+def _optimize_connected_components_in_parallel(optimization_cache: Optional[OptimizationCache],
+                                               template_dependency_graph: DependencyGraph,
+                                               new_template_defns: Dict[str, ir.TemplateDefn],
+                                               identifier_generator: Iterator[str],
+                                               context_object_file_content: ObjectFileContent,
+                                               num_referrers_by_template_name: Mapping[str, int]):
+    # To get the same result regardless of how the components are scheduled (and of the number of processes), each
+    # connected component gets its own identifier generator, whose identifiers all start with a fresh identifier taken
+    # from identifier_generator in a fixed order.
+    knob_values = {knob_name: getattr(ConfigurationKnobs, knob_name)
+                   for knob_name in _KNOBS_SENT_TO_WORKER_PROCESSES}
+    mp_context = (multiprocessing.get_context(ConfigurationKnobs.optimization_processes_start_method)
+                  if ConfigurationKnobs.optimization_processes_start_method is not None
+                  else None)
+    with concurrent.futures.ProcessPoolExecutor(max_workers=ConfigurationKnobs.num_optimization_processes,
+                                                mp_context=mp_context,
+                                                initializer=_initialize_worker_process,
+                                                initargs=(context_object_file_content, knob_values)) as executor:
+        for connected_components in _compute_connected_components_by_level(template_dependency_graph):
+            jobs = []
+            for connected_component in connected_components:
+                inlineable_refs_by_template_name = {template_name: _compute_inlineable_refs(template_name, template_dependency_graph)
+                                                    for template_name in connected_component}
+                base_identifier = next(identifier_generator)
+                if len(connected_components) == 1:
+                    # No parallelism to be gained here, so we avoid the cost of sending the templates to another process.
+                    _optimize_connected_component_using_cache(optimization_cache,
+                                                              connected_component,
+                                                              inlineable_refs_by_template_name,
+                                                              new_template_defns,
+                                                              _connected_component_identifier_generator(base_identifier),
+                                                              context_object_file_content,
+                                                              num_referrers_by_template_name)
+                    continue
+                key = None
+                if optimization_cache is not None:
+                    key = _compute_cache_key(optimization_cache, connected_component, inlineable_refs_by_template_name, new_template_defns,
+                                             num_referrers_by_template_name)
+                    cached_result = optimization_cache.lookup(key)
+                    if cached_result:
+                        new_template_defns.update(apply_cached_optimization_result(cached_result,
+                                                                                   _connected_component_identifier_generator(base_identifier)))
+                        continue
+                template_defn_by_name = {template_name: new_template_defns[template_name]
+                                         for template_name in itertools.chain(connected_component,
+                                                                              *inlineable_refs_by_template_name.values())}
+                jobs.append((key,
+                             executor.submit(_optimize_connected_component_in_worker_process,
+                                             connected_component,
+                                             inlineable_refs_by_template_name,
+                                             template_defn_by_name,
+                                             {template_name: num_referrers_by_template_name[template_name]
+                                              for template_name in template_defn_by_name},
+                                             base_identifier,
+                                             ConfigurationKnobs.optimization_profile is not None)))
+
+            # The results are merged in the same order in which the jobs were created, not in completion order.
+            for key, job in jobs:
+                result, counter_values, optimization_profile = job.result()
+                new_template_defns.update({template_defn.name: template_defn
+                                           for template_defn in result.optimized_template_defns})
+                for counter_name, value in counter_values.items():
+                    setattr(ConfigurationKnobs, counter_name, getattr(ConfigurationKnobs, counter_name) + value)
+                if optimization_profile is not None:
+                    ConfigurationKnobs.optimization_profile.merge(optimization_profile)
+                if key is not None and not counter_values['reached_max_num_remaining_loops_counter']:
+                    optimization_cache.store(key, result)
+
+def _optimize_header_second_pass(header: ir.Header,
+                                 identifier_generator: Iterator[str],
+                                 context_object_file_content: ObjectFileContent):
+    new_template_defns = {elem.name: elem
+                          for elem in header.template_defns}
+
+    template_dependency_graph = compute_template_dependency_graph(header.template_defns, new_template_defns)
+
+    # Used as the fan-out in the inlining cost model. The toplevel content counts as one more referrer.
+    toplevel_referenced_identifiers = {identifier
+                                       for elem in header.toplevel_content
+                                       for identifier in elem.referenced_identifiers}
+    num_referrers_by_template_name = {template_name: template_dependency_graph.in_degree(template_name)
+                                                     + (1 if template_name in toplevel_referenced_identifiers else 0)
+                                      for template_name in template_dependency_graph.nodes}
+
+    optimization_cache = (OptimizationCache(ConfigurationKnobs.optimization_cache_dir, context_object_file_content)
+                          if _should_use_optimization_cache()
+                          else None)
+
+    if _should_optimize_connected_components_in_parallel():
+        _optimize_connected_components_in_parallel(optimization_cache,
+                                                   template_dependency_graph,
+                                                   new_template_defns,
+                                                   identifier_generator,
+                                                   context_object_file_content,
+                                                   num_referrers_by_template_name)
+    else:
+        for connected_component in reversed(list(
+                compute_condensation_in_topological_order(template_dependency_graph))):
+            _optimize_connected_component_using_cache(optimization_cache,
+                                                      connected_component,
+                                                      {template_name: _compute_inlineable_refs(template_name, template_dependency_graph)
+                                                       for template_name in connected_component},
+                                                      new_template_defns,
+                                                      identifier_generator,
+                                                      context_object_file_content,
+                                                      num_referrers_by_template_name)
+
+    evaluator = ClosedInstantiationEvaluator(with_global_inlineable_templates(context_object_file_content,
+                                                                              list(new_template_defns.values())))
     optimizations = [
+        lambda toplevel_content: evaluate_closed_instantiations_in_toplevel_elems(toplevel_content,
+                                                                                 evaluator,
+                                                                                 identifier_generator),
         lambda toplevel_content: perform_template_inlining_on_toplevel_elems(toplevel_content,
                                                                              new_template_defns.keys(),
                                                                              new_template_defns,
                                                                              identifier_generator,
-                                                                             context_object_file_content),
+                                                                             context_object_file_content,
+                                                                             num_referrers_by_template_name),
         lambda toplevel_content: perform_local_optimizations_on_toplevel_elems(toplevel_content,
                                                                                identifier_generator,
                                                                                inline_template_instantiations_with_multiple_references=False),
@@ -165,16 +490,51 @@ def _optimize_header_third_pass(header: ir.Header, linking_final_header: bool):
 def optimize_header(header: ir.Header,
                     context_object_file_content: ObjectFileContent,
                     identifier_generator: Iterator[str],
-                    linking_final_header: bool):
+                    linking_final_header: bool,
+                    coverage_collection_enabled: bool):
+    preserve_coverage_markers = ConfigurationKnobs.preserve_coverage_markers
+    ConfigurationKnobs.preserve_coverage_markers = coverage_collection_enabled
+    try:
+        return _optimize_header_with_checkpoints(header, context_object_file_content, identifier_generator, linking_final_header)
+    finally:
+        ConfigurationKnobs.preserve_coverage_markers = preserve_coverage_markers
+
+def _optimize_header_with_checkpoints(header: ir.Header,
+                                      context_object_file_content: ObjectFileContent,
+                                      identifier_generator: Iterator[str],
+                                      linking_final_header: bool):
+    checkpoints = ConfigurationKnobs.optimization_checkpoints
+    if checkpoints is None:
+        return _optimize_header(header, context_object_file_content, identifier_generator, linking_final_header)
+    if _should_optimize_connected_components_in_parallel() or _should_use_optimization_cache():
+        # Some steps wouldn't be performed in this process (or at all), so they can't be recorded. The compilations
+        # that use these checkpoints later will just perform the steps of this header again.
+        ConfigurationKnobs.optimization_checkpoints = None
+        try:
+            return _optimize_header(header, context_object_file_content, identifier_generator, linking_final_header)
+        finally:
+            ConfigurationKnobs.optimization_checkpoints = checkpoints
+    with checkpoints.recording_identifiers(identifier_generator) as recording_identifier_generator:
+        return _optimize_header(header, context_object_file_content, recording_identifier_generator, linking_final_header)
+
+def _optimize_header(header: ir.Header,
+                     context_object_file_content: ObjectFileContent,
+                     identifier_generator: Iterator[str],
+                     linking_final_header: bool):
     if linking_final_header:
         # This is just a performance optimization. Notably this removes any unused builtins, to avoid wasting time
         # optimizing those.
         header = _optimize_header_third_pass(header, linking_final_header)
 
+    # Structurally-equal exprs (e.g. from different modules) then share a single instance. Transformations preserve
+    # unchanged subtrees, so this sharing mostly carries over through the optimizations below.
+    header = intern_exprs_in_header(header)
+
     header = recalculate_template_instantiation_can_trigger_static_asserts_info(header)
     header = _optimize_header_first_pass(header, identifier_generator, context_object_file_content)
     header = _optimize_header_second_pass(header, identifier_generator, context_object_file_content)
     header = _optimize_header_third_pass(header, linking_final_header)
+    header = intern_exprs_in_header(header)
 
     if linking_final_header:
         [header], _ = apply_elem_optimization((header,),
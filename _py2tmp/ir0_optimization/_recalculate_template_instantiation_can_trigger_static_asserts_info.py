@@ -12,13 +12,18 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from collections import defaultdict
 from typing import Dict
 
-import networkx as nx
-
 from _py2tmp.ir0 import GLOBAL_LITERALS_BY_NAME, Transformation, Visitor, compute_template_dependency_graph, ir
+from _py2tmp.ir0_optimization._configuration_knobs import ConfigurationKnobs
+
 
+# When the coverage markers are preserved, instantiating a template that contains one has a side effect (the marker is
+# reported by the C++ compiler), so the optimizations must treat them like static asserts that never fail: e.g. they
+# can be moved into the templates that instantiate that template (when inlining), but not removed or moved elsewhere.
+def is_static_assert_or_preserved_coverage_marker(elem: ir.TemplateBodyElement):
+    return isinstance(elem, ir.StaticAssert) or (isinstance(elem, ir.NoOpStmt)
+                                                 and ConfigurationKnobs.preserve_coverage_markers)
 
 def _is_global_literal_that_cannot_trigger_static_asserts(literal: ir.AtomicTypeLiteral):
     return literal.cpp_type in GLOBAL_LITERALS_BY_NAME and literal.cpp_type != 'CheckIfError'
@@ -30,6 +35,9 @@ class _CanTriggerStaticAsserts(Visitor):
     def visit_static_assert(self, static_assert: ir.StaticAssert):
         self.can_trigger_static_asserts = True
 
+    def visit_no_op_stmt(self, stmt: ir.NoOpStmt):
+        self.can_trigger_static_asserts |= is_static_assert_or_preserved_coverage_marker(stmt)
+
     def visit_template_instantiation(self, template_instantiation: ir.TemplateInstantiation):
         if (isinstance(template_instantiation.template_expr, ir.AtomicTypeLiteral)
                 and _is_global_literal_that_cannot_trigger_static_asserts(template_instantiation.template_expr)):
@@ -81,6 +89,9 @@ class _TemplateDefnContainsStaticAssertStmt(Visitor):
     def visit_static_assert(self, static_assert: ir.StaticAssert):
         self.found_static_assert_stmt = True
 
+    def visit_no_op_stmt(self, stmt: ir.NoOpStmt):
+        self.found_static_assert_stmt |= is_static_assert_or_preserved_coverage_marker(stmt)
+
 def _template_defn_contains_static_assert_stmt(template_defn: ir.TemplateDefn):
     visitor = _TemplateDefnContainsStaticAssertStmt()
     visitor.visit_template_defn(template_defn)
@@ -94,32 +105,20 @@ def recalculate_template_instantiation_can_trigger_static_asserts_info(header: i
                              for template_defn in header.template_defns}
     template_defn_dependency_graph = compute_template_dependency_graph(header.template_defns, template_defn_by_name)
 
-    condensed_graph = nx.condensation(template_defn_dependency_graph)
-    assert isinstance(condensed_graph, nx.DiGraph)
-
-    template_defn_dependency_graph_transitive_closure = nx.transitive_closure(template_defn_dependency_graph)
-    assert isinstance(template_defn_dependency_graph_transitive_closure, nx.DiGraph)
-
-    # Determine which connected components can trigger static assert errors.
-    condensed_node_can_trigger_static_asserts = defaultdict(lambda: False)
-    for connected_component_index in reversed(list(nx.lexicographical_topological_sort(condensed_graph))):
-        condensed_node = condensed_graph.nodes[connected_component_index]
-
+    # Determine which connected components can trigger static assert errors. The components that a component depends on
+    # come before it, so they've already been processed.
+    template_defn_can_trigger_static_asserts: Dict[str, bool] = dict()
+    for connected_component in template_defn_dependency_graph.strongly_connected_components():
         # If a template defn in this connected component can trigger a static assert, the whole component can.
-        for template_defn_name in condensed_node['members']:
-            if _template_defn_contains_static_assert_stmt(template_defn_by_name[template_defn_name]):
-                condensed_node_can_trigger_static_asserts[connected_component_index] = True
-
         # If a template defn in this connected component references a template defn in a connected component that can
         # trigger static asserts, this connected component can also trigger them.
-        for called_condensed_node_index in condensed_graph.successors(connected_component_index):
-            if condensed_node_can_trigger_static_asserts[called_condensed_node_index]:
-                condensed_node_can_trigger_static_asserts[connected_component_index] = True
-
-    template_defn_can_trigger_static_asserts = dict()
-    for connected_component_index in condensed_graph:
-        for template_defn_name in condensed_graph.nodes[connected_component_index]['members']:
-            template_defn_can_trigger_static_asserts[template_defn_name] = condensed_node_can_trigger_static_asserts[connected_component_index]
+        can_trigger_static_asserts = (any(_template_defn_contains_static_assert_stmt(template_defn_by_name[template_defn_name])
+                                          for template_defn_name in connected_component)
+                                      or any(template_defn_can_trigger_static_asserts.get(called_template_defn_name, False)
+                                             for template_defn_name in connected_component
+                                             for called_template_defn_name in template_defn_dependency_graph.successors(template_defn_name)))
+        for template_defn_name in connected_component:
+            template_defn_can_trigger_static_asserts[template_defn_name] = can_trigger_static_asserts
 
     return _apply_template_instantiation_can_trigger_static_asserts_info(header, template_defn_can_trigger_static_asserts)
 
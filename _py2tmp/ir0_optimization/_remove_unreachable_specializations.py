@@ -0,0 +1,192 @@
+#  Copyright 2017 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS-IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import collections
+from typing import Dict, List, Set, Tuple, Optional, Mapping, AbstractSet, Deque
+
+from _py2tmp.ir0 import ir, Visitor
+from _py2tmp.ir0_optimization._remove_unused_toplevel_elems import remove_unused_toplevel_elems
+from _py2tmp.ir0_optimization._replace_var_with_expr import replace_var_with_expr_in_expr, \
+    VariadicVarReplacementNotPossibleException
+from _py2tmp.ir0_optimization._specialization_index import SpecializationIndex
+
+# Removes the specializations that can't be selected by any of the instantiations in the (final) header, e.g. the
+# specializations generated for a match() or the CheckIfError specializations for error types that are never thrown
+# in the templates that are still there.
+# The instantiations are the only way to select a specialization, so this is only possible when linking the final header:
+# at that point all the instantiations of the non-public templates are known. The public templates (except CheckIfError,
+# that's only instantiated by the generated code) and the templates that are referenced in other ways (e.g. passed as a
+# template template param) are kept as they are, since they could be instantiated with any args.
+# The args of an instantiation in the main definition of a (non-public) template can refer to its template params, so
+# these are replaced with the args of each instantiation of that template, e.g. if F<T> instantiates G<T> and F is only
+# instantiated as F<int*>, G is only instantiated as G<int*>. Any other template param can be anything, as in
+# SpecializationIndex.
+def remove_unreachable_specializations(header: ir.Header) -> ir.Header:
+    while True:
+        new_header = _remove_unreachable_specializations_once(header)
+        if new_header is header:
+            return header
+        # The specializations that were removed might have been the only users of some templates (or of some of their
+        # specializations).
+        header = remove_unused_toplevel_elems(new_header, linking_final_header=True)
+
+# Above this number of possible arg tuples, we assume that a template can be instantiated with any args. This also
+# guarantees termination for recursive templates, e.g. if F<T> instantiates F<T*>.
+_MAX_NUM_POSSIBLE_ARGS_PER_TEMPLATE = 32
+
+def _remove_unreachable_specializations_once(header: ir.Header) -> ir.Header:
+    template_defn_by_name = {template_defn.name: template_defn
+                             for template_defn in header.template_defns}
+    visitor = _CollectInstantiationsVisitor(template_defn_by_name.keys())
+    visitor.visit_header(header)
+
+    tracked_template_names = {template_defn.name
+                              for template_defn in header.template_defns
+                              if (template_defn.name not in header.public_names or template_defn.name == 'CheckIfError')
+                              and template_defn.name not in visitor.escaped_template_names}
+    possible_args_by_template_name = _compute_possible_args_by_template_name(visitor, template_defn_by_name, tracked_template_names)
+
+    changed = False
+    template_defns: List[ir.TemplateDefn] = []
+    for template_defn in header.template_defns:
+        possible_args = possible_args_by_template_name.get(template_defn.name)
+        if not template_defn.specializations or possible_args is None:
+            template_defns.append(template_defn)
+            continue
+
+        specialization_index = SpecializationIndex(template_defn)
+        reachable_specialization_indexes = set()
+        for args in possible_args:
+            reachable_specialization_indexes.update(specialization_index.compute_candidate_specialization_indexes(args,
+                                                                                                                  local_var_definitions=dict()))
+            if len(reachable_specialization_indexes) == len(template_defn.specializations):
+                break
+
+        if len(reachable_specialization_indexes) == len(template_defn.specializations) or (
+                not reachable_specialization_indexes and not template_defn.main_definition):
+            # If no specialization is reachable and there's no main definition, the C++ compiler would report an error
+            # for any (full) instantiation; we leave the template as it is, so that it reports the same error.
+            template_defns.append(template_defn)
+            continue
+
+        changed = True
+        template_defns.append(ir.TemplateDefn(args=template_defn.args,
+                                              main_definition=template_defn.main_definition,
+                                              specializations=tuple(specialization
+                                                                    for specialization_index, specialization in enumerate(template_defn.specializations)
+                                                                    if specialization_index in reachable_specialization_indexes),
+                                              name=template_defn.name,
+                                              description=template_defn.description,
+                                              result_element_names=template_defn.result_element_names))
+
+    if not changed:
+        return header
+
+    return ir.Header(template_defns=tuple(template_defns),
+                     toplevel_content=header.toplevel_content,
+                     public_names=header.public_names,
+                     split_template_name_by_old_name_and_result_element_name=header.split_template_name_by_old_name_and_result_element_name,
+                     check_if_error_specializations=header.check_if_error_specializations)
+
+def _compute_possible_args_by_template_name(visitor: '_CollectInstantiationsVisitor',
+                                            template_defn_by_name: Mapping[str, ir.TemplateDefn],
+                                            tracked_template_names: AbstractSet[str]) \
+        -> Dict[str, Optional[Set[Tuple[ir.Expr, ...]]]]:
+    # Returns the possible args of each tracked template (None means that these are unknown).
+    possible_args_by_template_name: Dict[str, Optional[Set[Tuple[ir.Expr, ...]]]] = {name: set()
+                                                                                      for name in tracked_template_names}
+    templates_to_process: Deque[str] = collections.deque()
+
+    def add_possible_args(template_name: str, args: Optional[Tuple[ir.Expr, ...]]):
+        possible_args = possible_args_by_template_name.get(template_name, None)
+        if possible_args is None or args in possible_args:
+            return
+        if args is not None and any(isinstance(arg, ir.VariadicTypeExpansion) for arg in args):
+            # We don't know how many args there are, nor which arg is matched with each param.
+            args = None
+        if args is None or len(possible_args) == _MAX_NUM_POSSIBLE_ARGS_PER_TEMPLATE:
+            possible_args_by_template_name[template_name] = None
+        else:
+            possible_args.add(args)
+        if template_name in visitor.instantiations_by_enclosing_template_name:
+            templates_to_process.append(template_name)
+
+    for instantiation in visitor.instantiations_by_enclosing_template_name.get(None, []):
+        add_possible_args(instantiation.template_expr.cpp_type, instantiation.args)
+    for template_name in visitor.instantiations_by_enclosing_template_name:
+        if template_name is not None and template_name not in tracked_template_names:
+            templates_to_process.append(template_name)
+
+    while templates_to_process:
+        template_name = templates_to_process.popleft()
+        instantiations = visitor.instantiations_by_enclosing_template_name[template_name]
+        main_definition_args = template_defn_by_name[template_name].main_definition.args
+        possible_args = possible_args_by_template_name.get(template_name, None)
+        if possible_args is None or any(arg.is_variadic for arg in main_definition_args):
+            for instantiation in instantiations:
+                add_possible_args(instantiation.template_expr.cpp_type, instantiation.args)
+            continue
+        for args in list(possible_args):
+            if len(args) != len(main_definition_args):
+                continue
+            replacement_expr_by_var = {arg_decl.name: arg
+                                       for arg_decl, arg in zip(main_definition_args, args)}
+            for instantiation in instantiations:
+                try:
+                    replaced_instantiation = replace_var_with_expr_in_expr(instantiation, replacement_expr_by_var, dict())
+                except VariadicVarReplacementNotPossibleException:
+                    add_possible_args(instantiation.template_expr.cpp_type, None)
+                    continue
+                assert isinstance(replaced_instantiation, ir.TemplateInstantiation)
+                add_possible_args(instantiation.template_expr.cpp_type, replaced_instantiation.args)
+
+    return possible_args_by_template_name
+
+class _CollectInstantiationsVisitor(Visitor):
+    def __init__(self, template_names: AbstractSet[str]):
+        self.template_names = template_names
+        # The instantiations of the toplevel templates, by the name of the template whose main definition contains them.
+        # The ones anywhere else (e.g. in a specialization or at toplevel) are under None.
+        self.instantiations_by_enclosing_template_name: Dict[Optional[str], List[ir.TemplateInstantiation]] = dict()
+        # The templates that are referenced in a way other than instantiating them directly.
+        self.escaped_template_names: Set[str] = set()
+        self.enclosing_template_name: Optional[str] = None
+        self.is_in_template_defn = False
+
+    def visit_template_defn(self, template_defn: ir.TemplateDefn):
+        if self.is_in_template_defn:
+            super().visit_template_defn(template_defn)
+            return
+        self.is_in_template_defn = True
+        if template_defn.main_definition is not None:
+            self.enclosing_template_name = template_defn.name
+            self.visit_template_specialization(template_defn.main_definition)
+            self.enclosing_template_name = None
+        for specialization in template_defn.specializations:
+            self.visit_template_specialization(specialization)
+        self.is_in_template_defn = False
+
+    def visit_template_instantiation(self, template_instantiation: ir.TemplateInstantiation):
+        template_expr = template_instantiation.template_expr
+        if (isinstance(template_expr, ir.AtomicTypeLiteral)
+                and not template_expr.is_local
+                and template_expr.cpp_type in self.template_names):
+            self.instantiations_by_enclosing_template_name.setdefault(self.enclosing_template_name, []).append(template_instantiation)
+            self.visit_exprs(template_instantiation.args)
+        else:
+            super().visit_template_instantiation(template_instantiation)
+
+    def visit_type_literal(self, type_literal: ir.AtomicTypeLiteral):
+        if not type_literal.is_local and type_literal.cpp_type in self.template_names:
+            self.escaped_template_names.add(type_literal.cpp_type)
@@ -14,9 +14,8 @@
 
 import itertools
 
-import networkx as nx
-
 from _py2tmp.ir0 import ir
+from _py2tmp.utils import DependencyGraph
 
 
 def remove_unused_toplevel_elems(header: ir.Header, linking_final_header: bool):
@@ -29,7 +28,7 @@ def remove_unused_toplevel_elems(header: ir.Header, linking_final_header: bool):
         public_names = public_names.union(split_name
                                           for _, split_name in header.split_template_name_by_old_name_and_result_element_name)
 
-    elem_dependency_graph = nx.DiGraph()
+    elem_dependency_graph = DependencyGraph()
     for elem in itertools.chain(header.template_defns, header.toplevel_content):
         if isinstance(elem, (ir.TemplateDefn, ir.ConstantDef, ir.Typedef)):
             elem_name = elem.name
@@ -39,8 +38,8 @@ def remove_unused_toplevel_elems(header: ir.Header, linking_final_header: bool):
 
         elem_dependency_graph.add_node(elem_name)
 
-        if elem_name in public_names or (isinstance(elem, (ir.ConstantDef, ir.Typedef)) and any(isinstance(expr, ir.TemplateInstantiation) and expr.instantiation_might_trigger_static_asserts
-                                                                                                for expr in elem.transitive_subexpressions)):
+        if elem_name in public_names or (isinstance(elem, (ir.ConstantDef, ir.Typedef)) and any(expr.has_instantiation_that_might_trigger_static_asserts
+                                                                                                for expr in elem.direct_subexpressions)):
             # We also add an edge from the node '' to all toplevel defns that must remain, so that we can use '' as a source below.
             elem_dependency_graph.add_edge('', elem_name)
 
@@ -49,7 +48,7 @@ def remove_unused_toplevel_elems(header: ir.Header, linking_final_header: bool):
                 elem_dependency_graph.add_edge(elem_name, identifier)
 
     elem_dependency_graph.add_node('')
-    used_elem_names = nx.single_source_shortest_path(elem_dependency_graph, source='').keys()
+    used_elem_names = {'', *elem_dependency_graph.descendants('')}
 
     return ir.Header(template_defns=tuple(template_defn for template_defn in header.template_defns if
                                           template_defn.name in used_elem_names),
@@ -0,0 +1,146 @@
+#  Copyright 2017 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS-IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+from functools import lru_cache
+from typing import Dict, Tuple, Optional, Hashable, Set, List, Mapping, AbstractSet
+
+from _py2tmp.ir0 import ir
+
+# The exprs for which the unification strategy in _unify.py always requires syntactical equality (see
+# _ExprUnificationStrategy.equality_requires_syntactical_equality()), except AtomicTypeLiteral that's handled separately.
+_SYNTACTICALLY_COMPARABLE_EXPR_CLASSES = (
+    ir.Literal,
+    ir.PointerTypeExpr,
+    ir.ConstTypeExpr,
+    ir.ArrayTypeExpr,
+    ir.FunctionTypeExpr,
+    ir.TemplateInstantiation,
+)
+
+def _is_rigid(expr: ir.Expr, var_names: AbstractSet[str]):
+    # Returns True if the unification of this expr can never be ambiguous, i.e. if it has no variadic expansions and all
+    # its subexpressions are either (unification) vars or require syntactical equality.
+    for subexpr in expr.transitive_subexpressions:
+        if isinstance(subexpr, ir.AtomicTypeLiteral):
+            if subexpr.is_local:
+                if subexpr.cpp_type not in var_names:
+                    return False
+            elif subexpr.may_be_alias:
+                return False
+        elif not isinstance(subexpr, _SYNTACTICALLY_COMPARABLE_EXPR_CLASSES):
+            return False
+    return True
+
+def _compute_head(expr: ir.Expr, var_names: AbstractSet[str]) -> Optional[Hashable]:
+    # Returns a key such that the unification of 2 rigid exprs with different (non-None) keys always fails.
+    # None means that the key is unknown (e.g. because the expr is a var).
+    if isinstance(expr, ir.AtomicTypeLiteral):
+        if expr.is_local:
+            assert expr.cpp_type in var_names
+            return None
+        return ir.AtomicTypeLiteral, expr.cpp_type
+    elif isinstance(expr, ir.Literal):
+        return ir.Literal, expr.value
+    elif isinstance(expr, ir.TemplateInstantiation):
+        template_head = _compute_head(expr.template_expr, var_names)
+        if template_head is None:
+            return None
+        return ir.TemplateInstantiation, template_head, len(expr.args)
+    elif isinstance(expr, ir.FunctionTypeExpr):
+        return ir.FunctionTypeExpr, len(expr.arg_exprs)
+    else:
+        return expr.__class__
+
+class SpecializationIndex:
+    # An index over the specializations of a template, used to skip (without doing a unification) the specializations
+    # that definitely can't match a given instantiation.
+    # Specializations with patterns that might have an ambiguous unification (e.g. with variadic expansions) are always
+    # candidates. For the others, this indexes the number of args and the head (i.e. the outermost expr, and for
+    # template instantiations the template and the number of args) of each pattern.
+    def __init__(self, template_defn: ir.TemplateDefn):
+        self.num_specializations = len(template_defn.specializations)
+        self.non_rigid_specialization_indexes: Set[int] = set()
+        self.rigid_specialization_indexes_by_num_args: Dict[int, Set[int]] = dict()
+        # (num_args, arg_index, head) -> specialization indexes. The head is None for the patterns that can match any
+        # arg.
+        self.specialization_indexes_by_arg_head: Dict[Tuple[int, int, Optional[Hashable]], Set[int]] = dict()
+        # (specialization1 index, specialization2 index) -> whether specialization1 is at least as strict as
+        # specialization2 (see find_matches_in_unification_of_template_instantiation_with_definition()). This is only
+        # filled when needed.
+        self.is_at_least_as_strict_by_specialization_indexes: Dict[Tuple[int, int], bool] = dict()
+
+        for specialization_index, specialization in enumerate(template_defn.specializations):
+            pattern_var_names = {arg.name for arg in specialization.args}
+            if not all(_is_rigid(pattern, pattern_var_names) for pattern in specialization.patterns):
+                self.non_rigid_specialization_indexes.add(specialization_index)
+                continue
+            num_args = len(specialization.patterns)
+            self.rigid_specialization_indexes_by_num_args.setdefault(num_args, set()).add(specialization_index)
+            for arg_index, pattern in enumerate(specialization.patterns):
+                head = _compute_head(pattern, pattern_var_names)
+                self.specialization_indexes_by_arg_head.setdefault((num_args, arg_index, head), set()).add(specialization_index)
+
+    def compute_candidate_specialization_indexes(self,
+                                                 args: Tuple[ir.Expr, ...],
+                                                 local_var_definitions: Mapping[str, ir.Expr]) -> List[int]:
+        # Returns (in order) the indexes of the specializations that might match the instantiation with these args.
+        # The unification of the args with any other specialization would definitely fail.
+        heads = _compute_arg_heads(args, local_var_definitions)
+        if heads is None:
+            return list(range(self.num_specializations))
+
+        candidates = self.rigid_specialization_indexes_by_num_args.get(len(heads), set())
+        for arg_index, head in enumerate(heads):
+            if not candidates:
+                break
+            if head is not None:
+                candidates = candidates & (self.specialization_indexes_by_arg_head.get((len(heads), arg_index, head), set())
+                                           | self.specialization_indexes_by_arg_head.get((len(heads), arg_index, None), set()))
+        return sorted(candidates | self.non_rigid_specialization_indexes)
+
+def _compute_arg_heads(args: Tuple[ir.Expr, ...],
+                       local_var_definitions: Mapping[str, ir.Expr]) -> Optional[Tuple[Optional[Hashable], ...]]:
+    # Returns None if the unification of these args might be ambiguous (in that case the index can't be used).
+    # All the free vars of the args (and of the local var definitions) are unification vars, see
+    # find_matches_in_unification_of_template_instantiation_with_definition().
+    var_names = set(local_var_definitions.keys())
+    for expr in local_var_definitions.values():
+        var_names.update(var.cpp_type for var in expr.free_vars)
+    for arg in args:
+        var_names.update(var.cpp_type for var in arg.free_vars)
+
+    # Only the definitions of the local vars referenced (transitively) by the args are used in the unification.
+    exprs_to_check = list(args)
+    checked_local_var_names = set()
+    while exprs_to_check:
+        expr = exprs_to_check.pop()
+        if not _is_rigid(expr, var_names):
+            return None
+        for var in expr.free_vars:
+            if var.cpp_type in local_var_definitions and var.cpp_type not in checked_local_var_names:
+                checked_local_var_names.add(var.cpp_type)
+                exprs_to_check.append(local_var_definitions[var.cpp_type])
+
+    heads = []
+    for arg in args:
+        visited_local_var_names = set()
+        while isinstance(arg, ir.AtomicTypeLiteral) and arg.cpp_type in local_var_definitions and arg.cpp_type not in visited_local_var_names:
+            visited_local_var_names.add(arg.cpp_type)
+            arg = local_var_definitions[arg.cpp_type]
+        heads.append(_compute_head(arg, var_names))
+    return tuple(heads)
+
+@lru_cache(maxsize=4096)
+def get_specialization_index(template_defn: ir.TemplateDefn) -> SpecializationIndex:
+    # TemplateDefns are immutable, so the index is computed once for each version of a template.
+    return SpecializationIndex(template_defn)
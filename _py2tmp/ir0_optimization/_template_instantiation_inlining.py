@@ -12,7 +12,8 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 import itertools
-from typing import Dict, Iterator, Set, List, Union, AbstractSet, Tuple
+from collections import ChainMap
+from typing import Dict, Iterator, Set, List, Union, AbstractSet, Tuple, Mapping
 
 from _py2tmp.compiler.stages import expr_to_cpp_simple, template_defn_to_cpp_simple
 from _py2tmp.compiler.output_files import ObjectFileContent
@@ -22,6 +23,7 @@ from _py2tmp.ir0_optimization._configuration_knobs import ConfigurationKnobs
 from _py2tmp.ir0 import NameReplacementTransformation, ToplevelWriter, Transformation, \
     TemplateBodyWriter
 from _py2tmp.ir0_optimization._compute_non_expanded_variadic_vars import compute_non_expanded_variadic_vars
+from _py2tmp.ir0_optimization._inlining_cost_model import compute_inlining_cost, is_inlining_worth_it
 from _py2tmp.ir0_optimization._local_optimizations import perform_local_optimizations_on_template_defn, \
     perform_local_optimizations_on_toplevel_elems
 from _py2tmp.ir0_optimization._optimization_execution import apply_elem_optimization, describe_template_defns, \
@@ -148,23 +150,52 @@ TEMPLATE_DEFNS_DEFINED_AS_IR0 = [
      for type2, name2 in _select1st_type_and_name
 ]
 
-def _with_global_inlineable_templates(context_object_file_content: ObjectFileContent,
-                                      local_inlineable_templates: List[ir.TemplateDefn]):
-    result = {template_defn.name: template_defn
-              for module_info in context_object_file_content.modules_by_name.values()
-              for template_defn in module_info.ir0_header.template_defns}
-    for template_defn in itertools.chain(local_inlineable_templates, TEMPLATE_DEFNS_DEFINED_AS_IR0):
-        result[template_defn.name] = template_defn
-    return result
+def with_global_inlineable_templates(context_object_file_content: ObjectFileContent,
+                                     local_inlineable_templates: List[ir.TemplateDefn]):
+    # The context templates are looked up lazily, so that we only decode the IR0 headers of the modules that define
+    # templates that we actually inline.
+    return ChainMap({template_defn.name: template_defn
+                     for template_defn in itertools.chain(local_inlineable_templates, TEMPLATE_DEFNS_DEFINED_AS_IR0)},
+                    context_object_file_content.template_defn_by_name)
+
+# Converts the pattern variable values in the result of unify_template_instantiation_with_definition() to the format
+# expected by replace_var_with_expr_in_expr() (and similar functions).
+def compute_pattern_variable_values(value_by_pattern_variable,
+                                    value_by_expanded_pattern_variable) -> Tuple[Dict[str, ir.Expr], Dict[str, Tuple[ir.Expr, ...]]]:
+    new_value_by_pattern_variable: Dict[str, ir.Expr] = dict()
+    for var, exprs in value_by_pattern_variable:
+        assert isinstance(var, ir.AtomicTypeLiteral)
+        if isinstance(exprs, tuple):
+            [exprs] = exprs
+        assert not isinstance(exprs, tuple)
+        assert not isinstance(exprs, ir.VariadicTypeExpansion)
+        new_value_by_pattern_variable[var.cpp_type] = exprs
+
+    new_value_by_expanded_pattern_variable: Dict[str, Tuple[ir.Expr, ...]] = dict()
+    for var, exprs in value_by_expanded_pattern_variable:
+        if isinstance(var, ir.AtomicTypeLiteral):
+            if not isinstance(exprs, tuple):
+                exprs = (exprs,)
+            for expr in exprs:
+                assert not isinstance(expr, tuple)
+            new_value_by_expanded_pattern_variable[var.cpp_type] = exprs
+        else:
+            assert isinstance(var, ir.VariadicTypeExpansion) and isinstance(var.inner_expr, ir.AtomicTypeLiteral)
+            assert isinstance(exprs, tuple)
+
+            new_value_by_expanded_pattern_variable[var.inner_expr.cpp_type] = exprs
+    return new_value_by_pattern_variable, new_value_by_expanded_pattern_variable
 
 class _TemplateInstantiationInliningTransformation(Transformation):
     def __init__(self,
                  local_inlineable_templates: List[ir.TemplateDefn],
                  context_object_file_content: ObjectFileContent,
-                 identifier_generator: Iterator[str]):
+                 identifier_generator: Iterator[str],
+                 num_referrers_by_template_name: Mapping[str, int]):
         super().__init__(identifier_generator=identifier_generator)
         self.needs_another_loop = False
-        self.inlineable_templates_by_name = _with_global_inlineable_templates(context_object_file_content, local_inlineable_templates)
+        self.inlineable_templates_by_name = with_global_inlineable_templates(context_object_file_content, local_inlineable_templates)
+        self.num_referrers_by_template_name = num_referrers_by_template_name
         self.parent_template_specialization_definitions = dict()
         self.root_template_defn_name = None
 
@@ -230,30 +261,18 @@ class _TemplateInstantiationInliningTransformation(Transformation):
         specialization, value_by_pattern_variable, value_by_expanded_pattern_variable = unification
         assert len(value_by_pattern_variable) + len(value_by_expanded_pattern_variable) == len(specialization.args)
 
-        new_value_by_pattern_variable: Dict[str, ir.Expr] = dict()
-        for var, exprs in value_by_pattern_variable:
-            assert isinstance(var, ir.AtomicTypeLiteral)
-            if isinstance(exprs, tuple):
-                [exprs] = exprs
-            assert not isinstance(exprs, tuple)
-            assert not isinstance(exprs, ir.VariadicTypeExpansion)
-            new_value_by_pattern_variable[var.cpp_type] = exprs
-        value_by_pattern_variable = new_value_by_pattern_variable
-
-        new_value_by_expanded_pattern_variable: Dict[str, Tuple[ir.Expr, ...]] = dict()
-        for var, exprs in value_by_expanded_pattern_variable:
-            if isinstance(var, ir.AtomicTypeLiteral):
-                if not isinstance(exprs, tuple):
-                    exprs = (exprs,)
-                for expr in exprs:
-                    assert not isinstance(expr, tuple)
-                new_value_by_expanded_pattern_variable[var.cpp_type] = exprs
-            else:
-                assert isinstance(var, ir.VariadicTypeExpansion) and isinstance(var.inner_expr, ir.AtomicTypeLiteral)
-                assert isinstance(exprs, tuple)
+        if ConfigurationKnobs.preserve_coverage_markers and any(isinstance(elem, ir.NoOpStmt)
+                                                                for elem in specialization.body):
+            # The C++ compiler reports the coverage markers of an instantiation once, no matter how many times it's
+            # referenced, while each inlined copy of the body would have its own copy of the markers (and of the
+            # instantiations in the body, that can't be removed either). For recursive templates this can make the
+            # code exponentially bigger, so these templates are instantiated as they are.
+            if ConfigurationKnobs.verbose:
+                print('Not inlining %s because it contains coverage markers' % template_defn_to_inline.name)
+            return class_member_access
 
-                new_value_by_expanded_pattern_variable[var.inner_expr.cpp_type] = exprs
-        value_by_expanded_pattern_variable = new_value_by_expanded_pattern_variable
+        value_by_pattern_variable, value_by_expanded_pattern_variable = compute_pattern_variable_values(value_by_pattern_variable,
+                                                                                                        value_by_expanded_pattern_variable)
 
         body = []
         result_expr = None
@@ -311,6 +330,18 @@ class _TemplateInstantiationInliningTransformation(Transformation):
                      or class_member_access.inner_expr.template_expr.cpp_type.startswith('Always'))):
             return class_member_access
 
+        # Templates from other modules might have callers that we don't know about, we only count the ones in this
+        # header.
+        cost = compute_inlining_cost(body,
+                                     result_expr,
+                                     replaced_expr=class_member_access,
+                                     fan_out=self.num_referrers_by_template_name.get(template_defn_to_inline.name, 1))
+        if not is_inlining_worth_it(cost):
+            if ConfigurationKnobs.verbose:
+                print('Not inlining template defn: %s into %s because it\'s not worth it according to the cost model: %s' % (
+                    template_defn_to_inline.name, self.root_template_defn_name or expr_to_cpp_simple(class_member_access), cost))
+            return class_member_access
+
         self.needs_another_loop = True
         if ConfigurationKnobs.verbose:
             print('Inlining template defn: %s into %s' % (template_defn_to_inline.name, self.root_template_defn_name or expr_to_cpp_simple(class_member_access)))
@@ -343,7 +374,8 @@ def perform_template_inlining(template_defn: ir.TemplateDefn,
                               inlineable_refs: Set[str],
                               template_defn_by_name: Dict[str, ir.TemplateDefn],
                               identifier_generator: Iterator[str],
-                              context_object_file_content: ObjectFileContent):
+                              context_object_file_content: ObjectFileContent,
+                              num_referrers_by_template_name: Mapping[str, int]):
     template_defn, needs_another_loop1 = perform_local_optimizations_on_template_defn(template_defn,
                                                                                       identifier_generator,
                                                                                       inline_template_instantiations_with_multiple_references=True)
@@ -354,7 +386,8 @@ def perform_template_inlining(template_defn: ir.TemplateDefn,
         transformation = _TemplateInstantiationInliningTransformation([template_defn_by_name[template_name]
                                                                        for template_name in inlineable_refs],
                                                                       context_object_file_content,
-                                                                      identifier_generator)
+                                                                      identifier_generator,
+                                                                      num_referrers_by_template_name)
         writer = ToplevelWriter(allow_toplevel_elems=False)
         with transformation.set_writer(writer):
             transformation.transform_template_defn(template_defn)
@@ -373,7 +406,8 @@ def perform_template_inlining_on_toplevel_elems(toplevel_elems: List[Union[ir.St
                                                 inlineable_refs: AbstractSet[str],
                                                 template_defn_by_name: Dict[str, ir.TemplateDefn],
                                                 identifier_generator: Iterator[str],
-                                                context_object_file_content: ObjectFileContent):
+                                                context_object_file_content: ObjectFileContent,
+                                                num_referrers_by_template_name: Mapping[str, int]):
     toplevel_elems, needs_another_loop1 = perform_local_optimizations_on_toplevel_elems(toplevel_elems,
                                                                                         identifier_generator,
                                                                                         inline_template_instantiations_with_multiple_references=True)
@@ -384,7 +418,8 @@ def perform_template_inlining_on_toplevel_elems(toplevel_elems: List[Union[ir.St
         transformation = _TemplateInstantiationInliningTransformation([template_defn_by_name[template_name]
                                                                        for template_name in inlineable_refs],
                                                                       context_object_file_content,
-                                                                      identifier_generator)
+                                                                      identifier_generator,
+                                                                      num_referrers_by_template_name)
 
         elems = transformation.transform_template_body_elems(toplevel_elems)
         return elems, transformation.needs_another_loop
@@ -21,7 +21,10 @@ from bidict import bidict
 
 from _py2tmp.compiler.stages import expr_to_cpp_simple
 from _py2tmp.ir0 import NameReplacementTransformation, ir
+from _py2tmp.ir0_optimization._recalculate_template_instantiation_can_trigger_static_asserts_info import \
+    is_static_assert_or_preserved_coverage_marker
 from _py2tmp.ir0_optimization._replace_var_with_expr import replace_var_with_expr_in_expr
+from _py2tmp.ir0_optimization._specialization_index import get_specialization_index
 from _py2tmp.unification import TupleExpansion, UnificationStrategyForCanonicalization, UnificationStrategy, \
     UnificationFailedException, unify, UnificationAmbiguousException, CanonicalizationFailedException, canonicalize
 from _py2tmp.utils import ir_to_string
@@ -166,11 +169,19 @@ class _ExprUnificationStrategy(UnificationStrategyForCanonicalization[ir.Expr]):
 
 ExprOrExprTuple = TypeVar('ExprOrExprTuple', ir.Expr, Tuple[ir.Expr, ...])
 
+class _VarNameReplacementTransformation(NameReplacementTransformation):
+    def transform_expr(self, expr: ir.Expr) -> ir.Expr:
+        # Most subexpressions don't reference any of the renamed vars, so there's no need to rebuild them (and keeping
+        # the same objects also makes the unification of identical subexpressions trivial).
+        if not any(identifier in self.replacements for identifier in expr.referenced_identifiers):
+            return expr
+        return super().transform_expr(expr)
+
 def _replace_var_names_in_expr(expr: ExprOrExprTuple, new_name_by_old_name: Mapping[str, str]) -> ExprOrExprTuple:
     if isinstance(expr, tuple):
         return tuple(_replace_var_names_in_expr(elem, new_name_by_old_name)
                      for elem in expr)
-    return NameReplacementTransformation(new_name_by_old_name).transform_expr(expr)
+    return _VarNameReplacementTransformation(new_name_by_old_name).transform_expr(expr)
 
 class UnificationResultKind(Enum):
     CERTAIN = 1
@@ -200,11 +211,26 @@ def find_matches_in_unification_of_template_instantiation_with_definition(templa
     instantiation_vars = {var.cpp_type
                           for var in template_instantiation.free_vars}
 
+    specialization_index = get_specialization_index(template_defn)
+    candidate_specialization_indexes = set(specialization_index.compute_candidate_specialization_indexes(template_instantiation.args,
+                                                                                                         local_var_definitions))
+    num_identifiers_used_for_instantiation = None
+
     certain_matches: List[Tuple[ir.TemplateSpecialization,
                                 Tuple[Tuple[ir.AtomicTypeLiteral,
                                             Tuple[ir.Expr, ...]], ...], ...]] = []
+    certain_match_specialization_indexes: List[int] = []
     possible_matches: List[ir.TemplateSpecialization] = []
-    for specialization in template_defn.specializations:
+    for specialization_index_in_defn, specialization in enumerate(template_defn.specializations):
+        if specialization_index_in_defn not in candidate_specialization_indexes:
+            # The unification would definitely fail, so we can skip it. We still reserve the identifiers that it would
+            # have used, so that the generated code doesn't change.
+            if num_identifiers_used_for_instantiation is None:
+                num_identifiers_used_for_instantiation = _count_lhs_identifiers_used_by_unify(template_instantiation.args,
+                                                                                              local_var_definitions)
+            _skip_identifiers(identifier_generator,
+                              num_identifiers_used_for_instantiation + _count_rhs_identifiers_used_by_unify(specialization.patterns))
+            continue
         result = _unify(template_instantiation.args,
                         local_var_definitions,
                         specialization.patterns,
@@ -215,6 +241,7 @@ def find_matches_in_unification_of_template_instantiation_with_definition(templa
                         verbose)
         if result.kind == UnificationResultKind.CERTAIN:
             certain_matches.append((specialization, result.value_by_pattern_variable, result.value_by_expanded_pattern_variable))
+            certain_match_specialization_indexes.append(specialization_index_in_defn)
         elif result.kind == UnificationResultKind.POSSIBLE:
             possible_matches.append(specialization)
 
@@ -238,6 +265,7 @@ def find_matches_in_unification_of_template_instantiation_with_definition(templa
             certain_matches.append((template_defn.main_definition,
                                     result.value_by_pattern_variable,
                                     result.value_by_expanded_pattern_variable))
+            certain_match_specialization_indexes.append(specialization_index.num_specializations)
         else:
             possible_matches.append(template_defn.main_definition)
 
@@ -258,14 +286,24 @@ def find_matches_in_unification_of_template_instantiation_with_definition(templa
                 if not specialization2.patterns:
                     might_be_best_match[j] = False
                     continue
-                result = _unify(specialization1.patterns,
-                                dict(),
-                                specialization2.patterns,
-                                specialization1_arg_vars,
-                                specialization2_arg_vars,
-                                identifier_generator,
-                                verbose)
-                if result.kind == UnificationResultKind.CERTAIN:
+                # This only depends on the two specializations, so it's cached in the index.
+                specialization_indexes = (certain_match_specialization_indexes[i], certain_match_specialization_indexes[j])
+                is_at_least_as_strict = specialization_index.is_at_least_as_strict_by_specialization_indexes.get(specialization_indexes)
+                if is_at_least_as_strict is None:
+                    result = _unify(specialization1.patterns,
+                                    dict(),
+                                    specialization2.patterns,
+                                    specialization1_arg_vars,
+                                    specialization2_arg_vars,
+                                    identifier_generator,
+                                    verbose)
+                    is_at_least_as_strict = result.kind == UnificationResultKind.CERTAIN
+                    specialization_index.is_at_least_as_strict_by_specialization_indexes[specialization_indexes] = is_at_least_as_strict
+                else:
+                    _skip_identifiers(identifier_generator,
+                                      _count_lhs_identifiers_used_by_unify(specialization1.patterns, dict())
+                                      + _count_rhs_identifiers_used_by_unify(specialization2.patterns))
+                if is_at_least_as_strict:
                     might_be_best_match[j] = False
 
     indexes = tuple(index
@@ -312,7 +350,7 @@ def unify_template_instantiation_with_definition(template_instantiation: ir.Temp
     if certain_matches or possible_matches:
         result_exprs: List[ir.Expr] = []
         for specialization, _, _ in itertools.chain(certain_matches, possible_matches):
-            if any(isinstance(elem, ir.StaticAssert)
+            if any(is_static_assert_or_preserved_coverage_marker(elem)
                    for elem in specialization.body):
                 break
             [result_elem] = [elem
@@ -361,6 +399,23 @@ def unify_template_instantiation_with_definition(template_instantiation: ir.Temp
                       for specialization, replacements in certain_matches)))
     return None
 
+def _count_lhs_identifiers_used_by_unify(initial_exprs: Tuple[ir.Expr, ...],
+                                         local_var_definitions: Mapping[str, ir.Expr]):
+    # This must be kept in sync with _unify().
+    lhs_type_literal_names = set(local_var_definitions.keys())
+    for expr in itertools.chain(initial_exprs, local_var_definitions.values()):
+        for expr_literal in expr.free_vars:
+            lhs_type_literal_names.add(expr_literal.cpp_type)
+    return len(lhs_type_literal_names)
+
+def _count_rhs_identifiers_used_by_unify(patterns: Tuple[ir.Expr, ...]):
+    # This must be kept in sync with _unify().
+    return sum(len(pattern.free_vars) for pattern in patterns)
+
+def _skip_identifiers(identifier_generator: Iterator[str], num_identifiers: int):
+    for _ in range(num_identifiers):
+        next(identifier_generator)
+
 def _unify(initial_exprs: Tuple[ir.Expr, ...],
            local_var_definitions: Mapping[str, ir.Expr],
            patterns: Tuple[ir.Expr, ...],
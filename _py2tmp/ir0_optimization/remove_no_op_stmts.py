@@ -15,6 +15,7 @@ import dataclasses
 from typing import Optional, Iterator, Tuple
 
 from _py2tmp.ir0 import ir, Transformation
+from _py2tmp.ir0_optimization._configuration_knobs import ConfigurationKnobs
 
 
 class RemoveNoOpStmtsTransformation(Transformation):
@@ -28,4 +29,7 @@ class RemoveNoOpStmtsTransformation(Transformation):
 
     def transform_template_body_elems(self,
                                       elems: Tuple[ir.TemplateBodyElement, ...]) -> Tuple[ir.TemplateBodyElement, ...]:
+        if ConfigurationKnobs.preserve_coverage_markers:
+            # The NoOpStmts are the coverage markers.
+            return tuple(elems)
         return tuple(elem for elem in elems if not isinstance(elem, ir.NoOpStmt))
@@ -17,6 +17,10 @@ from _py2tmp.compiler.stages import expr_to_cpp_simple
 from _py2tmp.ir0 import ir0, Visitor, Transformation, ir
 
 
+# These builtins are emitted as fold expressions on some targets (see ir0_to_cpp), and that needs all the args in the
+# template instantiation.
+_BUILTINS_THAT_CANT_BE_REPLACED = ('FoldBoolsToType', 'FoldInt64sToType', 'FoldTypesToType')
+
 def _is_trivial_pattern(arg_decl: ir0.TemplateArgDecl, pattern: ir0.Expr):
     if isinstance(pattern, ir0.AtomicTypeLiteral):
         return arg_decl.name == pattern.cpp_type
@@ -56,7 +60,7 @@ def _determine_template_arg_indexes_that_can_be_moved_to_typedef_args(template_d
 class _DetermineTemplatesThatCanBeReplaced(Visitor):
     def __init__(self) -> None:
         self.all_defined_template_names: Set[str] = set()
-        self.template_names_that_cant_be_replaced: Set[str] = set()
+        self.template_names_that_cant_be_replaced: Set[str] = set(_BUILTINS_THAT_CANT_BE_REPLACED)
         self.movable_arg_indexes_by_template_name: Dict[str, Set[int]] = dict()
 
     def visit_template_defn(self, template_defn: ir0.TemplateDefn):
@@ -135,9 +139,13 @@ class _ApplyReplacement(Transformation):
         else:
             patterns = None
 
+        # The specialization's args might be in a different order than the template defn's args (e.g. for
+        # `template <int64_t... ns, int64_t n> struct F<false, Int64List<ns...>, n>`), but the patterns of movable
+        # args are trivial, so the corresponding specialization args have the same names.
+        moved_arg_names = {arg_decl.name for arg_decl in self.additional_typedef_args_in_current_template}
         args = tuple(self.transform_template_arg_decl(arg_decl)
-                     for index, arg_decl in enumerate(specialization.args)
-                     if not index in self.movable_arg_indexes_in_current_template)
+                     for arg_decl in specialization.args
+                     if arg_decl.name not in moved_arg_names)
 
         body = self.transform_template_body_elems(specialization.body)
         return ir.TemplateSpecialization(args=args,
@@ -18,7 +18,9 @@ import pytest
 
 from _py2tmp.ir0 import ir0
 from _py2tmp.compiler.testing import main
-from _py2tmp.ir0_optimization._unify import UnificationResultKind, _unify as unify_ir0, UnificationResult
+from _py2tmp.ir0_optimization._specialization_index import get_specialization_index
+from _py2tmp.ir0_optimization._unify import UnificationResultKind, _unify as unify_ir0, UnificationResult, \
+    find_matches_in_unification_of_template_instantiation_with_definition
 
 
 def identifier_generator_fun() -> Iterable[str]:
@@ -473,5 +475,60 @@ def test_unify_ir0_variadic_type_variable_matches_multiple_variadics() -> None:
                                                                     expr_type=ir0.TypeType(), is_variadic=True)))),
     )
 
+def _template_with_specializations(patterns_and_arg_names: Tuple[Tuple[ir0.Expr, Tuple[str, ...]], ...]) -> ir0.TemplateDefn:
+    return ir0.TemplateDefn(main_definition=None,
+                            specializations=tuple(ir0.TemplateSpecialization(args=tuple(ir0.TemplateArgDecl(expr_type=ir0.TypeType(),
+                                                                                                         name=arg_name,
+                                                                                                         is_variadic=False)
+                                                                                        for arg_name in arg_names),
+                                                                             patterns=(pattern,),
+                                                                             body=(),
+                                                                             is_metafunction=False)
+                                                  for pattern, arg_names in patterns_and_arg_names),
+                            name='Foo',
+                            description='',
+                            result_element_names=frozenset(),
+                            args=(ir0.TemplateArgDecl(expr_type=ir0.TypeType(), name='T', is_variadic=False),))
+
+def _vector_of(expr: ir0.Expr):
+    return ir0.TemplateInstantiation(template_expr=ir0.AtomicTypeLiteral.for_nonlocal_template(cpp_type='std::vector',
+                                                                                               args=(ir0.TemplateArgType(ir0.TypeType(), is_variadic=False),),
+                                                                                               is_metafunction_that_may_return_error=False,
+                                                                                               may_be_alias=False),
+                                     args=(expr,),
+                                     instantiation_might_trigger_static_asserts=False)
+
+def test_specialization_index_skips_specializations_that_cant_match() -> None:
+    template_defn = _template_with_specializations((
+        (type_literal('int'), ()),
+        (type_literal('float'), ()),
+        (_vector_of(local_type_literal('T')), ('T',)),
+        (ir0.PointerTypeExpr(local_type_literal('T')), ('T',)),
+        (_vector_of(_vector_of(local_type_literal('T'))), ('T',)),
+        (local_type_literal('T'), ('T',)),
+        (ir0.ClassMemberAccess(inner_expr=type_literal('MyClass'), member_name='value_type', expr_type=ir0.TypeType()), ()),
+    ))
+    instantiation = ir0.TemplateInstantiation(template_expr=ir0.AtomicTypeLiteral.for_nonlocal_template(cpp_type='Foo',
+                                                                                                        args=(ir0.TemplateArgType(ir0.TypeType(), is_variadic=False),),
+                                                                                                        is_metafunction_that_may_return_error=False,
+                                                                                                        may_be_alias=False),
+                                              args=(_vector_of(_vector_of(type_literal('int'))),),
+                                              instantiation_might_trigger_static_asserts=False)
+
+    # The ClassMemberAccess might be equal to anything, so it's always a candidate.
+    assert get_specialization_index(template_defn).compute_candidate_specialization_indexes(instantiation.args, dict()) == [2, 4, 5, 6]
+
+    identifier_generator = iter(identifier_generator_fun())
+    certain_matches, possible_matches = find_matches_in_unification_of_template_instantiation_with_definition(instantiation,
+                                                                                                              dict(),
+                                                                                                              template_defn,
+                                                                                                              identifier_generator,
+                                                                                                              verbose=False)
+    assert [specialization for specialization, _, _ in certain_matches] == [template_defn.specializations[4]]
+    assert possible_matches == (template_defn.specializations[6],)
+    # The identifiers for the skipped unifications are still reserved, so the names generated later don't depend on the
+    # index: 1 for each pattern var, plus 2 for each of the 3 comparisons between certain matches.
+    assert next(identifier_generator) == 'X_10'
+
 if __name__== '__main__':
     main()
@@ -52,6 +52,8 @@ class Visitor:
             self.visit_equality_comparison(expr)
         elif isinstance(expr, ir.IsInListExpr):
             self.visit_is_in_list_expr(expr)
+        elif isinstance(expr, ir.IsInSetExpr):
+            self.visit_is_in_set_expr(expr)
         elif isinstance(expr, ir.AttributeAccessExpr):
             self.visit_attribute_access_expr(expr)
         elif isinstance(expr, ir.NotExpr):
@@ -70,6 +72,16 @@ class Visitor:
             self.visit_int_binary_op_expr(expr)
         elif isinstance(expr, ir.ListConcatExpr):
             self.visit_list_concat_expr(expr)
+        elif isinstance(expr, ir.ListIndexExpr):
+            self.visit_list_index_expr(expr)
+        elif isinstance(expr, ir.ListSliceExpr):
+            self.visit_list_slice_expr(expr)
+        elif isinstance(expr, ir.IntRangeExpr):
+            self.visit_int_range_expr(expr)
+        elif isinstance(expr, ir.ListSortByKeysExpr):
+            self.visit_list_sort_by_keys_expr(expr)
+        elif isinstance(expr, ir.ListUniqueByKeysExpr):
+            self.visit_list_unique_by_keys_expr(expr)
         elif isinstance(expr, ir.ListComprehensionExpr):
             self.visit_list_comprehension_expr(expr)
         elif isinstance(expr, ir.IsInstanceExpr):
@@ -206,6 +218,10 @@ class Visitor:
         self.visit_expr(expr.lhs)
         self.visit_expr(expr.rhs)
     
+    def visit_is_in_set_expr(self, expr: ir.IsInSetExpr):
+        self.visit_expr(expr.lhs)
+        self.visit_expr(expr.rhs)
+    
     def visit_attribute_access_expr(self, expr: ir.AttributeAccessExpr):
         self.visit_expr(expr.var)
     
@@ -239,6 +255,27 @@ class Visitor:
         self.visit_expr(expr.lhs)
         self.visit_expr(expr.rhs)
     
+    def visit_list_index_expr(self, expr: ir.ListIndexExpr):
+        self.visit_expr(expr.var)
+        self.visit_expr(expr.index)
+    
+    def visit_list_slice_expr(self, expr: ir.ListSliceExpr):
+        self.visit_expr(expr.var)
+        self.visit_expr(expr.begin)
+        self.visit_expr(expr.end)
+    
+    def visit_int_range_expr(self, expr: ir.IntRangeExpr):
+        self.visit_expr(expr.begin)
+        self.visit_expr(expr.end)
+    
+    def visit_list_sort_by_keys_expr(self, expr: ir.ListSortByKeysExpr):
+        self.visit_expr(expr.var)
+        self.visit_expr(expr.keys)
+    
+    def visit_list_unique_by_keys_expr(self, expr: ir.ListUniqueByKeysExpr):
+        self.visit_expr(expr.var)
+        self.visit_expr(expr.keys)
+    
     def visit_is_instance_expr(self, expr: ir.IsInstanceExpr):
         self.visit_expr(expr.var)
     
@@ -723,6 +723,23 @@ class IsInListExpr(_Expr):
     def describe_other_fields(self) -> str:
         return '(lhs: %s; rhs: %s)' % (self.lhs.describe_other_fields(), self.rhs.describe_other_fields())
 
+@dataclass(frozen=True)
+class IsInSetExpr(_Expr):
+    expr_type: ExprType = field(init=False)
+    lhs: VarReference
+    rhs: VarReference
+    
+    def __post_init__(self) -> None:
+        self._init_expr_type(BoolType())
+        assert isinstance(self.rhs.expr_type, ListType)
+        assert self.lhs.expr_type == self.rhs.expr_type.elem_type
+
+    def __str__(self) -> str:
+        return '%s in set %s' % (self.lhs.name, self.rhs.name)
+
+    def describe_other_fields(self) -> str:
+        return '(lhs: %s; rhs: %s)' % (self.lhs.describe_other_fields(), self.rhs.describe_other_fields())
+
 @dataclass(frozen=True)
 class AttributeAccessExpr(_Expr):
     var: VarReference
@@ -885,6 +902,97 @@ class ListConcatExpr(_Expr):
     def describe_other_fields(self) -> str:
         return '(lhs: %s; rhs: %s)' % (self.lhs.describe_other_fields(), self.rhs.describe_other_fields())
 
+@dataclass(frozen=True)
+class ListIndexExpr(_Expr):
+    expr_type: ExprType = field(init=False)
+    var: VarReference
+    index: VarReference
+
+    def __post_init__(self) -> None:
+        assert isinstance(self.var.expr_type, ListType)
+        assert isinstance(self.index.expr_type, IntType)
+        self._init_expr_type(self.var.expr_type.elem_type)
+
+    def __str__(self) -> str:
+        return '%s[%s]' % (self.var.name, self.index.name)
+
+    def describe_other_fields(self) -> str:
+        return '(var: %s; index: %s)' % (self.var.describe_other_fields(), self.index.describe_other_fields())
+
+@dataclass(frozen=True)
+class ListSliceExpr(_Expr):
+    expr_type: ExprType = field(init=False)
+    var: VarReference
+    begin: VarReference
+    end: VarReference
+
+    def __post_init__(self) -> None:
+        assert isinstance(self.var.expr_type, ListType)
+        assert isinstance(self.begin.expr_type, IntType)
+        assert isinstance(self.end.expr_type, IntType)
+        self._init_expr_type(self.var.expr_type)
+
+    def __str__(self) -> str:
+        return '%s[%s:%s]' % (self.var.name, self.begin.name, self.end.name)
+
+    def describe_other_fields(self) -> str:
+        return '(var: %s; begin: %s; end: %s)' % (self.var.describe_other_fields(),
+                                                  self.begin.describe_other_fields(),
+                                                  self.end.describe_other_fields())
+
+@dataclass(frozen=True)
+class IntRangeExpr(_Expr):
+    expr_type: ExprType = field(init=False)
+    begin: VarReference
+    end: VarReference
+
+    def __post_init__(self) -> None:
+        assert isinstance(self.begin.expr_type, IntType)
+        assert isinstance(self.end.expr_type, IntType)
+        self._init_expr_type(ListType(IntType()))
+
+    def __str__(self) -> str:
+        return 'range(%s, %s)' % (self.begin.name, self.end.name)
+
+    def describe_other_fields(self) -> str:
+        return '(begin: %s; end: %s)' % (self.begin.describe_other_fields(), self.end.describe_other_fields())
+
+# The elements of var, sorted (stably) by the corresponding elements of keys.
+@dataclass(frozen=True)
+class ListSortByKeysExpr(_Expr):
+    expr_type: ExprType = field(init=False)
+    var: VarReference
+    keys: VarReference
+
+    def __post_init__(self) -> None:
+        assert isinstance(self.var.expr_type, ListType)
+        assert self.keys.expr_type == ListType(IntType())
+        self._init_expr_type(self.var.expr_type)
+
+    def __str__(self) -> str:
+        return 'sort_by_keys(%s, %s)' % (self.var.name, self.keys.name)
+
+    def describe_other_fields(self) -> str:
+        return '(var: %s; keys: %s)' % (self.var.describe_other_fields(), self.keys.describe_other_fields())
+
+# Like ListSortByKeysExpr, but only the first element with each key is kept.
+@dataclass(frozen=True)
+class ListUniqueByKeysExpr(_Expr):
+    expr_type: ExprType = field(init=False)
+    var: VarReference
+    keys: VarReference
+
+    def __post_init__(self) -> None:
+        assert isinstance(self.var.expr_type, ListType)
+        assert self.keys.expr_type == ListType(IntType())
+        self._init_expr_type(self.var.expr_type)
+
+    def __str__(self) -> str:
+        return 'unique_by_keys(%s, %s)' % (self.var.name, self.keys.name)
+
+    def describe_other_fields(self) -> str:
+        return '(var: %s; keys: %s)' % (self.var.describe_other_fields(), self.keys.describe_other_fields())
+
 @dataclass(frozen=True)
 class IsInstanceExpr(_Expr):
     expr_type: ExprType = field(init=False)
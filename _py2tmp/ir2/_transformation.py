@@ -110,6 +110,16 @@ class Transformation:
             return self.transform_list_comprehension(expr)
         elif isinstance(expr, ir2.ListConcatExpr):
             return self.transform_list_concat_expr(expr)
+        elif isinstance(expr, ir2.ListIndexExpr):
+            return self.transform_list_index_expr(expr)
+        elif isinstance(expr, ir2.ListSliceExpr):
+            return self.transform_list_slice_expr(expr)
+        elif isinstance(expr, ir2.IntRangeExpr):
+            return self.transform_int_range_expr(expr)
+        elif isinstance(expr, ir2.ListSortedExpr):
+            return self.transform_list_sorted_expr(expr)
+        elif isinstance(expr, ir2.ListUniqueExpr):
+            return self.transform_list_unique_expr(expr)
         elif isinstance(expr, ir2.IntBinaryOpExpr):
             return self.transform_int_binary_op_expr(expr)
         elif isinstance(expr, ir2.IntUnaryMinusExpr):
@@ -193,6 +203,27 @@ class Transformation:
         return ir2.ListConcatExpr(lhs=self.transform_expr(expr.lhs),
                                   rhs=self.transform_expr(expr.rhs))
 
+    def transform_list_index_expr(self, expr: ir2.ListIndexExpr) -> ir2.ListIndexExpr:
+        return ir2.ListIndexExpr(list_expr=self.transform_expr(expr.list_expr),
+                                 index_expr=self.transform_expr(expr.index_expr))
+
+    def transform_list_slice_expr(self, expr: ir2.ListSliceExpr) -> ir2.ListSliceExpr:
+        return ir2.ListSliceExpr(list_expr=self.transform_expr(expr.list_expr),
+                                 begin_expr=self.transform_expr(expr.begin_expr),
+                                 end_expr=self.transform_expr(expr.end_expr))
+
+    def transform_list_sorted_expr(self, expr: ir2.ListSortedExpr) -> ir2.ListSortedExpr:
+        return ir2.ListSortedExpr(list_expr=self.transform_expr(expr.list_expr),
+                                  key_expr=self.transform_expr(expr.key_expr) if expr.key_expr else None)
+
+    def transform_list_unique_expr(self, expr: ir2.ListUniqueExpr) -> ir2.ListUniqueExpr:
+        return ir2.ListUniqueExpr(list_expr=self.transform_expr(expr.list_expr),
+                                  key_expr=self.transform_expr(expr.key_expr) if expr.key_expr else None)
+
+    def transform_int_range_expr(self, expr: ir2.IntRangeExpr) -> ir2.IntRangeExpr:
+        return ir2.IntRangeExpr(begin_expr=self.transform_expr(expr.begin_expr),
+                                end_expr=self.transform_expr(expr.end_expr))
+
     def transform_int_binary_op_expr(self, expr: ir2.IntBinaryOpExpr) -> ir2.IntBinaryOpExpr:
         return ir2.IntBinaryOpExpr(lhs=self.transform_expr(expr.lhs),
                                    rhs=self.transform_expr(expr.rhs),
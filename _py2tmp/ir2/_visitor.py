@@ -84,6 +84,16 @@ class Visitor:
             self.visit_int_binary_op_expr(expr)
         elif isinstance(expr, ir.ListConcatExpr):
             self.visit_list_concat_expr(expr)
+        elif isinstance(expr, ir.ListIndexExpr):
+            self.visit_list_index_expr(expr)
+        elif isinstance(expr, ir.ListSliceExpr):
+            self.visit_list_slice_expr(expr)
+        elif isinstance(expr, ir.IntRangeExpr):
+            self.visit_int_range_expr(expr)
+        elif isinstance(expr, ir.ListSortedExpr):
+            self.visit_list_sorted_expr(expr)
+        elif isinstance(expr, ir.ListUniqueExpr):
+            self.visit_list_unique_expr(expr)
         elif isinstance(expr, ir.ListComprehension):
             self.visit_list_comprehension(expr)
         elif isinstance(expr, ir.SetComprehension):
@@ -210,6 +220,29 @@ class Visitor:
         self.visit_expr(expr.lhs)
         self.visit_expr(expr.rhs)
     
+    def visit_list_index_expr(self, expr: ir.ListIndexExpr):
+        self.visit_expr(expr.list_expr)
+        self.visit_expr(expr.index_expr)
+    
+    def visit_list_slice_expr(self, expr: ir.ListSliceExpr):
+        self.visit_expr(expr.list_expr)
+        self.visit_expr(expr.begin_expr)
+        self.visit_expr(expr.end_expr)
+    
+    def visit_int_range_expr(self, expr: ir.IntRangeExpr):
+        self.visit_expr(expr.begin_expr)
+        self.visit_expr(expr.end_expr)
+    
+    def visit_list_sorted_expr(self, expr: ir.ListSortedExpr):
+        self.visit_expr(expr.list_expr)
+        if expr.key_expr:
+            self.visit_expr(expr.key_expr)
+    
+    def visit_list_unique_expr(self, expr: ir.ListUniqueExpr):
+        self.visit_expr(expr.list_expr)
+        if expr.key_expr:
+            self.visit_expr(expr.key_expr)
+    
     def visit_list_comprehension(self, expr: ir.ListComprehension):
         self.visit_expr(expr.list_expr)
         self.visit_expr(expr.loop_var)
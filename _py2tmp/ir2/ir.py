@@ -464,6 +464,78 @@ class ListConcatExpr(Expr):
         assert isinstance(self.lhs.expr_type, ListType)
         assert self.lhs.expr_type == self.rhs.expr_type
 
+@dataclass(frozen=True)
+class ListIndexExpr(Expr):
+    expr_type: ExprType = field(init=False)
+    list_expr: Expr
+    index_expr: Expr
+
+    def __post_init__(self) -> None:
+        assert isinstance(self.list_expr.expr_type, ListType)
+        assert isinstance(self.index_expr.expr_type, IntType)
+        self._init_expr_type(self.list_expr.expr_type.elem_type)
+
+@dataclass(frozen=True)
+class ListSliceExpr(Expr):
+    expr_type: ExprType = field(init=False)
+    list_expr: Expr
+    begin_expr: Expr
+    end_expr: Expr
+
+    def __post_init__(self) -> None:
+        self._init_expr_type(self.list_expr.expr_type)
+        assert isinstance(self.list_expr.expr_type, ListType)
+        assert isinstance(self.begin_expr.expr_type, IntType)
+        assert isinstance(self.end_expr.expr_type, IntType)
+
+@dataclass(frozen=True)
+class IntRangeExpr(Expr):
+    expr_type: ExprType = field(init=False)
+    begin_expr: Expr
+    end_expr: Expr
+
+    def __post_init__(self) -> None:
+        self._init_expr_type(ListType(IntType()))
+        assert isinstance(self.begin_expr.expr_type, IntType)
+        assert isinstance(self.end_expr.expr_type, IntType)
+
+# sorted(l, key=f) (or sorted(l), for lists of ints). l can also be a set.
+@dataclass(frozen=True)
+class ListSortedExpr(Expr):
+    expr_type: ExprType = field(init=False)
+    list_expr: Expr
+    # A function from the elements of the list to int. If None, the elements themselves are the keys.
+    key_expr: Optional[Expr]
+
+    def __post_init__(self) -> None:
+        assert isinstance(self.list_expr.expr_type, (ListType, SetType))
+        self._init_expr_type(ListType(self.list_expr.expr_type.elem_type))
+        if self.key_expr:
+            assert self.key_expr.expr_type == FunctionType(argtypes=(self.list_expr.expr_type.elem_type,),
+                                                           argnames=None,
+                                                           returns=IntType())
+        else:
+            assert isinstance(self.list_expr.expr_type.elem_type, IntType)
+
+# unique(l, key=f) (or unique(l), for lists of ints): l sorted by key, keeping only the first element with each key.
+# l can also be a set.
+@dataclass(frozen=True)
+class ListUniqueExpr(Expr):
+    expr_type: ExprType = field(init=False)
+    list_expr: Expr
+    # A function from the elements of the list to int. If None, the elements themselves are the keys.
+    key_expr: Optional[Expr]
+
+    def __post_init__(self) -> None:
+        assert isinstance(self.list_expr.expr_type, (ListType, SetType))
+        self._init_expr_type(ListType(self.list_expr.expr_type.elem_type))
+        if self.key_expr:
+            assert self.key_expr.expr_type == FunctionType(argtypes=(self.list_expr.expr_type.elem_type,),
+                                                           argnames=None,
+                                                           returns=IntType())
+        else:
+            assert isinstance(self.list_expr.expr_type.elem_type, IntType)
+
 @dataclass(frozen=True)
 class ListComprehension(Expr):
     expr_type: ExprType = field(init=False)
@@ -12,11 +12,10 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 import itertools
-from collections import defaultdict
-from typing import Dict, Tuple
-import networkx as nx
+from typing import Dict, Mapping
 from _py2tmp.ir2 import ir, Transformation
 from _py2tmp.compiler.output_files import ObjectFileContent
+from _py2tmp.utils import LazyMapping, DependencyGraph
 
 
 class GetReferencedGlobalFunctionNamesTransformation(Transformation):
@@ -60,9 +59,9 @@ def function_contains_var_reference_that_can_throw(function_defn: ir.FunctionDef
     return transformation.found_var_ref_that_throws
 
 class ApplyFunctionCanThrowInfo(Transformation):
-    def __init__(self, function_can_throw: Dict[str, bool], external_function_can_throw: Dict[Tuple[str, str], bool]):
+    def __init__(self, function_can_throw: Dict[str, bool], external_function_can_throw_by_module: Mapping[str, Dict[str, bool]]):
         self.function_can_throw = function_can_throw
-        self.external_function_can_throw = external_function_can_throw
+        self.external_function_can_throw_by_module = external_function_can_throw_by_module
 
     def transform_var_reference(self, var: ir.VarReference):
         is_function_that_may_throw = var.is_function_that_may_throw
@@ -71,7 +70,7 @@ class ApplyFunctionCanThrowInfo(Transformation):
                 if not self.function_can_throw[var.name]:
                     is_function_that_may_throw = False
             else:
-                if not self.external_function_can_throw[(var.source_module, var.name)]:
+                if not self.external_function_can_throw_by_module[var.source_module][var.name]:
                     is_function_that_may_throw = False
 
         return ir.VarReference(expr_type=var.expr_type,
@@ -92,14 +91,14 @@ class ApplyFunctionCanThrowInfo(Transformation):
 
 def apply_function_can_throw_info(module: ir.Module,
                                   function_can_throw: Dict[str, bool],
-                                  external_function_can_throw: Dict[Tuple[str, str], bool]):
-    return ApplyFunctionCanThrowInfo(function_can_throw, external_function_can_throw).transform_module(module)
+                                  external_function_can_throw_by_module: Mapping[str, Dict[str, bool]]):
+    return ApplyFunctionCanThrowInfo(function_can_throw, external_function_can_throw_by_module).transform_module(module)
 
 def recalculate_function_can_throw_info(module: ir.Module, context_object_file_content: ObjectFileContent):
     if not module.function_defns:
         return module
 
-    function_dependency_graph = nx.DiGraph()
+    function_dependency_graph = DependencyGraph()
 
     function_defn_by_name = {function_defn.name: function_defn
                              for function_defn in module.function_defns}
@@ -111,39 +110,32 @@ def recalculate_function_can_throw_info(module: ir.Module, context_object_file_c
             if global_function_name in function_defn_by_name.keys():
                 function_dependency_graph.add_edge(function_defn.name, global_function_name)
 
-    condensed_graph = nx.condensation(function_dependency_graph)
-    assert isinstance(condensed_graph, nx.DiGraph)
-
-    function_dependency_graph_transitive_closure = nx.transitive_closure(function_dependency_graph)
-    assert isinstance(function_dependency_graph_transitive_closure, nx.DiGraph)
-
-    # Determine which connected components can throw.
-    condensed_node_can_throw = defaultdict(lambda: False)
-    for connected_component_index in reversed(list(nx.lexicographical_topological_sort(condensed_graph))):
-        condensed_node = condensed_graph.nodes[connected_component_index]
-
+    # Determine which connected components can throw. The components that a component depends on come before it, so
+    # they've already been processed.
+    function_can_throw: Dict[str, bool] = dict()
+    for connected_component in function_dependency_graph.strongly_connected_components():
         # If a function in this connected component can throw, the whole component can throw.
-        for function_name in condensed_node['members']:
-            if function_contains_raise_stmt(function_defn_by_name[function_name]):
-                condensed_node_can_throw[connected_component_index] = True
-
         # If a function in this connected component calls a function in a connected component that can throw, this
         # connected component can also throw.
-        for called_condensed_node_index in condensed_graph.successors(connected_component_index):
-            if condensed_node_can_throw[called_condensed_node_index]:
-                condensed_node_can_throw[connected_component_index] = True
-
-    function_can_throw = dict()
-    for connected_component_index in condensed_graph:
-        for function_name in condensed_graph.nodes[connected_component_index]['members']:
-            function_can_throw[function_name] = condensed_node_can_throw[connected_component_index]
-
-    external_function_can_throw = dict()
-    for module_name, module_info in context_object_file_content.modules_by_name.items():
-        for elem in itertools.chain(module_info.ir2_module.custom_types, module_info.ir2_module.function_defns):
-            if elem.name in module_info.ir2_module.public_names:
-                external_function_can_throw[(module_name, elem.name)] = (isinstance(elem, ir.FunctionDefn)
-                                                                         and (function_contains_raise_stmt(elem)
-                                                                              or function_contains_var_reference_that_can_throw(elem)))
-
-    return apply_function_can_throw_info(module, function_can_throw, external_function_can_throw)
+        can_throw = (any(function_contains_raise_stmt(function_defn_by_name[function_name])
+                         for function_name in connected_component)
+                     or any(function_can_throw.get(called_function_name, False)
+                            for function_name in connected_component
+                            for called_function_name in function_dependency_graph.successors(function_name)))
+        for function_name in connected_component:
+            function_can_throw[function_name] = can_throw
+
+    # Only the modules that define functions that we reference are decoded.
+    external_function_can_throw_by_module = LazyMapping([module_name
+                                                         for module_name, module_info in context_object_file_content.modules_by_name.items()
+                                                         if module_info.has_ir2_module],
+                                                        lambda module_name: _compute_external_function_can_throw(context_object_file_content.modules_by_name[module_name].ir2_module))
+
+    return apply_function_can_throw_info(module, function_can_throw, external_function_can_throw_by_module)
+
+def _compute_external_function_can_throw(module: ir.Module):
+    return {elem.name: (isinstance(elem, ir.FunctionDefn)
+                        and (function_contains_raise_stmt(elem)
+                             or function_contains_var_reference_that_can_throw(elem)))
+            for elem in itertools.chain(module.custom_types, module.function_defns)
+            if elem.name in module.public_names}
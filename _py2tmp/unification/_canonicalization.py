@@ -14,13 +14,11 @@
 
 from typing import List, Union, Dict, Set, Tuple
 
-import networkx as nx
-
 from _py2tmp.unification import CanonicalizationFailedException
 from _py2tmp.unification._strategy import TermT, UnificationStrategy, TupleExpansion, \
     UnificationStrategyForCanonicalization
 from _py2tmp.unification._utils import expr_to_string, exprs_to_string
-from _py2tmp.utils import compute_condensation_in_topological_order
+from _py2tmp.utils import compute_condensation_in_topological_order, DependencyGraph
 
 _NonTupleExpr = Union[str, TermT]
 _Expr = Union[_NonTupleExpr, Tuple[_NonTupleExpr, ...]]
@@ -37,7 +35,7 @@ def canonicalize(var_expr_equations: Dict[str, _NonTupleExpr],
 
     # A graph that has all variables on the LHS of equations as nodes and an edge var1->var2 if we have the equation
     # var1=expr and var2 appears in expr.
-    vars_dependency_graph = nx.DiGraph()
+    vars_dependency_graph = DependencyGraph()
     for lhs, rhs in var_expr_equations.items():
         vars_dependency_graph.add_node(lhs)
         for var in _get_free_variables(rhs, strategy):
@@ -68,7 +66,7 @@ def canonicalize(var_expr_equations: Dict[str, _NonTupleExpr],
                 # We can't flip the equation for this var since it's a "var=term" or "var=TupleExpansion(...)" equation.
                 assert not isinstance(var_expr_equations[var], str)
                 if not strategy.can_var_be_on_lhs(var):
-                    raise CanonicalizationFailedException('Deduced equation that can\'t be flipped with LHS-forbidden var: %s = %s' % (
+                    raise CanonicalizationFailedException(lambda: 'Deduced equation that can\'t be flipped with LHS-forbidden var: %s = %s' % (
                         var, expr_to_string(strategy, var_expr_equations[var])))
             elif var in expanded_var_expr_equations:
                 # We can't flip the equation for this var since it's a "TupleExpansion(var)=var2" or "TupleExpansion(var)=term" equation.
@@ -76,7 +74,7 @@ def canonicalize(var_expr_equations: Dict[str, _NonTupleExpr],
                             and isinstance(expanded_var_expr_equations[var][0], TupleExpansion)
                             and isinstance(expanded_var_expr_equations[var][0].expr, str))
                 if not strategy.can_var_be_on_lhs(var):
-                    raise CanonicalizationFailedException('Deduced equation that can\'t be flipped with LHS-forbidden var: TupleExpansion(%s) = %s' % (
+                    raise CanonicalizationFailedException(lambda: 'Deduced equation that can\'t be flipped with LHS-forbidden var: TupleExpansion(%s) = %s' % (
                         var, exprs_to_string(strategy, expanded_var_expr_equations[var])))
             else:
                 # This var is just part of a larger term in some other equation.
@@ -117,7 +115,7 @@ def canonicalize(var_expr_equations: Dict[str, _NonTupleExpr],
                 [rhs_var] = vars_in_rhs
             else:
                 # We need at least n-1 distinct LHS vars but we don't have enough vars allowed on the LHS.
-                raise CanonicalizationFailedException('Found var equality chain that can\'t be canonicalized due to multiple LHS-forbidden vars: %s' % ', '.join(vars_in_rhs))
+                raise CanonicalizationFailedException(lambda: 'Found var equality chain that can\'t be canonicalized due to multiple LHS-forbidden vars: %s' % ', '.join(vars_in_rhs))
 
             # Now we remove all equations defining these vars and the corresponding edges in the graph.
             for var in vars_in_connected_component:
@@ -144,7 +142,7 @@ def canonicalize(var_expr_equations: Dict[str, _NonTupleExpr],
     canonical_var_expr_equations: Dict[str, Union[_NonTupleExpr, Tuple[_NonTupleExpr, ...]]] = dict()
     canonical_expanded_var_expr_equations: Dict[str, Union[_NonTupleExpr, Tuple[_NonTupleExpr, ...]]] = dict()
 
-    for var in reversed(list(nx.lexicographical_topological_sort(vars_dependency_graph))):
+    for var in reversed(list(vars_dependency_graph.lexicographical_topological_sort())):
         expr = var_expr_equations.get(var)
         if expr is not None:
             expr = strategy.replace_variables_in_expr(expr, canonical_var_expr_equations, canonical_expanded_var_expr_equations)
@@ -12,11 +12,26 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-class UnificationFailedException(Exception):
+from typing import Union, Callable
+
+# Most of these exceptions are caught (and discarded) during optimization, while building the message can be expensive
+# (e.g. it can involve converting IR to C++), so the message can also be passed as a function that's only called if the
+# message is actually needed.
+class _ExceptionWithLazyMessage(Exception):
+    def __init__(self, message: Union[str, Callable[[], str]] = ''):
+        super().__init__()
+        self._message = message
+
+    def __str__(self):
+        if callable(self._message):
+            self._message = self._message()
+        return self._message
+
+class UnificationFailedException(_ExceptionWithLazyMessage):
     pass
 
-class UnificationAmbiguousException(Exception):
+class UnificationAmbiguousException(_ExceptionWithLazyMessage):
     pass
 
-class CanonicalizationFailedException(Exception):
+class CanonicalizationFailedException(_ExceptionWithLazyMessage):
     pass
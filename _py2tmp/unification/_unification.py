@@ -11,7 +11,7 @@
 # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 # See the License for the specific language governing permissions and
 # limitations under the License.
-from typing import Tuple, Union, Dict, Optional, List
+from typing import Tuple, Union, Dict, Optional, List, Set
 
 from _py2tmp.unification import UnificationAmbiguousException, UnificationFailedException
 from _py2tmp.unification._strategy import TermT, UnificationStrategy, TupleExpansion
@@ -31,9 +31,36 @@ class _UnificationContext:
         self.strategy = strategy
         self.expanded_non_syntactically_comparable_expr: Optional[_NonTupleExpr] = None
         # Each (var, expr) entry here represents an equation: var=expr
+        # When expr is a var, this is a link in a union-find forest (see find()), so the vars are never substituted
+        # into exprs during unification.
         self.var_expr_equations: Dict[str, _NonTupleExpr] = dict()
         # Each (var, exprs) entry here represents an equation: TupleExpansion(var)=exprs
         self.expanded_var_expr_equations: Dict[str, Tuple[_NonTupleExpr, ...]] = dict()
+        # The terms are stored too, so that their id()s can't be reused while this context is alive.
+        self._term_and_args_by_term_id: Dict[int, Tuple[TermT, Tuple[_NonTupleExpr, ...]]] = dict()
+
+    # Returns the representative of the set of vars that are known to be equal to var, compressing the path to it.
+    def find(self, var: str) -> str:
+        root = var
+        while True:
+            parent = self.var_expr_equations.get(root)
+            if not isinstance(parent, str):
+                break
+            root = parent
+        while var != root:
+            parent = self.var_expr_equations[var]
+            self.var_expr_equations[var] = root
+            var = parent
+        return root
+
+    # Equivalent to strategy.get_term_args(), but memoized since (e.g.) the occurrence check can visit the same term
+    # many times.
+    def get_term_args(self, term: TermT) -> Tuple[_NonTupleExpr, ...]:
+        term_and_args = self._term_and_args_by_term_id.get(id(term))
+        if term_and_args is None:
+            term_and_args = (term, self.strategy.get_term_args(term))
+            self._term_and_args_by_term_id[id(term)] = term_and_args
+        return term_and_args[1]
 
 def unify(initial_expr_expr_equations: List[Tuple[_Expr, _Expr]],
           context_var_expr_equations: Dict[str, _NonTupleExpr],
@@ -110,10 +137,10 @@ def _process_tuple_tuple_equation(lhs_tuple: Tuple[_NonTupleExpr], rhs_tuple: Tu
                         for rhs in rhs_tuple):
         # There are no tuple expansions but one of the two sides still has unmatched elems.
         if context.expanded_non_syntactically_comparable_expr:
-            raise UnificationAmbiguousException('Deduced %s = %s, which differ in length and have no tuple vars\nAfter expanding a non-syntactically-comparable expr:\n%s' % (
+            raise UnificationAmbiguousException(lambda: 'Deduced %s = %s, which differ in length and have no tuple vars\nAfter expanding a non-syntactically-comparable expr:\n%s' % (
                 exprs_to_string(strategy, lhs_tuple), exprs_to_string(strategy, rhs_tuple), expr_to_string(strategy, context.expanded_non_syntactically_comparable_expr)))
         else:
-            raise UnificationFailedException('Deduced %s = %s, which differ in length and have no tuple vars' % (
+            raise UnificationFailedException(lambda: 'Deduced %s = %s, which differ in length and have no tuple vars' % (
                 exprs_to_string(strategy, lhs_tuple), exprs_to_string(strategy, rhs_tuple)))
 
     if removed_something:
@@ -142,11 +169,23 @@ def _process_tuple_tuple_equation(lhs_tuple: Tuple[_NonTupleExpr], rhs_tuple: Tu
     # ['x', 'y', *l1] = [*l2, 'z']
     # [*l1, *l2] = [*l3, *l4]
     # ['x', *l1] = [*l2, *l3]
-    raise UnificationAmbiguousException('Deduced %s = %s' % (
+    raise UnificationAmbiguousException(lambda: 'Deduced %s = %s' % (
         exprs_to_string(strategy, lhs_tuple), exprs_to_string(strategy, rhs_tuple)))
 
 
 def _process_var_expr_equation(lhs: Union[str, TupleExpansion], rhs_tuple: Tuple[_NonTupleExpr], context: _UnificationContext):
+    # We only need to look at the representatives of the vars (see _UnificationContext.find()).
+    if isinstance(lhs, str):
+        lhs = context.find(lhs)
+    elif isinstance(lhs.expr, str):
+        lhs = TupleExpansion(context.find(lhs.expr))
+    if len(rhs_tuple) == 1:
+        [rhs] = rhs_tuple
+        if isinstance(rhs, str):
+            rhs_tuple = (context.find(rhs),)
+        elif isinstance(rhs, TupleExpansion) and isinstance(rhs.expr, str):
+            rhs_tuple = (TupleExpansion(context.find(rhs.expr)),)
+
     if len(rhs_tuple) == 1:
         [rhs] = rhs_tuple
         if isinstance(lhs, str) and isinstance(rhs, str) and lhs == rhs:
@@ -190,10 +229,10 @@ def _process_var_expr_equation(lhs: Union[str, TupleExpansion], rhs_tuple: Tuple
         # Different number of args and no tuple expansion to consider.
         strategy = context.strategy
         if context.expanded_non_syntactically_comparable_expr:
-            raise UnificationAmbiguousException('Found expr tuples of different lengths with no tuple exprs: %s vs %s\nAfter expanding a non-syntactically-comparable expr:\n%s' % (
+            raise UnificationAmbiguousException(lambda: 'Found expr tuples of different lengths with no tuple exprs: %s vs %s\nAfter expanding a non-syntactically-comparable expr:\n%s' % (
                 exprs_to_string(strategy, (lhs,)), exprs_to_string(strategy, rhs_tuple), expr_to_string(strategy, context.expanded_non_syntactically_comparable_expr)))
         else:
-            raise UnificationFailedException('Found expr tuples of different lengths with no tuple exprs: %s vs %s' % (
+            raise UnificationFailedException(lambda: 'Found expr tuples of different lengths with no tuple exprs: %s vs %s' % (
                 exprs_to_string(strategy, (lhs,)), exprs_to_string(strategy, rhs_tuple)))
 
     if isinstance(lhs, str):
@@ -212,6 +251,10 @@ def _process_var_expr_equation(lhs: Union[str, TupleExpansion], rhs_tuple: Tuple
 
 
 def _process_term_term_equation(lhs: TermT, rhs: TermT, context: _UnificationContext):
+    if lhs is rhs:
+        # This is trivially true (even for terms that don't require syntactical equality), and all the equations that
+        # we'd deduce from the args would be trivial too.
+        return
     strategy = context.strategy
     expanding_non_syntactically_comparable_expr = None
     if not strategy.equality_requires_syntactical_equality(lhs):
@@ -221,59 +264,63 @@ def _process_term_term_equation(lhs: TermT, rhs: TermT, context: _UnificationCon
     if not strategy.is_same_term_excluding_args(lhs, rhs):
         if context.expanded_non_syntactically_comparable_expr or (
                 expanding_non_syntactically_comparable_expr and strategy.may_be_equal(lhs, rhs)):
-            raise UnificationAmbiguousException(
+            raise UnificationAmbiguousException(lambda:
                 'Found different terms (even excluding args):\n%s\n== vs ==\n%s\nAfter expanding a non-syntactically-comparable expr:\n%s' % (
                     strategy.term_to_string(lhs), strategy.term_to_string(rhs),
                     strategy.term_to_string(
                         context.expanded_non_syntactically_comparable_expr or expanding_non_syntactically_comparable_expr)))
         else:
-            raise UnificationFailedException('Found different terms (even excluding args):\n%s\n== vs ==\n%s' % (
+            raise UnificationFailedException(lambda: 'Found different terms (even excluding args):\n%s\n== vs ==\n%s' % (
                 strategy.term_to_string(lhs), strategy.term_to_string(rhs)))
     if not context.expanded_non_syntactically_comparable_expr:
         context.expanded_non_syntactically_comparable_expr = expanding_non_syntactically_comparable_expr
-    lhs_args = strategy.get_term_args(lhs)
-    rhs_args = strategy.get_term_args(rhs)
+    lhs_args = context.get_term_args(lhs)
+    rhs_args = context.get_term_args(rhs)
     context.expr_expr_equations.append((lhs_args, rhs_args))
 
+# Checks that var1 (the representative of its set of vars) doesn't occur in expr1 (taking into account the equations
+# deduced so far). Vars and terms that were already visited aren't visited again, so this is linear in the size of the
+# DAG of the exprs, even when the same vars/subterms are referenced many times.
 def _occurence_check(var1: str, expr1: _Expr, context: _UnificationContext):
     strategy = context.strategy
-    if isinstance(expr1, str):
-        var_expr_pairs_to_check = [(var1, expr1, None)]
-    elif isinstance(expr1, TupleExpansion):
+    if isinstance(expr1, TupleExpansion):
         if not context.expanded_non_syntactically_comparable_expr:
             context.expanded_non_syntactically_comparable_expr = expr1
-        var_expr_pairs_to_check = [(var1, expr1, context.expanded_non_syntactically_comparable_expr)]
-    else:
+    elif not isinstance(expr1, str):
         if not context.expanded_non_syntactically_comparable_expr and not strategy.equality_requires_syntactical_equality(expr1):
             context.expanded_non_syntactically_comparable_expr = expr1
-        var_expr_pairs_to_check = [(var1, expr1, context.expanded_non_syntactically_comparable_expr)]
 
-    while var_expr_pairs_to_check:
-        var, expr, only_expanded_terms_with_syntactical_equality = var_expr_pairs_to_check.pop()
+    visited_vars: Set[str] = set()
+    visited_term_ids: Set[int] = set()
+    exprs_to_check = [expr1]
+    while exprs_to_check:
+        expr = exprs_to_check.pop()
         if isinstance(expr, str):
-            if var == expr:
+            var = context.find(expr)
+            if var == var1:
                 if context.expanded_non_syntactically_comparable_expr:
-                    raise UnificationAmbiguousException("Ambiguous occurrence check for var %s while checking %s in %s with equations:\n%s\nSince the following non-syntactically-comparable expr has been expanded:\n%s" % (
-                        var,
+                    raise UnificationAmbiguousException(lambda: "Ambiguous occurrence check for var %s while checking %s in %s with equations:\n%s\nSince the following non-syntactically-comparable expr has been expanded:\n%s" % (
+                        expr,
                         var1,
                         expr_to_string(strategy, expr1),
                         {var: expr_to_string(strategy, expr)
                          for var, expr in context.var_expr_equations.items()},
                         expr_to_string(strategy, context.expanded_non_syntactically_comparable_expr)))
                 else:
-                    raise UnificationFailedException("Failed occurrence check for var %s while checking %s in %s with equations:\n%s" % (
-                        var, var1, expr_to_string(strategy, expr1), {var: expr_to_string(strategy, expr)
-                                                                     for var, expr in context.var_expr_equations.items()}))
-            if expr in context.var_expr_equations:
-                var_expr_pairs_to_check.append((var, context.var_expr_equations[expr], only_expanded_terms_with_syntactical_equality))
-            if expr in context.expanded_var_expr_equations:
-                for elem in context.var_expr_equations[expr]:
-                    var_expr_pairs_to_check.append((var, elem, only_expanded_terms_with_syntactical_equality))
-            if expr in context.context_var_expr_equations:
-                var_expr_pairs_to_check.append((var, context.context_var_expr_equations[expr], only_expanded_terms_with_syntactical_equality))
+                    raise UnificationFailedException(lambda: "Failed occurrence check for var %s while checking %s in %s with equations:\n%s" % (
+                        expr, var1, expr_to_string(strategy, expr1), {var: expr_to_string(strategy, expr)
+                                                                      for var, expr in context.var_expr_equations.items()}))
+            if var in visited_vars:
+                continue
+            visited_vars.add(var)
+            if var in context.var_expr_equations:
+                exprs_to_check.append(context.var_expr_equations[var])
+            if var in context.expanded_var_expr_equations:
+                exprs_to_check.extend(context.expanded_var_expr_equations[var])
+            if var in context.context_var_expr_equations:
+                exprs_to_check.append(context.context_var_expr_equations[var])
         elif isinstance(expr, TupleExpansion):
-            var_expr_pairs_to_check.append((var, expr.expr, False))
-        else:
-            is_term_with_syntactical_equality = strategy.equality_requires_syntactical_equality(expr)
-            for arg in strategy.get_term_args(expr):
-                var_expr_pairs_to_check.append((var, arg, only_expanded_terms_with_syntactical_equality and is_term_with_syntactical_equality))
+            exprs_to_check.append(expr.expr)
+        elif id(expr) not in visited_term_ids:
+            visited_term_ids.add(id(expr))
+            exprs_to_check.extend(context.get_term_args(expr))
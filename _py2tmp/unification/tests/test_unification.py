@@ -548,5 +548,32 @@ def test_unify_tuples_many_to_many_tuple_vars_ok_if_same(canonicalize):
     ], canonicalize)
     assert equations == {}
 
+@pytest.mark.parametrize('canonicalize', [True, False])
+def test_unify_long_chain_of_variable_equalities(canonicalize):
+    equations = unify([
+        ('x1', Term('f', ('y',))),
+        *(('x%s' % (i + 1), 'x%s' % i) for i in range(1, 30)),
+        ('x30', Term('f', ('z',))),
+    ], canonicalize)
+    assert equations['y'] == 'z'
+
+def _term_with_shared_subterms(var: str, depth: int):
+    # The tree of this term has 2^depth leaves, but there are only depth+1 distinct subterms.
+    term = var
+    for _ in range(depth):
+        term = Term('f', (term, term))
+    return term
+
+def test_unify_occurrence_check_with_shared_subterms_ok():
+    term = _term_with_shared_subterms('y', depth=60)
+    var_expr_equations, expanded_var_expr_equations = _unification.unify([('x', term)], dict(), ExampleUnificationStrategy([]))
+    assert var_expr_equations == {'x': term}
+    assert expanded_var_expr_equations == {}
+
+def test_unify_occurrence_check_with_shared_subterms_error():
+    term = _term_with_shared_subterms('x', depth=60)
+    with pytest.raises(UnificationFailedException):
+        _unification.unify([('x', Term('g', (term,)))], dict(), ExampleUnificationStrategy([]))
+
 if __name__== '__main__':
     main()
@@ -13,6 +13,7 @@
 # limitations under the License.
 
 from ._ast_to_string import ast_to_string
-from ._clang_format import clang_format
-from ._graphs import compute_condensation_in_topological_order
+from ._clang_format import clang_format, is_clang_format_available
+from ._graphs import DependencyGraph, compute_condensation_in_topological_order
 from ._ir_to_string import ir_to_string
+from ._lazy_mapping import LazyMapping
@@ -11,8 +11,13 @@
 # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 # See the License for the specific language governing permissions and
 # limitations under the License.
+import shutil
 import subprocess
+from functools import lru_cache
 
+@lru_cache()
+def is_clang_format_available() -> bool:
+    return shutil.which('clang-format') is not None
 
 def clang_format(cxx_source: str, code_style='LLVM') -> str:
     command = ['clang-format',
@@ -11,15 +11,238 @@
 # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 # See the License for the specific language governing permissions and
 # limitations under the License.
-import networkx as nx
 
+import heapq
+from typing import Hashable, List, Dict, Optional, Iterator, Set, Sequence, Callable, Any
 
-def compute_condensation_in_topological_order(dependency_graph: nx.DiGraph, sort_by = lambda x: x):
-    if not dependency_graph.number_of_nodes():
-        return
 
-    condensed_graph = nx.condensation(dependency_graph)
-    assert isinstance(condensed_graph, nx.DiGraph)
+class _Condensation:
+    def __init__(self, successor_ids_by_node_id: List[Dict[int, None]]):
+        num_nodes = len(successor_ids_by_node_id)
+        # The strongly connected components, in the order in which Tarjan's algorithm finds them: each component only
+        # depends on itself and on the ones before it.
+        self.member_ids_by_component: List[List[int]] = []
+        self.component_by_node_id: List[int] = [-1] * num_nodes
 
-    for connected_component_index in nx.lexicographical_topological_sort(condensed_graph, key=sort_by):
-        yield list(sorted(condensed_graph.nodes[connected_component_index]['members'], key=sort_by))
\ No newline at end of file
+        # An iterative version of Tarjan's algorithm.
+        index_by_node_id = [-1] * num_nodes
+        lowlink_by_node_id = [0] * num_nodes
+        is_on_stack = [False] * num_nodes
+        stack: List[int] = []
+        next_index = 0
+        for root_id in range(num_nodes):
+            if index_by_node_id[root_id] >= 0:
+                continue
+            index_by_node_id[root_id] = lowlink_by_node_id[root_id] = next_index
+            next_index += 1
+            stack.append(root_id)
+            is_on_stack[root_id] = True
+            dfs_stack = [(root_id, iter(successor_ids_by_node_id[root_id]))]
+            while dfs_stack:
+                node_id, successor_ids = dfs_stack[-1]
+                for successor_id in successor_ids:
+                    if index_by_node_id[successor_id] < 0:
+                        index_by_node_id[successor_id] = lowlink_by_node_id[successor_id] = next_index
+                        next_index += 1
+                        stack.append(successor_id)
+                        is_on_stack[successor_id] = True
+                        dfs_stack.append((successor_id, iter(successor_ids_by_node_id[successor_id])))
+                        break
+                    elif is_on_stack[successor_id]:
+                        lowlink_by_node_id[node_id] = min(lowlink_by_node_id[node_id], index_by_node_id[successor_id])
+                else:
+                    dfs_stack.pop()
+                    if dfs_stack:
+                        parent_id = dfs_stack[-1][0]
+                        lowlink_by_node_id[parent_id] = min(lowlink_by_node_id[parent_id], lowlink_by_node_id[node_id])
+                    if lowlink_by_node_id[node_id] == index_by_node_id[node_id]:
+                        component = len(self.member_ids_by_component)
+                        member_ids = []
+                        while True:
+                            member_id = stack.pop()
+                            is_on_stack[member_id] = False
+                            self.component_by_node_id[member_id] = component
+                            member_ids.append(member_id)
+                            if member_id == node_id:
+                                break
+                        self.member_ids_by_component.append(member_ids)
+
+        self.successor_components_by_component: List[Dict[int, None]] = [dict() for _ in self.member_ids_by_component]
+        self.has_cycle_by_component = [len(member_ids) > 1 for member_ids in self.member_ids_by_component]
+        for node_id, successor_ids in enumerate(successor_ids_by_node_id):
+            component = self.component_by_node_id[node_id]
+            for successor_id in successor_ids:
+                successor_component = self.component_by_node_id[successor_id]
+                if successor_component == component:
+                    # A self-loop, or an edge within a component with >1 nodes.
+                    self.has_cycle_by_component[component] = True
+                else:
+                    self.successor_components_by_component[component][successor_component] = None
+
+        # For each component, the bitset of the other components reachable from it. These are only computed when needed.
+        self._reachable_components_bitset_by_component: List[Optional[int]] = [None] * len(self.member_ids_by_component)
+
+    def compute_reachable_components_bitset(self, component: int) -> int:
+        bitsets = self._reachable_components_bitset_by_component
+        if bitsets[component] is None:
+            # The successors of a component always come before it, so we can compute the bitsets of the components in
+            # the order in which they're popped (without recursion, since there can be very long dependency chains).
+            components_to_process = [component]
+            while components_to_process:
+                current_component = components_to_process[-1]
+                if bitsets[current_component] is not None:
+                    components_to_process.pop()
+                    continue
+                successor_components = self.successor_components_by_component[current_component]
+                missing_successor_components = [successor_component
+                                                for successor_component in successor_components
+                                                if bitsets[successor_component] is None]
+                if missing_successor_components:
+                    components_to_process.extend(missing_successor_components)
+                    continue
+                bitset = 0
+                for successor_component in successor_components:
+                    bitset |= bitsets[successor_component] | (1 << successor_component)
+                bitsets[current_component] = bitset
+                components_to_process.pop()
+        return bitsets[component]
+
+# A directed graph where an edge a->b means that a depends on b (e.g. a template that references another template).
+# The nodes are stored with integer ids, so that the strongly connected components and the reachability information
+# (a bitset of the reachable components, computed lazily for each component) are cheap to compute and to store.
+# The nodes, and the successors of each node, are kept in insertion order so that all the results are deterministic.
+class DependencyGraph:
+    def __init__(self):
+        self._nodes: List[Hashable] = []
+        self._id_by_node: Dict[Hashable, int] = dict()
+        self._successor_ids_by_node_id: List[Dict[int, None]] = []
+        self._in_degree_by_node_id: List[int] = []
+        # Only computed when needed, and reset when the graph changes.
+        self._condensation: Optional[_Condensation] = None
+
+    def add_node(self, node: Hashable):
+        self._add_node(node)
+
+    def _add_node(self, node: Hashable):
+        node_id = self._id_by_node.get(node)
+        if node_id is None:
+            node_id = len(self._nodes)
+            self._nodes.append(node)
+            self._id_by_node[node] = node_id
+            self._successor_ids_by_node_id.append(dict())
+            self._in_degree_by_node_id.append(0)
+            self._condensation = None
+        return node_id
+
+    def add_edge(self, source: Hashable, target: Hashable):
+        source_id = self._add_node(source)
+        target_id = self._add_node(target)
+        successor_ids = self._successor_ids_by_node_id[source_id]
+        if target_id not in successor_ids:
+            successor_ids[target_id] = None
+            self._in_degree_by_node_id[target_id] += 1
+            self._condensation = None
+
+    def remove_edge(self, source: Hashable, target: Hashable):
+        target_id = self._id_by_node[target]
+        del self._successor_ids_by_node_id[self._id_by_node[source]][target_id]
+        self._in_degree_by_node_id[target_id] -= 1
+        self._condensation = None
+
+    @property
+    def nodes(self) -> Sequence[Hashable]:
+        return self._nodes
+
+    def number_of_nodes(self):
+        return len(self._nodes)
+
+    def has_node(self, node: Hashable):
+        return node in self._id_by_node
+
+    def successors(self, node: Hashable) -> Iterator[Hashable]:
+        return (self._nodes[successor_id]
+                for successor_id in self._successor_ids_by_node_id[self._id_by_node[node]])
+
+    def in_degree(self, node: Hashable):
+        return self._in_degree_by_node_id[self._id_by_node[node]]
+
+    def _get_condensation(self):
+        if self._condensation is None:
+            self._condensation = _Condensation(self._successor_ids_by_node_id)
+        return self._condensation
+
+    def _nodes_in_components(self, components_bitset: int) -> Set[Hashable]:
+        condensation = self._get_condensation()
+        result = set()
+        while components_bitset:
+            lowest_bit = components_bitset & -components_bitset
+            components_bitset ^= lowest_bit
+            result.update(self._nodes[member_id]
+                          for member_id in condensation.member_ids_by_component[lowest_bit.bit_length() - 1])
+        return result
+
+    def strongly_connected_components(self) -> List[List[Hashable]]:
+        # Each component only depends on itself and on the ones before it.
+        return [[self._nodes[member_id] for member_id in member_ids]
+                for member_ids in self._get_condensation().member_ids_by_component]
+
+    def descendants(self, node: Hashable) -> Set[Hashable]:
+        # The nodes reachable from this node with a path of at least 1 edge. So this node is included only if it's in a
+        # cycle.
+        condensation = self._get_condensation()
+        component = condensation.component_by_node_id[self._id_by_node[node]]
+        components_bitset = condensation.compute_reachable_components_bitset(component)
+        if condensation.has_cycle_by_component[component]:
+            components_bitset |= 1 << component
+        return self._nodes_in_components(components_bitset)
+
+    def descendants_outside_strongly_connected_component(self, node: Hashable) -> Set[Hashable]:
+        # The nodes reachable from this node that can't reach it.
+        condensation = self._get_condensation()
+        component = condensation.component_by_node_id[self._id_by_node[node]]
+        return self._nodes_in_components(condensation.compute_reachable_components_bitset(component))
+
+    def condensation_in_topological_order(self, sort_by: Callable[[Hashable], Any] = lambda x: x) -> Iterator[List[Hashable]]:
+        # The strongly connected components, each one before the ones it depends on. Among the ones that can come next,
+        # the component found first by Tarjan's algorithm comes first.
+        condensation = self._get_condensation()
+        num_predecessors_by_component = [0] * len(condensation.member_ids_by_component)
+        for successor_components in condensation.successor_components_by_component:
+            for successor_component in successor_components:
+                num_predecessors_by_component[successor_component] += 1
+        ready_components = [component
+                            for component, num_predecessors in enumerate(num_predecessors_by_component)
+                            if num_predecessors == 0]
+        heapq.heapify(ready_components)
+        while ready_components:
+            component = heapq.heappop(ready_components)
+            yield sorted((self._nodes[member_id] for member_id in condensation.member_ids_by_component[component]),
+                         key=sort_by)
+            for successor_component in condensation.successor_components_by_component[component]:
+                num_predecessors_by_component[successor_component] -= 1
+                if num_predecessors_by_component[successor_component] == 0:
+                    heapq.heappush(ready_components, successor_component)
+
+    def lexicographical_topological_sort(self, key: Callable[[Hashable], Any] = lambda x: x) -> Iterator[Hashable]:
+        # Each node comes before the ones it depends on. Among the nodes that can come next, the one with the smallest
+        # key comes first. The graph must be acyclic.
+        num_predecessors_by_node_id = list(self._in_degree_by_node_id)
+        ready_nodes = [(key(self._nodes[node_id]), node_id)
+                       for node_id, num_predecessors in enumerate(num_predecessors_by_node_id)
+                       if num_predecessors == 0]
+        heapq.heapify(ready_nodes)
+        num_sorted_nodes = 0
+        while ready_nodes:
+            _, node_id = heapq.heappop(ready_nodes)
+            num_sorted_nodes += 1
+            yield self._nodes[node_id]
+            for successor_id in self._successor_ids_by_node_id[node_id]:
+                num_predecessors_by_node_id[successor_id] -= 1
+                if num_predecessors_by_node_id[successor_id] == 0:
+                    heapq.heappush(ready_nodes, (key(self._nodes[successor_id]), successor_id))
+        if num_sorted_nodes != len(self._nodes):
+            raise ValueError('The graph has a cycle, so it can\'t be sorted topologically')
+
+
+def compute_condensation_in_topological_order(dependency_graph: DependencyGraph, sort_by = lambda x: x):
+    return dependency_graph.condensation_in_topological_order(sort_by)
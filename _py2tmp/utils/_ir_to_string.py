@@ -30,5 +30,7 @@ def ir_to_string(ir_elem, line_indent=''):
         return (ir_elem.__class__.__name__
                 + '('
                 + ','.join('\n' + next_line_indent + field_name + ' = ' + ir_to_string(child_node, next_line_indent)
-                           for field_name, child_node in ir_elem.__dict__.items())
+                           for field_name, child_node in ir_elem.__dict__.items()
+                           # Skip private attributes, e.g. memoized values.
+                           if not field_name.startswith('_'))
                 + ')')
\ No newline at end of file
@@ -0,0 +1,47 @@
+#  Copyright 2017 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS-IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+from typing import Mapping, Iterable, Callable, TypeVar, Dict, Iterator
+
+K = TypeVar('K')
+V = TypeVar('V')
+
+# A read-only mapping with a fixed set of keys, where the value for a key is only computed (and then cached) when it's
+# first looked up.
+class LazyMapping(Mapping[K, V]):
+    def __init__(self, keys: Iterable[K], compute_value: Callable[[K], V]):
+        # A dict (instead of a set) to keep the iteration order deterministic.
+        self._keys: Dict[K, None] = dict.fromkeys(keys)
+        self._compute_value = compute_value
+        self._values: Dict[K, V] = dict()
+
+    def __getitem__(self, key: K) -> V:
+        try:
+            return self._values[key]
+        except KeyError:
+            pass
+        if key not in self._keys:
+            raise KeyError(key)
+        value = self._compute_value(key)
+        self._values[key] = value
+        return value
+
+    def __contains__(self, key) -> bool:
+        # The default implementation would compute the value.
+        return key in self._keys
+
+    def __iter__(self) -> Iterator[K]:
+        return iter(self._keys)
+
+    def __len__(self) -> int:
+        return len(self._keys)
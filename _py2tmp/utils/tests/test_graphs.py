@@ -0,0 +1,68 @@
+#  Copyright 2017 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS-IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+import pytest
+
+from _py2tmp.compiler.testing import main
+from _py2tmp.utils import DependencyGraph, compute_condensation_in_topological_order
+
+
+def _graph(*edges: str):
+    graph = DependencyGraph()
+    for edge in edges:
+        source, target = edge.split('->')
+        graph.add_edge(source, target)
+    return graph
+
+def test_strongly_connected_components():
+    graph = _graph('a->b', 'b->c', 'c->b', 'c->d', 'e->e')
+    graph.add_node('f')
+    assert graph.strongly_connected_components() == [['d'], ['c', 'b'], ['a'], ['e'], ['f']]
+    assert list(compute_condensation_in_topological_order(graph)) == [['a'], ['b', 'c'], ['d'], ['e'], ['f']]
+
+def test_descendants():
+    graph = _graph('a->b', 'b->c', 'c->b', 'c->d', 'e->e', 'e->a')
+    assert graph.descendants('a') == {'b', 'c', 'd'}
+    assert graph.descendants('b') == {'b', 'c', 'd'}
+    assert graph.descendants('d') == set()
+    assert graph.descendants('e') == {'a', 'b', 'c', 'd', 'e'}
+    assert graph.descendants_outside_strongly_connected_component('b') == {'d'}
+    assert graph.descendants_outside_strongly_connected_component('e') == {'a', 'b', 'c', 'd'}
+
+def test_descendants_updated_after_adding_an_edge():
+    graph = _graph('a->b', 'c->d')
+    assert graph.descendants('a') == {'b'}
+    graph.add_edge('b', 'c')
+    assert graph.descendants('a') == {'b', 'c', 'd'}
+
+def test_descendants_long_chain():
+    graph = DependencyGraph()
+    for i in range(10000):
+        graph.add_edge(i, i + 1)
+    assert graph.descendants(0) == set(range(1, 10001))
+
+def test_lexicographical_topological_sort():
+    graph = _graph('b->a', 'c->a', 'd->c')
+    assert graph.in_degree('a') == 2
+    assert list(graph.lexicographical_topological_sort()) == ['b', 'd', 'c', 'a']
+    graph.remove_edge('c', 'a')
+    assert graph.in_degree('a') == 1
+    assert list(graph.lexicographical_topological_sort()) == ['b', 'a', 'd', 'c']
+
+def test_lexicographical_topological_sort_with_cycle_error():
+    graph = _graph('a->b', 'b->a')
+    with pytest.raises(ValueError):
+        list(graph.lexicographical_topological_sort())
+
+if __name__== '__main__':
+    main()
@@ -12,7 +12,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from typing import Type, List, Set, TypeVar
+from typing import Type, List, Set, TypeVar, Iterable, Callable, Optional
 
 T = TypeVar('T')
 
@@ -21,3 +21,13 @@ def empty_list(t: Type[T]) -> List[T]:
 
 def empty_set(t: Type[T]) -> Set[T]:
     return set()
+
+def unique(l: Iterable[T], key: Optional[Callable[[T], int]] = None) -> List[T]:
+    result = []
+    seen_keys = set()
+    for elem in sorted(l, key=key):
+        elem_key = key(elem) if key else elem
+        if elem_key not in seen_keys:
+            seen_keys.add(elem_key)
+            result.append(elem)
+    return result
@@ -0,0 +1,438 @@
+#  Copyright 2017 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS-IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Measures how the compilation of the C++ code generated by TMPPy scales with the size of the input.
+#
+# Each benchmark generates a TMPPy program (and C++ code that uses it) for a few increasing sizes (e.g. the length of
+# a list). The programs are converted to C++ with and without the IR0 optimizations, and the result is compiled with
+# each of the specified C++ compilers, recording:
+# * The time taken by TMPPy to convert the program to C++.
+# * The compile time (user+sys) and the peak RSS of the compiler, minus the ones of a file that only includes tmppy.h.
+# * The number of template instantiations (also minus the ones in tmppy.h). This is only available with Clang, from the
+#   -ftime-trace output.
+# * The template instantiation time reported by GCC with -ftime-report.
+# Each compilation is repeated (--repetitions) and the min of each metric is used, to reduce the noise.
+#
+# Two kinds of regression checks are done:
+# * The growth exponent of each metric between the two largest sizes must not exceed the one declared in the
+#   benchmark, e.g. an exponent of 1.2 means that doubling the size can multiply the metric by at most 2**1.2. This
+#   catches changes in the asymptotic behavior, that the small tests can't detect.
+# * If a baseline (the JSON written by a previous run, with --output) is specified, each metric must not be more than
+#   --max_regression (as a fraction) worse than in the baseline.
+# The exit code is 1 if any check fails.
+
+import argparse
+import json
+import math
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+from dataclasses import dataclass
+from typing import Callable, Tuple, Dict, List, Optional, Any
+
+from _py2tmp.compiler._compile import compile_source_code
+from _py2tmp.compiler._link import link
+from _py2tmp.compiler.output_files import load_object_files
+from _py2tmp.ir0_optimization import ConfigurationKnobs
+from py2tmp.time_trace_report import parse_gcc_time_report
+
+_DEFAULT_INCLUDE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', 'include')
+_MODULE_NAME = 'benchmark'
+_HEADER_INCLUDE = '#include "benchmark.h"\n'
+
+# Below these values, the measurements are dominated by noise, so they're not used for the regression checks.
+_MIN_SIGNIFICANT_VALUE_BY_METRIC = {
+    'conversion_time_s': 0.2,
+    'compile_time_s': 0.1,
+    'peak_rss_mb': 5,
+    'num_instantiations': 100,
+    'template_instantiation_time_s': 0.2,
+}
+
+@dataclass(frozen=True)
+class Benchmark:
+    name: str
+    description: str
+    # Sorted in increasing order. The growth exponents are computed between the last two.
+    sizes: Tuple[int, ...]
+    # Returns the TMPPy source for the given size.
+    generate_tmppy_source: Callable[[int], str]
+    # Returns the C++ source that uses the generated header (benchmark.h) for the given size.
+    generate_cpp_source: Callable[[int], str]
+    # The max growth exponent of each metric, for the optimized code. Metrics not listed here are not checked.
+    max_growth_exponent_by_metric: Dict[str, float]
+    # The additional compiler flags used for the given size.
+    generate_compiler_flags: Callable[[int], Tuple[str, ...]] = lambda size: ()
+
+def _list_elems(size: int):
+    # A deterministic sequence that is not already sorted.
+    return [(i * 7919) % (2 * size + 1) for i in range(size)]
+
+def _int64_list(elems: List[int]):
+    return 'Int64List<%s>' % ', '.join('%sLL' % elem for elem in elems)
+
+def _list_length_cpp_source(size: int):
+    elems = _list_elems(size)
+    return _HEADER_INCLUDE + 'static_assert(f<%s>::value == %sLL, "");\n' % (
+        _int64_list(elems), sum(elem * 3 for elem in elems) + elems[-1] + min(elems))
+
+def _set_size_cpp_source(size: int):
+    elems = sorted(set(_list_elems(size)))
+    return _HEADER_INCLUDE + 'static_assert(f<%s>::value == %sLL, "");\n' % (
+        _int64_list(elems), sum(set(elem // 2 for elem in elems)))
+
+def _specializations_tmppy_source(size: int):
+    return ('from tmppy import Type, match\n'
+            'def f(x: Type) -> int:\n'
+            '    return match(x)(lambda T: {\n'
+            + ''.join('        Type.template_instantiation(\'Holder%s\', [T]): %s,\n' % (i, i) for i in range(size))
+            + '        T: -1,\n'
+            '    })\n')
+
+def _specializations_cpp_source(size: int):
+    return (''.join('template <typename> struct Holder%s {};\n' % i for i in range(size))
+            + _HEADER_INCLUDE
+            + ''.join('static_assert(f<Holder%s<int>>::value == %s, "");\n' % (i, i) for i in range(size)))
+
+def _match_arms_tmppy_source(size: int):
+    return ('from tmppy import Type, match\n'
+            'def f(x: Type) -> int:\n'
+            '    return match(x)(lambda T: {\n'
+            + ''.join('        Type(\'Tag%s\'): %s,\n' % (i, i) for i in range(size))
+            + '        T: -1,\n'
+            '    })\n')
+
+def _match_arms_cpp_source(size: int):
+    return (''.join('struct Tag%s {};\n' % i for i in range(size))
+            + _HEADER_INCLUDE
+            + ''.join('static_assert(f<Tag%s>::value == %s, "");\n' % (i, i) for i in range(size)))
+
+BENCHMARKS = (
+    Benchmark(name='list_length',
+              description='A list comprehension, sum(), an index and sorted() on a list with the given length',
+              sizes=(250, 500, 1000, 2000),
+              generate_tmppy_source=lambda size: ('from typing import List\n'
+                                                  'def f(l: List[int]) -> int:\n'
+                                                  '    return sum([x * 3 for x in l]) + l[-1] + sorted(l)[0]\n'),
+              generate_cpp_source=_list_length_cpp_source,
+              max_growth_exponent_by_metric={'conversion_time_s': 1.5,
+                                             'compile_time_s': 1.7,
+                                             'peak_rss_mb': 1.5,
+                                             'num_instantiations': 1.3}),
+    Benchmark(name='set_size',
+              description='A set comprehension (with duplicate results) and sum() on a set with the given size',
+              sizes=(100, 200, 400, 800),
+              generate_tmppy_source=lambda size: ('from typing import Set\n'
+                                                  'def f(s: Set[int]) -> int:\n'
+                                                  '    return sum({x // 2 for x in s})\n'),
+              generate_cpp_source=_set_size_cpp_source,
+              max_growth_exponent_by_metric={'conversion_time_s': 1.5,
+                                             'compile_time_s': 2.5,
+                                             'peak_rss_mb': 2.5,
+                                             'num_instantiations': 1.3}),
+    Benchmark(name='recursion_depth',
+              description='A function that calls itself recursively, with the given recursion depth',
+              sizes=(400, 800, 1600, 3200),
+              generate_tmppy_source=lambda size: ('def f(n: int) -> int:\n'
+                                                  '    if n == 0:\n'
+                                                  '        return 0\n'
+                                                  '    else:\n'
+                                                  '        return f(n - 1) + 2\n'),
+              generate_cpp_source=lambda size: _HEADER_INCLUDE + 'static_assert(f<%s>::value == %s, "");\n' % (
+                  size, 2 * size),
+              max_growth_exponent_by_metric={'conversion_time_s': 1.5,
+                                             'compile_time_s': 1.5,
+                                             'peak_rss_mb': 1.5,
+                                             'num_instantiations': 1.2},
+              generate_compiler_flags=lambda size: ('-ftemplate-depth=%s' % (10 * size + 1000),)),
+    Benchmark(name='specializations',
+              description='A match() with the given number of template instantiation patterns, called for each of them',
+              sizes=(100, 200, 400, 800),
+              generate_tmppy_source=_specializations_tmppy_source,
+              generate_cpp_source=_specializations_cpp_source,
+              max_growth_exponent_by_metric={'conversion_time_s': 1.5,
+                                             'compile_time_s': 2.2,
+                                             'peak_rss_mb': 2.2,
+                                             'num_instantiations': 1.2}),
+    Benchmark(name='match_arms',
+              description='A match() with the given number of atomic type patterns, called for each of them',
+              sizes=(100, 200, 400, 800),
+              generate_tmppy_source=_match_arms_tmppy_source,
+              generate_cpp_source=_match_arms_cpp_source,
+              max_growth_exponent_by_metric={'conversion_time_s': 1.5,
+                                             'compile_time_s': 2.2,
+                                             'peak_rss_mb': 2.2,
+                                             'num_instantiations': 1.2}),
+)
+
+@dataclass(frozen=True)
+class Compiler:
+    executable: str
+    # 'GCC' or 'Clang'.
+    kind: str
+    version: str
+
+def detect_compiler(executable: str):
+    version_output = subprocess.run([executable, '--version'],
+                                    stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True,
+                                    check=True).stdout
+    kind = 'Clang' if 'clang' in version_output.lower() else 'GCC'
+    return Compiler(executable=executable, kind=kind, version=version_output.splitlines()[0])
+
+def convert_to_cpp(tmppy_source: str, builtins_path: str, optimized: bool):
+    ConfigurationKnobs.max_num_optimization_steps = -1 if optimized else 0
+    try:
+        object_file_content = compile_source_code(module_name=_MODULE_NAME,
+                                                  source_code=tmppy_source,
+                                                  context_object_file_content=load_object_files((builtins_path,)),
+                                                  include_intermediate_irs_for_debugging=False,
+                                                  coverage_collection_enabled=False)
+        return link(_MODULE_NAME, object_file_content, coverage_collection_enabled=False, use_clang_format=False)
+    finally:
+        ConfigurationKnobs.max_num_optimization_steps = -1
+
+def _run_and_measure(command: List[str], cwd: str):
+    with tempfile.TemporaryFile(mode='w+') as output_file:
+        process = subprocess.Popen(command, stdout=output_file, stderr=subprocess.STDOUT, cwd=cwd)
+        # Unlike subprocess.run(), this gives the resource usage of this specific child.
+        _, status, rusage = os.wait4(process.pid, 0)
+        process.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1
+        output_file.seek(0)
+        output = output_file.read()
+    if process.returncode != 0:
+        raise Exception('Command failed: %s\nOutput:\n%s' % (' '.join(command), output))
+    # ru_maxrss is in bytes on macOS and in KB elsewhere.
+    peak_rss_mb = rusage.ru_maxrss / (1024 * 1024 if sys.platform == 'darwin' else 1024)
+    return rusage.ru_utime + rusage.ru_stime, peak_rss_mb, output
+
+def compile_cpp(compiler: Compiler, cpp_source: str, include_dir: str, additional_flags: Tuple[str, ...],
+                work_dir: str) -> Dict[str, Optional[float]]:
+    source_file_name = os.path.join(work_dir, 'main.cpp')
+    object_file_name = os.path.join(work_dir, 'main.o')
+    with open(source_file_name, 'w') as file:
+        file.write(cpp_source)
+    command = [compiler.executable, '-std=c++11', '-g0', '-I' + include_dir, '-I' + work_dir, *additional_flags]
+    if compiler.kind == 'Clang':
+        # With the default granularity, the trace only contains the instantiations that take more than 500us.
+        command += ['-ftime-trace', '-ftime-trace-granularity=0']
+    else:
+        command += ['-ftime-report']
+    command += ['-c', source_file_name, '-o', object_file_name]
+
+    compile_time, peak_rss_mb, output = _run_and_measure(command, cwd=work_dir)
+
+    num_instantiations = None
+    template_instantiation_time = None
+    if compiler.kind == 'Clang':
+        with open(os.path.join(work_dir, 'main.json')) as file:
+            trace_events = json.load(file)['traceEvents']
+        num_instantiations = sum(1
+                                 for event in trace_events
+                                 if event.get('ph') == 'X' and event.get('name') in ('InstantiateClass', 'InstantiateFunction'))
+    else:
+        template_instantiation_time = parse_gcc_time_report(output)
+    return {
+        'compile_time_s': compile_time,
+        'peak_rss_mb': peak_rss_mb,
+        'num_instantiations': num_instantiations,
+        'template_instantiation_time_s': template_instantiation_time,
+    }
+
+# The metrics that include the cost of parsing tmppy.h (and instantiating the templates used there).
+_METRICS_WITH_BASELINE = ('compile_time_s', 'peak_rss_mb', 'num_instantiations')
+
+def _subtract_baseline(metrics: Dict[str, Optional[float]], baseline_metrics: Dict[str, Optional[float]]):
+    return {metric: (value - baseline_metrics[metric]
+                     if metric in _METRICS_WITH_BASELINE and value is not None and baseline_metrics[metric] is not None
+                     else value)
+            for metric, value in metrics.items()}
+
+def compile_cpp_repeatedly(compiler: Compiler, cpp_source: str, include_dir: str, additional_flags: Tuple[str, ...],
+                           header: str, repetitions: int):
+    metrics_list = []
+    for _ in range(repetitions):
+        work_dir = tempfile.mkdtemp(prefix='tmppy_benchmark_')
+        try:
+            with open(os.path.join(work_dir, 'benchmark.h'), 'w') as file:
+                file.write(header)
+            metrics_list.append(compile_cpp(compiler, cpp_source, include_dir, additional_flags, work_dir))
+        finally:
+            shutil.rmtree(work_dir)
+    min_metrics = {}
+    for metric in metrics_list[0]:
+        values = [metrics[metric] for metrics in metrics_list if metrics[metric] is not None]
+        min_metrics[metric] = min(values) if values else None
+    return min_metrics
+
+def run_benchmark(benchmark: Benchmark, compilers: List[Compiler], builtins_path: str, include_dir: str,
+                  baseline_metrics_by_compiler: Dict[str, Dict[str, Optional[float]]], repetitions: int):
+    results = []
+    for size in benchmark.sizes:
+        tmppy_source = benchmark.generate_tmppy_source(size)
+        for optimized in (True, False):
+            start_time = time.time()
+            header = convert_to_cpp(tmppy_source, builtins_path, optimized)
+            conversion_time = time.time() - start_time
+            for compiler in compilers:
+                metrics = compile_cpp_repeatedly(compiler,
+                                                 benchmark.generate_cpp_source(size),
+                                                 include_dir,
+                                                 benchmark.generate_compiler_flags(size),
+                                                 header,
+                                                 repetitions)
+                result = {
+                    'benchmark': benchmark.name,
+                    'size': size,
+                    'optimized': optimized,
+                    'compiler': compiler.executable,
+                    'header_size_bytes': len(header),
+                    'conversion_time_s': conversion_time,
+                    **_subtract_baseline(metrics, baseline_metrics_by_compiler[compiler.executable]),
+                }
+                print('%-16s size=%-5s %-11s %-5s conversion: %7.3fs compile: %7.3fs %8.1fMB instantiations: %s' % (
+                    benchmark.name, size, 'optimized' if optimized else 'unoptimized', compiler.kind,
+                    conversion_time, result['compile_time_s'], result['peak_rss_mb'], result['num_instantiations']),
+                      flush=True)
+                results.append(result)
+    return results
+
+def _is_significant(metric: str, value: Optional[float]):
+    return value is not None and value >= _MIN_SIGNIFICANT_VALUE_BY_METRIC[metric]
+
+def check_growth_exponents(benchmark: Benchmark, results: List[Dict[str, Any]], compilers: List[Compiler]):
+    violations = []
+    if len(benchmark.sizes) < 2:
+        return violations
+    smaller_size, larger_size = benchmark.sizes[-2:]
+    for compiler in compilers:
+        result_by_size = {result['size']: result
+                          for result in results
+                          if result['compiler'] == compiler.executable and result['optimized']}
+        for metric, max_exponent in benchmark.max_growth_exponent_by_metric.items():
+            smaller_value = result_by_size[smaller_size][metric]
+            larger_value = result_by_size[larger_size][metric]
+            if not (_is_significant(metric, smaller_value) and _is_significant(metric, larger_value)):
+                continue
+            exponent = math.log(larger_value / smaller_value) / math.log(larger_size / smaller_size)
+            if exponent > max_exponent:
+                violations.append('%s (%s): %s grows as size**%.2f between the sizes %s and %s (%s -> %s), but the '
+                                  'limit is size**%s' % (benchmark.name, compiler.kind, metric, exponent, smaller_size,
+                                                         larger_size, smaller_value, larger_value, max_exponent))
+    return violations
+
+def check_against_baseline(results: List[Dict[str, Any]], baseline_results: List[Dict[str, Any]], max_regression: float):
+    def key(result: Dict[str, Any]):
+        return result['benchmark'], result['size'], result['optimized'], result['compiler']
+    baseline_result_by_key = {key(result): result for result in baseline_results}
+
+    violations = []
+    for result in results:
+        baseline_result = baseline_result_by_key.get(key(result))
+        if baseline_result is None:
+            continue
+        for metric in _MIN_SIGNIFICANT_VALUE_BY_METRIC:
+            value = result[metric]
+            baseline_value = baseline_result.get(metric)
+            if not (_is_significant(metric, value) and _is_significant(metric, baseline_value)):
+                continue
+            if value > baseline_value * (1 + max_regression):
+                violations.append('%s (size=%s, %s, %s): %s regressed from %s to %s' % (
+                    result['benchmark'], result['size'], 'optimized' if result['optimized'] else 'unoptimized',
+                    result['compiler'], metric, baseline_value, value))
+    return violations
+
+def main(builtins_path: str,
+         include_dir: str,
+         compiler_executables: List[str],
+         benchmark_names: Optional[List[str]],
+         output_file: Optional[str],
+         baseline_file: Optional[str],
+         max_regression: float,
+         repetitions: int):
+    benchmarks = [benchmark
+                  for benchmark in BENCHMARKS
+                  if benchmark_names is None or benchmark.name in benchmark_names]
+    unknown_benchmark_names = set(benchmark_names or ()) - {benchmark.name for benchmark in BENCHMARKS}
+    if unknown_benchmark_names:
+        raise Exception('Unknown benchmarks: %s (available: %s)' % (', '.join(sorted(unknown_benchmark_names)),
+                                                                   ', '.join(benchmark.name for benchmark in BENCHMARKS)))
+    compilers = [detect_compiler(executable) for executable in compiler_executables]
+    if not compilers:
+        raise Exception('No C++ compilers specified')
+
+    baseline_metrics_by_compiler = {compiler.executable: compile_cpp_repeatedly(compiler,
+                                                                                '#include <tmppy/tmppy.h>\n',
+                                                                                include_dir,
+                                                                                (),
+                                                                                header='',
+                                                                                repetitions=repetitions)
+                                    for compiler in compilers}
+
+    results = []
+    violations = []
+    for benchmark in benchmarks:
+        benchmark_results = run_benchmark(benchmark, compilers, builtins_path, include_dir, baseline_metrics_by_compiler,
+                                          repetitions)
+        results.extend(benchmark_results)
+        violations.extend(check_growth_exponents(benchmark, benchmark_results, compilers))
+
+    if baseline_file:
+        with open(baseline_file) as file:
+            violations.extend(check_against_baseline(results, json.load(file)['results'], max_regression))
+
+    if output_file:
+        with open(output_file, 'w') as file:
+            json.dump({
+                'compilers': [{'executable': compiler.executable, 'kind': compiler.kind, 'version': compiler.version}
+                              for compiler in compilers],
+                'results': results,
+                'violations': violations,
+            }, file, indent=2)
+
+    for violation in violations:
+        print('REGRESSION: ' + violation, file=sys.stderr)
+    return not violations
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Measures how the compilation of the C++ code generated by TMPPy '
+                                                 'scales with the size of the input.')
+    parser.add_argument('--builtins-path', required=True, help='The path to the builtins.tmppyc file.')
+    parser.add_argument('--include_dir', default=_DEFAULT_INCLUDE_DIR,
+                        help='The directory containing tmppy/tmppy.h.')
+    parser.add_argument('--compilers', nargs='+', default=[name for name in ('g++', 'clang++') if shutil.which(name)],
+                        help='The C++ compilers to use (GCC and/or Clang). Defaults to the g++ and clang++ in the PATH.')
+    parser.add_argument('--benchmarks', nargs='+', metavar='benchmark_name',
+                        help='The benchmarks to run (default: all). Available: '
+                             + ', '.join(benchmark.name for benchmark in BENCHMARKS))
+    parser.add_argument('-o', '--output', metavar='results_file', help='Where to write the results, as JSON.')
+    parser.add_argument('--baseline', metavar='baseline_results_file',
+                        help='The results of a previous run (written with --output), to check for regressions.')
+    parser.add_argument('--max_regression', type=float, default=0.25,
+                        help='The max allowed increase of each metric compared to the baseline, as a fraction of the '
+                             'baseline value (default: 0.25).')
+    parser.add_argument('--repetitions', type=int, default=3,
+                        help='How many times each C++ compilation is repeated (default: 3).')
+    args = parser.parse_args()
+    success = main(builtins_path=args.builtins_path,
+                   include_dir=args.include_dir,
+                   compiler_executables=args.compilers,
+                   benchmark_names=args.benchmarks,
+                   output_file=args.output,
+                   baseline_file=args.baseline,
+                   max_regression=args.max_regression,
+                   repetitions=args.repetitions)
+    sys.exit(0 if success else 1)
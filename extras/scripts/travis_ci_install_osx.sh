@@ -58,7 +58,6 @@ install_brew_package boost
 install_brew_package python@3.8
 time pip3 install absl-py
 time pip3 install bidict
-time pip3 install networkx
 time pip3 install pytest
 time pip3 install pytest-xdist
 time pip3 install sh
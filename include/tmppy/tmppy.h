@@ -104,5 +104,558 @@ struct Select1stTypeType {
   using value = T;
 };
 
+// These must be here because they're used in ir0_to_cpp (when short-circuiting
+// "&&" and "||"). Like std::conjunction/std::disjunction (that are only
+// available in C++17), these only instantiate T when b doesn't already
+// determine the result.
+template <bool b, typename T>
+struct LazyBoolAnd {
+  static constexpr bool value = false;
+};
+
+template <typename T>
+struct LazyBoolAnd<true, T> {
+  static constexpr bool value = T::value;
+};
+
+template <bool b, typename T>
+struct LazyBoolOr {
+  static constexpr bool value = true;
+};
+
+template <typename T>
+struct LazyBoolOr<false, T> {
+  static constexpr bool value = T::value;
+};
+
+// These must be here because they're used in ir0_to_cpp (on targets with fold expressions). FoldTypesToType<Acc, F,
+// List<Ts...>>::type is emitted as
+// typename decltype((FoldAcc<Acc>{} << ... << TypeFoldStep<F, Ts>{}))::type
+// so that the elements are folded without recursive template instantiations (and same for bools and int64s).
+template <typename T>
+struct FoldAcc {
+  using type = T;
+};
+
+template <template <typename, bool> class F, bool b>
+struct BoolFoldStep {};
+
+template <template <typename, int64_t> class F, int64_t n>
+struct Int64FoldStep {};
+
+template <template <typename, typename> class F, typename T>
+struct TypeFoldStep {};
+
+// Only used in decltype(), so these are never defined.
+template <typename Acc, template <typename, bool> class F, bool b>
+FoldAcc<typename F<Acc, b>::type> operator<<(FoldAcc<Acc>, BoolFoldStep<F, b>);
+
+template <typename Acc, template <typename, int64_t> class F, int64_t n>
+FoldAcc<typename F<Acc, n>::type> operator<<(FoldAcc<Acc>, Int64FoldStep<F, n>);
+
+template <typename Acc, template <typename, typename> class F, typename T>
+FoldAcc<typename F<Acc, T>::type> operator<<(FoldAcc<Acc>, TypeFoldStep<F, T>);
+
+// Similarly, GetFirstError<Ts...>::type is emitted as
+// typename decltype((FoldAcc<void>{} << ... << GetFirstErrorFoldStep<Ts>{}))::type
+// The first overload is more specialized, so it's selected until an error (i.e. a type other than void) is found.
+template <typename T>
+struct GetFirstErrorFoldStep {};
+
+template <typename T>
+FoldAcc<T> operator<<(FoldAcc<void>, GetFirstErrorFoldStep<T>);
+
+template <typename Error, typename T>
+FoldAcc<Error> operator<<(FoldAcc<Error>, GetFirstErrorFoldStep<T>);
+
+// This must be here because it's used in ir0_to_cpp (on targets with fold expressions, for Int64ListSum<L>::value when
+// the elements of L are not known).
+#if defined(__cpp_fold_expressions)
+template <typename L>
+struct Int64ListFoldSum;
+
+template <int64_t... ns>
+struct Int64ListFoldSum<Int64List<ns...>> {
+  static constexpr int64_t value = (0LL + ... + ns);
+};
+#endif
+
+// These must be here because they're used in the set builtins.
+// A set with elements Ts... is checked for membership of T with a single
+// std::is_base_of<TypeSetIndexElem<T>, TypeSetIndex<Ts...>> check, instead of
+// comparing T with each element. The elements of a set are always distinct, so
+// each base class appears at most once.
+template <bool>
+struct BoolSetIndexElem {};
+
+template <bool... bs>
+struct BoolSetIndex : BoolSetIndexElem<bs>... {};
+
+template <int64_t>
+struct Int64SetIndexElem {};
+
+template <int64_t... ns>
+struct Int64SetIndex : Int64SetIndexElem<ns>... {};
+
+template <typename>
+struct TypeSetIndexElem {};
+
+template <typename... Ts>
+struct TypeSetIndex : TypeSetIndexElem<Ts>... {};
+
+// These must be here because they're used in ir0_to_cpp (for the coverage markers, when these are emitted in the object
+// file instead of as compiler warnings). Evaluating tmppyCoverageMarker<T, cs...>() in a static_assert instantiates it
+// (and TmppyCoverageMarker<T, cs...>::mark(), that it references), so the string cs... ends up in the object file.
+// T is a class declared next to the static_assert, so that in a template this only happens when the template is
+// instantiated.
+#if defined(__GNUC__)
+template <typename T, char... cs>
+struct TmppyCoverageMarker {
+  __attribute__((used)) static void mark() {
+    __attribute__((used)) static const char marker[] = {cs..., 0};
+  }
+};
+
+template <typename T, char... cs>
+__attribute__((used)) constexpr bool tmppyCoverageMarker() {
+  return &TmppyCoverageMarker<T, cs...>::mark != nullptr;
+}
+#endif
+
+#if defined(__has_builtin)
+#if __has_builtin(__make_integer_seq)
+#define TMPPY_HAS_MAKE_INTEGER_SEQ 1
+#endif
+#if __has_builtin(__integer_pack)
+#define TMPPY_HAS_INTEGER_PACK 1
+#endif
+#if __has_builtin(__type_pack_element)
+#define TMPPY_HAS_TYPE_PACK_ELEMENT 1
+#endif
+#endif
+
+// This must be here because it's used in ir0_to_cpp (instead of std::is_same<...>::value, when targeting GCC or Clang).
+// GCC only has __is_same since GCC 10 (and __has_builtin too), older versions only have __is_same_as.
+#if defined(__clang__)
+#define TMPPY_IS_SAME __is_same
+#elif defined(__has_builtin)
+#if __has_builtin(__is_same)
+#define TMPPY_IS_SAME __is_same
+#else
+#define TMPPY_IS_SAME __is_same_as
+#endif
+#else
+#define TMPPY_IS_SAME __is_same_as
+#endif
+
+// These must be here because they're used in range() and in the list indexing/slicing builtins.
+// Int64Indexes<n>::type is Int64List<0, 1, ..., n-1>. This uses a compiler builtin when available, otherwise the list
+// is built by doubling, so the instantiation depth is O(log(n)) instead of O(n).
+#if defined(TMPPY_HAS_MAKE_INTEGER_SEQ)
+
+template <typename T, T... ns>
+struct Int64IndexesHelper {
+  using type = Int64List<ns...>;
+};
+
+template <int64_t n>
+struct Int64Indexes : __make_integer_seq<Int64IndexesHelper, int64_t, n> {};
+
+#elif defined(TMPPY_HAS_INTEGER_PACK)
+
+template <int64_t n>
+struct Int64Indexes {
+  using type = Int64List<__integer_pack(n)...>;
+};
+
+#else
+
+template <typename L1, typename L2>
+struct Int64IndexesConcat;
+
+template <int64_t... ns, int64_t... ms>
+struct Int64IndexesConcat<Int64List<ns...>, Int64List<ms...>> {
+  using type = Int64List<ns..., (static_cast<int64_t>(sizeof...(ns)) + ms)...>;
+};
+
+template <int64_t n>
+struct Int64Indexes : Int64IndexesConcat<typename Int64Indexes<n / 2>::type, typename Int64Indexes<n - n / 2>::type> {};
+
+template <>
+struct Int64Indexes<0> {
+  using type = Int64List<>;
+};
+
+template <>
+struct Int64Indexes<1> {
+  using type = Int64List<0>;
+};
+
+#endif
+
+template <int64_t begin, typename Indexes>
+struct Int64RangeHelper;
+
+template <int64_t begin, int64_t... ns>
+struct Int64RangeHelper<begin, Int64List<ns...>> {
+  using type = Int64List<(begin + ns)...>;
+};
+
+// Int64Range<begin, end>::type is Int64List<begin, begin+1, ..., end-1> (empty if end <= begin), like range(begin, end).
+template <int64_t begin, int64_t end>
+struct Int64Range : Int64RangeHelper<begin, typename Int64Indexes<(end > begin ? end - begin : 0)>::type> {};
+
+// Converts a (possibly negative) list index to a non-negative one, as in Python.
+constexpr int64_t normalizeListIndex(int64_t i, int64_t n) {
+  return i < 0 ? i + n : i;
+}
+
+// Converts a (possibly negative) slice bound to a non-negative one, clamping it to [0, n] as in Python.
+constexpr int64_t normalizeSliceBound(int64_t i, int64_t n) {
+  return i < 0 ? (i + n < 0 ? 0 : i + n) : (i > n ? n : i);
+}
+
+// TypeListGetIndex<Int64List<0, ..., n-1>, Ts...> inherits from all the (index, element) pairs, so that an element
+// can be selected by index with a single overload resolution (see selectTypeListGetElem).
+template <int64_t, typename T>
+struct TypeListGetElem {
+  using type = T;
+};
+
+template <typename Indexes, typename... Ts>
+struct TypeListGetIndex;
+
+template <int64_t... is, typename... Ts>
+struct TypeListGetIndex<Int64List<is...>, Ts...> : TypeListGetElem<is, Ts>... {};
+
+// Only used in decltype(), so it's never defined.
+template <int64_t i, typename T>
+TypeListGetElem<i, T> selectTypeListGetElem(TypeListGetElem<i, T>*);
+
+// TypeListGet<List<Ts...>, i>::type is the i-th element of Ts. When __type_pack_element is not available, the element
+// is selected with a single overload resolution against a class that inherits from all the (index, element) pairs,
+// so the instantiation depth doesn't depend on the length of the list.
+#if defined(TMPPY_HAS_TYPE_PACK_ELEMENT)
+
+template <typename L, int64_t i>
+struct TypeListGet;
+
+template <typename... Ts, int64_t i>
+struct TypeListGet<List<Ts...>, i> {
+  static_assert(-static_cast<int64_t>(sizeof...(Ts)) <= i && i < static_cast<int64_t>(sizeof...(Ts)),
+                "list index out of range");
+  using type = __type_pack_element<normalizeListIndex(i, sizeof...(Ts)), Ts...>;
+};
+
+#else
+
+template <typename L, int64_t i>
+struct TypeListGet;
+
+template <typename... Ts, int64_t i>
+struct TypeListGet<List<Ts...>, i> {
+  static_assert(-static_cast<int64_t>(sizeof...(Ts)) <= i && i < static_cast<int64_t>(sizeof...(Ts)),
+                "list index out of range");
+  using type = typename decltype(selectTypeListGetElem<normalizeListIndex(i, sizeof...(Ts))>(
+      static_cast<TypeListGetIndex<typename Int64Indexes<sizeof...(Ts)>::type, Ts...>*>(nullptr)))::type;
+};
+
+#endif
+
+template <typename L, int64_t i>
+struct Int64ListGet;
+
+template <int64_t... ns, int64_t i>
+struct Int64ListGet<Int64List<ns...>, i> {
+  static constexpr int64_t value = TypeListGet<List<std::integral_constant<int64_t, ns>...>, i>::type::value;
+};
+
+template <typename L, int64_t i>
+struct BoolListGet;
+
+template <bool... bs, int64_t i>
+struct BoolListGet<BoolList<bs...>, i> {
+  static constexpr bool value = TypeListGet<List<std::integral_constant<bool, bs>...>, i>::type::value;
+};
+
+template <typename L, typename Indexes>
+struct TypeListSliceHelper;
+
+template <typename... Ts, int64_t... is>
+struct TypeListSliceHelper<List<Ts...>, Int64List<is...>> {
+  using type = List<typename TypeListGet<List<Ts...>, is>::type...>;
+};
+
+// TypeListSlice<List<Ts...>, begin, end>::type is the list of the elements of Ts with index in [begin, end), with the
+// same handling of negative and out-of-range bounds as Python's l[begin:end].
+template <typename L, int64_t begin, int64_t end>
+struct TypeListSlice;
+
+template <typename... Ts, int64_t begin, int64_t end>
+struct TypeListSlice<List<Ts...>, begin, end>
+    : TypeListSliceHelper<List<Ts...>,
+                          typename Int64Range<normalizeSliceBound(begin, sizeof...(Ts)),
+                                              normalizeSliceBound(end, sizeof...(Ts))>::type> {};
+
+template <typename L, typename Indexes>
+struct Int64ListSliceHelper;
+
+template <int64_t... ns, int64_t... is>
+struct Int64ListSliceHelper<Int64List<ns...>, Int64List<is...>> {
+  using type = Int64List<Int64ListGet<Int64List<ns...>, is>::value...>;
+};
+
+template <typename L, int64_t begin, int64_t end>
+struct Int64ListSlice;
+
+template <int64_t... ns, int64_t begin, int64_t end>
+struct Int64ListSlice<Int64List<ns...>, begin, end>
+    : Int64ListSliceHelper<Int64List<ns...>,
+                           typename Int64Range<normalizeSliceBound(begin, sizeof...(ns)),
+                                               normalizeSliceBound(end, sizeof...(ns))>::type> {};
+
+template <typename L, typename Indexes>
+struct BoolListSliceHelper;
+
+template <bool... bs, int64_t... is>
+struct BoolListSliceHelper<BoolList<bs...>, Int64List<is...>> {
+  using type = BoolList<BoolListGet<BoolList<bs...>, is>::value...>;
+};
+
+template <typename L, int64_t begin, int64_t end>
+struct BoolListSlice;
+
+template <bool... bs, int64_t begin, int64_t end>
+struct BoolListSlice<BoolList<bs...>, begin, end>
+    : BoolListSliceHelper<BoolList<bs...>,
+                          typename Int64Range<normalizeSliceBound(begin, sizeof...(bs)),
+                                              normalizeSliceBound(end, sizeof...(bs))>::type> {};
+
+// These must be here because they're used in the sorted() and unique() builtins.
+// Int64Array<ns...>::values contains ns... (followed by a 0, so that the array is never empty). The templates below
+// take a pointer to it as a template argument, so that constexpr functions can access the elements by index; this
+// also avoids mentioning ns... in the pack expansions over the indexes, that would make GCC copy the whole pack for
+// each element.
+template <int64_t... ns>
+struct Int64Array {
+  static constexpr int64_t values[sizeof...(ns) + 1] = {ns..., 0};
+};
+
+template <int64_t... ns>
+constexpr int64_t Int64Array<ns...>::values[sizeof...(ns) + 1];
+
+// The number of elements of keys1 among the first p elements of the (stable) merge of the sorted arrays keys1 and
+// keys2, found with a binary search in [begin, end).
+constexpr int64_t int64MergePath(const int64_t* keys1, const int64_t* keys2, int64_t p, int64_t begin, int64_t end) {
+  return begin == end ? begin
+       : keys1[begin + (end - begin) / 2] <= keys2[p - (begin + (end - begin) / 2) - 1]
+           ? int64MergePath(keys1, keys2, p, begin + (end - begin) / 2 + 1, end)
+           : int64MergePath(keys1, keys2, p, begin, begin + (end - begin) / 2);
+}
+
+// The value at position p, when the first p elements of the merge contain i elements of the first array.
+constexpr int64_t int64MergedElemHelper(const int64_t* keys1, const int64_t* values1, int64_t n1,
+                                        const int64_t* keys2, const int64_t* values2, int64_t n2,
+                                        int64_t p, int64_t i) {
+  return p - i == n2 || (i < n1 && keys1[i] <= keys2[p - i]) ? values1[i] : values2[p - i];
+}
+
+// The value at position p when merging (values1, values2) by the corresponding sorted keys. Elements of the first
+// array come before elements of the second array with the same key.
+constexpr int64_t int64MergedElem(const int64_t* keys1, const int64_t* values1, int64_t n1,
+                                  const int64_t* keys2, const int64_t* values2, int64_t n2,
+                                  int64_t p) {
+  return int64MergedElemHelper(keys1, values1, n1, keys2, values2, n2,
+                               p, int64MergePath(keys1, keys2, p, p > n2 ? p - n2 : 0, p < n1 ? p : n1));
+}
+
+// The number of distinct elements of the sorted array ns in [begin, end).
+constexpr int64_t int64SortedArrayCountDistinct(const int64_t* ns, int64_t begin, int64_t end) {
+  return end - begin == 0 ? 0
+       : end - begin == 1 ? (begin == 0 || ns[begin - 1] != ns[begin] ? 1 : 0)
+       : int64SortedArrayCountDistinct(ns, begin, begin + (end - begin) / 2)
+           + int64SortedArrayCountDistinct(ns, begin + (end - begin) / 2, end);
+}
+
+template <const int64_t* values, typename Indexes>
+struct Int64ArraySelect;
+
+template <const int64_t* values, int64_t... is>
+struct Int64ArraySelect<values, Int64List<is...>> {
+  using type = Int64List<values[is]...>;
+};
+
+template <const int64_t* values, typename Indexes>
+struct BoolArraySelect;
+
+template <const int64_t* values, int64_t... is>
+struct BoolArraySelect<values, Int64List<is...>> {
+  using type = BoolList<(values[is] != 0)...>;
+};
+
+template <typename Index, typename Indexes>
+struct TypeListGetIndexSelect;
+
+template <typename Index, int64_t... is>
+struct TypeListGetIndexSelect<Index, Int64List<is...>> {
+  using type = List<typename decltype(selectTypeListGetElem<is>(static_cast<Index*>(nullptr)))::type...>;
+};
+
+// Int64ListSelect<L, Int64List<is...>>::type is the list of the elements of L with indexes is... (in that order). The
+// indexes must be in range. The instantiation depth doesn't depend on the length of the list.
+template <typename L, typename Indexes>
+struct Int64ListSelect;
+
+template <int64_t... ns, typename Indexes>
+struct Int64ListSelect<Int64List<ns...>, Indexes> : Int64ArraySelect<Int64Array<ns...>::values, Indexes> {};
+
+template <typename L, typename Indexes>
+struct BoolListSelect;
+
+template <bool... bs, typename Indexes>
+struct BoolListSelect<BoolList<bs...>, Indexes> : BoolArraySelect<Int64Array<bs...>::values, Indexes> {};
+
+template <typename L, typename Indexes>
+struct TypeListSelect;
+
+template <typename... Ts, typename Indexes>
+struct TypeListSelect<List<Ts...>, Indexes>
+    : TypeListGetIndexSelect<TypeListGetIndex<typename Int64Indexes<sizeof...(Ts)>::type, Ts...>, Indexes> {};
+
+// ListFirstHalf<L>::type is the list of the first n/2 elements of L (a List, Int64List or BoolList with n elements), and
+// ListSecondHalf<L>::type is the list of the other elements. The builtins that recurse on a list (e.g. Int64ListSum)
+// split it in halves with these, so that their instantiation depth is O(log(n)).
+template <typename L>
+struct ListFirstHalf;
+
+template <typename... Ts>
+struct ListFirstHalf<List<Ts...>> : TypeListSelect<List<Ts...>, typename Int64Indexes<sizeof...(Ts) / 2>::type> {};
+
+template <int64_t... ns>
+struct ListFirstHalf<Int64List<ns...>>
+    : Int64ListSelect<Int64List<ns...>, typename Int64Indexes<sizeof...(ns) / 2>::type> {};
+
+template <bool... bs>
+struct ListFirstHalf<BoolList<bs...>> : BoolListSelect<BoolList<bs...>, typename Int64Indexes<sizeof...(bs) / 2>::type> {};
+
+template <typename L>
+struct ListSecondHalf;
+
+template <typename... Ts>
+struct ListSecondHalf<List<Ts...>>
+    : TypeListSelect<List<Ts...>, typename Int64Range<sizeof...(Ts) / 2, sizeof...(Ts)>::type> {};
+
+template <int64_t... ns>
+struct ListSecondHalf<Int64List<ns...>>
+    : Int64ListSelect<Int64List<ns...>, typename Int64Range<sizeof...(ns) / 2, sizeof...(ns)>::type> {};
+
+template <bool... bs>
+struct ListSecondHalf<BoolList<bs...>>
+    : BoolListSelect<BoolList<bs...>, typename Int64Range<sizeof...(bs) / 2, sizeof...(bs)>::type> {};
+
+// Merges (values1, values2), that are sorted by the corresponding keys. Each element of the result is found
+// independently with a binary search (see int64MergePath), so this doesn't recurse on the arrays.
+template <const int64_t* keys1, const int64_t* values1, int64_t n1,
+          const int64_t* keys2, const int64_t* values2, int64_t n2,
+          typename Positions>
+struct Int64ArraysMergeByKeys;
+
+template <const int64_t* keys1, const int64_t* values1, int64_t n1,
+          const int64_t* keys2, const int64_t* values2, int64_t n2,
+          int64_t... ps>
+struct Int64ArraysMergeByKeys<keys1, values1, n1, keys2, values2, n2, Int64List<ps...>> {
+  using keys = Int64List<int64MergedElem(keys1, keys1, n1, keys2, keys2, n2, ps)...>;
+  using type = Int64List<int64MergedElem(keys1, values1, n1, keys2, values2, n2, ps)...>;
+};
+
+template <typename Keys1, typename Values1, typename Keys2, typename Values2>
+struct Int64ListMergeByKeys;
+
+template <int64_t... ks1, int64_t... vs1, int64_t... ks2, int64_t... vs2>
+struct Int64ListMergeByKeys<Int64List<ks1...>, Int64List<vs1...>, Int64List<ks2...>, Int64List<vs2...>>
+    : Int64ArraysMergeByKeys<Int64Array<ks1...>::values, Int64Array<vs1...>::values, sizeof...(ks1),
+                             Int64Array<ks2...>::values, Int64Array<vs2...>::values, sizeof...(ks2),
+                             typename Int64Indexes<sizeof...(ks1) + sizeof...(ks2)>::type> {};
+
+// Int64ListMergeSortByKeys<Keys, Values>::type is Values sorted (stably) by the corresponding element of Keys, and
+// ::keys is Keys sorted. This is a merge sort that splits the lists in halves, so the instantiation depth is
+// O(log(n)).
+template <typename Keys, typename Values>
+struct Int64ListMergeSortByKeys;
+
+template <const int64_t* keysArray, const int64_t* valuesArray, int64_t n>
+struct Int64ArrayMergeSortByKeys {
+  using FirstHalfIndexes = typename Int64Range<0, n / 2>::type;
+  using SecondHalfIndexes = typename Int64Range<n / 2, n>::type;
+  using FirstHalf = Int64ListMergeSortByKeys<typename Int64ArraySelect<keysArray, FirstHalfIndexes>::type,
+                                             typename Int64ArraySelect<valuesArray, FirstHalfIndexes>::type>;
+  using SecondHalf = Int64ListMergeSortByKeys<typename Int64ArraySelect<keysArray, SecondHalfIndexes>::type,
+                                              typename Int64ArraySelect<valuesArray, SecondHalfIndexes>::type>;
+  using Merged = Int64ListMergeByKeys<typename FirstHalf::keys, typename FirstHalf::type,
+                                      typename SecondHalf::keys, typename SecondHalf::type>;
+  using keys = typename Merged::keys;
+  using type = typename Merged::type;
+};
+
+template <int64_t... ks, int64_t... vs>
+struct Int64ListMergeSortByKeys<Int64List<ks...>, Int64List<vs...>>
+    : Int64ArrayMergeSortByKeys<Int64Array<ks...>::values, Int64Array<vs...>::values, sizeof...(ks)> {};
+
+template <int64_t k, int64_t v>
+struct Int64ListMergeSortByKeys<Int64List<k>, Int64List<v>> {
+  using keys = Int64List<k>;
+  using type = Int64List<v>;
+};
+
+template <>
+struct Int64ListMergeSortByKeys<Int64List<>, Int64List<>> {
+  using keys = Int64List<>;
+  using type = Int64List<>;
+};
+
+// Int64ListSortedIndexes<Keys>::type is the list of the indexes of Keys, sorted (stably) by the corresponding key.
+template <typename Keys>
+struct Int64ListSortedIndexes;
+
+template <int64_t... ks>
+struct Int64ListSortedIndexes<Int64List<ks...>> {
+  using type = typename Int64ListMergeSortByKeys<Int64List<ks...>,
+                                                 typename Int64Indexes<sizeof...(ks)>::type>::type;
+};
+
+template <const int64_t* sortedKeys, typename SortedIndexes, typename Positions>
+struct Int64ArrayUniqueSortedIndexes;
+
+template <const int64_t* sortedKeys, int64_t... is, int64_t... ps>
+struct Int64ArrayUniqueSortedIndexes<sortedKeys, Int64List<is...>, Int64List<ps...>> {
+  // Sorting (stably) by this key (0 for the first element with each key, 1 for the others) moves the first element
+  // with each key to the front, without changing their order.
+  using FirstIndexesFirst = Int64ListMergeSortByKeys<
+      Int64List<(ps == 0 || sortedKeys[ps - 1] != sortedKeys[ps] ? 0 : 1)...>,
+      Int64List<is...>>;
+  using type = typename Int64ListSelect<
+      typename FirstIndexesFirst::type,
+      typename Int64Indexes<int64SortedArrayCountDistinct(sortedKeys, 0, sizeof...(ps))>::type>::type;
+};
+
+template <typename SortedKeys, typename SortedIndexes>
+struct Int64ListUniqueSortedIndexesHelper;
+
+template <int64_t... ks, int64_t... is>
+struct Int64ListUniqueSortedIndexesHelper<Int64List<ks...>, Int64List<is...>>
+    : Int64ArrayUniqueSortedIndexes<Int64Array<ks...>::values,
+                                    Int64List<is...>,
+                                    typename Int64Indexes<sizeof...(ks)>::type> {};
+
+// Int64ListUniqueSortedIndexes<Keys>::type is like Int64ListSortedIndexes<Keys>::type, but with only the first index
+// for each distinct key.
+template <typename Keys>
+struct Int64ListUniqueSortedIndexes;
+
+template <int64_t... ks>
+struct Int64ListUniqueSortedIndexes<Int64List<ks...>> {
+  using Sorted = Int64ListMergeSortByKeys<Int64List<ks...>, typename Int64Indexes<sizeof...(ks)>::type>;
+  using type = typename Int64ListUniqueSortedIndexesHelper<typename Sorted::keys, typename Sorted::type>::type;
+};
 
 #endif // TMPPY_H
@@ -13,11 +13,21 @@
 # limitations under the License.
 
 import argparse
-import pickle
-from typing import List
+import contextlib
+import copy
+import json
+import os
+import shlex
+import sys
+import tempfile
+import traceback
+from typing import List, Optional, TextIO
 
-from _py2tmp.utils import ir_to_string
-from _py2tmp.compiler import compile, link
+from _py2tmp.utils import ir_to_string, is_clang_format_available
+from _py2tmp.compiler import compile, link, link_to_files
+from _py2tmp.compiler.stages import CompilationError, CppTarget, CPP_STANDARDS, CPP_COMPILERS
+from _py2tmp.compiler.output_files import serialize_object_file_content, SourceMap
+from _py2tmp.ir0_optimization import ConfigurationKnobs, OptimizationProfile
 
 
 def _module_name_from_filename(file_name: str):
@@ -45,12 +55,24 @@ def _compile(module_name: str, object_files: List[str], filename: str, verbose:
 
     return object_file_content
 
-def _compile_and_link(module_name: str, object_files: List[str], filename: str, verbose: bool, coverage_collection_enabled: bool):
-    object_file_content = _compile(module_name, object_files, filename, verbose)
+def _compile_and_link(module_name: str,
+                      object_files: List[str],
+                      filename: str,
+                      verbose: bool,
+                      coverage_collection_enabled: bool,
+                      use_clang_format: bool,
+                      source_map: Optional[SourceMap],
+                      target: CppTarget,
+                      short_circuit_bool_ops: bool):
+    object_file_content = _compile(module_name, object_files, filename, verbose, coverage_collection_enabled)
 
     result = link(module_name,
                   object_file_content,
-                  coverage_collection_enabled=coverage_collection_enabled)
+                  coverage_collection_enabled=coverage_collection_enabled,
+                  use_clang_format=use_clang_format,
+                  source_map=source_map,
+                  target=target,
+                  short_circuit_bool_ops=short_circuit_bool_ops)
 
     if verbose:
         print('Conversion result:')
@@ -62,7 +84,16 @@ def main(verbose: bool,
          output_file: str,
          source: str,
          object_files: List[str],
-         coverage_collection_enabled: bool):
+         coverage_collection_enabled: bool,
+         num_optimization_processes: int = 1,
+         optimization_cache_dir: Optional[str] = None,
+         use_clang_format: Optional[bool] = None,
+         optimization_profile_output_file: Optional[str] = None,
+         source_map_output_file: Optional[str] = None,
+         target: CppTarget = CppTarget(),
+         short_circuit_bool_ops: bool = False,
+         shard_header: bool = False,
+         cpp20_module_output_file: Optional[str] = None):
     object_files = object_files + [builtins_path]
     for object_file in object_files:
         if not object_file.endswith('.tmppyc'):
@@ -72,37 +103,206 @@ def main(verbose: bool,
     if not source.endswith(suffix):
         raise Exception('The input file name does not end with .py: ' + source)
 
+    if source_map_output_file and not output_file.endswith('.h'):
+        raise Exception('A source map can only be generated when the output file is a .h file')
+
+    if (shard_header or cpp20_module_output_file) and not output_file.endswith('.h'):
+        raise Exception('A sharded header or a C++20 module can only be generated when the output file is a .h file')
+
+    if (shard_header or cpp20_module_output_file) and source_map_output_file:
+        raise Exception('A source map can\'t be generated together with a sharded header or a C++20 module')
+
+    if cpp20_module_output_file and target.standard != 'c++20':
+        raise Exception('A C++20 module can only be generated when targeting C++20 (--cpp_standard c++20)')
+
     module_name = _module_name_from_filename(source)
 
-    verbose = (verbose == 'true')
-    if output_file.endswith('.h'):
-        result = _compile_and_link(module_name, object_files, source, verbose, coverage_collection_enabled)
-        with open(output_file, 'w') as output_file:
-            output_file.write(result)
-    elif output_file.endswith('.tmppyc'):
-        result = pickle.dumps(_compile(module_name, object_files, source, verbose, coverage_collection_enabled))
-        with open(output_file, 'wb') as output_file:
-            output_file.write(result)
-    else:
-        raise Exception('The output file name does not end with .h or .tmppyc: ' + output_file)
+    ConfigurationKnobs.num_optimization_processes = num_optimization_processes
+    ConfigurationKnobs.optimization_cache_dir = optimization_cache_dir
+    ConfigurationKnobs.optimization_profile = OptimizationProfile() if optimization_profile_output_file else None
+    if use_clang_format is None:
+        use_clang_format = is_clang_format_available()
+    try:
+        if shard_header or cpp20_module_output_file:
+            cpp_source_by_file_name = link_to_files(module_name,
+                                                    _compile(module_name, object_files, source, verbose, coverage_collection_enabled),
+                                                    coverage_collection_enabled=coverage_collection_enabled,
+                                                    header_file_name=output_file,
+                                                    use_clang_format=use_clang_format,
+                                                    target=target,
+                                                    short_circuit_bool_ops=short_circuit_bool_ops,
+                                                    shard_header=shard_header,
+                                                    cpp20_module_file_name=cpp20_module_output_file)
+            # The main output file is written last, so that it being up to date means that all the others are too.
+            for file_name, cpp_source in cpp_source_by_file_name.items():
+                if file_name != output_file:
+                    _write_file_atomically(file_name, cpp_source.encode('utf-8'))
+            result = cpp_source_by_file_name[output_file].encode('utf-8')
+        elif output_file.endswith('.h'):
+            source_map = SourceMap() if source_map_output_file else None
+            result = _compile_and_link(module_name, object_files, source, verbose, coverage_collection_enabled, use_clang_format, source_map, target, short_circuit_bool_ops).encode('utf-8')
+            if source_map is not None:
+                _write_file_atomically(source_map_output_file, json.dumps(source_map.to_json(), indent=2).encode('utf-8'))
+        elif output_file.endswith('.tmppyc'):
+            result = serialize_object_file_content(_compile(module_name, object_files, source, verbose, coverage_collection_enabled))
+        else:
+            raise Exception('The output file name does not end with .h or .tmppyc: ' + output_file)
+        _write_file_atomically(output_file, result)
 
-if __name__ == '__main__':
-    parser = argparse.ArgumentParser(description='Converts python source code into C++ metafunctions.')
-    parser.add_argument('--verbose', help='If "true", prints verbose messages during the conversion')
-    parser.add_argument('--enable_coverage', help='If "true", disables optimizations and enables coverage data collection')
-    parser.add_argument('--builtins-path', required=True, help='The path to the builtins.tmppyc file.')
-    parser.add_argument('-o', required=True, metavar='output_file', help='Output file (.tmppyc or .h).')
-    parser.add_argument('source', help='The python source file to convert')
-    parser.add_argument('object_files', nargs='*', help='.tmppyc object files for the modules (directly) imported in this source file')
+        if optimization_profile_output_file == '-':
+            print(ConfigurationKnobs.optimization_profile.to_table(), file=sys.stderr)
+        elif optimization_profile_output_file:
+            _write_file_atomically(optimization_profile_output_file,
+                                   json.dumps(ConfigurationKnobs.optimization_profile.to_json(), indent=2).encode('utf-8'))
+    finally:
+        ConfigurationKnobs.optimization_profile = None
 
-    args = parser.parse_args()
+def _write_file_atomically(file_name: str, content: bytes):
+    # Object files are memory-mapped when loaded, so we must not truncate an existing one (that might still be mapped,
+    # e.g. in batch mode). Writing to a new file and renaming it also ensures that a failed or interrupted compilation
+    # never leaves a partially-written output around.
+    file_descriptor, temporary_file_name = tempfile.mkstemp(dir=os.path.dirname(os.path.abspath(file_name)),
+                                                            prefix=os.path.basename(file_name) + '.',
+                                                            suffix='.tmp')
+    try:
+        with os.fdopen(file_descriptor, 'wb') as file:
+            file.write(content)
+        os.replace(temporary_file_name, file_name)
+    except BaseException:
+        os.remove(temporary_file_name)
+        raise
+
+def _run_batch(parser: argparse.ArgumentParser, batch_args: argparse.Namespace, commands: TextIO):
+    # Each line of the batch is a command, with the same syntax as the command line of this script (the options
+    # specified on the actual command line are used as defaults). Commands are run in order (so a command can use the
+    # object files written by the previous ones) and after each one a JSON object describing the outcome is printed on
+    # a line of stdout. Since the commands are read incrementally, this can also be used as a long-running compilation
+    # server, by writing the commands to its stdin.
+    # Loaded object files (including the builtins) are kept in memory across commands, as long as they don't change.
+    # Anything else that would be printed on stdout (e.g. the IRs, with --verbose true) goes to stderr instead.
+    all_succeeded = True
+    for line in commands:
+        try:
+            command = shlex.split(line, comments=True)
+        except ValueError as e:
+            outcome = {'output': None, 'success': False, 'error': 'Invalid batch command: %s' % e}
+        else:
+            if not command:
+                continue
+            outcome = _run_batch_command(parser, batch_args, command)
+        all_succeeded = all_succeeded and outcome['success']
+        print(json.dumps(outcome), flush=True)
+    return all_succeeded
 
+def _run_batch_command(parser: argparse.ArgumentParser, batch_args: argparse.Namespace, command: List[str]):
+    with contextlib.redirect_stdout(sys.stderr):
+        try:
+            args = parser.parse_args(command, namespace=copy.copy(batch_args))
+        except SystemExit:
+            # argparse already printed the usage and the error on stderr.
+            return {'output': None, 'success': False, 'error': 'Invalid batch command: %s' % shlex.join(command)}
+        try:
+            if args.batch != batch_args.batch:
+                raise Exception('--batch can\'t be used in a batch command')
+            _run(args)
+            return {'output': args.o, 'success': True}
+        except CompilationError as e:
+            return {'output': args.o, 'success': False, 'error': str(e)}
+        except Exception:
+            return {'output': args.o, 'success': False, 'error': traceback.format_exc()}
+
+def _run(args: argparse.Namespace):
     if not args.source:
         raise Exception('You must specify a source file')
+    if not args.o:
+        raise Exception('You must specify an output file')
+    if not args.builtins_path:
+        raise Exception('You must specify the path to the builtins.tmppyc file')
 
     main(verbose=(args.verbose == 'true'),
          builtins_path=args.builtins_path,
          output_file=args.o,
          source=args.source,
          object_files=args.object_files,
-         coverage_collection_enabled=(args.enable_coverage == 'true'))
+         coverage_collection_enabled=(args.enable_coverage == 'true'),
+         num_optimization_processes=args.optimization_processes,
+         optimization_cache_dir=args.optimization_cache_dir,
+         use_clang_format=None if args.clang_format is None else (args.clang_format == 'true'),
+         optimization_profile_output_file=args.optimization_profile,
+         source_map_output_file=args.source_map,
+         target=CppTarget(standard=args.cpp_standard, compiler=args.cpp_compiler),
+         short_circuit_bool_ops=(args.short_circuit_bool_ops == 'true'),
+         shard_header=(args.shard_header == 'true'),
+         cpp20_module_output_file=args.cpp20_module)
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Converts python source code into C++ metafunctions.')
+    parser.add_argument('--verbose', help='If "true", prints verbose messages during the conversion')
+    parser.add_argument('--enable_coverage', help='If "true", enables coverage data collection')
+    parser.add_argument('--optimization_processes', type=int, default=1,
+                        help='If >1, optimizes independent templates in parallel using (at most) this many processes. '
+                             'The output is deterministic, but it might differ from the one obtained without this '
+                             'option.')
+    parser.add_argument('--optimization_cache_dir',
+                        help='If specified, optimized templates are cached in this directory and reused in later '
+                             'compilations (e.g. when only some modules changed).')
+    parser.add_argument('--optimization_profile', metavar='profile_file',
+                        help='If specified, statistics about each optimization (time, number of calls, how often it '
+                             'changed the code, code size before/after), also broken down by template and by '
+                             'connected component of the template dependency graph, are written to this file as '
+                             'JSON. If this is "-", they are printed to stderr as tables instead.')
+    parser.add_argument('--source_map', metavar='source_map_file',
+                        help='If specified (only allowed when generating a .h file), a JSON file is written here that '
+                             'maps each template in the generated header (and the lines where its definition and '
+                             'specializations are) to the TMPPy function and source line it comes from. This can be '
+                             'used with time_trace_report.py to attribute C++ compilation time to TMPPy functions.')
+    parser.add_argument('--clang_format',
+                        help='If "true", formats the generated .h file with clang-format (which must be in the PATH). '
+                             'If "false", the generated code is still consistently indented, but long lines are not '
+                             'wrapped. By default, clang-format is used if available.')
+    parser.add_argument('--cpp_standard', choices=CPP_STANDARDS, default='c++11',
+                        help='The C++ standard that the generated .h file will be compiled with. With newer standards, '
+                             'some constructs are emitted in a way that is cheaper to compile (e.g. using fold '
+                             'expressions). The default (c++11) generates code that can be used with any standard.')
+    parser.add_argument('--cpp_compiler', choices=CPP_COMPILERS, default='generic',
+                        help='The compiler that the generated .h file will be compiled with. When this is not '
+                             '"generic", compiler intrinsics (e.g. __is_same) are used instead of some std:: type '
+                             'traits, so the generated code might only work with that compiler.')
+    parser.add_argument('--short_circuit_bool_ops',
+                        help='If "true", "&&" and "||" in the generated .h file are emitted so that the C++ compiler '
+                             'doesn\'t instantiate the templates in the RHS when the LHS already determines the result '
+                             '(at the cost of an additional template instantiation when it doesn\'t).')
+    parser.add_argument('--shard_header',
+                        help='If "true", the generated .h file just includes a separate header for each public name '
+                             '(<output_file>_shard_<name>.h), written next to it, that only contains the templates '
+                             'needed by that name. Templates needed by multiple names go in a shared '
+                             '<output_file>_core.h header. So the code that uses only a few names doesn\'t need to '
+                             'parse the whole generated code.')
+    parser.add_argument('--cpp20_module', metavar='module_interface_file',
+                        help='If specified (only allowed when generating a .h file with --cpp_standard c++20), a C++20 '
+                             'module interface unit with the same content as the generated .h file is also written '
+                             'here. The module has the same name as the converted module and exports its public names.')
+    parser.add_argument('--builtins-path', help='The path to the builtins.tmppyc file (required).')
+    parser.add_argument('--batch', metavar='batch_file',
+                        help='Instead of converting a single file, runs the commands in this file (or in stdin, if '
+                             'this is "-"), one per line. Each command has the same syntax as the command line of '
+                             'this script, and defaults to the options specified on the actual command line. This '
+                             'avoids the startup cost (including loading builtins.tmppyc) for each file.')
+    parser.add_argument('-o', metavar='output_file', help='Output file (.tmppyc or .h), required unless using --batch.')
+    parser.add_argument('source', nargs='?', help='The python source file to convert')
+    parser.add_argument('object_files', nargs='*', help='.tmppyc object files for the modules (directly) imported in this source file')
+
+    args = parser.parse_args()
+
+    if args.batch is None:
+        _run(args)
+    else:
+        if args.o or args.source or args.object_files:
+            raise Exception('When using --batch, the files to convert must be specified in the batch commands')
+        if args.batch == '-':
+            succeeded = _run_batch(parser, args, sys.stdin)
+        else:
+            with open(args.batch) as batch_file:
+                succeeded = _run_batch(parser, args, batch_file)
+        if not succeeded:
+            sys.exit(1)
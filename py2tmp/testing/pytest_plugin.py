@@ -33,6 +33,41 @@ def pytest_addoption(parser: Any):
         help='*.tmppyc files used by tests (comma-separated list).',
         type='pathlist'
     )
+    group.addoption(
+        "--tmppy_compilation_cache_dir",
+        action="store",
+        dest="tmppy_compilation_cache_dir",
+        default="",
+        help='A directory where the results of the C++ compilations done by tests are cached (also across test runs).',
+    )
+    parser.addini(
+        name='tmppy_compilation_cache_dir',
+        help='A directory where the results of the C++ compilations done by tests are cached (also across test runs).',
+    )
+    group.addoption(
+        "--tmppy_batch_compilations",
+        action="store_true",
+        dest="tmppy_batch_compilations",
+        default=False,
+        help='Compile the C++ sources that each test expects to compile successfully in a single translation unit.',
+    )
+    group.addoption(
+        "--tmppy_compilation_jobs",
+        action="store",
+        dest="tmppy_compilation_jobs",
+        type=int,
+        default=1,
+        help='The max number of C++ compilations of a test that run in parallel (with --tmppy_batch_compilations).',
+    )
+
+def pytest_configure(config: Any):
+    cache_dir = config.getoption('tmppy_compilation_cache_dir') or config.getini('tmppy_compilation_cache_dir')
+    batch_compilations = config.getoption('tmppy_batch_compilations')
+    if cache_dir or batch_compilations:
+        from _py2tmp.compiler.testing import CompilationSettings
+        CompilationSettings.cache_dir = cache_dir or None
+        CompilationSettings.batch_compilations = batch_compilations
+        CompilationSettings.num_jobs = config.getoption('tmppy_compilation_jobs')
 
 @dataclass(frozen=True)
 class TmppyFixture:
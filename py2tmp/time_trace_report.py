@@ -0,0 +1,164 @@
+#  Copyright 2017 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS-IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Attributes the template instantiation time reported by the C++ compiler to the TMPPy functions that the instantiated
+# templates were generated from, using the source map written by main.py (with --source_map).
+#
+# Supported inputs:
+# * The JSON files written by Clang with -ftime-trace. These have a (nested) event for each template instantiation, so
+#   both the number of instantiations and their time can be attributed to TMPPy functions.
+# * The output of GCC with -ftime-report. GCC only reports the total template instantiation time, so this is reported
+#   as a single (unattributed) row.
+
+import argparse
+import json
+import re
+from collections import defaultdict
+from dataclasses import dataclass
+from typing import Dict, List, Optional, Iterable, Any, Tuple
+
+from _py2tmp.compiler.output_files import SourceMap
+
+_CLANG_INSTANTIATION_EVENT_NAMES = ('InstantiateClass', 'InstantiateFunction')
+# E.g. "tmppy_internal_foo_x12<int, (bool)true>" or "std::is_same<int, float>".
+_INSTANTIATED_TEMPLATE_NAME_REGEX = re.compile(r'\s*(?:(?:struct|class)\s+)?(?:[A-Za-z_0-9]+::)*([A-Za-z_][A-Za-z_0-9]*)')
+# E.g. " template instantiation             :   0.05 ( 16%)   0.01 ( 14%)   0.06 ( 15%)  2100k ( 15%)".
+_GCC_TEMPLATE_INSTANTIATION_TIME_REGEX = re.compile(r'\s*template instantiation\s*:\s*'
+                                                    r'(?:[0-9.]+\s*\(\s*[0-9]+%\)\s*){2}([0-9.]+)\s*\(')
+
+NOT_GENERATED_BY_TMPPY = ('(not generated by TMPPy)', '')
+UNATTRIBUTED_GCC_TIME = ('(total template instantiation time reported by GCC, not attributable)', '')
+
+# The function name and its source location (as "file:line").
+FunctionKey = Tuple[str, str]
+
+@dataclass
+class FunctionTimes:
+    num_instantiations: int = 0
+    # Time spent instantiating templates of this function, excluding the nested instantiations of other templates.
+    self_time_us: float = 0.0
+    # Also includes nested instantiations, but it doesn't double-count recursive instantiations of the same function.
+    total_time_us: float = 0.0
+
+    def to_json(self):
+        return {
+            'num_instantiations': self.num_instantiations,
+            'self_time_ms': self.self_time_us / 1000,
+            'total_time_ms': self.total_time_us / 1000,
+        }
+
+def _get_function_key(source_map: SourceMap, detail: str) -> FunctionKey:
+    match = _INSTANTIATED_TEMPLATE_NAME_REGEX.match(detail)
+    entry = source_map.entry_by_cpp_template_name.get(match.group(1)) if match else None
+    if entry is None:
+        return NOT_GENERATED_BY_TMPPY
+    return entry.source_location.function_name, '%s:%s' % (entry.source_location.file_name, entry.source_location.line)
+
+def attribute_clang_time_trace(source_map: SourceMap,
+                               trace_events: Iterable[Dict[str, Any]],
+                               times_by_function: Dict[FunctionKey, FunctionTimes]):
+    events_by_thread = defaultdict(list)
+    for event in trace_events:
+        if event.get('ph') == 'X' and event.get('name') in _CLANG_INSTANTIATION_EVENT_NAMES:
+            events_by_thread[(event.get('pid'), event.get('tid'))].append(event)
+
+    for events in events_by_thread.values():
+        # Nested events must come after the events that contain them.
+        events.sort(key=lambda event: (event['ts'], -event['dur']))
+
+        # The events that contain the current one. Each element is [end_ts, function_key, dur, time of the nested events].
+        stack: List[List[Any]] = []
+
+        def pop_event():
+            _, function_key, dur, nested_time_us = stack.pop()
+            times_by_function[function_key].self_time_us += dur - nested_time_us
+            if stack:
+                stack[-1][3] += dur
+            if all(other_function_key != function_key for _, other_function_key, _, _ in stack):
+                times_by_function[function_key].total_time_us += dur
+
+        for event in events:
+            while stack and stack[-1][0] <= event['ts']:
+                pop_event()
+            function_key = _get_function_key(source_map, event.get('args', {}).get('detail', ''))
+            times_by_function[function_key].num_instantiations += 1
+            stack.append([event['ts'] + event['dur'], function_key, event['dur'], 0])
+        while stack:
+            pop_event()
+
+def parse_gcc_time_report(report: str) -> Optional[float]:
+    for line in report.splitlines():
+        match = _GCC_TEMPLATE_INSTANTIATION_TIME_REGEX.match(line)
+        if match:
+            return float(match.group(1))
+    return None
+
+def compute_times_by_function(source_map: SourceMap, trace_file_contents: Iterable[str]) -> Dict[FunctionKey, FunctionTimes]:
+    times_by_function: Dict[FunctionKey, FunctionTimes] = defaultdict(FunctionTimes)
+    for trace_file_content in trace_file_contents:
+        try:
+            trace = json.loads(trace_file_content)
+        except ValueError:
+            trace = None
+        if isinstance(trace, dict) and 'traceEvents' in trace:
+            attribute_clang_time_trace(source_map, trace['traceEvents'], times_by_function)
+        else:
+            wall_time_seconds = parse_gcc_time_report(trace_file_content)
+            if wall_time_seconds is None:
+                raise Exception('Unrecognized input: expected a JSON file written by Clang with -ftime-trace or the '
+                                'output of GCC with -ftime-report')
+            times = times_by_function[UNATTRIBUTED_GCC_TIME]
+            times.self_time_us += wall_time_seconds * 1000000
+            times.total_time_us += wall_time_seconds * 1000000
+    return dict(times_by_function)
+
+def times_by_function_to_table(times_by_function: Dict[FunctionKey, FunctionTimes]):
+    rows = [('Function', 'Location', 'Instantiations', 'Self time (ms)', 'Total time (ms)')]
+    for (function_name, location), times in sorted(times_by_function.items(), key=lambda item: (-item[1].self_time_us, item[0])):
+        rows.append((function_name,
+                     location,
+                     str(times.num_instantiations),
+                     '%.3f' % (times.self_time_us / 1000),
+                     '%.3f' % (times.total_time_us / 1000)))
+    column_widths = [max(len(row[i]) for row in rows) for i in range(len(rows[0]))]
+    return '\n'.join('  '.join(cell.ljust(width) if i < 2 else cell.rjust(width)
+                               for i, (cell, width) in enumerate(zip(row, column_widths))).rstrip()
+                     for row in rows)
+
+def main(source_map_file: str, trace_files: List[str], output_json: bool):
+    with open(source_map_file) as file:
+        source_map = SourceMap.from_json(json.load(file))
+    trace_file_contents = []
+    for trace_file in trace_files:
+        with open(trace_file) as file:
+            trace_file_contents.append(file.read())
+
+    times_by_function = compute_times_by_function(source_map, trace_file_contents)
+    if output_json:
+        print(json.dumps([{'function': function_name, 'location': location, **times.to_json()}
+                          for (function_name, location), times in sorted(times_by_function.items())],
+                         indent=2))
+    else:
+        print(times_by_function_to_table(times_by_function))
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Attributes C++ template instantiation time to TMPPy functions.')
+    parser.add_argument('--source_map', required=True, metavar='source_map_file',
+                        help='The source map of the generated header (written by main.py with --source_map).')
+    parser.add_argument('--json', action='store_true', help='Print the result as JSON instead of as a table.')
+    parser.add_argument('trace_files', nargs='+',
+                        help='The JSON files written by Clang with -ftime-trace and/or files containing the output of '
+                             'GCC with -ftime-report.')
+    args = parser.parse_args()
+    main(args.source_map, args.trace_files, args.json)
@@ -15,4 +15,4 @@
 # noinspection PyUnresolvedReferences
 from _tmppy.type import Type, match
 # noinspection PyUnresolvedReferences
-from _tmppy.lists import empty_list, empty_set
+from _tmppy.lists import empty_list, empty_set, unique